@@ -167,6 +167,30 @@ fi
 echo "present"
 rm "config.out"
 
+# Check if POSIX threads are available
+echo -n "Checking for pthreads... "
+cat <<EOF > config.c
+#include <stdio.h>
+#include <pthread.h>
+int main(void)
+{
+	pthread_mutex_t lock;
+	pthread_mutex_init(&lock, NULL);
+	printf("Hello world!\n");
+	return 0;
+}
+EOF
+if ! "$CC" -o "config.out" "config.c" -std=c99 -Wall -g -pthread $CFLAGS -lm -lpthread $LDFLAGS &>/dev/null
+then
+	echo "not present"
+	echo -e "\e[1m\e[31mERROR: \e[0mPOSIX threads are not available in the system!"
+	rm "Makefile.tmp"
+	rm "config.c"
+	exit 1
+fi
+echo "present"
+rm "config.out"
+
 # Check for Doxygen
 echo -n "Checking for working Doxygen... "
 if ! doxygen --version &>/dev/null
@@ -39,6 +39,7 @@ extern "C"
 #include <openssl/rand.h>
 #include <openssl/aes.h>
 #include <openssl/err.h>
+#include <openssl/crypto.h>
 
 // Constant definitions
 const int32_t KEY_SIZE = 32;
@@ -54,7 +55,7 @@ int32_t aes_gen_iv(uint8_t iv[IV_SIZE])
 	return 0;
 }
 
-int32_t aes_encrypt(const uint8_t *msg, uint64_t len, const uint8_t key[KEY_SIZE], const uint8_t iv[IV_SIZE], uint8_t **result, uint64_t *reslen)
+int32_t aes_encrypt(Arena *arena, const uint8_t *msg, uint64_t len, const uint8_t key[KEY_SIZE], const uint8_t iv[IV_SIZE], uint8_t **result, uint64_t *reslen)
 {
 	// Calculate output length
 	if (len % AES_BLOCK_SIZE)
@@ -63,8 +64,8 @@ int32_t aes_encrypt(const uint8_t *msg, uint64_t len, const uint8_t key[KEY_SIZE
 		*reslen = len;
 	
 	// Allocate output
-	*result = (uint8_t*)calloc(*reslen, sizeof(uint8_t));
-	if (!result)
+	*result = (uint8_t*)arena_alloc(arena, *reslen);
+	if (!(*result))
 		return 1;
 
 	// Initialize AES-256 key
@@ -73,11 +74,12 @@ int32_t aes_encrypt(const uint8_t *msg, uint64_t len, const uint8_t key[KEY_SIZE
 
 	// Encrypt with AES-CBC
 	AES_cbc_encrypt(msg, *result, len, &aes_key, iv, AES_ENCRYPT);
+	OPENSSL_cleanse(&aes_key, sizeof(aes_key));
 
 	return 0;
 }
 
-int32_t aes_decrypt(const uint8_t *msg, uint64_t len, const uint8_t key[KEY_SIZE], const uint8_t iv[IV_SIZE], uint8_t **result, uint64_t *reslen)
+int32_t aes_decrypt(Arena *arena, const uint8_t *msg, uint64_t len, const uint8_t key[KEY_SIZE], const uint8_t iv[IV_SIZE], uint8_t **result, uint64_t *reslen)
 {
 	// Calculate input length
 	uint64_t elen = 0;
@@ -88,8 +90,8 @@ int32_t aes_decrypt(const uint8_t *msg, uint64_t len, const uint8_t key[KEY_SIZE
 	
 	// Allocate output
 	*reslen = len;
-	*result = (uint8_t*)calloc(elen, sizeof(uint8_t));
-	if (!result)
+	*result = (uint8_t*)arena_alloc(arena, elen);
+	if (!(*result))
 		return 1;
 
 	// Initialize AES-256 key
@@ -98,6 +100,24 @@ int32_t aes_decrypt(const uint8_t *msg, uint64_t len, const uint8_t key[KEY_SIZE
 
 	// Decrypt with AES-CBC
 	AES_cbc_encrypt(msg, *result, elen, &aes_key, iv, AES_DECRYPT);
+	OPENSSL_cleanse(&aes_key, sizeof(aes_key));
+
+	return 0;
+}
+
+int32_t aes_decrypt_chain(uint8_t *data, uint64_t len, const uint8_t key[KEY_SIZE], uint8_t chain[IV_SIZE])
+{
+	if (len % AES_BLOCK_SIZE)
+		return 1;
+
+	// Initialize AES-256 key
+	AES_KEY aes_key;
+	AES_set_decrypt_key(key, 256, &aes_key);
+
+	// Decrypt with AES-CBC, which leaves the last block of ciphertext in the
+	// chaining value
+	AES_cbc_encrypt(data, data, len, &aes_key, chain, AES_DECRYPT);
+	OPENSSL_cleanse(&aes_key, sizeof(aes_key));
 
 	return 0;
 }
@@ -39,6 +39,9 @@ extern "C"
 {
 #endif
 
+// Arena allocator
+#include "arena.h"
+
 /** The size of the AES-256 key, in bytes. */
 extern const int32_t KEY_SIZE;
 
@@ -59,6 +62,8 @@ int32_t aes_gen_iv(uint8_t iv[IV_SIZE]);
  * Encrypts a specified message, using the AES-256 algorithm, with specified 
  * key and initialization vector.
  *
+ * \param arena Arena to allocate the result from. If NULL, the result is 
+ *              allocated on the heap.
  * \param msg Pointer to byte array, containing data to encrypt.
  * \param len Length of the data to encrypt.
  * \param key Key to use when encrypting.
@@ -70,12 +75,14 @@ int32_t aes_gen_iv(uint8_t iv[IV_SIZE]);
  *
  * \return 0 if the operation was successful, an error code otherwise.
  */
-int32_t aes_encrypt(const uint8_t *msg, uint64_t len, const uint8_t key[KEY_SIZE], const uint8_t iv[IV_SIZE], uint8_t **result, uint64_t *reslen);
+int32_t aes_encrypt(Arena *arena, const uint8_t *msg, uint64_t len, const uint8_t key[KEY_SIZE], const uint8_t iv[IV_SIZE], uint8_t **result, uint64_t *reslen);
 
 /**
  * Decrypts a specified message, using the AES-256 algorithm, with specified 
  * key and initialization vector.
  *
+ * \param arena Arena to allocate the result from. If NULL, the result is 
+ *              allocated on the heap.
  * \param msg Pointer to byte array containing data to decrypt.
  * \param len Length of the data to decrypt.
  * \param key Key to use when decrypting.
@@ -87,7 +94,23 @@ int32_t aes_encrypt(const uint8_t *msg, uint64_t len, const uint8_t key[KEY_SIZE
  *
  * \return 0 if the operation was successful, an error code otherwise.
  */
-int32_t aes_decrypt(const uint8_t *msg, uint64_t len, const uint8_t key[KEY_SIZE], const uint8_t iv[IV_SIZE], uint8_t **result, uint64_t *reslen);
+int32_t aes_decrypt(Arena *arena, const uint8_t *msg, uint64_t len, const uint8_t key[KEY_SIZE], const uint8_t iv[IV_SIZE], uint8_t **result, uint64_t *reslen);
+
+/**
+ * Decrypts a piece of a message in place, using the AES-256 algorithm. The 
+ * message can be decrypted in consecutive pieces by passing the same chaining
+ * value to every call.
+ *
+ * \param data Pointer to byte array containing data to decrypt. Its length 
+ *             has to be a multiple of 16 bytes.
+ * \param len Length of the data to decrypt.
+ * \param key Key to use when decrypting.
+ * \param chain Chaining value. It has to hold the initialization vector before
+ *              the first piece, and is updated to continue with the next one.
+ *
+ * \return 0 if the operation was successful, an error code otherwise.
+ */
+int32_t aes_decrypt_chain(uint8_t *data, uint64_t len, const uint8_t key[KEY_SIZE], uint8_t chain[IV_SIZE]);
 
 // Define C extern for C++
 #ifdef __cplusplus
@@ -0,0 +1,332 @@
+// This file is part of stegman project
+//
+// Copyright (c) 2018 Mateusz Brawański (Emzi0767)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Check if we're using a C99-capable compiler
+#if __STDC_VERSION__ < 199901L
+#error "You need to use a C99-capable compiler to build this program!"
+#endif
+
+// Define C extern for C++
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Appropriate headers
+#include "defs.h"
+#include "arena.h"
+#include "spill.h"
+
+// Standard library
+#include <stdlib.h>
+#include <string.h>
+#include <openssl/crypto.h>
+
+// Constant definitions
+static const size_t ARENA_BLOCK_SIZE = 1024 * 1024;
+static const size_t ARENA_ALIGNMENT = 16;
+
+// Single block of memory. Bytes past used are always zero.
+typedef struct ArenaBlock
+{
+	struct ArenaBlock *next;
+	size_t size;
+	size_t used;
+	uint8_t *data;
+	bool spilled;
+} ArenaBlock;
+
+struct Arena
+{
+	size_t blocksize;
+
+	// Blocks past this much memory are backed by temporary files
+	size_t limit;
+	size_t resident;
+
+	ArenaBlock *head;
+	ArenaBlock *current;
+
+	// Most recent allocation, which can be resized or released in place
+	uint8_t *last;
+
+	// Usage since the last reset
+	size_t inuse;
+	ArenaStats stats;
+};
+
+// Helper functions
+static ArenaBlock *arena_block_create(Arena *arena, size_t size)
+{
+	ArenaBlock *blk = (ArenaBlock*)calloc(1, sizeof(ArenaBlock));
+	if (!blk)
+		return NULL;
+
+	// Large blocks are usually mapped directly, so calloc doesn't have to 
+	// clear them
+	blk->spilled = arena->limit && arena->resident + size > arena->limit;
+	blk->data = blk->spilled ? (uint8_t*)spill_map(size) : (uint8_t*)calloc(size, sizeof(uint8_t));
+	if (!blk->data)
+	{
+		free(blk);
+		return NULL;
+	}
+
+	blk->size = size;
+	if (!blk->spilled)
+		arena->resident += size;
+	return blk;
+}
+
+static void arena_block_destroy(Arena *arena, ArenaBlock *blk)
+{
+	OPENSSL_cleanse(blk->data, blk->used);
+	if (blk->spilled)
+	{
+		spill_unmap(blk->data, blk->size);
+	}
+	else
+	{
+		free(blk->data);
+		arena->resident -= blk->size;
+	}
+
+	free(blk);
+}
+
+static size_t arena_align(const ArenaBlock *blk)
+{
+	uintptr_t addr = (uintptr_t)(blk->data + blk->used);
+	return (ARENA_ALIGNMENT - addr % ARENA_ALIGNMENT) % ARENA_ALIGNMENT;
+}
+
+static bool arena_fits(const ArenaBlock *blk, size_t size)
+{
+	size_t pad = arena_align(blk);
+	return blk->used + pad <= blk->size && size <= blk->size - blk->used - pad;
+}
+
+static void arena_grew(Arena *arena, size_t used, size_t size)
+{
+	arena->inuse += used;
+	arena->stats.allocated += size;
+	if (arena->inuse > arena->stats.peak)
+		arena->stats.peak = arena->inuse;
+}
+
+// Function definitions
+int32_t arena_create(size_t blocksize, Arena **arena)
+{
+	Arena *a = (Arena*)calloc(1, sizeof(Arena));
+	if (!a)
+		return 1;
+
+	a->blocksize = blocksize ? blocksize : ARENA_BLOCK_SIZE;
+	*arena = a;
+	return 0;
+}
+
+void arena_destroy(Arena *arena)
+{
+	if (!arena)
+		return;
+
+	ArenaBlock *blk = arena->head;
+	while (blk)
+	{
+		ArenaBlock *next = blk->next;
+		arena_block_destroy(arena, blk);
+		blk = next;
+	}
+
+	free(arena);
+}
+
+void *arena_alloc(Arena *arena, size_t size)
+{
+	if (!arena)
+		return calloc(size ? size : 1, sizeof(uint8_t));
+
+	// Find a block with enough space left, starting with the current one
+	ArenaBlock *blk = arena->current;
+	while (blk && !arena_fits(blk, size))
+		blk = blk->next;
+
+	if (!blk)
+	{
+		blk = arena_block_create(arena, size + ARENA_ALIGNMENT > arena->blocksize ? size + ARENA_ALIGNMENT : arena->blocksize);
+		if (!blk)
+			return NULL;
+
+		if (arena->current)
+		{
+			blk->next = arena->current->next;
+			arena->current->next = blk;
+		}
+		else
+		{
+			arena->head = blk;
+		}
+	}
+
+	size_t pad = arena_align(blk);
+	blk->used += pad;
+	uint8_t *ptr = blk->data + blk->used;
+	blk->used += size;
+	arena->current = blk;
+	arena->last = ptr;
+	arena->stats.allocations++;
+	arena_grew(arena, pad + size, size);
+	return ptr;
+}
+
+void *arena_realloc(Arena *arena, void *ptr, size_t oldsize, size_t size)
+{
+	if (!arena)
+		return realloc(ptr, size ? size : 1);
+
+	if (!ptr)
+		return arena_alloc(arena, size);
+
+	// Resize the most recent allocation in place
+	ArenaBlock *blk = arena->current;
+	if (ptr == arena->last && (uint8_t*)ptr - blk->data + size <= blk->size)
+	{
+		if (size < oldsize)
+			OPENSSL_cleanse((uint8_t*)ptr + size, oldsize - size);
+
+		size_t used = (uint8_t*)ptr - blk->data + size;
+		if (used > blk->used)
+			arena_grew(arena, used - blk->used, used - blk->used);
+		else
+			arena->inuse -= blk->used - used;
+
+		blk->used = used;
+		return ptr;
+	}
+
+	// Otherwise move it
+	if (size <= oldsize)
+		return ptr;
+
+	uint8_t *ptr2 = (uint8_t*)arena_alloc(arena, size);
+	if (!ptr2)
+		return NULL;
+
+	memcpy(ptr2, ptr, oldsize);
+	return ptr2;
+}
+
+void arena_free(Arena *arena, void *ptr)
+{
+	if (!arena)
+	{
+		free(ptr);
+		return;
+	}
+
+	if (!ptr || ptr != arena->last)
+		return;
+
+	// Reclaim the most recent allocation
+	ArenaBlock *blk = arena->current;
+	size_t offset = (uint8_t*)ptr - blk->data;
+	OPENSSL_cleanse(ptr, blk->used - offset);
+	arena->inuse -= blk->used - offset;
+	blk->used = offset;
+	arena->last = NULL;
+}
+
+void arena_reset(Arena *arena)
+{
+	// Blocks backed by files are only kept for the operation which needed 
+	// them
+	for (ArenaBlock **link = &arena->head; *link; )
+	{
+		ArenaBlock *blk = *link;
+		if (blk->spilled)
+		{
+			*link = blk->next;
+			arena_block_destroy(arena, blk);
+		}
+		else
+		{
+			link = &blk->next;
+		}
+	}
+
+	size_t total = 0, count = 0;
+	for (ArenaBlock *blk = arena->head; blk; blk = blk->next)
+	{
+		OPENSSL_cleanse(blk->data, blk->used);
+		blk->used = 0;
+		total += blk->size;
+		count++;
+	}
+
+	arena->current = arena->head;
+	arena->last = NULL;
+	arena->inuse = 0;
+	memset(&arena->stats, 0, sizeof(ArenaStats));
+
+	// Merge the blocks, if a single one can be allocated. Under a limit, the
+	// old blocks are released first, so that the memory isn't held twice.
+	if (count > 1)
+	{
+		ArenaBlock *merged = NULL;
+		if (!arena->limit)
+		{
+			merged = arena_block_create(arena, total);
+			if (!merged)
+				return;
+		}
+
+		ArenaBlock *blk = arena->head;
+		while (blk)
+		{
+			ArenaBlock *next = blk->next;
+			arena_block_destroy(arena, blk);
+			blk = next;
+		}
+
+		if (arena->limit)
+			merged = arena_block_create(arena, total);
+
+		arena->head = merged;
+		arena->current = merged;
+	}
+}
+
+void arena_set_limit(Arena *arena, size_t limit)
+{
+	arena->limit = limit;
+}
+
+void arena_stats(const Arena *arena, ArenaStats *stats)
+{
+	*stats = arena->stats;
+}
+
+// Define C extern for C++
+#ifdef __cplusplus
+}
+#endif
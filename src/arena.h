@@ -0,0 +1,146 @@
+// This file is part of stegman project
+//
+// Copyright (c) 2018 Mateusz Brawański (Emzi0767)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/**
+ * \file
+ * \brief Arena allocator for buffers which live for the duration of a single operation.
+ */
+
+// Only include once
+#pragma once
+
+// Check if we're using a C99-capable compiler
+#if __STDC_VERSION__ < 199901L
+#error "You need to use a C99-capable compiler to build this program!"
+#endif
+
+// Define C extern for C++
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/** Opaque arena handle. */
+typedef struct Arena Arena;
+
+/** Usage of an arena since it was last reset. */
+typedef struct ArenaStats
+{
+	/** Total number of bytes handed out, including memory later released. */
+	size_t allocated;
+
+	/** Largest number of bytes in use at once, including alignment. */
+	size_t peak;
+
+	/** Number of allocations made. */
+	size_t allocations;
+} ArenaStats;
+
+/**
+ * Creates a new arena. Memory is carved out of large blocks, and is only 
+ * returned to the system when the arena is destroyed. An arena must not be 
+ * used by multiple threads at once.
+ *
+ * \param blocksize Minimum size of a single block, in bytes. If 0, a default 
+ *                  size is used.
+ * \param arena Pointer to the arena handle. The underlying pointer will be 
+ *              initialized.
+ *
+ * \return 0 if the operation was successful, an error code otherwise.
+ */
+int32_t arena_create(size_t blocksize, Arena **arena);
+
+/**
+ * Wipes and frees all memory held by the arena, then frees the arena.
+ *
+ * \param arena Arena to destroy. Can be NULL.
+ */
+void arena_destroy(Arena *arena);
+
+/**
+ * Allocates zero-filled memory from the arena. If arena is NULL, the memory is
+ * allocated using `calloc` instead.
+ *
+ * \param arena Arena to allocate from. Can be NULL.
+ * \param size Number of bytes to allocate.
+ *
+ * \return Pointer to the allocated memory, or NULL if the allocation failed.
+ */
+void *arena_alloc(Arena *arena, size_t size);
+
+/**
+ * Resizes memory allocated from the arena, preserving its contents. The most 
+ * recent allocation is resized in place when possible. If arena is NULL, 
+ * `realloc` is used instead.
+ *
+ * \param arena Arena the memory was allocated from. Can be NULL.
+ * \param ptr Memory to resize.
+ * \param oldsize Current size of the memory, in bytes.
+ * \param size Requested size, in bytes.
+ *
+ * \return Pointer to the resized memory, or NULL if the allocation failed, in
+ *         which case the original memory is left untouched.
+ */
+void *arena_realloc(Arena *arena, void *ptr, size_t oldsize, size_t size);
+
+/**
+ * Releases memory allocated from the arena. Only the most recent allocation is
+ * actually reclaimed, the rest is reclaimed when the arena is reset. If arena
+ * is NULL, `free` is used instead.
+ *
+ * \param arena Arena the memory was allocated from. Can be NULL.
+ * \param ptr Memory to release. Can be NULL.
+ */
+void arena_free(Arena *arena, void *ptr);
+
+/**
+ * Wipes all memory allocated from the arena, and makes it available for 
+ * reuse. If the previous operation needed more than one block, the blocks are
+ * merged into one, so that an operation of the same size is served from a 
+ * single block next time.
+ *
+ * \param arena Arena to reset.
+ */
+void arena_reset(Arena *arena);
+
+/**
+ * Limits the memory held by the arena. Blocks which would take it past the 
+ * limit are backed by temporary files instead, and are released when the 
+ * arena is reset.
+ *
+ * \param arena Arena to limit.
+ * \param limit Largest number of bytes to hold in memory, or 0 for no limit.
+ */
+void arena_set_limit(Arena *arena, size_t limit);
+
+/**
+ * Gets usage counters of the arena, collected since it was last reset.
+ *
+ * \param arena Arena to examine.
+ * \param stats Pointer to the counters to fill.
+ */
+void arena_stats(const Arena *arena, ArenaStats *stats);
+
+// Define C extern for C++
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,411 @@
+// This file is part of stegman project
+//
+// Copyright (c) 2018 Mateusz Brawański (Emzi0767)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Check if we're using a C99-capable compiler
+#if __STDC_VERSION__ < 199901L
+#error "You need to use a C99-capable compiler to build this program!"
+#endif
+
+// Define C extern for C++
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Appropriate headers
+#include "defs.h"
+#include "job.h"
+#include "io.h"
+#include "batch.h"
+
+// Standard library
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// Shared state of a running batch
+typedef struct BatchState
+{
+	JobRunner *runner;
+	IoQueue *io;
+	PoolGroup group;
+	FILE *results;
+	size_t failed;
+
+	// Jobs finished by the workers, waiting for their output to be written
+	pthread_mutex_t lock;
+	struct BatchTask *done;
+} BatchState;
+
+// Single job of the batch
+typedef struct BatchTask
+{
+	BatchState *state;
+	char *line;
+	Job job;
+	JobResult result;
+
+	// Files read ahead, and the output being written
+	IoFile carrier;
+	IoFile payload;
+	IoFile output;
+	size_t reads;
+	struct BatchTask *next;
+} BatchTask;
+
+// Helper functions
+static size_t batch_split(char *line, char **fields, size_t maxfields)
+{
+	size_t count = 0;
+	char *field = line;
+	while (count < maxfields)
+	{
+		fields[count++] = field;
+		char *tab = strchr(field, '\t');
+		if (!tab)
+			break;
+
+		*tab = '\0';
+		field = tab + 1;
+	}
+
+	return count;
+}
+
+// Fills the job from a manifest line, returns NULL or a description of the 
+// problem
+static const char *batch_parse(char *line, Job *job)
+{
+	char *fields[6];
+	size_t count = batch_split(line, fields, 6);
+	job->op = JOB_UNKNOWN;
+	if (strcmp(fields[0], "encode") == 0)
+	{
+		if (count != 5)
+			return "Encode jobs need 5 fields";
+
+		job->op = JOB_ENCODE;
+		job->carrier = fields[1];
+		job->payload = fields[2];
+		job->output = fields[3];
+		job->password = fields[4];
+		return NULL;
+	}
+
+	if (strcmp(fields[0], "decode") == 0)
+	{
+		if (count != 4)
+			return "Decode jobs need 4 fields";
+
+		job->op = JOB_DECODE;
+		job->carrier = fields[1];
+		job->output = fields[2];
+		job->password = fields[3];
+		return NULL;
+	}
+
+	job->op = JOB_UNKNOWN;
+	return "Unknown operation";
+}
+
+static void batch_record(BatchState *state, const Job *job, const JobResult *result)
+{
+	job_write_result(state->results, job, result);
+	fflush(state->results);
+	if (result->res != STEGMAN_OK)
+		state->failed++;
+}
+
+static void batch_task(void *arg)
+{
+	BatchTask *task = (BatchTask*)arg;
+	BatchState *state = task->state;
+	job_run(state->runner, &task->job, &task->result);
+
+	free(task->carrier.data);
+	free(task->payload.data);
+	task->carrier.data = NULL;
+	task->payload.data = NULL;
+
+	// Writing is left to the I/O thread, the worker moves on to the next job
+	pthread_mutex_lock(&state->lock);
+	task->next = state->done;
+	state->done = task;
+	pthread_mutex_unlock(&state->lock);
+	io_wake(state->io);
+}
+
+// Starts reading the job's files ahead of time
+static void batch_prefetch(BatchState *state, BatchTask *task)
+{
+	task->state = state;
+	task->job.keepoutput = true;
+	task->reads = 1;
+	if (task->job.op == JOB_ENCODE && task->job.payload && task->job.payload[0] == '@')
+		task->reads++;
+
+	io_read_file(state->io, task->job.carrier, &task->carrier, task);
+	if (task->reads == 2)
+		io_read_file(state->io, task->job.payload + 1, &task->payload, task);
+}
+
+// Handles a finished read, and queues the job once all of them are done
+static void batch_read(BatchState *state, BatchTask *task, IoFile *file)
+{
+	if (file->error && !task->result.error)
+	{
+		task->result.res = STEGMAN_E_IO;
+		task->result.detail = file->error;
+		task->result.error = file == &task->carrier ? "Could not read the carrier" : "Could not read the source file";
+	}
+
+	if (--task->reads)
+		return;
+
+	if (task->result.error)
+	{
+		free(task->carrier.data);
+		free(task->payload.data);
+		pthread_mutex_lock(&state->lock);
+		task->next = state->done;
+		state->done = task;
+		pthread_mutex_unlock(&state->lock);
+		return;
+	}
+
+	task->job.carrierdata = task->carrier.data;
+	task->job.carrierlen = task->carrier.len;
+	task->job.payloaddata = task->payload.data;
+	task->job.payloadlen = task->payload.len;
+	if (pool_submit(runner_pool(state->runner), &state->group, batch_task, task))
+		batch_task(task);
+}
+
+// Starts writing the output of a finished job, returns whether the job is done
+static bool batch_write(BatchState *state, BatchTask *task)
+{
+	if (task->result.res != STEGMAN_OK || !task->result.output)
+	{
+		batch_record(state, &task->job, &task->result);
+		return true;
+	}
+
+	const char *path = task->job.output && task->job.output[0] ? task->job.output : task->job.carrier;
+	io_write_file(state->io, path, task->result.output, task->result.outputlen, &task->output, task);
+	return false;
+}
+
+static void batch_written(BatchState *state, BatchTask *task)
+{
+	if (task->output.error)
+	{
+		task->result.res = STEGMAN_E_IO;
+		task->result.detail = task->output.error;
+		task->result.error = "Could not write the output file";
+
+		// Don't leave partial files behind, unless it was the carrier
+		if (task->output.path != task->job.carrier)
+			remove(task->output.path);
+	}
+
+	free(task->result.output);
+	task->result.output = NULL;
+	batch_record(state, &task->job, &task->result);
+}
+
+static void batch_usage(void)
+{
+	werrorf(L"Usage: batch <manifest> [--results <file>] [--threads <count>] [--reuse-key]\n");
+}
+
+// Function definitions
+int32_t batch_main(int argc, char **argv)
+{
+	if (argc < 1)
+	{
+		batch_usage();
+		return 1;
+	}
+
+	// Parse the options
+	const char *manifest = argv[0];
+	const char *results = NULL;
+	size_t threads = 0;
+	StegmanOptions options;
+	stegman_default_options(&options);
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--results") == 0 && i + 1 < argc)
+		{
+			results = argv[++i];
+		}
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+		{
+			threads = strtoul(argv[++i], NULL, 10);
+		}
+		else if (strcmp(argv[i], "--reuse-key") == 0)
+		{
+			options.reuse_key = true;
+		}
+		else
+		{
+			batch_usage();
+			return 1;
+		}
+	}
+
+	// Read the manifest
+	FILE *fman = strcmp(manifest, "-") == 0 ? stdin : fopen(manifest, "rb");
+	if (!fman)
+		fail(2, L"There was an error opening '%s'\n", manifest);
+
+	BatchTask *tasks = NULL;
+	size_t count = 0, cap = 0, lineno = 0;
+	char *line = NULL;
+	size_t linecap = 0;
+	ssize_t linelen = 0;
+	while ((linelen = getline(&line, &linecap, fman)) >= 0)
+	{
+		lineno++;
+		while (linelen > 0 && (line[linelen - 1] == '\n' || line[linelen - 1] == '\r'))
+			line[--linelen] = '\0';
+
+		if (!linelen || line[0] == '#')
+			continue;
+
+		if (count == cap)
+		{
+			cap = cap ? cap * 2 : 64;
+			BatchTask *tasks2 = (BatchTask*)realloc(tasks, cap * sizeof(BatchTask));
+			if (!tasks2)
+				fail(128, L"Could not allocate memory (E_BATCH_ALLOC)\n");
+
+			tasks = tasks2;
+		}
+
+		BatchTask *task = tasks + count++;
+		memset(task, 0, sizeof(BatchTask));
+		task->line = strdup(line);
+		if (!task->line)
+			fail(128, L"Could not allocate memory (E_BATCH_ALLOC)\n");
+
+		task->job.line = lineno;
+		task->result.error = batch_parse(task->line, &task->job);
+		if (task->result.error)
+			task->result.res = STEGMAN_E_ARGUMENT;
+	}
+
+	free(line);
+	if (fman != stdin)
+		fclose(fman);
+
+	// Prepare the output
+	BatchState state;
+	memset(&state, 0, sizeof(BatchState));
+	state.results = results ? fopen(results, "wb") : stdout;
+	if (!state.results)
+		fail(2, L"There was an error opening '%s'\n", results);
+
+	if (runner_create(threads, &options, &state.runner))
+		fail(4, L"Could not start worker threads\n");
+
+	// Keep a couple of jobs per worker read ahead
+	size_t window = pool_size(runner_pool(state.runner)) * 2;
+	if (io_create(window * 3, &state.io))
+		fail(4, L"Could not set up I/O\n");
+
+	pthread_mutex_init(&state.lock, NULL);
+	pool_group_init(&state.group);
+
+	// This thread only moves data. It reads the files of upcoming jobs while
+	// the workers embed, and writes finished outputs, so that the workers 
+	// never wait for the disk. Invalid jobs are only reported.
+	size_t next = 0, active = 0, finished = 0;
+	while (finished < count)
+	{
+		while (next < count && active < window)
+		{
+			BatchTask *task = tasks + next++;
+			if (task->result.error)
+			{
+				batch_record(&state, &task->job, &task->result);
+				finished++;
+				continue;
+			}
+
+			active++;
+			batch_prefetch(&state, task);
+		}
+
+		pthread_mutex_lock(&state.lock);
+		BatchTask *done = state.done;
+		state.done = NULL;
+		pthread_mutex_unlock(&state.lock);
+
+		for (BatchTask *task = done, *nexttask = NULL; task; task = nexttask)
+		{
+			nexttask = task->next;
+			if (batch_write(&state, task))
+				active--, finished++;
+		}
+
+		if (!active)
+			continue;
+
+		IoFile *file = io_wait(state.io);
+		if (!file)
+			continue;
+
+		BatchTask *task = (BatchTask*)file->user;
+		if (file == &task->output)
+		{
+			batch_written(&state, task);
+			active--;
+			finished++;
+		}
+		else
+		{
+			batch_read(&state, task, file);
+		}
+	}
+
+	pool_group_wait(runner_pool(state.runner), &state.group);
+	pool_group_destroy(&state.group);
+	runner_destroy(state.runner);
+	io_destroy(state.io);
+	pthread_mutex_destroy(&state.lock);
+
+	if (results)
+		fclose(state.results);
+
+	for (size_t i = 0; i < count; i++)
+		free(tasks[i].line);
+	free(tasks);
+
+	werrorf(L"Processed %lu jobs, %lu failed.\n", (unsigned long)count, (unsigned long)state.failed);
+	return state.failed ? 1 : 0;
+}
+
+// Define C extern for C++
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,65 @@
+// This file is part of stegman project
+//
+// Copyright (c) 2018 Mateusz Brawański (Emzi0767)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/**
+ * \file
+ * \brief Batch processing of jobs listed in a manifest.
+ */
+
+// Only include once
+#pragma once
+
+// Check if we're using a C99-capable compiler
+#if __STDC_VERSION__ < 199901L
+#error "You need to use a C99-capable compiler to build this program!"
+#endif
+
+// Define C extern for C++
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * Runs all jobs listed in a manifest, in parallel, and writes a result record
+ * for each of them as a line of JSON.
+ *
+ * Each line of the manifest describes a single job, with fields separated by
+ * tabs. Empty lines and lines starting with `#` are ignored.
+ *
+ *     encode <carrier> <message or @source file> <output file> <password ref>
+ *     decode <carrier> <output file> <password ref>
+ *
+ * An empty output file encodes in-place. Password references are described 
+ * by Job.
+ *
+ * \param argc Number of arguments, following the mode name.
+ * \param argv Arguments following the mode name. The first is the manifest.
+ *
+ * \return Exit code for the program.
+ */
+int32_t batch_main(int argc, char **argv);
+
+// Define C extern for C++
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,434 @@
+// This file is part of stegman project
+//
+// Copyright (c) 2018 Mateusz Brawański (Emzi0767)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Check if we're using a C99-capable compiler
+#if __STDC_VERSION__ < 199901L
+#error "You need to use a C99-capable compiler to build this program!"
+#endif
+
+// Define C extern for C++
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Appropriate headers
+#include "defs.h"
+#include "sha256.h"
+#include "aes.h"
+#include "zlib.h"
+#include "steg.h"
+#include "png.h"
+#include "synth.h"
+
+// Standard library
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// Synthetic input sizes. Payloads stay at or below the chunk size, so the
+// single-stream codecs are measured.
+static const uint64_t BENCH_PAYLOADS[] = { 16 * 1024, 256 * 1024, 4 * 1024 * 1024 };
+static const uint32_t BENCH_CARRIERS[] = { 256, 1024, 2048 };
+static const uint16_t BENCH_CYCLES = 4096;
+
+// Channel kernels, measured apart from the default layout
+typedef struct BenchLayout
+{
+	const char *encode;
+	const char *decode;
+	StegChannels channels;
+	uint8_t pixelsize;
+} BenchLayout;
+
+static const BenchLayout BENCH_LAYOUTS[] =
+{
+	{ "steg_encode_rgb4", "steg_decode_rgb4", STEG_CHANNELS_RGB, 4 },
+	{ "steg_encode_alpha4", "steg_decode_alpha4", STEG_CHANNELS_ALPHA, 4 },
+	{ "steg_encode_blue4", "steg_decode_blue4", STEG_CHANNELS_BLUE, 4 },
+	{ "steg_encode_blue3", "steg_decode_blue3", STEG_CHANNELS_BLUE, 3 }
+};
+
+// Measured operation, returning 0 on success
+typedef int32_t (*BenchStep)(void *arg);
+
+// Measurement settings and output state
+typedef struct Bench
+{
+	double mintime;
+	bool quick;
+	bool first;
+	SynthRandom rnd;
+} Bench;
+
+// Inputs shared by the steps
+typedef struct BenchData
+{
+	uint8_t *input;
+	uint64_t inputlen;
+	uint8_t *output;
+	uint64_t outputlen;
+	uint8_t key[32];
+	uint8_t iv[16];
+	uint8_t salt[16];
+	StegMessage msg;
+	StegTraversal trav;
+	StegLayout layout;
+	PngImageInfo image;
+} BenchData;
+
+// Helper functions
+static double bench_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Runs the step until the minimum time passes, after one warm-up run
+static bool bench_run(Bench *bench, BenchStep step, void *arg, uint64_t *iterations, double *seconds)
+{
+	if (step(arg))
+		return false;
+
+	uint64_t count = 0;
+	double start = bench_now(), elapsed = 0;
+	do
+	{
+		if (step(arg))
+			return false;
+
+		count++;
+		elapsed = bench_now() - start;
+	}
+	while (elapsed < bench->mintime || count < 3);
+
+	*iterations = count;
+	*seconds = elapsed;
+	return true;
+}
+
+// Runs the step, and prints the result as a JSON object. The rate is amount 
+// of work per second in given unit, or time per unit for timing units.
+static bool bench_report(Bench *bench, const char *stage, uint64_t size, double work, const char *unit, BenchStep step, void *arg)
+{
+	uint64_t iterations = 0;
+	double seconds = 0;
+	if (!bench_run(bench, step, arg, &iterations, &seconds))
+	{
+		fprintf(stderr, "Benchmark %s failed at size %llu\n", stage, (unsigned long long)size);
+		return false;
+	}
+
+	double rate = strcmp(unit, "ns/cycle") == 0 ? seconds * 1e9 / (iterations * work) : iterations * work / seconds;
+	printf("%s\n    { \"stage\": \"%s\", \"size\": %llu, \"iterations\": %llu, \"seconds\": %.6f, \"rate\": %.3f, \"unit\": \"%s\" }", bench->first ? "" : ",", stage, (unsigned long long)size, (unsigned long long)iterations, seconds, rate, unit);
+	bench->first = false;
+	fflush(stdout);
+	return true;
+}
+
+// Benchmark steps
+static int32_t step_sha_hash(void *arg)
+{
+	BenchData *data = (BenchData*)arg;
+	return sha_hash(data->input, data->inputlen, data->salt, BENCH_CYCLES, data->key);
+}
+
+static int32_t step_zlib_compress(void *arg)
+{
+	BenchData *data = (BenchData*)arg;
+	uint8_t *result = NULL;
+	uint64_t reslen = 0;
+	int32_t res = zlib_compress(NULL, data->input, data->inputlen, &result, &reslen);
+	arena_free(NULL, result);
+	return res;
+}
+
+static int32_t step_zlib_decompress(void *arg)
+{
+	BenchData *data = (BenchData*)arg;
+	uint8_t *result = NULL;
+	uint64_t reslen = 0;
+	int32_t res = zlib_decompress(NULL, data->output, data->outputlen, &result, &reslen);
+	if (!res)
+		arena_free(NULL, result);
+	return res;
+}
+
+static int32_t step_aes_encrypt(void *arg)
+{
+	BenchData *data = (BenchData*)arg;
+	uint8_t *result = NULL;
+	uint64_t reslen = 0;
+	int32_t res = aes_encrypt(NULL, data->input, data->inputlen, data->key, data->iv, &result, &reslen);
+	arena_free(NULL, result);
+	return res;
+}
+
+static int32_t step_aes_decrypt(void *arg)
+{
+	BenchData *data = (BenchData*)arg;
+	uint8_t *result = NULL;
+	uint64_t reslen = 0;
+	int32_t res = aes_decrypt(NULL, data->input, data->inputlen, data->key, data->iv, &result, &reslen);
+	arena_free(NULL, result);
+	return res;
+}
+
+static int32_t step_steg_encode(void *arg)
+{
+	BenchData *data = (BenchData*)arg;
+	return steg_encode(&data->msg, data->output, data->outputlen) ? 0 : 1;
+}
+
+static int32_t step_steg_decode(void *arg)
+{
+	BenchData *data = (BenchData*)arg;
+	StegMessage msg;
+	steg_init_msg(&msg);
+	if (!steg_decode(NULL, data->output, data->outputlen, &msg))
+		return 1;
+
+	arena_free(NULL, msg.contents);
+	return 0;
+}
+
+static int32_t step_steg_encode_scattered(void *arg)
+{
+	BenchData *data = (BenchData*)arg;
+	return steg_encode_scattered(&data->trav, data->input, data->inputlen, 0, data->output, data->outputlen) ? 0 : 1;
+}
+
+static int32_t step_steg_decode_scattered(void *arg)
+{
+	BenchData *data = (BenchData*)arg;
+	return steg_decode_scattered(&data->trav, data->output, data->outputlen, 0, data->input, data->inputlen) ? 0 : 1;
+}
+
+static int32_t step_steg_encode_layout(void *arg)
+{
+	BenchData *data = (BenchData*)arg;
+	return steg_encode_range(&data->layout, data->input, data->inputlen, 0, data->output, data->outputlen) ? 0 : 1;
+}
+
+static int32_t step_steg_decode_layout(void *arg)
+{
+	BenchData *data = (BenchData*)arg;
+	return steg_decode_range(&data->layout, data->output, data->outputlen, 0, data->input, data->inputlen) ? 0 : 1;
+}
+
+static int32_t step_png_save(void *arg)
+{
+	BenchData *data = (BenchData*)arg;
+	char *buf = NULL;
+	size_t buflen = 0;
+	FILE *out = open_memstream(&buf, &buflen);
+	if (!out)
+		return 1;
+
+	int32_t res = png_save_pixels(data->input, data->inputlen, &data->image, out);
+	fclose(out);
+	free(data->output);
+	data->output = (uint8_t*)buf;
+	data->outputlen = buflen;
+	return res;
+}
+
+static int32_t step_png_load(void *arg)
+{
+	BenchData *data = (BenchData*)arg;
+	FILE *in = fmemopen(data->output, data->outputlen, "rb");
+	if (!in)
+		return 1;
+
+	uint8_t *pixels = NULL;
+	size_t pixellen = 0;
+	PngImageInfo image;
+	int32_t res = png_load_pixels(in, &pixels, &pixellen, &image);
+	fclose(in);
+	free(pixels);
+	return res;
+}
+
+// Benchmark groups
+static bool bench_sha(Bench *bench)
+{
+	BenchData data;
+	memset(&data, 0, sizeof(BenchData));
+	uint8_t password[32];
+	synth_random(&bench->rnd, password, sizeof(password));
+	synth_random(&bench->rnd, data.salt, sizeof(data.salt));
+	data.input = password;
+	data.inputlen = sizeof(password);
+	return bench_report(bench, "sha_hash", BENCH_CYCLES, BENCH_CYCLES, "ns/cycle", step_sha_hash, &data);
+}
+
+static bool bench_payloads(Bench *bench)
+{
+	size_t sizes = sizeof(BENCH_PAYLOADS) / sizeof(BENCH_PAYLOADS[0]) - (bench->quick ? 1 : 0);
+	bool ok = true;
+	for (size_t i = 0; ok && i < sizes; i++)
+	{
+		uint64_t len = BENCH_PAYLOADS[i];
+		double mb = len / 1e6;
+		BenchData data;
+		memset(&data, 0, sizeof(BenchData));
+		data.inputlen = len;
+		data.input = (uint8_t*)malloc(len);
+		if (!data.input)
+			return false;
+
+		// Compression works on text, everything else doesn't care
+		synth_text(&bench->rnd, data.input, len);
+		ok = !zlib_compress(NULL, data.input, len, &data.output, &data.outputlen);
+		ok = ok && bench_report(bench, "zlib_compress", len, mb, "MB/s", step_zlib_compress, &data);
+		ok = ok && bench_report(bench, "zlib_decompress", len, mb, "MB/s", step_zlib_decompress, &data);
+		arena_free(NULL, data.output);
+
+		synth_random(&bench->rnd, data.key, sizeof(data.key));
+		synth_random(&bench->rnd, data.iv, sizeof(data.iv));
+		ok = ok && bench_report(bench, "aes_encrypt", len, mb, "MB/s", step_aes_encrypt, &data);
+		ok = ok && bench_report(bench, "aes_decrypt", len, mb, "MB/s", step_aes_decrypt, &data);
+
+		// The carrier has just enough room for the message
+		steg_init_msg(&data.msg);
+		data.msg.length = len;
+		data.msg.contents = data.input;
+		data.outputlen = (STEG_HEADER_SIZE + len) * 4;
+		data.output = (uint8_t*)malloc(data.outputlen);
+		if (data.output)
+			synth_random(&bench->rnd, data.output, data.outputlen);
+		ok = ok && data.output;
+		ok = ok && bench_report(bench, "steg_encode", len, mb, "MB/s", step_steg_encode, &data);
+		ok = ok && bench_report(bench, "steg_decode", len, mb, "MB/s", step_steg_decode, &data);
+
+		// Scattered blocks fill the same carrier in key-seeded order
+		ok = ok && !steg_traversal_init(&data.trav, NULL, data.key, data.outputlen);
+		ok = ok && bench_report(bench, "steg_encode_scattered", len, mb, "MB/s", step_steg_encode_scattered, &data);
+		ok = ok && bench_report(bench, "steg_decode_scattered", len, mb, "MB/s", step_steg_decode_scattered, &data);
+		free(data.output);
+
+		// Each channel kernel gets a carrier with just enough room as well
+		for (size_t j = 0; ok && j < sizeof(BENCH_LAYOUTS) / sizeof(BENCH_LAYOUTS[0]); j++)
+		{
+			const BenchLayout *layout = BENCH_LAYOUTS + j;
+			steg_layout_init(&data.layout, layout->channels, layout->pixelsize);
+			data.outputlen = steg_layout_span(&data.layout, len);
+			data.output = (uint8_t*)malloc(data.outputlen);
+			if (data.output)
+				synth_random(&bench->rnd, data.output, data.outputlen);
+			ok = data.output != NULL;
+			ok = ok && bench_report(bench, layout->encode, len, mb, "MB/s", step_steg_encode_layout, &data);
+			ok = ok && bench_report(bench, layout->decode, len, mb, "MB/s", step_steg_decode_layout, &data);
+			free(data.output);
+		}
+
+		free(data.input);
+	}
+
+	return ok;
+}
+
+static bool bench_carriers(Bench *bench)
+{
+	size_t sizes = sizeof(BENCH_CARRIERS) / sizeof(BENCH_CARRIERS[0]) - (bench->quick ? 1 : 0);
+	bool ok = true;
+	for (size_t i = 0; ok && i < sizes; i++)
+	{
+		BenchData data;
+		memset(&data, 0, sizeof(BenchData));
+		data.image.width = BENCH_CARRIERS[i];
+		data.image.height = BENCH_CARRIERS[i];
+		data.image.bit_depth = 32;
+		data.inputlen = png_row_size(&data.image) * data.image.height;
+		data.input = (uint8_t*)malloc(data.inputlen);
+		if (!data.input)
+			return false;
+
+		synth_pixels(&bench->rnd, data.input, &data.image);
+		uint64_t pixels = (uint64_t)data.image.width * data.image.height;
+		double mp = pixels / 1e6;
+		ok = bench_report(bench, "png_save_pixels", pixels, mp, "MP/s", step_png_save, &data);
+		ok = ok && bench_report(bench, "png_load_pixels", pixels, mp, "MP/s", step_png_load, &data);
+
+		free(data.output);
+		free(data.input);
+	}
+
+	return ok;
+}
+
+static void bench_usage(void)
+{
+	fprintf(stderr, "Usage: stegman-bench [--time <seconds>] [--quick]\n\n");
+	fprintf(stderr, "Measures the throughput of each stage on synthetic inputs, and prints\n");
+	fprintf(stderr, "the results as JSON.\n\n");
+	fprintf(stderr, "--time    Minimum time to spend measuring each stage at each size,\n");
+	fprintf(stderr, "          0.5 seconds by default.\n");
+	fprintf(stderr, "--quick   Skip the largest sizes.\n");
+}
+
+// Entry point
+int32_t main(int argc, char **argv)
+{
+	Bench bench = { 0.5, false, true, { 0 } };
+	synth_seed(&bench.rnd, 0);
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--time") == 0 && i + 1 < argc)
+		{
+			char *end = NULL;
+			bench.mintime = strtod(argv[++i], &end);
+			if (*end || bench.mintime < 0)
+			{
+				bench_usage();
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--quick") == 0)
+		{
+			bench.quick = true;
+		}
+		else
+		{
+			bench_usage();
+			return 1;
+		}
+	}
+
+	printf("{\n  \"program\": \"stegman-bench\",\n");
+#ifdef __BUILDINFO__
+	printf("  \"commit\": \"%ls\",\n  \"compiler\": \"%ls\",\n", __GIT_COMMIT__, __COMPILER__);
+#endif
+	printf("  \"min_time\": %.3f,\n  \"results\": [", bench.mintime);
+
+	bool ok = bench_sha(&bench) && bench_payloads(&bench) && bench_carriers(&bench);
+
+	printf("\n  ]\n}\n");
+	return ok ? 0 : 1;
+}
+
+// Define C extern for C++
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,122 @@
+// This file is part of stegman project
+//
+// Copyright (c) 2018 Mateusz Brawański (Emzi0767)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Check if we're using a C99-capable compiler
+#if __STDC_VERSION__ < 199901L
+#error "You need to use a C99-capable compiler to build this program!"
+#endif
+
+// Define C extern for C++
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Appropriate headers
+#include "defs.h"
+#include "zlib.h"
+#include "png.h"
+#include "steg.h"
+#include "capacity.h"
+
+// Standard library
+#include <stdlib.h>
+#include <string.h>
+
+// Helper functions
+static void capacity_header(PayloadInfo *info, const uint8_t *pixels, size_t loaded)
+{
+	StegMessage smsg;
+	if (!steg_decode_header(pixels, loaded, info->image.bit_depth / 8, &smsg))
+		return;
+
+	// A stray magic number in an unrelated image is unlikely, but possible
+	if (smsg.length > info->capacity)
+		return;
+
+	info->found = true;
+	info->flags = smsg.flags;
+	info->cycles = smsg.cycles;
+	info->length = smsg.length;
+}
+
+// Function definitions
+uint64_t capacity_content_length(uint64_t complen)
+{
+	uint64_t len = complen + sizeof(int32_t);
+	if (len % 16)
+		len = ((len / 16) + 1) * 16;
+
+	return len;
+}
+
+int32_t capacity_probe(FILE *png, uint64_t msglen, StegChannels channels, CapacityInfo *info)
+{
+	int32_t res = png_read_header(png, &info->image);
+	if (res)
+		return res;
+
+	// Only the selected channels count
+	StegLayout layout;
+	info->pixellen = (uint64_t)png_row_size(&info->image) * info->image.height;
+	info->available = steg_layout_init(&layout, channels, info->image.bit_depth / 8);
+	info->capacity = info->available ? steg_layout_capacity(&layout, info->pixellen) : 0;
+	info->minlen = capacity_content_length(zlib_compress_min(msglen));
+	info->maxlen = capacity_content_length(zlib_compress_bound(msglen));
+
+	if (info->minlen > info->capacity)
+		info->fit = FIT_NO;
+	else if (info->maxlen > info->capacity)
+		info->fit = FIT_MAYBE;
+	else
+		info->fit = FIT_YES;
+
+	return 0;
+}
+
+int32_t capacity_payload(FILE *png, PayloadInfo *info)
+{
+	memset(info, 0, sizeof(PayloadInfo));
+	off_t start = ftello(png);
+	if (start < 0)
+		return 128;
+
+	uint8_t *pixels = NULL;
+	size_t loaded = 0;
+	int32_t res = png_load_head(png, STEG_HEADER_SPAN, &pixels, &loaded, &info->image);
+	if (!res)
+	{
+		info->capacity = steg_capacity((uint64_t)png_row_size(&info->image) * info->image.height);
+		capacity_header(info, pixels, loaded);
+	}
+
+	free(pixels);
+	if (fseeko(png, start, SEEK_SET) && !res)
+		res = 128;
+
+	return res;
+}
+
+// Define C extern for C++
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,149 @@
+// This file is part of stegman project
+//
+// Copyright (c) 2018 Mateusz Brawański (Emzi0767)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/**
+ * \file
+ * \brief Carrier capacity probing.
+ */
+
+// Only include once
+#pragma once
+
+// Check if we're using a C99-capable compiler
+#if __STDC_VERSION__ < 199901L
+#error "You need to use a C99-capable compiler to build this program!"
+#endif
+
+// Define C extern for C++
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Standard library
+#include <stdio.h>
+
+// Image information and message layouts
+#include "png.h"
+#include "steg.h"
+
+/** Whether a message fits in a carrier. */
+typedef enum CapacityFit
+{
+	/** The message cannot fit, no matter how well it compresses. */
+	FIT_NO = 0,
+
+	/** The message fits if it compresses well enough. */
+	FIT_MAYBE = 1,
+
+	/** The message fits even if it doesn't compress at all. */
+	FIT_YES = 2
+} CapacityFit;
+
+/** Result of a capacity probe. */
+typedef struct CapacityInfo
+{
+	/** Information about the carrier image. */
+	PngImageInfo image;
+
+	/** Length of the carrier's pixel data, in bytes. */
+	uint64_t pixellen;
+
+	/** Whether the selected channels are available on the carrier's pixels.
+	 * Nothing fits otherwise. */
+	bool available;
+
+	/** Number of encrypted content bytes the selected channels of the 
+	 * carrier can hold. */
+	uint64_t capacity;
+
+	/** Smallest possible length of the encrypted contents. */
+	uint64_t minlen;
+
+	/** Largest possible length of the encrypted contents. */
+	uint64_t maxlen;
+
+	/** Whether the message fits in the carrier. */
+	CapacityFit fit;
+} CapacityInfo;
+
+/** Result of a payload probe. */
+typedef struct PayloadInfo
+{
+	/** Information about the carrier image. */
+	PngImageInfo image;
+
+	/** Number of encrypted content bytes the carrier can hold. */
+	uint64_t capacity;
+
+	/** Whether the carrier holds a message. */
+	bool found;
+
+	/** Flags of the message, if found. */
+	int32_t flags;
+
+	/** Number of key derivation cycles of the message, if found. */
+	uint16_t cycles;
+
+	/** Length of the encrypted contents of the message, if found. */
+	uint64_t length;
+} PayloadInfo;
+
+/**
+ * Calculates the length of the encrypted contents for a given compressed 
+ * message length. This accounts for the control value and AES padding.
+ *
+ * \param complen Length of the compressed message.
+ *
+ * \return Length of the encrypted contents.
+ */
+uint64_t capacity_content_length(uint64_t complen);
+
+/**
+ * Checks whether a message of given length can fit in a carrier. Only the 
+ * header of the carrier is read, so this is much cheaper than loading it.
+ *
+ * \param png Carrier PNG file. The position in the file is preserved.
+ * \param msglen Length of the message to encode.
+ * \param channels Channels of each pixel to hold the message.
+ * \param info Result of the probe.
+ *
+ * \return 0 if the operation was successful, an error code otherwise.
+ */
+int32_t capacity_probe(FILE *png, uint64_t msglen, StegChannels channels, CapacityInfo *info);
+
+/**
+ * Checks whether a carrier holds a message, and reads its unencrypted header.
+ * Only the leading rows holding the header are decompressed, except for 
+ * interlaced images, which have to be loaded as a whole.
+ *
+ * \param png Carrier PNG file. The position in the file is preserved.
+ * \param info Result of the probe.
+ *
+ * \return 0 if the operation was successful, an error code otherwise.
+ */
+int32_t capacity_payload(FILE *png, PayloadInfo *info);
+
+// Define C extern for C++
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,64 @@
+// This file is part of stegman project
+//
+// Copyright (c) 2018 Mateusz Brawański (Emzi0767)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/**
+ * \file
+ * \brief Library internals shared with the program, which are not part of the public API.
+ */
+
+// Only include once
+#pragma once
+
+// Check if we're using a C99-capable compiler
+#if __STDC_VERSION__ < 199901L
+#error "You need to use a C99-capable compiler to build this program!"
+#endif
+
+// Define C extern for C++
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Library and thread pool
+#include "stegman.h"
+#include "pool.h"
+
+/**
+ * Creates a new library context, which runs its work on an existing thread 
+ * pool instead of creating its own.
+ *
+ * \param options Options for the context. If NULL, defaults are used. The 
+ *                thread count is ignored.
+ * \param pool Pool to run the work on. Can be NULL, in which case everything
+ *             runs on the calling thread. The pool must outlive the context.
+ * \param ctx Pointer to the context handle. The underlying pointer will be 
+ *            initialized.
+ *
+ * \return STEGMAN_OK if the operation was successful, an error code otherwise.
+ */
+StegmanResult stegman_create_shared(const StegmanOptions *options, ThreadPool *pool, StegmanContext **ctx);
+
+// Define C extern for C++
+#ifdef __cplusplus
+}
+#endif
@@ -33,105 +33,200 @@ extern "C"
 
 // Appropriate headers
 #include "defs.h"
-#include "aes.h"
-#include "sha256.h"
-#include "zlib.h"
-#include "png.h"
-#include "steg.h"
+#include "stegman.h"
+#include "text.h"
 #include "decode.h"
 
 // Standard library
 #include <stdlib.h>
-#include <stdio.h>
 #include <string.h>
 
-// Function definitions
-bool decode(const wchar_t *password, size_t passlen, FILE *png, uint8_t **message, size_t *msglen, bool *isfile)
+// Destination of a decoded message
+typedef struct DecodeSink
+{
+    FILE *output;
+    StegmanPayload type;
+
+    // Older text messages are collected, as they need converting to UTF-8 
+    // as a whole
+    uint8_t *text;
+    size_t textlen;
+    size_t textcap;
+} DecodeSink;
+
+// Helper functions
+static StegmanResult decode_create(uint64_t maxmemory, StegmanContext **ctx)
+{
+    StegmanOptions options;
+    stegman_default_options(&options);
+    options.max_memory = maxmemory;
+    return stegman_create(&options, ctx);
+}
+
+static void decode_report(StegmanContext *ctx, StegmanResult res)
 {
-    uint8_t key[KEY_SIZE];
-
-    // Load the PNG data
-    uint8_t *pixels = NULL;
-	uint64_t pixelcount = 0;
-	PngImageInfo pnginf;
-	int32_t res = png_load_pixels(png, &pixels, &pixelcount, &pnginf);
-	if (res)
-	{
-		werrorf(L"Error loading PNG image (%d). Refer to libpng manual for details.\n", res);
-		return false;
-	}
-
-    // Decode the steganographic message
-    StegMessage smsg;
-    steg_init_msg(&smsg);
-    if (!steg_decode(pixels, pixelcount, &smsg))
+    int32_t detail = stegman_error_detail(ctx);
+    if (detail)
+        werrorf(L"%s (%d).\n", stegman_strerror(res), detail);
+    else
+        werrorf(L"%s.\n", stegman_strerror(res));
+}
+
+static int32_t decode_sink(void *arg, const uint8_t *data, size_t len)
+{
+    DecodeSink *sink = (DecodeSink*)arg;
+    if (sink->type != STEGMAN_PAYLOAD_TEXT_WCHAR)
+        return fwrite(data, sizeof(uint8_t), len, sink->output) != len;
+
+    if (sink->textlen + len > sink->textcap)
     {
-        free(pixels);
-        werrorf(L"Failed to decode data from pixels!\n");
+        size_t cap = sink->textcap ? sink->textcap : 4096;
+        while (cap < sink->textlen + len)
+            cap *= 2;
+
+        uint8_t *text = (uint8_t*)realloc(sink->text, cap);
+        if (!text)
+            return 1;
+
+        sink->text = text;
+        sink->textcap = cap;
+    }
+
+    memcpy(sink->text + sink->textlen, data, len);
+    sink->textlen += len;
+    return 0;
+}
+
+// Writes a collected older text message as UTF-8
+static bool decode_finish(DecodeSink *sink, StegmanResult res)
+{
+    if (res != STEGMAN_OK)
+    {
+        free(sink->text);
         return false;
     }
 
-    // Set the is file flag
-    *isfile = (smsg.flags & MSG_FILE) == MSG_FILE;
+    if (sink->type == STEGMAN_PAYLOAD_TEXT_WCHAR)
+    {
+        // Older messages hold whole wide characters, anything past them is 
+        // ignored
+        uint8_t *utf8 = NULL;
+        size_t utf8len = 0;
+        int32_t tres = text_wcs_to_utf8((const wchar_t*)sink->text, sink->textlen / sizeof(wchar_t), &utf8, &utf8len);
+        free(sink->text);
+        if (tres)
+        {
+            werrorf(L"Decoded message is not valid text (%d).\n", tres);
+            return false;
+        }
+
+        bool written = fwrite(utf8, sizeof(uint8_t), utf8len, sink->output) == utf8len;
+        free(utf8);
+        if (!written)
+        {
+            werrorf(L"%s.\n", stegman_strerror(STEGMAN_E_IO));
+            return false;
+        }
+    }
 
-    // Create the AES key by hashing the password using SHA-256
-	res = sha_hash((uint8_t*)password, passlen * sizeof(wchar_t), smsg.salt, smsg.cycles, key);
-	if (res)
-	{
-        free(smsg.contents);
-        free(pixels);
-		werrorf(L"Error generating AES key (%lu). Refer to OpenSSL docs for SHA256 for more details.\n", res);
-		return false;
-	}
+    return true;
+}
 
-    // Decrypt the data
-    uint8_t *data = NULL;
-	uint64_t datalen = 0;
-    res = aes_decrypt(smsg.contents, smsg.length, key, smsg.iv, &data, &datalen);
-    if (res)
+// Function definitions
+bool decode(const wchar_t *password, size_t passlen, FILE *png, uint8_t **message, size_t *msglen, bool *isfile, StatsFormat stats, uint64_t maxmemory)
+{
+    StegmanContext *ctx = NULL;
+    StegmanResult res = decode_create(maxmemory, &ctx);
+    if (res != STEGMAN_OK)
     {
-        free(smsg.contents);
-        free(pixels);
-		werrorf(L"Error decrypting data (%d). Refer to OpenSSL manual for details.\n", res);
-		return false;
+        werrorf(L"%s.\n", stegman_strerror(res));
+        return false;
     }
 
-    // Check if header matches
-    if (*((int32_t*)data) != STEG_MAGIC)
+    uint8_t *data = NULL;
+    size_t datalen = 0;
+    StegmanPayload type = STEGMAN_PAYLOAD_FILE;
+    res = stegman_decode_file(ctx, (const uint8_t*)password, passlen * sizeof(wchar_t), png, &data, &datalen, &type);
+    if (res != STEGMAN_OK)
+        decode_report(ctx, res);
+
+    stats_print(ctx, stats, "decode");
+    stegman_destroy(ctx);
+    if (res != STEGMAN_OK)
+        return false;
+
+    *isfile = type == STEGMAN_PAYLOAD_FILE;
+    if (type == STEGMAN_PAYLOAD_TEXT)
     {
+        // Convert the text back to a wide string
+        wchar_t *wmsg = NULL;
+        size_t wmsglen = 0;
+        int32_t tres = text_utf8_to_wcs(data, datalen, &wmsg, &wmsglen);
         free(data);
-        free(smsg.contents);
-        free(pixels);
-		werrorf(L"Decrypted data was corrupted or invalid. Did you supply a correct password?\n");
-		return false;
+        if (tres)
+        {
+            werrorf(L"Decoded message is not valid UTF-8 (%d).\n", tres);
+            return false;
+        }
+
+        *message = (uint8_t*)wmsg;
+        *msglen = wmsglen * sizeof(wchar_t);
     }
+    else
+    {
+        // Files and older text messages, stored as wide strings, are returned
+        // as they are
+        *message = data;
+        *msglen = datalen;
+    }
+
+    return true;
+}
 
-    // Decompress the data
-    uint8_t *data2 = NULL;
-    uint64_t data2len = 0;
-    size_t isize = sizeof(int32_t);
-    res = zlib_decompress(data + isize, datalen - isize, &data2, &data2len);
-    if (res)
+bool decode_to(const wchar_t *password, size_t passlen, FILE *png, FILE *output, bool *isfile, StatsFormat stats, uint64_t maxmemory)
+{
+    StegmanContext *ctx = NULL;
+    StegmanResult res = decode_create(maxmemory, &ctx);
+    if (res != STEGMAN_OK)
     {
-        free(data);
-        free(smsg.contents);
-        free(pixels);
-		werrorf(L"Error decompressing data (%d). Refer to ZLib manual for details.\n", res);
+        werrorf(L"%s.\n", stegman_strerror(res));
         return false;
     }
 
-    // Allocate the target buffer and copy the result
-    *message = (uint8_t*)calloc(data2len, sizeof(uint8_t));
-    *msglen = data2len;
-    memcpy(*message, data2, data2len);
+    DecodeSink sink;
+    memset(&sink, 0, sizeof(DecodeSink));
+    sink.output = output;
+    res = stegman_decode_sink(ctx, (const uint8_t*)password, passlen * sizeof(wchar_t), png, decode_sink, &sink, &sink.type);
+    if (res != STEGMAN_OK)
+        decode_report(ctx, res);
+
+    stats_print(ctx, stats, "decode");
+    stegman_destroy(ctx);
+    *isfile = sink.type == STEGMAN_PAYLOAD_FILE;
+    return decode_finish(&sink, res);
+}
 
-    // Free the memory
-    free(data2);
-    free(data);
-    free(smsg.contents);
-    free(pixels);
+bool decode_shards_to(const wchar_t *password, size_t passlen, FILE **pngs, size_t count, FILE *output, bool *isfile, StatsFormat stats)
+{
+    StegmanContext *ctx = NULL;
+    StegmanResult res = decode_create(0, &ctx);
+    if (res != STEGMAN_OK)
+    {
+        werrorf(L"%s.\n", stegman_strerror(res));
+        return false;
+    }
 
-    return true;
+    DecodeSink sink;
+    memset(&sink, 0, sizeof(DecodeSink));
+    sink.output = output;
+    res = stegman_decode_shards(ctx, (const uint8_t*)password, passlen * sizeof(wchar_t), pngs, count, decode_sink, &sink, &sink.type);
+    if (res != STEGMAN_OK)
+        decode_report(ctx, res);
+
+    stats_print(ctx, stats, "decode");
+    stegman_destroy(ctx);
+    *isfile = sink.type == STEGMAN_PAYLOAD_FILE;
+    return decode_finish(&sink, res);
 }
 
 // Define C extern for C++
@@ -42,6 +42,9 @@ extern "C"
 // Standard library
 #include <stdio.h>
 
+// Measurement reports
+#include "stats.h"
+
 /**
  * Decodes data from a picture. This method will read data from the supplied 
  * PNG image's pixels.
@@ -50,13 +53,50 @@ extern "C"
  * \param passlen Length of the password.
  * \param png File to decode the data from. This should be a PNG file.
  * \param message Pointer to message bytes. Underlying pointer will be 
- *                initialized.
+ *                initialized. Text messages are returned as a null-terminated
+ *                wide string.
  * \param msglen Length of the resulting message.
  * \param isfile Whether the message is a file.
+ * \param stats Format to report measurements of the operation in.
+ * \param maxmemory Memory budget of the operation, in bytes, or 0 for none.
+ *
+ * \return Whether the operation was successful.
+ */
+bool decode(const wchar_t *password, size_t passlen, FILE *png, uint8_t **message, size_t *msglen, bool *isfile, StatsFormat stats, uint64_t maxmemory);
+
+/**
+ * Decodes data from a picture, writing it to a file as it's decompressed, so 
+ * that the whole message never needs to be held in memory. Text messages are
+ * written as UTF-8, including older ones stored as wide strings.
+ *
+ * \param password Password to decrypt the data with.
+ * \param passlen Length of the password.
+ * \param png File to decode the data from. This should be a PNG file.
+ * \param output File to write the message to.
+ * \param isfile Whether the message is a file.
+ * \param stats Format to report measurements of the operation in.
+ * \param maxmemory Memory budget of the operation, in bytes, or 0 for none.
+ *
+ * \return Whether the operation was successful.
+ */
+bool decode_to(const wchar_t *password, size_t passlen, FILE *png, FILE *output, bool *isfile, StatsFormat stats, uint64_t maxmemory);
+
+/**
+ * Decodes data split across multiple pictures, writing it to a file as it's
+ * decompressed. The pictures can be supplied in any order, but all of them 
+ * are needed. Text is written as in decode_to.
+ *
+ * \param password Password to decrypt the data with.
+ * \param passlen Length of the password.
+ * \param pngs Files to decode the data from. These should be PNG files.
+ * \param count Number of files.
+ * \param output File to write the message to.
+ * \param isfile Whether the message is a file.
+ * \param stats Format to report measurements of the operation in.
  *
  * \return Whether the operation was successful.
  */
-bool decode(const wchar_t *password, size_t passlen, FILE *png, uint8_t **message, size_t *msglen, bool *isfile);
+bool decode_shards_to(const wchar_t *password, size_t passlen, FILE **pngs, size_t count, FILE *output, bool *isfile, StatsFormat stats);
 
 // Define C extern for C++
 #ifdef __cplusplus
@@ -43,6 +43,11 @@ extern "C"
 #define _UNICODE
 #define UNICODE
 
+// Enable POSIX.1-2008 functionality
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 // Standard types
 #include <stddef.h>
 
@@ -59,6 +64,12 @@ extern "C"
 #include <wchar.h>
 #include <wctype.h>
 
+// Streams
+#include <stdio.h>
+
+// Message channels
+#include "stegman.h"
+
 // Program metadata
 /** Name of the program. */
 extern const wchar_t* const PROGRAM_NAME;
@@ -72,6 +83,20 @@ extern const wchar_t* const PROGRAM_AUTHOR;
 /** Description of the program. */
 extern const wchar_t* const PROGRAM_DESCRIPTION; 
 
+// Type definitions
+/** Contents of an input file. */
+typedef struct InputFile
+{
+	/** Contents of the file. */
+	const uint8_t *data;
+
+	/** Length of the contents, in bytes. */
+	size_t len;
+
+	/** Whether the contents are mapped, rather than read into memory. */
+	bool mapped;
+} InputFile;
+
 // Function declarations
 /**
  * Prints a formatted string to standard error.
@@ -90,6 +115,19 @@ int32_t werrorf(const wchar_t *format, ...);
  */
 void print_usage(char *progname);
 
+/**
+ * Prints how much data a carrier can hold, and optionally whether a message
+ * fits in it. Only the header of the carrier is read.
+ *
+ * \param target Path to the carrier file.
+ * \param message Message to check, `@` followed by a path for files. Can be 
+ *                NULL.
+ * \param channels Channels of each pixel to count.
+ *
+ * \return Exit code for the program.
+ */
+int32_t print_capacity(char *target, char *message, StegmanChannels channels);
+
 /**
  * Quits the program with specified error message and status code.
  *
@@ -99,6 +137,53 @@ void print_usage(char *progname);
  */
 void fail(int32_t code, wchar_t *format, ...);
 
+/**
+ * Reads everything that's left in a stream.
+ *
+ * \param src Stream to read.
+ * \param data Pointer to the contents. The underlying pointer will be 
+ *             initialized, and needs to be freed.
+ * \param len Pointer to the length of the contents.
+ *
+ * \return Whether the operation was successful.
+ */
+bool read_stream(FILE *src, uint8_t **data, size_t *len);
+
+/**
+ * Opens a file named on the command line for reading. `-` stands for the 
+ * standard input, which is read into memory first, so that the result can be 
+ * seeked like any other file.
+ *
+ * \param path Path to the file, or `-`.
+ * \param buffer Pointer to the buffer holding the standard input. The
+ *               underlying pointer will be set, and needs to be freed after 
+ *               the file is closed.
+ *
+ * \return The opened file, or NULL if it could not be opened.
+ */
+FILE *open_input(const char *path, uint8_t **buffer);
+
+/**
+ * Makes the contents of an input file available. Regular files are mapped 
+ * into memory instead of being copied, other files are read. `-` stands for 
+ * the standard input.
+ *
+ * \param path Path to the file, or `-`.
+ * \param input Pointer to the contents. Needs to be released with 
+ *              input_release.
+ *
+ * \return 0 if the operation was successful, 1 if the file could not be 
+ *         opened, 2 if it could not be read.
+ */
+int32_t input_map(const char *path, InputFile *input);
+
+/**
+ * Releases the contents of an input file.
+ *
+ * \param input Contents to release.
+ */
+void input_release(InputFile *input);
+
 /**
  * Calculates the length of a multibyte string.
  * 
@@ -108,6 +193,50 @@ void fail(int32_t code, wchar_t *format, ...);
  */
 size_t mbcslen(char *str);
 
+/** Kinds of values taken by command line options. */
+typedef enum OptionValue
+{
+	/** The option is a flag, and takes no value. */
+	OPTION_NONE = 0,
+
+	/** The value can be given as `--name=value`, or left out. */
+	OPTION_OPTIONAL = 1,
+
+	/** The value has to be given, as `--name=value` or `--name value`. */
+	OPTION_REQUIRED = 2
+} OptionValue;
+
+/**
+ * Finds all occurrences of an option, and removes them from the arguments, 
+ * along with their values, so that the remaining ones can be parsed 
+ * positionally. Arguments before the first examined one are positional 
+ * operands, and are never taken for options, even if they look like one.
+ *
+ * \param argc Pointer to the number of arguments. The underlying value will
+ *             be updated.
+ * \param argv Arguments to examine.
+ * \param first Index of the first argument which can be an option.
+ * \param name Name of the option, including the leading dashes.
+ * \param kind Kind of value the option takes.
+ * \param value Pointer to the value of the last occurrence. The underlying 
+ *              pointer will be set to NULL if there's no value. Can be NULL 
+ *              for flags.
+ *
+ * \return Number of occurrences, or -1 if an occurrence has a value it 
+ *         shouldn't have, or lacks a value it needs.
+ */
+int32_t take_option(int *argc, char **argv, int first, const char *name, OptionValue kind, const char **value);
+
+/**
+ * Parses a size in bytes, with an optional K, M, or G suffix.
+ *
+ * \param str String to parse.
+ * \param size Pointer to the parsed size.
+ *
+ * \return Whether the string was a valid size.
+ */
+bool parse_size(const char *str, uint64_t *size);
+
 // Define C extern for C++
 #ifdef __cplusplus
 }
@@ -0,0 +1,105 @@
+// This file is part of stegman project
+//
+// Copyright (c) 2018 Mateusz Brawański (Emzi0767)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Check if we're using a C99-capable compiler
+#if __STDC_VERSION__ < 199901L
+#error "You need to use a C99-capable compiler to build this program!"
+#endif
+
+// Define C extern for C++
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Appropriate headers
+#include "defs.h"
+#include "dict.h"
+
+// Standard library
+#include <pthread.h>
+
+// Constant definitions
+const int32_t DICT_ID_SHIFT = 8;
+const uint64_t DICT_MAX_MESSAGE = 64 * 1024;
+
+// Message vocabulary. Deflate reaches the end of the dictionary with the
+// shortest distances, so the most common strings are placed last. The
+// contents must never change once released, as the decoder has to rebuild
+// the exact same dictionary. New vocabularies need a new ID.
+static const char DICT_TEXT[] =
+	"https://www. .com .org .net .pl @gmail.com password account address "
+	"attached document file photo picture link download upload folder drive "
+	"January February March April May June July August September October "
+	"November December Monday Tuesday Wednesday Thursday Friday Saturday Sunday "
+	"morning afternoon evening tonight tomorrow yesterday today next week "
+	"o'clock 10:00 12:00 2018 2019 2020 0123456789 "
+	"station airport hotel office house street city north south east west "
+	"money bank transfer payment price order number code key door box "
+	"secret message hidden safe careful trust nobody anyone everyone "
+	"meet meeting call phone contact send sent receive received reply "
+	"please thank you thanks sorry hello hi hey dear regards best wishes "
+	"love miss see soon later again still already never always maybe "
+	"I'm I'll I've don't can't won't didn't isn't it's that's there's "
+	"what when where which who why how about after before between through "
+	"would could should will shall must might need want know think "
+	"there their they them then than this that these those with from "
+	"have has had was were been being are is am be do does did done "
+	"your you our we us my me his her him she he it its of to in on at "
+	"for and the a an. the the and to of in is you that it for on ";
+
+// Lazily-built wchar_t copy of the vocabulary
+static wchar_t dict_wchar[sizeof(DICT_TEXT)];
+static pthread_once_t dict_wchar_once = PTHREAD_ONCE_INIT;
+
+// Helper functions
+static void dict_build_wchar(void)
+{
+	for (size_t i = 0; i < sizeof(DICT_TEXT) - 1; i++)
+		dict_wchar[i] = (wchar_t)DICT_TEXT[i];
+}
+
+// Function definitions
+int32_t dict_get(DictionaryId id, const uint8_t **dict, size_t *dictlen)
+{
+	switch (id)
+	{
+		case DICT_TEXT_WCHAR:
+			pthread_once(&dict_wchar_once, dict_build_wchar);
+			*dict = (const uint8_t*)dict_wchar;
+			*dictlen = (sizeof(DICT_TEXT) - 1) * sizeof(wchar_t);
+			return 0;
+
+		case DICT_TEXT_UTF8:
+			*dict = (const uint8_t*)DICT_TEXT;
+			*dictlen = sizeof(DICT_TEXT) - 1;
+			return 0;
+
+		default:
+			return 1;
+	}
+}
+
+// Define C extern for C++
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,76 @@
+// This file is part of stegman project
+//
+// Copyright (c) 2018 Mateusz Brawański (Emzi0767)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/**
+ * \file
+ * \brief Preset compression dictionaries for short text messages.
+ */
+
+// Only include once
+#pragma once
+
+// Check if we're using a C99-capable compiler
+#if __STDC_VERSION__ < 199901L
+#error "You need to use a C99-capable compiler to build this program!"
+#endif
+
+// Define C extern for C++
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/** Identifiers of available preset dictionaries. */
+typedef enum DictionaryId
+{
+	/** No dictionary. */
+	DICT_NONE = 0,
+
+	/** Common message vocabulary, laid out as `wchar_t` strings. */
+	DICT_TEXT_WCHAR = 1,
+
+	/** Common message vocabulary, encoded as UTF-8. */
+	DICT_TEXT_UTF8 = 2
+} DictionaryId;
+
+/** Position of the dictionary ID within the message flags, in bits. */
+extern const int32_t DICT_ID_SHIFT;
+
+/** Largest message for which a dictionary is attempted, in bytes. */
+extern const uint64_t DICT_MAX_MESSAGE;
+
+/**
+ * Gets the contents of a preset dictionary.
+ *
+ * \param id ID of the dictionary to get.
+ * \param dict Pointer to dictionary bytes. The underlying pointer will be set
+ *             to static data, which must not be freed.
+ * \param dictlen Pointer to dictionary length.
+ *
+ * \return 0 if the operation was successful, an error code otherwise.
+ */
+int32_t dict_get(DictionaryId id, const uint8_t **dict, size_t *dictlen);
+
+// Define C extern for C++
+#ifdef __cplusplus
+}
+#endif
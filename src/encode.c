@@ -33,144 +33,75 @@ extern "C"
 
 // Appropriate headers
 #include "defs.h"
-#include "aes.h"
-#include "sha256.h"
-#include "zlib.h"
-#include "png.h"
-#include "steg.h"
+#include "stegman.h"
 #include "encode.h"
 
 // Standard library
 #include <stdlib.h>
-#include <time.h>
-#include <string.h>
-#include <unistd.h>
 
 // Function definitions
-bool encode(const wchar_t *password, size_t passlen, FILE *png, const uint8_t *message, size_t msglen, bool isfile)
+bool encode(const wchar_t *password, size_t passlen, FILE *png, FILE *output, const uint8_t *message, size_t msglen, bool isfile, StatsFormat stats, uint64_t maxmemory, bool scatter, StegmanChannels channels)
 {
-	uint8_t salt[SALT_SIZE], iv[IV_SIZE], key[KEY_SIZE];
-
-	// Generate salt
-	int32_t res = sha_gen_salt(salt);
-	if (res)
-	{
-		werrorf(L"Error generating salt (%lu). Refer to OpenSSL docs for RAND_bytes for more details.\n", res);
-		return false;
-	}
-
-	// Generate IV
-	res = aes_gen_iv(iv);
-	if (res)
-	{
-		werrorf(L"Error generating IV (%lu). Refer to OpenSSL docs for RAND_bytes for more details.\n", res);
-		return false;
-	}
-
-	// Generate hash cycle count
-	srand(time(NULL));
-	uint16_t hc = (uint16_t)(rand() % 32768 + 32767);
-
-	// Create the AES key by hashing the password using SHA-256
-	res = sha_hash((uint8_t*)password, passlen * sizeof(wchar_t), salt, hc, key);
-	if (res)
-	{
-		werrorf(L"Error generating AES key (%lu). Refer to OpenSSL docs for SHA256 for more details.\n", res);
-		return false;
-	}
-
-	// Compress the data
-	uint8_t *data = NULL;
-	uint64_t datalen = 0;
-	res = zlib_compress(message, msglen, &data, &datalen);
-	if (res)
+	StegmanOptions options;
+	stegman_default_options(&options);
+	options.max_memory = maxmemory;
+	options.scatter = scatter;
+	options.channels = channels;
+
+	StegmanContext *ctx = NULL;
+	StegmanResult res = stegman_create(&options, &ctx);
+	if (res != STEGMAN_OK)
 	{
-		werrorf(L"Error compressing data (%d). Refer to ZLib manual for details.\n", res);
+		werrorf(L"%s.\n", stegman_strerror(res));
 		return false;
 	}
 
-	// Reallocate the message buffer
-	uint32_t isize = sizeof(int32_t);
-	uint8_t *data2 = (uint8_t*)calloc(datalen + isize, sizeof(uint8_t));
-	if (!data2)
+	StegmanPayload type = isfile ? STEGMAN_PAYLOAD_FILE : STEGMAN_PAYLOAD_TEXT;
+	if (output)
+		res = stegman_encode_copy(ctx, (const uint8_t*)password, passlen * sizeof(wchar_t), png, output, message, msglen, type);
+	else
+		res = stegman_encode_file(ctx, (const uint8_t*)password, passlen * sizeof(wchar_t), png, message, msglen, type);
+	if (res != STEGMAN_OK)
 	{
-		free(data);
-		werrorf(L"Error allocating data buffer (E_MSG_BUFFER_ZLIB_AES).\n");
-		return false;
+		int32_t detail = stegman_error_detail(ctx);
+		if (detail)
+			werrorf(L"%s (%d).\n", stegman_strerror(res), detail);
+		else
+			werrorf(L"%s.\n", stegman_strerror(res));
 	}
-	memcpy(data2 + isize, data, datalen);
-	*((int32_t*)data2) = STEG_MAGIC;
-	uint64_t data2len = datalen + isize;
-	free(data);
 
-	// Encrypt the data
-	uint8_t iv2[IV_SIZE];
-	memcpy(iv2, iv, IV_SIZE * sizeof(uint8_t));
-	res = aes_encrypt(data2, data2len, key, iv2, &data, &datalen);
-	if (res)
-	{
-		free(data2);
-		free(data);
-		werrorf(L"Error encrypting data (%d). Refer to OpenSSL manual for details.\n", res);
-		return false;
-	}
+	stats_print(ctx, stats, "encode");
+	stegman_destroy(ctx);
+	return res == STEGMAN_OK;
+}
 
-	// Load the PNG file pixels
-	uint8_t *pixels = NULL;
-	uint64_t pixelcount = 0;
-	PngImageInfo pnginf;
-	res = png_load_pixels(png, &pixels, &pixelcount, &pnginf);
-	if (res)
-	{
-		free(data2);
-		free(data);
-		werrorf(L"Error loading PNG image (%d). Refer to libpng manual for details.\n", res);
-		return false;
-	}
+bool encode_shards(const wchar_t *password, size_t passlen, FILE **pngs, size_t count, const uint8_t *message, size_t msglen, bool isfile, StatsFormat stats, size_t *used)
+{
+	StegmanOptions options;
+	stegman_default_options(&options);
 
-	// Check if enough space
-	if (data2len > (pixelcount / 4))
+	StegmanContext *ctx = NULL;
+	StegmanResult res = stegman_create(&options, &ctx);
+	if (res != STEGMAN_OK)
 	{
-		free(data2);
-		free(data);
-		werrorf(L"Not enough pixel data to encode the message in!\n");
+		werrorf(L"%s.\n", stegman_strerror(res));
 		return false;
 	}
 
-	// Prepare steganographic data
-	StegMessage smsg;
-	steg_init_msg(&smsg);
-	smsg.flags = isfile ? MSG_FILE : 0;
-	smsg.cycles = hc;
-	memcpy(smsg.iv, iv, IV_SIZE);
-	memcpy(smsg.salt, salt, SALT_SIZE);
-	smsg.length = data2len;
-	smsg.contents = (uint8_t*)calloc(datalen, sizeof(uint8_t));
-	memcpy(smsg.contents, data, datalen);
-
-	// Steganographically encode the data
-	if (!steg_encode(&smsg, pixels, pixelcount))
+	StegmanPayload type = isfile ? STEGMAN_PAYLOAD_FILE : STEGMAN_PAYLOAD_TEXT;
+	res = stegman_encode_shards(ctx, (const uint8_t*)password, passlen * sizeof(wchar_t), pngs, count, message, msglen, type, used);
+	if (res != STEGMAN_OK)
 	{
-		free(data2);
-		free(data);
-		werrorf(L"Failed to encode data into pixels!\n");
-		return false;
+		int32_t detail = stegman_error_detail(ctx);
+		if (detail)
+			werrorf(L"%s (%d).\n", stegman_strerror(res), detail);
+		else
+			werrorf(L"%s.\n", stegman_strerror(res));
 	}
-	
-	// Write the PNG
-	fflush(png);
-	fseek(png, 0L, SEEK_SET);
-	ftruncate(fileno(png), 0L);
-	png_save_pixels(pixels, pixelcount, &pnginf, png);
-
-	// Free memory
-	free(smsg.contents);
-	free(pixels);
-	free(data2);
-	free(data);
 
-	// Return success
-	return true;
+	stats_print(ctx, stats, "encode");
+	stegman_destroy(ctx);
+	return res == STEGMAN_OK;
 }
 
 // Define C extern for C++
@@ -42,20 +42,53 @@ extern "C"
 // Standard library
 #include <stdio.h>
 
+// Measurement reports
+#include "stats.h"
+
+// Library options
+#include "stegman.h"
+
 /**
  * Encodes data into the picture. This method will encode data into the pixels,
- * in-place.
+ * in-place, or write the resulting picture to another file.
  *
  * \param password Password to encrypt the data with.
  * \param passlen Length of the password, as measured by `wcslen`.
  * \param png File to encode the data into. This should be a PNG file.
- * \param message Bytes of the message to encode.
+ * \param output File to write the resulting picture to, or NULL to replace
+ *               the contents of png.
+ * \param message Bytes of the message to encode. Text messages need to be 
+ *                encoded as UTF-8.
+ * \param msglen Length of the message to encode.
+ * \param isfile Whether the message is a file.
+ * \param stats Format to report measurements of the operation in.
+ * \param maxmemory Memory budget of the operation, in bytes, or 0 for none.
+ * \param scatter Whether to spread the message over the whole picture, in an
+ *                order derived from the key.
+ * \param channels Channels of each pixel to hold the message in.
+ *
+ * \return Whether the operation was successful.
+ */
+bool encode(const wchar_t *password, size_t passlen, FILE *png, FILE *output, const uint8_t *message, size_t msglen, bool isfile, StatsFormat stats, uint64_t maxmemory, bool scatter, StegmanChannels channels);
+
+/**
+ * Encodes data split across multiple pictures, in-place. The carriers are 
+ * filled in order, and the ones which aren't needed are left unchanged.
+ *
+ * \param password Password to encrypt the data with.
+ * \param passlen Length of the password, as measured by `wcslen`.
+ * \param pngs Files to encode the data into. These should be PNG files.
+ * \param count Number of files.
+ * \param message Bytes of the message to encode. Text messages need to be 
+ *                encoded as UTF-8.
  * \param msglen Length of the message to encode.
  * \param isfile Whether the message is a file.
+ * \param stats Format to report measurements of the operation in.
+ * \param used Number of files which received a part of the message.
  *
  * \return Whether the operation was successful.
  */
-bool encode(const wchar_t *password, size_t passlen, FILE *png, const uint8_t *message, size_t msglen, bool isfile);
+bool encode_shards(const wchar_t *password, size_t passlen, FILE **pngs, size_t count, const uint8_t *message, size_t msglen, bool isfile, StatsFormat stats, size_t *used);
 
 // Define C extern for C++
 #ifdef __cplusplus
@@ -0,0 +1,402 @@
+// This file is part of stegman project
+//
+// Copyright (c) 2018 Mateusz Brawański (Emzi0767)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Check if we're using a C99-capable compiler
+#if __STDC_VERSION__ < 199901L
+#error "You need to use a C99-capable compiler to build this program!"
+#endif
+
+// Define C extern for C++
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Appropriate headers
+#include "defs.h"
+#include "zlib.h"
+#include "capacity.h"
+#include "pool.h"
+#include "scan.h"
+#include "index.h"
+
+// Standard library
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+// Constant definitions
+static const char INDEX_NAME[] = ".stegman-index";
+static const char INDEX_HEADER[] = "# stegman carrier index 1";
+
+// Carrier known to the index. The probe results stay valid for as long as 
+// the file keeps its size and modification time.
+typedef struct IndexEntry
+{
+	char *path;
+	uint64_t size;
+	int64_t mtime;
+	int64_t mtimens;
+	int32_t res;
+	PayloadInfo info;
+} IndexEntry;
+
+typedef struct CarrierIndex
+{
+	IndexEntry *entries;
+	size_t count;
+	size_t probed;
+	size_t found;
+	size_t failed;
+} CarrierIndex;
+
+// Options shared by both modes
+typedef struct IndexOptions
+{
+	const char *root;
+	const char *path;
+	size_t threads;
+} IndexOptions;
+
+// Helper functions
+static int index_compare(const void *a, const void *b)
+{
+	return strcmp(((const IndexEntry*)a)->path, ((const IndexEntry*)b)->path);
+}
+
+static char *index_join(const char *root, const char *name)
+{
+	size_t len = strlen(root) + strlen(name) + 2;
+	char *path = (char*)malloc(len);
+	if (!path)
+		fail(128, L"Could not allocate memory (E_INDEX_ALLOC)\n");
+
+	snprintf(path, len, "%s/%s", root, name);
+	return path;
+}
+
+// Parses a line of the index, paths are stored relative to the root
+static bool index_parse(const char *root, char *line, IndexEntry *entry)
+{
+	char *fields[13];
+	size_t count = 0;
+	for (char *field = line; field && count < 13; count++)
+	{
+		fields[count] = field;
+		field = strchr(field, '\t');
+		if (field)
+			*field++ = '\0';
+	}
+
+	if (count != 13)
+		return false;
+
+	memset(entry, 0, sizeof(IndexEntry));
+	entry->size = strtoull(fields[1], NULL, 10);
+	entry->mtime = strtoll(fields[2], NULL, 10);
+	entry->mtimens = strtoll(fields[3], NULL, 10);
+	entry->res = (int32_t)strtol(fields[4], NULL, 10);
+	entry->info.image.width = (uint32_t)strtoul(fields[5], NULL, 10);
+	entry->info.image.height = (uint32_t)strtoul(fields[6], NULL, 10);
+	entry->info.image.bit_depth = (uint8_t)(strtoul(fields[7], NULL, 10) * 8);
+	entry->info.image.interlaced = fields[8][0] == '1';
+	entry->info.capacity = strtoull(fields[9], NULL, 10);
+	entry->info.found = fields[10][0] == '1';
+	entry->info.flags = (int32_t)strtol(fields[11], NULL, 10);
+	entry->info.length = strtoull(fields[12], NULL, 10);
+	entry->path = index_join(root, fields[0]);
+	return true;
+}
+
+// Reads the index from the last run, a missing or unreadable index is empty
+static void index_load(const IndexOptions *options, CarrierIndex *index)
+{
+	memset(index, 0, sizeof(CarrierIndex));
+	FILE *fidx = fopen(options->path, "rb");
+	if (!fidx)
+		return;
+
+	size_t cap = 0;
+	char *line = NULL;
+	size_t linecap = 0;
+	ssize_t linelen = 0;
+	bool valid = false;
+	while ((linelen = getline(&line, &linecap, fidx)) >= 0)
+	{
+		while (linelen > 0 && (line[linelen - 1] == '\n' || line[linelen - 1] == '\r'))
+			line[--linelen] = '\0';
+
+		// Indexes written by other versions are rebuilt from scratch
+		if (!valid)
+		{
+			valid = strcmp(line, INDEX_HEADER) == 0;
+			if (!valid)
+				break;
+
+			continue;
+		}
+
+		if (index->count == cap)
+		{
+			cap = cap ? cap * 2 : 256;
+			IndexEntry *entries = (IndexEntry*)realloc(index->entries, cap * sizeof(IndexEntry));
+			if (!entries)
+				fail(128, L"Could not allocate memory (E_INDEX_ALLOC)\n");
+
+			index->entries = entries;
+		}
+
+		if (index_parse(options->root, line, index->entries + index->count))
+			index->count++;
+	}
+
+	free(line);
+	fclose(fidx);
+	qsort(index->entries, index->count, sizeof(IndexEntry), index_compare);
+}
+
+static void index_free(CarrierIndex *index)
+{
+	for (size_t i = 0; i < index->count; i++)
+		free(index->entries[i].path);
+	free(index->entries);
+}
+
+static void index_task(void *arg)
+{
+	IndexEntry *entry = (IndexEntry*)arg;
+	entry->res = scan_probe(entry->path, &entry->info);
+}
+
+// Lists the carriers, takes over what's still valid from the old index, and
+// probes the rest in parallel
+static void index_refresh(const IndexOptions *options, CarrierIndex *index)
+{
+	CarrierIndex old;
+	index_load(options, &old);
+
+	char **paths = NULL;
+	size_t count = 0;
+	scan_find(options->root, &paths, &count);
+
+	memset(index, 0, sizeof(CarrierIndex));
+	index->entries = (IndexEntry*)calloc(count ? count : 1, sizeof(IndexEntry));
+	if (!index->entries)
+		fail(128, L"Could not allocate memory (E_INDEX_ALLOC)\n");
+
+	ThreadPool *pool = NULL;
+	if (pool_create(options->threads, &pool))
+		fail(4, L"Could not start worker threads\n");
+
+	PoolGroup group;
+	pool_group_init(&group);
+	for (size_t i = 0; i < count; i++)
+	{
+		// Tabs and line breaks would break the index format
+		struct stat st;
+		if (strpbrk(paths[i], "\t\r\n") || stat(paths[i], &st))
+			continue;
+
+		IndexEntry *entry = index->entries + index->count++;
+		entry->path = paths[i];
+		entry->size = (uint64_t)st.st_size;
+		entry->mtime = (int64_t)st.st_mtim.tv_sec;
+		entry->mtimens = (int64_t)st.st_mtim.tv_nsec;
+		paths[i] = NULL;
+
+		IndexEntry *known = (IndexEntry*)bsearch(entry, old.entries, old.count, sizeof(IndexEntry), index_compare);
+		if (known && known->size == entry->size && known->mtime == entry->mtime && known->mtimens == entry->mtimens)
+		{
+			entry->res = known->res;
+			entry->info = known->info;
+			continue;
+		}
+
+		index->probed++;
+		if (pool_submit(pool, &group, index_task, entry))
+			index_task(entry);
+	}
+
+	pool_group_wait(pool, &group);
+	pool_group_destroy(&group);
+	pool_destroy(pool);
+	scan_free(paths, count);
+	index_free(&old);
+
+	for (size_t i = 0; i < index->count; i++)
+	{
+		if (index->entries[i].res)
+			index->failed++;
+		else if (index->entries[i].info.found)
+			index->found++;
+	}
+}
+
+// Replaces the index file, so that readers never see a partial one
+static bool index_save(const IndexOptions *options, const CarrierIndex *index)
+{
+	size_t len = strlen(options->path) + 5;
+	char *tmp = (char*)malloc(len);
+	if (!tmp)
+		return false;
+
+	snprintf(tmp, len, "%s.tmp", options->path);
+	FILE *fidx = fopen(tmp, "wb");
+	if (!fidx)
+	{
+		free(tmp);
+		return false;
+	}
+
+	size_t rootlen = strlen(options->root) + 1;
+	fprintf(fidx, "%s\n", INDEX_HEADER);
+	for (size_t i = 0; i < index->count; i++)
+	{
+		const IndexEntry *entry = index->entries + i;
+		const PayloadInfo *info = &entry->info;
+		fprintf(fidx, "%s\t%llu\t%lld\t%lld\t%d\t%lu\t%lu\t%u\t%d\t%llu\t%d\t%d\t%llu\n", entry->path + rootlen, (unsigned long long)entry->size, (long long)entry->mtime, (long long)entry->mtimens, (int)entry->res, (unsigned long)info->image.width, (unsigned long)info->image.height, (unsigned)(info->image.bit_depth / 8), info->image.interlaced ? 1 : 0, (unsigned long long)info->capacity, info->found ? 1 : 0, (int)info->flags, (unsigned long long)info->length);
+	}
+
+	bool ok = !ferror(fidx);
+	ok = !fclose(fidx) && ok;
+	ok = ok && !rename(tmp, options->path);
+	if (!ok)
+		remove(tmp);
+
+	free(tmp);
+	return ok;
+}
+
+static void index_update(const IndexOptions *options, CarrierIndex *index)
+{
+	index_refresh(options, index);
+	if (!index_save(options, index))
+		werrorf(L"Could not write the index to '%s'\n", options->path);
+}
+
+// Parses the options following the positional arguments
+static bool index_options(int argc, char **argv, int first, IndexOptions *options)
+{
+	options->root = argv[0];
+	options->path = NULL;
+	options->threads = pool_cpu_count() * SCAN_THREADS_PER_CPU;
+	for (int i = first; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--index") == 0 && i + 1 < argc)
+			options->path = argv[++i];
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			options->threads = strtoul(argv[++i], NULL, 10);
+		else
+			return false;
+	}
+
+	struct stat st;
+	if (stat(options->root, &st) || !S_ISDIR(st.st_mode))
+		fail(2, L"'%s' is not a directory\n", options->root);
+
+	return true;
+}
+
+static void index_usage(void)
+{
+	werrorf(L"Usage: index <dir> [--index <file>] [--threads <count>]\n");
+}
+
+static void pick_usage(void)
+{
+	werrorf(L"Usage: pick <dir> <size> [--index <file>] [--threads <count>]\n");
+}
+
+// Function definitions
+int32_t index_main(int argc, char **argv)
+{
+	IndexOptions options;
+	if (argc < 1 || !index_options(argc, argv, 1, &options))
+	{
+		index_usage();
+		return 1;
+	}
+
+	char *path = options.path ? NULL : index_join(options.root, INDEX_NAME);
+	if (path)
+		options.path = path;
+
+	CarrierIndex index;
+	index_update(&options, &index);
+	werrorf(L"Indexed %lu images, probed %lu, %lu hold a message, %lu failed.\n", (unsigned long)index.count, (unsigned long)index.probed, (unsigned long)index.found, (unsigned long)index.failed);
+
+	index_free(&index);
+	free(path);
+	return 0;
+}
+
+int32_t pick_main(int argc, char **argv)
+{
+	IndexOptions options;
+	uint64_t size = 0;
+	if (argc < 2 || !parse_size(argv[1], &size) || !index_options(argc, argv, 2, &options))
+	{
+		pick_usage();
+		return 1;
+	}
+
+	char *path = options.path ? NULL : index_join(options.root, INDEX_NAME);
+	if (path)
+		options.path = path;
+
+	CarrierIndex index;
+	index_update(&options, &index);
+
+	// The payload has to fit even if it doesn't compress at all
+	uint64_t needed = capacity_content_length(zlib_compress_bound(size));
+	const IndexEntry *best = NULL;
+	for (size_t i = 0; i < index.count; i++)
+	{
+		const IndexEntry *entry = index.entries + i;
+		if (entry->res || entry->info.found || entry->info.capacity < needed)
+			continue;
+
+		if (!best || entry->info.capacity < best->info.capacity || (entry->info.capacity == best->info.capacity && strcmp(entry->path, best->path) < 0))
+			best = entry;
+	}
+
+	int32_t res = 0;
+	if (best)
+	{
+		printf("%s\n", best->path);
+	}
+	else
+	{
+		werrorf(L"None of the %lu unused images can hold %llu bytes.\n", (unsigned long)(index.count - index.found - index.failed), (unsigned long long)size);
+		res = 1;
+	}
+
+	index_free(&index);
+	free(path);
+	return res;
+}
+
+// Define C extern for C++
+#ifdef __cplusplus
+}
+#endif
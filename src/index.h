@@ -0,0 +1,69 @@
+// This file is part of stegman project
+//
+// Copyright (c) 2018 Mateusz Brawański (Emzi0767)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/**
+ * \file
+ * \brief Persistent index of carriers, for picking one by capacity.
+ */
+
+// Only include once
+#pragma once
+
+// Check if we're using a C99-capable compiler
+#if __STDC_VERSION__ < 199901L
+#error "You need to use a C99-capable compiler to build this program!"
+#endif
+
+// Define C extern for C++
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * Brings the carrier index of a directory tree up to date, probing only the
+ * images which were added or changed since the last run.
+ *
+ * \param argc Number of arguments, following the mode name.
+ * \param argv Arguments following the mode name. The first is the directory.
+ *
+ * \return Exit code for the program.
+ */
+int32_t index_main(int argc, char **argv);
+
+/**
+ * Brings the carrier index of a directory tree up to date, and prints the 
+ * path of the smallest carrier without a message, which can hold a payload 
+ * of given size.
+ *
+ * \param argc Number of arguments, following the mode name.
+ * \param argv Arguments following the mode name. The first is the directory,
+ *             the second the size of the payload.
+ *
+ * \return Exit code for the program.
+ */
+int32_t pick_main(int argc, char **argv);
+
+// Define C extern for C++
+#ifdef __cplusplus
+}
+#endif
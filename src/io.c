@@ -0,0 +1,524 @@
+// This file is part of stegman project
+//
+// Copyright (c) 2018 Mateusz Brawański (Emzi0767)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Check if we're using a C99-capable compiler
+#if __STDC_VERSION__ < 199901L
+#error "You need to use a C99-capable compiler to build this program!"
+#endif
+
+// Define C extern for C++
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// io_uring is only reachable through syscall(), which POSIX doesn't cover
+#define _DEFAULT_SOURCE
+
+// Appropriate headers
+#include "defs.h"
+#include "io.h"
+#include "trace.h"
+
+// Standard library
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <linux/io_uring.h>
+
+// Constant definitions
+static const size_t IO_MAX_CHUNK = 1 << 30;
+static const uint64_t IO_WAKE_DATA = 0;
+
+struct IoQueue
+{
+	// io_uring descriptor, or -1 if I/O is done synchronously
+	int ring;
+	size_t depth;
+	size_t inflight;
+	uint32_t unsubmitted;
+
+	// Submission ring
+	void *sqring;
+	size_t sqringlen;
+	uint32_t *sqhead;
+	uint32_t *sqtail;
+	uint32_t sqmask;
+	uint32_t *sqarray;
+	struct io_uring_sqe *sqes;
+	size_t sqeslen;
+
+	// Completion ring, which can share the mapping with the submission ring
+	void *cqring;
+	size_t cqringlen;
+	uint32_t *cqhead;
+	uint32_t *cqtail;
+	uint32_t cqmask;
+	struct io_uring_cqe *cqes;
+
+	// Wakeups, through an eventfd polled by the ring, or a condition
+	int wakefd;
+	bool wakearmed;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	bool woken;
+
+	// Operations waiting for a slot, and finished ones not reported yet
+	IoFile *backlog;
+	IoFile *backlogtail;
+	IoFile *finished;
+	IoFile *finishedtail;
+};
+
+// Helper functions
+static void io_append(IoFile **head, IoFile **tail, IoFile *file)
+{
+	file->next = NULL;
+	if (*tail)
+		(*tail)->next = file;
+	else
+		*head = file;
+	*tail = file;
+}
+
+static IoFile *io_take(IoFile **head, IoFile **tail)
+{
+	IoFile *file = *head;
+	if (file)
+	{
+		*head = file->next;
+		if (!*head)
+			*tail = NULL;
+	}
+
+	return file;
+}
+
+static void io_finish(IoQueue *queue, IoFile *file, int32_t error)
+{
+	if (file->fd >= 0 && close(file->fd) && !error && file->write)
+		error = errno;
+
+	file->fd = -1;
+	file->error = error;
+	trace_async_end("io", file->write ? "write" : "read", (uint64_t)(uintptr_t)file);
+	io_append(&queue->finished, &queue->finishedtail, file);
+}
+
+static int io_uring_setup(uint32_t entries, struct io_uring_params *params)
+{
+	return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int io_uring_enter(int ring, uint32_t submit, uint32_t complete, uint32_t flags)
+{
+	return (int)syscall(__NR_io_uring_enter, ring, submit, complete, flags, NULL, 0);
+}
+
+// Hands the queued entries to the kernel, optionally waiting for a completion
+static int32_t io_submit(IoQueue *queue, bool wait)
+{
+	while (true)
+	{
+		int res = io_uring_enter(queue->ring, queue->unsubmitted, wait ? 1 : 0, wait ? IORING_ENTER_GETEVENTS : 0);
+		if (res >= 0)
+		{
+			queue->unsubmitted -= (uint32_t)res < queue->unsubmitted ? (uint32_t)res : queue->unsubmitted;
+			return 0;
+		}
+
+		if (errno != EINTR)
+			return errno;
+	}
+}
+
+static struct io_uring_sqe *io_get_sqe(IoQueue *queue)
+{
+	uint32_t tail = *queue->sqtail;
+	if (tail - __atomic_load_n(queue->sqhead, __ATOMIC_ACQUIRE) > queue->sqmask)
+	{
+		io_submit(queue, false);
+		if (tail - __atomic_load_n(queue->sqhead, __ATOMIC_ACQUIRE) > queue->sqmask)
+			return NULL;
+	}
+
+	struct io_uring_sqe *sqe = queue->sqes + (tail & queue->sqmask);
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	queue->sqarray[tail & queue->sqmask] = tail & queue->sqmask;
+	return sqe;
+}
+
+static void io_push_sqe(IoQueue *queue)
+{
+	__atomic_store_n(queue->sqtail, *queue->sqtail + 1, __ATOMIC_RELEASE);
+	queue->unsubmitted++;
+}
+
+// Transfers the next chunk of a file
+static void io_step(IoQueue *queue, IoFile *file)
+{
+	size_t len = file->len - file->done;
+	if (len > IO_MAX_CHUNK)
+		len = IO_MAX_CHUNK;
+
+	if (queue->ring < 0)
+	{
+		while (file->done < file->len)
+		{
+			ssize_t res = file->write 
+				? pwrite(file->fd, file->data + file->done, len, file->done)
+				: pread(file->fd, file->data + file->done, len, file->done);
+			if (res < 0 && errno == EINTR)
+				continue;
+
+			if (res <= 0)
+			{
+				io_finish(queue, file, res < 0 ? errno : EIO);
+				return;
+			}
+
+			file->done += res;
+			len = file->len - file->done;
+			if (len > IO_MAX_CHUNK)
+				len = IO_MAX_CHUNK;
+		}
+
+		io_finish(queue, file, 0);
+		return;
+	}
+
+	if (queue->inflight >= queue->depth)
+	{
+		io_append(&queue->backlog, &queue->backlogtail, file);
+		return;
+	}
+
+	struct io_uring_sqe *sqe = io_get_sqe(queue);
+	if (!sqe)
+	{
+		io_append(&queue->backlog, &queue->backlogtail, file);
+		return;
+	}
+
+	sqe->opcode = file->write ? IORING_OP_WRITE : IORING_OP_READ;
+	sqe->fd = file->fd;
+	sqe->addr = (uint64_t)(uintptr_t)(file->data + file->done);
+	sqe->len = (uint32_t)len;
+	sqe->off = file->done;
+	sqe->user_data = (uint64_t)(uintptr_t)file;
+	io_push_sqe(queue);
+	queue->inflight++;
+}
+
+static void io_start(IoQueue *queue, IoFile *file)
+{
+	if (file->done >= file->len)
+		io_finish(queue, file, 0);
+	else
+		io_step(queue, file);
+}
+
+// Processes completions, returns whether a wakeup was among them
+static bool io_reap(IoQueue *queue)
+{
+	bool woken = false;
+	uint32_t head = *queue->cqhead;
+	uint32_t tail = __atomic_load_n(queue->cqtail, __ATOMIC_ACQUIRE);
+	for (; head != tail; head++)
+	{
+		struct io_uring_cqe *cqe = queue->cqes + (head & queue->cqmask);
+		if (cqe->user_data == IO_WAKE_DATA)
+		{
+			uint64_t count = 0;
+			while (read(queue->wakefd, &count, sizeof(count)) < 0 && errno == EINTR)
+				;
+
+			queue->wakearmed = false;
+			woken = true;
+			continue;
+		}
+
+		IoFile *file = (IoFile*)(uintptr_t)cqe->user_data;
+		queue->inflight--;
+		if (cqe->res < 0 && cqe->res != -EINTR && cqe->res != -EAGAIN)
+			io_finish(queue, file, -cqe->res);
+		else if (cqe->res == 0)
+			io_finish(queue, file, EIO);
+		else
+		{
+			if (cqe->res > 0)
+				file->done += cqe->res;
+			io_start(queue, file);
+		}
+	}
+
+	__atomic_store_n(queue->cqhead, head, __ATOMIC_RELEASE);
+
+	// Slots were freed up
+	while (queue->backlog && queue->inflight < queue->depth)
+		io_step(queue, io_take(&queue->backlog, &queue->backlogtail));
+
+	return woken;
+}
+
+static int32_t io_ring_create(IoQueue *queue)
+{
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	queue->ring = io_uring_setup((uint32_t)queue->depth + 1, &params);
+	if (queue->ring < 0)
+		return 1;
+
+	queue->sqringlen = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+	queue->cqringlen = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if (queue->cqringlen > queue->sqringlen)
+			queue->sqringlen = queue->cqringlen;
+		queue->cqringlen = 0;
+	}
+
+	queue->sqring = mmap(NULL, queue->sqringlen, PROT_READ | PROT_WRITE, MAP_SHARED, queue->ring, IORING_OFF_SQ_RING);
+	if (queue->sqring == MAP_FAILED)
+	{
+		queue->sqring = NULL;
+		return 2;
+	}
+
+	queue->cqring = queue->sqring;
+	if (queue->cqringlen)
+	{
+		queue->cqring = mmap(NULL, queue->cqringlen, PROT_READ | PROT_WRITE, MAP_SHARED, queue->ring, IORING_OFF_CQ_RING);
+		if (queue->cqring == MAP_FAILED)
+		{
+			queue->cqring = NULL;
+			return 2;
+		}
+	}
+
+	queue->sqeslen = params.sq_entries * sizeof(struct io_uring_sqe);
+	queue->sqes = (struct io_uring_sqe*)mmap(NULL, queue->sqeslen, PROT_READ | PROT_WRITE, MAP_SHARED, queue->ring, IORING_OFF_SQES);
+	if (queue->sqes == MAP_FAILED)
+	{
+		queue->sqes = NULL;
+		return 2;
+	}
+
+	uint8_t *sq = (uint8_t*)queue->sqring;
+	queue->sqhead = (uint32_t*)(sq + params.sq_off.head);
+	queue->sqtail = (uint32_t*)(sq + params.sq_off.tail);
+	queue->sqmask = *(uint32_t*)(sq + params.sq_off.ring_mask);
+	queue->sqarray = (uint32_t*)(sq + params.sq_off.array);
+
+	uint8_t *cq = (uint8_t*)queue->cqring;
+	queue->cqhead = (uint32_t*)(cq + params.cq_off.head);
+	queue->cqtail = (uint32_t*)(cq + params.cq_off.tail);
+	queue->cqmask = *(uint32_t*)(cq + params.cq_off.ring_mask);
+	queue->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+	// Never hand more to the kernel than the completion ring can take
+	if (queue->depth > params.cq_entries - 1)
+		queue->depth = params.cq_entries - 1;
+
+	queue->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (queue->wakefd < 0)
+		return 4;
+
+	return 0;
+}
+
+static void io_ring_destroy(IoQueue *queue)
+{
+	if (queue->sqes)
+		munmap(queue->sqes, queue->sqeslen);
+	if (queue->cqring && queue->cqring != queue->sqring)
+		munmap(queue->cqring, queue->cqringlen);
+	if (queue->sqring)
+		munmap(queue->sqring, queue->sqringlen);
+	if (queue->wakefd >= 0)
+		close(queue->wakefd);
+	if (queue->ring >= 0)
+		close(queue->ring);
+
+	queue->sqes = NULL;
+	queue->cqring = NULL;
+	queue->sqring = NULL;
+	queue->wakefd = -1;
+	queue->ring = -1;
+}
+
+static bool io_open(IoQueue *queue, const char *path, IoFile *file, void *user, bool write)
+{
+	memset(file, 0, sizeof(IoFile));
+	file->path = path;
+	file->user = user;
+	file->write = write;
+	trace_async_begin("io", write ? "write" : "read", (uint64_t)(uintptr_t)file);
+	file->fd = write ? open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666) : open(path, O_RDONLY | O_CLOEXEC);
+	if (file->fd < 0)
+	{
+		io_finish(queue, file, errno);
+		return false;
+	}
+
+	return true;
+}
+
+// Function definitions
+int32_t io_create(size_t depth, IoQueue **queue)
+{
+	IoQueue *q = (IoQueue*)calloc(1, sizeof(IoQueue));
+	if (!q)
+		return 1;
+
+	q->depth = depth ? depth : 1;
+	q->wakefd = -1;
+	pthread_mutex_init(&q->lock, NULL);
+	pthread_cond_init(&q->wake, NULL);
+
+	// Kernels without io_uring, or which forbid it, get synchronous I/O
+	if (io_ring_create(q))
+		io_ring_destroy(q);
+
+	*queue = q;
+	return 0;
+}
+
+void io_destroy(IoQueue *queue)
+{
+	if (!queue)
+		return;
+
+	io_ring_destroy(queue);
+	pthread_cond_destroy(&queue->wake);
+	pthread_mutex_destroy(&queue->lock);
+	free(queue);
+}
+
+bool io_async(const IoQueue *queue)
+{
+	return queue->ring >= 0;
+}
+
+void io_read_file(IoQueue *queue, const char *path, IoFile *file, void *user)
+{
+	if (!io_open(queue, path, file, user, false))
+		return;
+
+	struct stat st;
+	if (fstat(file->fd, &st))
+	{
+		io_finish(queue, file, errno);
+		return;
+	}
+
+	file->len = st.st_size;
+	file->data = (uint8_t*)malloc(file->len ? file->len : 1);
+	if (!file->data)
+	{
+		io_finish(queue, file, ENOMEM);
+		return;
+	}
+
+	io_start(queue, file);
+}
+
+void io_write_file(IoQueue *queue, const char *path, uint8_t *data, size_t len, IoFile *file, void *user)
+{
+	if (!io_open(queue, path, file, user, true))
+		return;
+
+	file->data = data;
+	file->len = len;
+	io_start(queue, file);
+}
+
+IoFile *io_wait(IoQueue *queue)
+{
+	while (true)
+	{
+		IoFile *file = io_take(&queue->finished, &queue->finishedtail);
+		if (file)
+			return file;
+
+		if (queue->ring < 0)
+		{
+			pthread_mutex_lock(&queue->lock);
+			while (!queue->woken)
+				pthread_cond_wait(&queue->wake, &queue->lock);
+			queue->woken = false;
+			pthread_mutex_unlock(&queue->lock);
+			return NULL;
+		}
+
+		// The eventfd is polled like any other operation, so that waiting for
+		// I/O and for wakeups is the same thing
+		if (!queue->wakearmed)
+		{
+			struct io_uring_sqe *sqe = io_get_sqe(queue);
+			if (sqe)
+			{
+				sqe->opcode = IORING_OP_POLL_ADD;
+				sqe->fd = queue->wakefd;
+				sqe->poll_events = POLLIN;
+				sqe->user_data = IO_WAKE_DATA;
+				io_push_sqe(queue);
+				queue->wakearmed = true;
+			}
+		}
+
+		if (io_submit(queue, true))
+			return NULL;
+
+		if (io_reap(queue) && !queue->finished)
+			return NULL;
+	}
+}
+
+void io_wake(IoQueue *queue)
+{
+	if (queue->ring >= 0)
+	{
+		uint64_t one = 1;
+		while (write(queue->wakefd, &one, sizeof(one)) < 0 && errno == EINTR)
+			;
+		return;
+	}
+
+	pthread_mutex_lock(&queue->lock);
+	queue->woken = true;
+	pthread_cond_signal(&queue->wake);
+	pthread_mutex_unlock(&queue->lock);
+}
+
+// Define C extern for C++
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,157 @@
+// This file is part of stegman project
+//
+// Copyright (c) 2018 Mateusz Brawański (Emzi0767)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/**
+ * \file
+ * \brief Asynchronous whole-file reads and writes, using io_uring where available.
+ */
+
+// Only include once
+#pragma once
+
+// Check if we're using a C99-capable compiler
+#if __STDC_VERSION__ < 199901L
+#error "You need to use a C99-capable compiler to build this program!"
+#endif
+
+// Define C extern for C++
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/** Opaque I/O queue handle. */
+typedef struct IoQueue IoQueue;
+
+/** Read or write of a whole file. */
+typedef struct IoFile
+{
+	/** Path of the file. Not copied, needs to stay valid until the operation
+	 *  finishes. */
+	const char *path;
+
+	/** Contents of the file. For reads, the buffer is allocated by the queue,
+	 *  and owned by the caller once the operation finishes. For writes, it's
+	 *  supplied by the caller. */
+	uint8_t *data;
+
+	/** Length of the contents, in bytes. */
+	size_t len;
+
+	/** 0 if the operation was successful, an `errno` value otherwise. */
+	int32_t error;
+
+	/** Data for the caller's use. */
+	void *user;
+
+	/** Descriptor of the open file. Used internally. */
+	int fd;
+
+	/** Number of bytes transferred so far. Used internally. */
+	size_t done;
+
+	/** Whether this is a write. Used internally. */
+	bool write;
+
+	/** Next operation on the same list. Used internally. */
+	struct IoFile *next;
+} IoFile;
+
+/**
+ * Creates a new I/O queue. Uses io_uring if the kernel allows it, otherwise 
+ * operations are carried out with plain `pread` and `pwrite` as soon as they
+ * are queued. Either way, a queue must only be used by a single thread, with 
+ * the exception of io_wake.
+ *
+ * \param depth Largest number of operations handed to the kernel at once. 
+ *              Further operations wait in the queue.
+ * \param queue Pointer to the queue handle. The underlying pointer will be
+ *              initialized.
+ *
+ * \return 0 if the operation was successful, an error code otherwise.
+ */
+int32_t io_create(size_t depth, IoQueue **queue);
+
+/**
+ * Destroys the queue. No operations can be in progress.
+ *
+ * \param queue Queue to destroy.
+ */
+void io_destroy(IoQueue *queue);
+
+/**
+ * Checks whether the queue performs I/O asynchronously.
+ *
+ * \param queue Queue to examine.
+ *
+ * \return Whether io_uring is used.
+ */
+bool io_async(const IoQueue *queue);
+
+/**
+ * Starts reading a whole file into a newly allocated buffer. The outcome, 
+ * including failure to open the file, is always reported through io_wait.
+ *
+ * \param queue Queue to use.
+ * \param path Path of the file to read.
+ * \param file Operation to start. Needs to stay valid until it finishes.
+ * \param user Data for the caller's use.
+ */
+void io_read_file(IoQueue *queue, const char *path, IoFile *file, void *user);
+
+/**
+ * Starts writing a buffer to a file, replacing the file. The outcome, 
+ * including failure to open the file, is always reported through io_wait.
+ *
+ * \param queue Queue to use.
+ * \param path Path of the file to write.
+ * \param data Contents to write. Need to stay valid until the operation 
+ *             finishes.
+ * \param len Length of the contents, in bytes.
+ * \param file Operation to start. Needs to stay valid until it finishes.
+ * \param user Data for the caller's use.
+ */
+void io_write_file(IoQueue *queue, const char *path, uint8_t *data, size_t len, IoFile *file, void *user);
+
+/**
+ * Waits until an operation finishes, or the queue is woken up.
+ *
+ * \param queue Queue to wait on.
+ *
+ * \return The finished operation, or NULL if the queue was woken up by 
+ *         io_wake.
+ */
+IoFile *io_wait(IoQueue *queue);
+
+/**
+ * Wakes up a thread waiting in io_wait. Wakeups are not lost if nobody is
+ * waiting at the moment; the next wait returns immediately instead. Safe to
+ * call from any thread.
+ *
+ * \param queue Queue to wake up.
+ */
+void io_wake(IoQueue *queue);
+
+// Define C extern for C++
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,471 @@
+// This file is part of stegman project
+//
+// Copyright (c) 2018 Mateusz Brawański (Emzi0767)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Check if we're using a C99-capable compiler
+#if __STDC_VERSION__ < 199901L
+#error "You need to use a C99-capable compiler to build this program!"
+#endif
+
+// Define C extern for C++
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Appropriate headers
+#include "defs.h"
+#include "text.h"
+#include "context.h"
+#include "job.h"
+#include "trace.h"
+
+// Standard library
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <openssl/crypto.h>
+
+struct JobRunner
+{
+	ThreadPool *pool;
+	StegmanOptions options;
+
+	// Contexts not used by any job at the moment
+	pthread_mutex_t lock;
+	StegmanContext **idle;
+	size_t idlecount;
+	size_t idlecap;
+};
+
+// Helper functions
+static double job_clock(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool job_fail(JobResult *result, StegmanResult res, const char *error)
+{
+	result->res = res;
+	result->error = error;
+	return false;
+}
+
+static bool job_password(const Job *job, uint8_t **password, size_t *passlen, JobResult *result)
+{
+	const char *ref = job->password;
+	if (!ref)
+		return job_fail(result, STEGMAN_E_ARGUMENT, "No password reference");
+
+	if (strncmp(ref, "env:", 4) == 0)
+	{
+		const char *value = getenv(ref + 4);
+		if (!value)
+			return job_fail(result, STEGMAN_E_ARGUMENT, "Password environment variable is not set");
+
+		if (!job_widen(value, password, passlen))
+			return job_fail(result, STEGMAN_E_ARGUMENT, "Could not convert password");
+
+		return true;
+	}
+
+	if (strncmp(ref, "file:", 5) == 0)
+	{
+		FILE *fpw = fopen(ref + 5, "rb");
+		if (!fpw)
+			return job_fail(result, STEGMAN_E_IO, "Could not open password file");
+
+		char *line = NULL;
+		size_t linecap = 0;
+		ssize_t linelen = getline(&line, &linecap, fpw);
+		fclose(fpw);
+		if (linelen < 0)
+		{
+			free(line);
+			return job_fail(result, STEGMAN_E_IO, "Could not read password file");
+		}
+
+		while (linelen > 0 && (line[linelen - 1] == '\n' || line[linelen - 1] == '\r'))
+			line[--linelen] = '\0';
+
+		bool ok = job_widen(line, password, passlen);
+		OPENSSL_cleanse(line, linecap);
+		free(line);
+		if (!ok)
+			return job_fail(result, STEGMAN_E_ARGUMENT, "Could not convert password");
+
+		return true;
+	}
+
+	return job_fail(result, STEGMAN_E_ARGUMENT, "Unknown password reference");
+}
+
+static bool job_payload(const Job *job, InputFile *input, StegmanPayload *type, JobResult *result)
+{
+	const char *payload = job->payload ? job->payload : "";
+	if (payload[0] != '@')
+	{
+		// Text is stored as UTF-8
+		uint8_t *wmsg = NULL, *msg = NULL;
+		size_t wmsglen = 0;
+		if (!job_widen(payload, &wmsg, &wmsglen))
+			return job_fail(result, STEGMAN_E_ARGUMENT, "Could not convert message");
+
+		int32_t res = text_wcs_to_utf8((wchar_t*)wmsg, wmsglen / sizeof(wchar_t), &msg, &input->len);
+		free(wmsg);
+		if (res)
+			return job_fail(result, STEGMAN_E_ARGUMENT, "Could not convert message");
+
+		input->data = msg;
+		input->mapped = false;
+		*type = STEGMAN_PAYLOAD_TEXT;
+		return true;
+	}
+
+	*type = STEGMAN_PAYLOAD_FILE;
+	if (job->payloaddata)
+	{
+		input->data = job->payloaddata;
+		input->len = job->payloadlen;
+		input->mapped = false;
+		return true;
+	}
+
+	int32_t res = input_map(payload + 1, input);
+	if (res == 1)
+		return job_fail(result, STEGMAN_E_IO, "Could not open the source file");
+	else if (res)
+		return job_fail(result, STEGMAN_E_IO, "Could not read the source file");
+
+	return true;
+}
+
+static void job_release_payload(const Job *job, InputFile *input)
+{
+	if (input->data != job->payloaddata)
+		input_release(input);
+}
+
+// Opens the carrier, or its contents read ahead of time
+static FILE *job_open_carrier(const Job *job, bool update)
+{
+	if (job->carrierdata)
+		return fmemopen((void*)job->carrierdata, job->carrierlen ? job->carrierlen : 1, "rb");
+
+	return fopen(job->carrier, update ? "rb+" : "rb");
+}
+
+static bool job_encode(StegmanContext *ctx, const Job *job, const uint8_t *password, size_t passlen, JobResult *result)
+{
+	InputFile msg = { NULL, 0, false };
+	StegmanPayload type = STEGMAN_PAYLOAD_FILE;
+	if (!job_payload(job, &msg, &type, result))
+		return false;
+
+	// Results kept in memory are always encoded as a copy
+	bool inplace = !job->keepoutput && (!job->output || !job->output[0]);
+	FILE *carrier = job_open_carrier(job, inplace);
+	if (!carrier)
+	{
+		job_release_payload(job, &msg);
+		return job_fail(result, STEGMAN_E_IO, "Could not open the carrier");
+	}
+
+	char *memout = NULL;
+	size_t memoutlen = 0;
+	FILE *output = inplace ? carrier : job->keepoutput ? open_memstream(&memout, &memoutlen) : fopen(job->output, "wb");
+	if (!output)
+	{
+		fclose(carrier);
+		job_release_payload(job, &msg);
+		return job_fail(result, STEGMAN_E_IO, "Could not open the output file");
+	}
+
+	if (inplace)
+		result->res = stegman_encode_file(ctx, password, passlen, carrier, msg.data, msg.len, type);
+	else
+		result->res = stegman_encode_copy(ctx, password, passlen, carrier, output, msg.data, msg.len, type);
+
+	result->detail = stegman_error_detail(ctx);
+	job_release_payload(job, &msg);
+	fclose(carrier);
+	if (!inplace)
+	{
+		if (fclose(output) && result->res == STEGMAN_OK)
+			result->res = STEGMAN_E_IO;
+
+		if (job->keepoutput)
+		{
+			if (result->res == STEGMAN_OK)
+			{
+				result->output = (uint8_t*)memout;
+				result->outputlen = memoutlen;
+			}
+			else
+			{
+				free(memout);
+			}
+		}
+		// Don't leave partial images behind
+		else if (result->res != STEGMAN_OK)
+		{
+			remove(job->output);
+		}
+	}
+
+	return result->res == STEGMAN_OK;
+}
+
+static bool job_decode(StegmanContext *ctx, const Job *job, const uint8_t *password, size_t passlen, JobResult *result)
+{
+	if (!job->output || !job->output[0])
+		return job_fail(result, STEGMAN_E_ARGUMENT, "No output file");
+
+	FILE *carrier = job_open_carrier(job, false);
+	if (!carrier)
+		return job_fail(result, STEGMAN_E_IO, "Could not open the carrier");
+
+	uint8_t *msg = NULL;
+	size_t msglen = 0;
+	StegmanPayload type = STEGMAN_PAYLOAD_FILE;
+	result->res = stegman_decode_file(ctx, password, passlen, carrier, &msg, &msglen, &type);
+	result->detail = stegman_error_detail(ctx);
+	fclose(carrier);
+	if (result->res != STEGMAN_OK)
+		return false;
+
+	// Older text messages are stored as wide strings, write them as UTF-8 
+	// like everything else
+	if (!job_text_utf8(&msg, &msglen, &type))
+	{
+		free(msg);
+		return job_fail(result, STEGMAN_E_ARGUMENT, "Could not convert message");
+	}
+
+	if (job->keepoutput)
+	{
+		result->output = msg;
+		result->outputlen = msglen;
+		return true;
+	}
+
+	FILE *output = fopen(job->output, "wb");
+	if (!output)
+	{
+		free(msg);
+		return job_fail(result, STEGMAN_E_IO, "Could not open the output file");
+	}
+
+	bool written = fwrite(msg, sizeof(uint8_t), msglen, output) == msglen;
+	free(msg);
+	if (fclose(output) || !written)
+	{
+		remove(job->output);
+		return job_fail(result, STEGMAN_E_IO, "Could not write the output file");
+	}
+
+	return true;
+}
+
+// Function definitions
+int32_t runner_create(size_t threads, const StegmanOptions *options, JobRunner **runner)
+{
+	JobRunner *r = (JobRunner*)calloc(1, sizeof(JobRunner));
+	if (!r)
+		return 1;
+
+	if (options)
+		r->options = *options;
+	else
+		stegman_default_options(&r->options);
+
+	if (pool_create(threads, &r->pool))
+	{
+		free(r);
+		return 2;
+	}
+
+	pthread_mutex_init(&r->lock, NULL);
+	*runner = r;
+	return 0;
+}
+
+void runner_destroy(JobRunner *runner)
+{
+	if (!runner)
+		return;
+
+	pool_destroy(runner->pool);
+	for (size_t i = 0; i < runner->idlecount; i++)
+		stegman_destroy(runner->idle[i]);
+
+	pthread_mutex_destroy(&runner->lock);
+	free(runner->idle);
+	free(runner);
+}
+
+ThreadPool *runner_pool(JobRunner *runner)
+{
+	return runner->pool;
+}
+
+StegmanContext *runner_acquire(JobRunner *runner)
+{
+	StegmanContext *ctx = NULL;
+	pthread_mutex_lock(&runner->lock);
+	if (runner->idlecount)
+		ctx = runner->idle[--runner->idlecount];
+	pthread_mutex_unlock(&runner->lock);
+
+	if (!ctx && stegman_create_shared(&runner->options, runner->pool, &ctx) != STEGMAN_OK)
+		return NULL;
+
+	return ctx;
+}
+
+void runner_release(JobRunner *runner, StegmanContext *ctx)
+{
+	pthread_mutex_lock(&runner->lock);
+	if (runner->idlecount == runner->idlecap)
+	{
+		size_t cap = runner->idlecap ? runner->idlecap * 2 : 8;
+		StegmanContext **idle = (StegmanContext**)realloc(runner->idle, cap * sizeof(StegmanContext*));
+		if (!idle)
+		{
+			pthread_mutex_unlock(&runner->lock);
+			stegman_destroy(ctx);
+			return;
+		}
+
+		runner->idle = idle;
+		runner->idlecap = cap;
+	}
+
+	runner->idle[runner->idlecount++] = ctx;
+	pthread_mutex_unlock(&runner->lock);
+}
+
+bool job_widen(const char *str, uint8_t **result, size_t *reslen)
+{
+	size_t len = mbstowcs(NULL, str, 0);
+	if (len == (size_t)-1)
+		return false;
+
+	wchar_t *wstr = (wchar_t*)calloc(len + 1, sizeof(wchar_t));
+	if (!wstr)
+		return false;
+
+	mbstowcs(wstr, str, len + 1);
+	*result = (uint8_t*)wstr;
+	*reslen = len * sizeof(wchar_t);
+	return true;
+}
+
+bool job_text_utf8(uint8_t **message, size_t *msglen, StegmanPayload *type)
+{
+	if (*type != STEGMAN_PAYLOAD_TEXT_WCHAR)
+		return true;
+
+	uint8_t *utf = NULL;
+	size_t utflen = 0;
+	if (text_wcs_to_utf8((wchar_t*)*message, *msglen / sizeof(wchar_t), &utf, &utflen))
+		return false;
+
+	free(*message);
+	*message = utf;
+	*msglen = utflen;
+	*type = STEGMAN_PAYLOAD_TEXT;
+	return true;
+}
+
+void job_run(JobRunner *runner, const Job *job, JobResult *result)
+{
+	memset(result, 0, sizeof(JobResult));
+	double start = job_clock();
+	const char *name = job->op == JOB_ENCODE ? "encode" : job->op == JOB_DECODE ? "decode" : "unknown";
+	trace_begin("job", name);
+
+	StegmanContext *ctx = runner_acquire(runner);
+	if (!ctx)
+	{
+		job_fail(result, STEGMAN_E_ALLOC, NULL);
+		result->seconds = job_clock() - start;
+		trace_end("job", name);
+		return;
+	}
+
+	uint8_t *password = NULL;
+	size_t passlen = 0;
+	if (!job->carrier || !job->carrier[0])
+		job_fail(result, STEGMAN_E_ARGUMENT, "No carrier");
+	else if (job_password(job, &password, &passlen, result))
+	{
+		if (job->op == JOB_ENCODE)
+			job_encode(ctx, job, password, passlen, result);
+		else if (job->op == JOB_DECODE)
+			job_decode(ctx, job, password, passlen, result);
+		else
+			job_fail(result, STEGMAN_E_ARGUMENT, "Unknown operation");
+
+		OPENSSL_cleanse(password, passlen);
+		free(password);
+	}
+
+	runner_release(runner, ctx);
+	result->seconds = job_clock() - start;
+	trace_end("job", name);
+}
+
+void job_write_string(FILE *out, const char *str)
+{
+	fputc('"', out);
+	for (const unsigned char *c = (const unsigned char*)(str ? str : ""); *c; c++)
+	{
+		if (*c == '"' || *c == '\\')
+			fprintf(out, "\\%c", *c);
+		else if (*c < 0x20)
+			fprintf(out, "\\u%04x", *c);
+		else
+			fputc(*c, out);
+	}
+	fputc('"', out);
+}
+
+void job_write_result(FILE *out, const Job *job, const JobResult *result)
+{
+	const char *op = job->op == JOB_ENCODE ? "encode" : job->op == JOB_DECODE ? "decode" : "unknown";
+	fprintf(out, "{\"line\":%lu,\"op\":\"%s\",\"carrier\":", (unsigned long)job->line, op);
+	job_write_string(out, job->carrier);
+	fprintf(out, ",\"output\":");
+	job_write_string(out, job->output);
+	fprintf(out, ",\"status\":\"%s\",\"code\":%d,\"detail\":%d,\"message\":", result->res == STEGMAN_OK ? "ok" : "error", (int)result->res, (int)result->detail);
+	job_write_string(out, result->error ? result->error : stegman_strerror(result->res));
+	fprintf(out, ",\"seconds\":%.6f}\n", result->seconds);
+}
+
+// Define C extern for C++
+#ifdef __cplusplus
+}
+#endif
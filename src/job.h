@@ -0,0 +1,242 @@
+// This file is part of stegman project
+//
+// Copyright (c) 2018 Mateusz Brawański (Emzi0767)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/**
+ * \file
+ * \brief Encode and decode jobs run by the batch processing modes.
+ */
+
+// Only include once
+#pragma once
+
+// Check if we're using a C99-capable compiler
+#if __STDC_VERSION__ < 199901L
+#error "You need to use a C99-capable compiler to build this program!"
+#endif
+
+// Define C extern for C++
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Standard library
+#include <stdio.h>
+
+// Library and thread pool
+#include "stegman.h"
+#include "pool.h"
+
+/** Operation performed by a job. */
+typedef enum JobOperation
+{
+	/** Encodes a message into a carrier. */
+	JOB_ENCODE = 0,
+
+	/** Decodes a message from a carrier. */
+	JOB_DECODE = 1,
+
+	/** Operation could not be recognized, the job can only be reported. */
+	JOB_UNKNOWN = 2
+} JobOperation;
+
+/** Single encode or decode job. */
+typedef struct Job
+{
+	/** Operation to perform. */
+	JobOperation op;
+
+	/** Path to the carrier PNG. */
+	char *carrier;
+
+	/** Message to encode, or `@` followed by the path of a file to encode. 
+	 *  Unused when decoding. */
+	char *payload;
+
+	/** Path to write the result to. When encoding, NULL or an empty string 
+	 *  encodes in-place. When decoding, the message is written to this file,
+	 *  text as UTF-8. */
+	char *output;
+
+	/** Reference to the password, either `env:` followed by the name of an
+	 *  environment variable, or `file:` followed by the path of a file whose
+	 *  first line is the password. */
+	char *password;
+
+	/** Line of the manifest the job came from, or 0. */
+	size_t line;
+
+	/** Contents of the carrier, read ahead by the caller, or NULL to read the
+	 *  carrier file. */
+	const uint8_t *carrierdata;
+
+	/** Length of the carrier contents. */
+	size_t carrierlen;
+
+	/** Contents of the source file, read ahead by the caller, or NULL to read
+	 *  the file. Only used when the payload names a file. */
+	const uint8_t *payloaddata;
+
+	/** Length of the source file contents. */
+	size_t payloadlen;
+
+	/** When set, the result is kept in memory, in the outcome of the job, 
+	 *  instead of being written to the output file. The caller writes it to
+	 *  the output file, or the carrier when encoding in-place. */
+	bool keepoutput;
+} Job;
+
+/** Outcome of a job. */
+typedef struct JobResult
+{
+	/** Result of the operation. */
+	StegmanResult res;
+
+	/** Underlying error code, if any. */
+	int32_t detail;
+
+	/** Description of errors which happened outside of the library, or NULL.
+	 *  Points to static data. */
+	const char *error;
+
+	/** Time taken by the job, in seconds. */
+	double seconds;
+
+	/** Result kept in memory for jobs which asked for it, or NULL. Must be 
+	 *  freed by the caller. */
+	uint8_t *output;
+
+	/** Length of the result kept in memory. */
+	size_t outputlen;
+} JobResult;
+
+/** Opaque job runner handle. Holds the worker threads, and a set of library
+ *  contexts whose buffers and caches are reused by consecutive jobs. */
+typedef struct JobRunner JobRunner;
+
+/**
+ * Creates a new job runner.
+ *
+ * \param threads Number of worker threads. If 0, the number of processors is
+ *                used.
+ * \param options Options for library contexts. Can be NULL.
+ * \param runner Pointer to the runner handle. The underlying pointer will be
+ *               initialized.
+ *
+ * \return 0 if the operation was successful, an error code otherwise.
+ */
+int32_t runner_create(size_t threads, const StegmanOptions *options, JobRunner **runner);
+
+/**
+ * Destroys the runner, its worker threads, and its contexts. No jobs can be
+ * running.
+ *
+ * \param runner Runner to destroy.
+ */
+void runner_destroy(JobRunner *runner);
+
+/**
+ * Gets the pool jobs should be submitted to.
+ *
+ * \param runner Runner to examine.
+ *
+ * \return The runner's thread pool.
+ */
+ThreadPool *runner_pool(JobRunner *runner);
+
+/**
+ * Takes an idle library context from the runner, or creates a new one. Safe 
+ * to call from multiple threads at once.
+ *
+ * \param runner Runner to take the context from.
+ *
+ * \return Library context, or NULL if it could not be created.
+ */
+StegmanContext *runner_acquire(JobRunner *runner);
+
+/**
+ * Returns a context taken with runner_acquire, so that its buffers and caches
+ * are reused by a later job.
+ *
+ * \param runner Runner the context was taken from.
+ * \param ctx Context to return.
+ */
+void runner_release(JobRunner *runner, StegmanContext *ctx);
+
+/**
+ * Converts a multibyte string to wide string bytes, which is how the program 
+ * passes passwords to the library.
+ *
+ * \param str String to convert.
+ * \param result Pointer to resulting bytes. The underlying pointer will be 
+ *               initialized.
+ * \param reslen Pointer to length of the result, in bytes, not including the
+ *               terminator.
+ *
+ * \return Whether the conversion was successful.
+ */
+bool job_widen(const char *str, uint8_t **result, size_t *reslen);
+
+/**
+ * Converts a decoded text message stored as a wide string, as done by older
+ * versions, to UTF-8. Other messages are left untouched.
+ *
+ * \param message Pointer to message bytes. Replaced with a new buffer if 
+ *                converted.
+ * \param msglen Pointer to length of the message.
+ * \param type Pointer to kind of the message.
+ *
+ * \return Whether the conversion was successful.
+ */
+bool job_text_utf8(uint8_t **message, size_t *msglen, StegmanPayload *type);
+
+/**
+ * Runs a job on the calling thread. Safe to call from multiple threads at 
+ * once; each call uses its own library context.
+ *
+ * \param runner Runner to use.
+ * \param job Job to run.
+ * \param result Pointer to the outcome of the job.
+ */
+void job_run(JobRunner *runner, const Job *job, JobResult *result);
+
+/**
+ * Writes a string as a quoted and escaped JSON string.
+ *
+ * \param out File to write to.
+ * \param str String to write. NULL is written as an empty string.
+ */
+void job_write_string(FILE *out, const char *str);
+
+/**
+ * Writes the outcome of a job as a single line of JSON.
+ *
+ * \param out File to write to.
+ * \param job Job which was run.
+ * \param result Outcome of the job.
+ */
+void job_write_result(FILE *out, const Job *job, const JobResult *result);
+
+// Define C extern for C++
+#ifdef __cplusplus
+}
+#endif
@@ -39,10 +39,114 @@ extern "C"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/types.h>
 #include <png.h>
 
+// Largest dimension allowed by the PNG specification
+static const uint32_t PNG_DIMENSION_MAX = 0x7FFFFFFF;
+
+struct PngReader
+{
+    png_structp png;
+    png_infop info;
+    size_t rowsize;
+};
+
+struct PngWriter
+{
+    png_structp png;
+    png_infop info;
+    size_t rowsize;
+};
+
+// Helper functions
+static inline uint32_t read_be32(const uint8_t *ptr)
+{
+	return ((uint32_t)ptr[0] << 24) | ((uint32_t)ptr[1] << 16) | ((uint32_t)ptr[2] << 8) | (uint32_t)ptr[3];
+}
+
+// libpng rejects images over a million pixels wide or tall by default, which
+// rules out large carriers. Only the limits of the format itself apply.
+static void png_lift_limits(png_structp png_ptr)
+{
+    png_set_user_limits(png_ptr, PNG_DIMENSION_MAX, PNG_DIMENSION_MAX);
+}
+
+// Reads the image information, and validates the pixel format
+static int32_t png_read_format(png_structp png_ptr, png_infop png_inf, PngImageInfo *imginfo)
+{
+    png_read_info(png_ptr, png_inf);
+
+    imginfo->width = png_get_image_width(png_ptr, png_inf);
+    imginfo->height = png_get_image_height(png_ptr, png_inf);
+    imginfo->interlaced = png_get_interlace_type(png_ptr, png_inf) != PNG_INTERLACE_NONE;
+
+    int32_t bits = png_get_bit_depth(png_ptr, png_inf);
+    int32_t ctpe = png_get_color_type(png_ptr, png_inf);
+
+    if (bits != 8)
+        return 16;
+
+    if (ctpe != PNG_COLOR_TYPE_RGB && ctpe != PNG_COLOR_TYPE_RGB_ALPHA)
+        return 32;
+
+    imginfo->bit_depth = bits * (ctpe == PNG_COLOR_TYPE_RGB_ALPHA ? 4 : 3);
+    return 0;
+}
+
 // Function definitions
+size_t png_row_size(const PngImageInfo *imginfo)
+{
+    return (size_t)imginfo->width * (imginfo->bit_depth / 8);
+}
+
+int32_t png_read_header(FILE *src, PngImageInfo *imginfo)
+{
+    off_t start = ftello(src);
+    if (start < 0)
+        return 128;
+
+    // Signature, followed by IHDR chunk length, type, and data
+    uint8_t header[8 + 4 + 4 + 13];
+    size_t read = fread(header, sizeof(uint8_t), sizeof(header), src);
+    if (fseeko(src, start, SEEK_SET))
+        return 128;
+
+    if (read != sizeof(header) || png_sig_cmp(header, 0, 8))
+        return 1;
+
+    const uint8_t *ihdr = header + 8;
+    if (read_be32(ihdr) != 13 || memcmp(ihdr + 4, "IHDR", 4))
+        return 1;
+
+    ihdr += 8;
+    uint32_t width = read_be32(ihdr);
+    uint32_t height = read_be32(ihdr + 4);
+    uint8_t bits = ihdr[8];
+    uint8_t ctpe = ihdr[9];
+    if (!width || !height || width > PNG_DIMENSION_MAX || height > PNG_DIMENSION_MAX)
+        return 1;
+
+    if (bits != 8)
+        return 16;
+
+    if (ctpe != PNG_COLOR_TYPE_RGB && ctpe != PNG_COLOR_TYPE_RGB_ALPHA)
+        return 32;
+
+    imginfo->width = width;
+    imginfo->height = height;
+    imginfo->bit_depth = bits * (ctpe == PNG_COLOR_TYPE_RGB_ALPHA ? 4 : 3);
+    imginfo->interlaced = ihdr[12] != PNG_INTERLACE_NONE;
+    return 0;
+}
+
 int32_t png_load_pixels(FILE *src, uint8_t **tgt, size_t *tgtlen, PngImageInfo *imginfo)
+{
+    *tgt = NULL;
+    return png_load_pixels_progress(src, tgt, NULL, tgtlen, imginfo, NULL, NULL);
+}
+
+int32_t png_load_pixels_progress(FILE *src, uint8_t **tgt, size_t *tgtcap, size_t *tgtlen, PngImageInfo *imginfo, PngLoadProgress progress, void *arg)
 {
     uint8_t header[8];
     fread(header, sizeof(uint8_t), 8, src);
@@ -71,122 +175,285 @@ int32_t png_load_pixels(FILE *src, uint8_t **tgt, size_t *tgtlen, PngImageInfo *
     
     png_init_io(png_ptr, src);
     png_set_sig_bytes(png_ptr, 8);
-    png_read_info(png_ptr, png_inf);
+    png_lift_limits(png_ptr);
 
-    imginfo->width = png_get_image_width(png_ptr, png_inf);
-    imginfo->height = png_get_image_height(png_ptr, png_inf);
+    int32_t res = png_read_format(png_ptr, png_inf, imginfo);
+    if (res)
+    {
+        png_destroy_read_struct(&png_ptr, &png_inf, NULL);
+        return res;
+    }
 
-    int32_t bits = png_get_bit_depth(png_ptr, png_inf);
-    int32_t ctpe = png_get_color_type(png_ptr, png_inf);
+    int32_t passes = png_set_interlace_handling(png_ptr);
+    png_read_update_info(png_ptr, png_inf);
 
-    if (bits != 8)
+    // Decode the rows directly into the target buffer, reusing the supplied
+    // one if it's large enough
+    size_t rowsize = png_get_rowbytes(png_ptr, png_inf);
+    size_t pixlen = rowsize * imginfo->height;
+    bool reuse = tgtcap && *tgt && *tgtcap >= pixlen;
+    uint8_t *pixels = reuse ? *tgt : (uint8_t*)calloc(pixlen, sizeof(uint8_t));
+    uint8_t **rows = (uint8_t**)calloc(imginfo->height, sizeof(uint8_t*));
+    if (!pixels || !rows)
     {
-        png_destroy_read_struct(&png_ptr, NULL, NULL);
-        return 16;
+        free(rows);
+        if (!reuse)
+            free(pixels);
+        png_destroy_read_struct(&png_ptr, &png_inf, NULL);
+        return 128;
     }
 
-    if (ctpe != PNG_COLOR_TYPE_RGB && ctpe != PNG_COLOR_TYPE_RGB_ALPHA)
+    for (uint32_t i = 0; i < imginfo->height; i++)
+        rows[i] = pixels + (size_t)i * rowsize;
+
+    // Rows loaded before the callback stopped the loading
+    size_t loaded = pixlen;
+    if (setjmp(png_jmpbuf(png_ptr)))
     {
-        png_destroy_read_struct(&png_ptr, NULL, NULL);
-        return 32;
+        free(rows);
+        if (!reuse)
+            free(pixels);
+        png_destroy_read_struct(&png_ptr, &png_inf, NULL);
+        return 64;
     }
 
-    imginfo->bit_depth = bits * (ctpe == PNG_COLOR_TYPE_RGB_ALPHA ? 4 : 3);
+    if (passes > 1 || !progress)
+    {
+        // Interlaced rows are not final until the last pass
+        png_read_image(png_ptr, rows);
+    }
+    else
+    {
+        // Report each finished row, so the caller can start on early rows
+        for (uint32_t i = 0; i < imginfo->height; i++)
+        {
+            png_read_row(png_ptr, rows[i], NULL);
+            if (!progress(arg, pixels, (size_t)(i + 1) * rowsize))
+            {
+                loaded = (size_t)(i + 1) * rowsize;
+                break;
+            }
+        }
+    }
 
-    png_set_interlace_handling(png_ptr);
-    png_read_update_info(png_ptr, png_inf);
+    png_destroy_read_struct(&png_ptr, &png_inf, NULL);
+    free(rows);
 
-    if (setjmp(png_jmpbuf(png_ptr)))
+    if (progress && passes > 1)
+        progress(arg, pixels, pixlen);
+
+    if (tgtcap && !reuse)
     {
-        png_destroy_read_struct(&png_ptr, NULL, NULL);
-        return 64;
+        free(*tgt);
+        *tgtcap = pixlen;
     }
 
-    int32_t rowsize = png_get_rowbytes(png_ptr, png_inf);
-    uint8_t **rows = (uint8_t**)calloc(imginfo->height, sizeof(uint8_t*));
-    for (int32_t i = 0; i < imginfo->height; i++)
-        rows[i] = (uint8_t*)calloc(rowsize, sizeof(uint8_t));
+    *tgt = pixels;
+    *tgtlen = loaded;
+    return 0;
+}
+
+int32_t png_load_head(FILE *src, size_t len, uint8_t **tgt, size_t *tgtlen, PngImageInfo *imginfo)
+{
+    *tgt = NULL;
+    off_t start = ftello(src);
+    if (start < 0)
+        return 128;
+
+    PngReader *reader = NULL;
+    int32_t res = png_reader_open(src, &reader, imginfo);
+    if (res == 256)
+    {
+        if (fseeko(src, start, SEEK_SET))
+            return 128;
+
+        return png_load_pixels(src, tgt, tgtlen, imginfo);
+    }
 
-    png_read_image(png_ptr, rows);
+    if (res)
+        return res;
 
-    *tgtlen = imginfo->width * imginfo->height * (imginfo->bit_depth / 8);
-    *tgt = (uint8_t*)calloc(*tgtlen, sizeof(uint8_t*));
+    // Only the rows covering the requested bytes are inflated
+    size_t rowsize = reader->rowsize;
+    uint64_t rows = rowsize ? (len + rowsize - 1) / rowsize : 0;
+    if (rows > imginfo->height)
+        rows = imginfo->height;
 
-    uint8_t* tgtptr = *tgt;
-    for (int32_t i = 0; i < imginfo->height; i++)
+    uint8_t *pixels = (uint8_t*)malloc(rows * rowsize);
+    res = pixels ? png_reader_rows(reader, pixels, (uint32_t)rows) : 128;
+    png_reader_close(reader);
+    if (res)
     {
-        memcpy(tgtptr, rows[i], rowsize * sizeof(uint8_t));
-        tgtptr += rowsize;
-        free(rows[i]);
+        free(pixels);
+        return res;
     }
-    free(rows);
 
+    *tgt = pixels;
+    *tgtlen = rows * rowsize;
     return 0;
 }
 
 int32_t png_save_pixels(const uint8_t *src, size_t srclen, const PngImageInfo *imginfo, FILE *tgt)
 {
-    png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-    png_infop png_inf = NULL;
+    PngWriter *writer = NULL;
+    int32_t res = png_writer_open(tgt, imginfo, &writer);
+    if (res)
+        return res;
+
+    // The rows are written straight from the pixel buffer
+    res = png_writer_rows(writer, src, imginfo->height);
+    if (res)
+    {
+        png_writer_abort(writer);
+        return res;
+    }
 
-    if (!png_ptr)
+    return png_writer_finish(writer);
+}
+
+int32_t png_reader_open(FILE *src, PngReader **reader, PngImageInfo *imginfo)
+{
+    uint8_t header[8];
+    if (fread(header, sizeof(uint8_t), 8, src) != 8 || png_sig_cmp(header, 0, 8))
         return 1;
 
-    png_inf = png_create_info_struct(png_ptr);
-    if (!png_inf)
+    PngReader *r = (PngReader*)calloc(1, sizeof(PngReader));
+    if (!r)
+        return 128;
+
+    r->png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    if (!r->png)
     {
-        png_destroy_write_struct(&png_ptr, NULL);
+        free(r);
         return 2;
     }
 
-    if (setjmp(png_jmpbuf(png_ptr)))
+    r->info = png_create_info_struct(r->png);
+    if (!r->info)
     {
-        png_destroy_write_struct(&png_ptr, NULL);
+        png_reader_close(r);
         return 4;
     }
 
-    png_init_io(png_ptr, tgt);
-    if (setjmp(png_jmpbuf(png_ptr)))
+    if (setjmp(png_jmpbuf(r->png)))
     {
-        png_destroy_write_struct(&png_ptr, NULL);
+        png_reader_close(r);
         return 8;
     }
 
-    int32_t colourtype = imginfo->bit_depth / 8;
-    colourtype = colourtype == 3 ? PNG_COLOR_TYPE_RGB : PNG_COLOR_TYPE_RGB_ALPHA;
-    png_set_IHDR(png_ptr, png_inf, imginfo->width, imginfo->height, 8, colourtype, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
-    png_write_info(png_ptr, png_inf);
-    if (setjmp(png_jmpbuf(png_ptr)))
+    png_init_io(r->png, src);
+    png_set_sig_bytes(r->png, 8);
+    png_lift_limits(r->png);
+
+    int32_t res = png_read_format(r->png, r->info, imginfo);
+    if (!res && imginfo->interlaced)
+        res = 256;
+
+    if (res)
     {
-        png_destroy_write_struct(&png_ptr, NULL);
-        return 16;
+        png_reader_close(r);
+        return res;
     }
 
-    int32_t rowsize = png_get_rowbytes(png_ptr, png_inf);
-    uint8_t **rows = (uint8_t**)calloc(imginfo->height, sizeof(uint8_t*));
-    const uint8_t *pxdat = src;
-    for (int32_t i = 0; i < imginfo->height; i++)
+    png_read_update_info(r->png, r->info);
+    r->rowsize = png_get_rowbytes(r->png, r->info);
+    *reader = r;
+    return 0;
+}
+
+int32_t png_reader_rows(PngReader *reader, uint8_t *tgt, uint32_t count)
+{
+    if (setjmp(png_jmpbuf(reader->png)))
+        return 64;
+
+    for (uint32_t i = 0; i < count; i++)
+        png_read_row(reader->png, tgt + (size_t)i * reader->rowsize, NULL);
+
+    return 0;
+}
+
+void png_reader_close(PngReader *reader)
+{
+    if (!reader)
+        return;
+
+    png_destroy_read_struct(&reader->png, &reader->info, NULL);
+    free(reader);
+}
+
+int32_t png_writer_open(FILE *tgt, const PngImageInfo *imginfo, PngWriter **writer)
+{
+    PngWriter *w = (PngWriter*)calloc(1, sizeof(PngWriter));
+    if (!w)
+        return 64;
+
+    w->png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    if (!w->png)
+    {
+        free(w);
+        return 1;
+    }
+
+    w->info = png_create_info_struct(w->png);
+    if (!w->info)
     {
-        rows[i] = (uint8_t*)calloc(rowsize, sizeof(uint8_t));
-        memcpy(rows[i], pxdat, rowsize * sizeof(uint8_t));
-        pxdat += rowsize;
+        png_writer_abort(w);
+        return 2;
     }
 
-    png_write_image(png_ptr, rows);
-    if (setjmp(png_jmpbuf(png_ptr)))
+    if (setjmp(png_jmpbuf(w->png)))
     {
-        png_destroy_write_struct(&png_ptr, NULL);
-        return 32;
+        png_writer_abort(w);
+        return 8;
     }
 
-    png_write_end(png_ptr, NULL);
+    png_init_io(w->png, tgt);
+    png_lift_limits(w->png);
 
-    for (int32_t i = 0; i < imginfo->height; i++)
-        free(rows[i]);
-    free(rows);
+    int32_t colourtype = imginfo->bit_depth / 8;
+    colourtype = colourtype == 3 ? PNG_COLOR_TYPE_RGB : PNG_COLOR_TYPE_RGB_ALPHA;
+    png_set_IHDR(w->png, w->info, imginfo->width, imginfo->height, 8, colourtype, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+    png_write_info(w->png, w->info);
+
+    w->rowsize = png_get_rowbytes(w->png, w->info);
+    *writer = w;
+    return 0;
+}
+
+int32_t png_writer_rows(PngWriter *writer, const uint8_t *src, uint32_t count)
+{
+    if (setjmp(png_jmpbuf(writer->png)))
+        return 16;
+
+    // libpng doesn't modify the rows
+    for (uint32_t i = 0; i < count; i++)
+        png_write_row(writer->png, (png_const_bytep)(src + (size_t)i * writer->rowsize));
+
+    return 0;
+}
+
+int32_t png_writer_finish(PngWriter *writer)
+{
+    if (setjmp(png_jmpbuf(writer->png)))
+    {
+        png_writer_abort(writer);
+        return 32;
+    }
+
+    png_write_end(writer->png, NULL);
+    png_writer_abort(writer);
     return 0;
 }
 
+void png_writer_abort(PngWriter *writer)
+{
+    if (!writer)
+        return;
+
+    png_destroy_write_struct(&writer->png, &writer->info);
+    free(writer);
+}
+
 // Define C extern for C++
 #ifdef __cplusplus
 }
@@ -51,20 +51,52 @@ typedef struct PngImageInfo
 	/**
 	 * Width of the image, in pixels.
 	 */
-	int32_t width;
+	uint32_t width;
 
 	/**
 	 * Height of the image, in pixels.
 	 */
-	int32_t height;
+	uint32_t height;
 
 	/**
 	 * Colour depth of the picture, in bits. To get the number of bytes per 
 	 * pixel, divide this number by 8.
 	 */
 	uint8_t bit_depth; 
+
+	/**
+	 * Whether the image is stored interlaced. Interlaced images can only be 
+	 * loaded as a whole.
+	 */
+	bool interlaced;
 } PngImageInfo;
 
+/** Opaque handle of a PNG image being read row by row. */
+typedef struct PngReader PngReader;
+
+/** Opaque handle of a PNG image being written row by row. */
+typedef struct PngWriter PngWriter;
+
+/**
+ * Calculates the length of a single row of pixels.
+ *
+ * \param imginfo Information about the image.
+ *
+ * \return Length of a row, in bytes.
+ */
+size_t png_row_size(const PngImageInfo *imginfo);
+
+/**
+ * Reads image information from the header of a supplied PNG image, without 
+ * decoding any pixel data. The position in the file is restored afterwards.
+ *
+ * \param src Source PNG file.
+ * \param imginfo Information about the image.
+ *
+ * \return 0 if the operation was successful, an error code otherwise.
+ */
+int32_t png_read_header(FILE *src, PngImageInfo *imginfo);
+
 /**
  * Loads pixels from a supplied PNG image.
  *
@@ -77,6 +109,55 @@ typedef struct PngImageInfo
  */
 int32_t png_load_pixels(FILE *src, uint8_t **tgt, size_t *tgtlen, PngImageInfo *imginfo);
 
+/**
+ * Callback reporting progress of pixel loading. Pixels before the reported 
+ * position are final, and will not be modified anymore.
+ *
+ * \param arg Argument supplied to the loading function.
+ * \param pixels Pixel buffer being loaded.
+ * \param loaded Number of bytes loaded so far.
+ *
+ * \return Whether to continue loading. If false, loading stops, and only the
+ *         rows loaded so far are returned.
+ */
+typedef bool (*PngLoadProgress)(void *arg, const uint8_t *pixels, size_t loaded);
+
+/**
+ * Loads pixels from a supplied PNG image, reporting progress as rows are 
+ * decoded. Interlaced images are only reported once fully loaded.
+ *
+ * \param src Source PNG file.
+ * \param tgt Pointer to target bytes. If tgtcap is supplied, and the buffer is
+ *            large enough, it's reused. Otherwise it's replaced with a new 
+ *            one.
+ * \param tgtcap Pointer to capacity of the target buffer. Can be NULL, in 
+ *               which case a new buffer is always allocated.
+ * \param tgtlen Pointer to length of resulting data. If loading was stopped 
+ *               by the callback, this is the length of the loaded rows.
+ * \param imginfo Information about the image.
+ * \param progress Callback to invoke as rows are loaded. Can be NULL.
+ * \param arg Argument for the callback.
+ *
+ * \return 0 if the operation was successful, an error code otherwise.
+ */
+int32_t png_load_pixels_progress(FILE *src, uint8_t **tgt, size_t *tgtcap, size_t *tgtlen, PngImageInfo *imginfo, PngLoadProgress progress, void *arg);
+
+/**
+ * Loads only the leading rows of a PNG image, as many as needed to hold given
+ * number of bytes. Interlaced images can only be loaded whole.
+ *
+ * \param src Source PNG file.
+ * \param len Number of bytes of pixel data needed.
+ * \param tgt Pointer to target bytes. The underlying pointer will be 
+ *            initialized, and needs to be freed.
+ * \param tgtlen Pointer to length of resulting data. This is less than len 
+ *               only if the whole image is smaller.
+ * \param imginfo Information about the image.
+ *
+ * \return 0 if the operation was successful, an error code otherwise.
+ */
+int32_t png_load_head(FILE *src, size_t len, uint8_t **tgt, size_t *tgtlen, PngImageInfo *imginfo);
+
 /**
  * Writes supplied pixels to a PNG file.
  *
@@ -89,6 +170,78 @@ int32_t png_load_pixels(FILE *src, uint8_t **tgt, size_t *tgtlen, PngImageInfo *
  */
 int32_t png_save_pixels(const uint8_t *src, size_t srclen, const PngImageInfo *imginfo, FILE *tgt);
 
+/**
+ * Starts reading a PNG image row by row, so that only a band of rows needs to
+ * be held in memory at a time. Interlaced images are not supported.
+ *
+ * \param src Source PNG file.
+ * \param reader Pointer to the reader handle. The underlying pointer will be
+ *               initialized.
+ * \param imginfo Information about the image.
+ *
+ * \return 0 if the operation was successful, an error code otherwise.
+ */
+int32_t png_reader_open(FILE *src, PngReader **reader, PngImageInfo *imginfo);
+
+/**
+ * Reads the next rows of the image.
+ *
+ * \param reader Reader to read from.
+ * \param tgt Buffer for the rows, which must hold `count` rows.
+ * \param count Number of rows to read. Must not exceed the number of rows 
+ *              left in the image.
+ *
+ * \return 0 if the operation was successful, an error code otherwise.
+ */
+int32_t png_reader_rows(PngReader *reader, uint8_t *tgt, uint32_t count);
+
+/**
+ * Stops reading and frees the reader. Rows which were not read are skipped.
+ *
+ * \param reader Reader to close. Can be NULL.
+ */
+void png_reader_close(PngReader *reader);
+
+/**
+ * Starts writing a non-interlaced PNG image row by row.
+ *
+ * \param tgt Target PNG file.
+ * \param imginfo Information about the image.
+ * \param writer Pointer to the writer handle. The underlying pointer will be
+ *               initialized.
+ *
+ * \return 0 if the operation was successful, an error code otherwise.
+ */
+int32_t png_writer_open(FILE *tgt, const PngImageInfo *imginfo, PngWriter **writer);
+
+/**
+ * Writes the next rows of the image.
+ *
+ * \param writer Writer to write to.
+ * \param src Rows to write.
+ * \param count Number of rows to write.
+ *
+ * \return 0 if the operation was successful, an error code otherwise.
+ */
+int32_t png_writer_rows(PngWriter *writer, const uint8_t *src, uint32_t count);
+
+/**
+ * Finishes the image, once all rows were written, and frees the writer.
+ *
+ * \param writer Writer to finish.
+ *
+ * \return 0 if the operation was successful, an error code otherwise.
+ */
+int32_t png_writer_finish(PngWriter *writer);
+
+/**
+ * Frees the writer without finishing the image. The output is left 
+ * incomplete.
+ *
+ * \param writer Writer to abort. Can be NULL.
+ */
+void png_writer_abort(PngWriter *writer);
+
 // Define C extern for C++
 #ifdef __cplusplus
 }
@@ -0,0 +1,404 @@
+// This file is part of stegman project
+//
+// Copyright (c) 2018 Mateusz Brawański (Emzi0767)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Check if we're using a C99-capable compiler
+#if __STDC_VERSION__ < 199901L
+#error "You need to use a C99-capable compiler to build this program!"
+#endif
+
+// Define C extern for C++
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Appropriate headers
+#include "defs.h"
+#include "pool.h"
+#include "trace.h"
+
+// Standard library
+#include <stdlib.h>
+#include <unistd.h>
+
+// Queued task
+typedef struct PoolItem
+{
+	PoolTask task;
+	void *arg;
+	PoolGroup *group;
+	struct PoolItem *above;
+	struct PoolItem *below;
+} PoolItem;
+
+// Double-ended task queue. The owner pushes and pops at the top, so nested
+// work stays on the thread which created it, while other threads steal the
+// oldest tasks from the bottom.
+typedef struct PoolDeque
+{
+	pthread_mutex_t lock;
+	PoolItem *top;
+	PoolItem *bottom;
+} PoolDeque;
+
+typedef struct PoolWorker
+{
+	ThreadPool *pool;
+	size_t index;
+	pthread_t thread;
+	PoolDeque deque;
+} PoolWorker;
+
+struct ThreadPool
+{
+	// Protects the counter below, and is used for sleeping
+	pthread_mutex_t lock;
+	pthread_cond_t available;
+	int64_t queued;
+	bool stopping;
+
+	// Tasks submitted by threads outside of the pool
+	PoolDeque inject;
+
+	size_t threads;
+	PoolWorker *workers;
+};
+
+// Worker running on the current thread
+static pthread_key_t pool_worker_key;
+static pthread_once_t pool_worker_once = PTHREAD_ONCE_INIT;
+
+// Helper functions
+static void pool_worker_key_create(void)
+{
+	pthread_key_create(&pool_worker_key, NULL);
+}
+
+static PoolWorker *pool_current(const ThreadPool *pool)
+{
+	pthread_once(&pool_worker_once, pool_worker_key_create);
+	PoolWorker *worker = (PoolWorker*)pthread_getspecific(pool_worker_key);
+	return worker && worker->pool == pool ? worker : NULL;
+}
+
+static void deque_init(PoolDeque *deque)
+{
+	pthread_mutex_init(&deque->lock, NULL);
+	deque->top = NULL;
+	deque->bottom = NULL;
+}
+
+static void deque_push(PoolDeque *deque, PoolItem *item)
+{
+	pthread_mutex_lock(&deque->lock);
+	item->above = NULL;
+	item->below = deque->top;
+	if (deque->top)
+		deque->top->above = item;
+	else
+		deque->bottom = item;
+	deque->top = item;
+	pthread_mutex_unlock(&deque->lock);
+}
+
+// Pops the most recent task, optionally only if it belongs to given group
+static PoolItem *deque_pop(PoolDeque *deque, const PoolGroup *group)
+{
+	pthread_mutex_lock(&deque->lock);
+	PoolItem *item = deque->top;
+	if (item && (!group || item->group == group))
+	{
+		deque->top = item->below;
+		if (deque->top)
+			deque->top->above = NULL;
+		else
+			deque->bottom = NULL;
+	}
+	else
+	{
+		item = NULL;
+	}
+	pthread_mutex_unlock(&deque->lock);
+
+	return item;
+}
+
+// Takes the oldest task
+static PoolItem *deque_steal(PoolDeque *deque)
+{
+	pthread_mutex_lock(&deque->lock);
+	PoolItem *item = deque->bottom;
+	if (item)
+	{
+		deque->bottom = item->above;
+		if (deque->bottom)
+			deque->bottom->below = NULL;
+		else
+			deque->top = NULL;
+	}
+	pthread_mutex_unlock(&deque->lock);
+
+	return item;
+}
+
+static void pool_taken(ThreadPool *pool)
+{
+	pthread_mutex_lock(&pool->lock);
+	pool->queued--;
+	pthread_mutex_unlock(&pool->lock);
+}
+
+// Finds work for a worker: its own newest task first, then tasks submitted
+// from outside, then the oldest task of another worker
+static PoolItem *pool_take(ThreadPool *pool, PoolWorker *self)
+{
+	PoolItem *item = deque_pop(&self->deque, NULL);
+	if (!item)
+		item = deque_steal(&pool->inject);
+
+	for (size_t i = 1; !item && i < pool->threads; i++)
+		item = deque_steal(&pool->workers[(self->index + i) % pool->threads].deque);
+
+	if (item)
+		pool_taken(pool);
+
+	return item;
+}
+
+static void pool_finish(PoolGroup *group)
+{
+	pthread_mutex_lock(&group->lock);
+	if (--group->pending == 0)
+		pthread_cond_broadcast(&group->done);
+	pthread_mutex_unlock(&group->lock);
+}
+
+static void pool_run(PoolItem *item)
+{
+	PoolGroup *group = item->group;
+	item->task(item->arg);
+	free(item);
+	pool_finish(group);
+}
+
+static void *pool_worker(void *arg)
+{
+	PoolWorker *self = (PoolWorker*)arg;
+	ThreadPool *pool = self->pool;
+	pthread_once(&pool_worker_once, pool_worker_key_create);
+	pthread_setspecific(pool_worker_key, self);
+	trace_name_thread("worker", (int32_t)self->index);
+
+	while (true)
+	{
+		PoolItem *item = pool_take(pool, self);
+		if (item)
+		{
+			pool_run(item);
+			continue;
+		}
+
+		// Sleep until something is queued
+		pthread_mutex_lock(&pool->lock);
+		while (pool->queued <= 0 && !pool->stopping)
+			pthread_cond_wait(&pool->available, &pool->lock);
+		bool stop = pool->stopping && pool->queued <= 0;
+		pthread_mutex_unlock(&pool->lock);
+
+		if (stop)
+			break;
+	}
+
+	pthread_setspecific(pool_worker_key, NULL);
+	return NULL;
+}
+
+// Function definitions
+size_t pool_cpu_count(void)
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	return cpus > 0 ? (size_t)cpus : 1;
+}
+
+int32_t pool_create(size_t threads, ThreadPool **pool)
+{
+	if (!threads)
+		threads = pool_cpu_count();
+
+	ThreadPool *p = (ThreadPool*)calloc(1, sizeof(ThreadPool));
+	if (!p)
+		return 1;
+
+	p->workers = (PoolWorker*)calloc(threads, sizeof(PoolWorker));
+	if (!p->workers)
+	{
+		free(p);
+		return 2;
+	}
+
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->available, NULL);
+	deque_init(&p->inject);
+
+	// All deques need to exist before any worker starts stealing
+	p->threads = threads;
+	for (size_t i = 0; i < threads; i++)
+	{
+		p->workers[i].pool = p;
+		p->workers[i].index = i;
+		deque_init(&p->workers[i].deque);
+	}
+
+	for (size_t i = 0; i < threads; i++)
+	{
+		if (pthread_create(&p->workers[i].thread, NULL, pool_worker, p->workers + i))
+		{
+			pthread_mutex_lock(&p->lock);
+			p->stopping = true;
+			pthread_cond_broadcast(&p->available);
+			pthread_mutex_unlock(&p->lock);
+
+			for (size_t j = 0; j < i; j++)
+				pthread_join(p->workers[j].thread, NULL);
+
+			p->threads = 0;
+			pool_destroy(p);
+			return 4;
+		}
+	}
+
+	*pool = p;
+	return 0;
+}
+
+void pool_destroy(ThreadPool *pool)
+{
+	if (!pool)
+		return;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stopping = true;
+	pthread_cond_broadcast(&pool->available);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (size_t i = 0; i < pool->threads; i++)
+		pthread_join(pool->workers[i].thread, NULL);
+
+	for (size_t i = 0; i < pool->threads; i++)
+		pthread_mutex_destroy(&pool->workers[i].deque.lock);
+
+	pthread_mutex_destroy(&pool->inject.lock);
+	pthread_cond_destroy(&pool->available);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool->workers);
+	free(pool);
+}
+
+size_t pool_size(const ThreadPool *pool)
+{
+	return pool ? pool->threads : 1;
+}
+
+void pool_group_init(PoolGroup *group)
+{
+	pthread_mutex_init(&group->lock, NULL);
+	pthread_cond_init(&group->done, NULL);
+	group->pending = 0;
+}
+
+void pool_group_destroy(PoolGroup *group)
+{
+	pthread_cond_destroy(&group->done);
+	pthread_mutex_destroy(&group->lock);
+}
+
+int32_t pool_submit(ThreadPool *pool, PoolGroup *group, PoolTask task, void *arg)
+{
+	// No pool, run inline
+	if (!pool)
+	{
+		task(arg);
+		return 0;
+	}
+
+	PoolItem *item = (PoolItem*)calloc(1, sizeof(PoolItem));
+	if (!item)
+		return 1;
+
+	item->task = task;
+	item->arg = arg;
+	item->group = group;
+
+	pthread_mutex_lock(&group->lock);
+	group->pending++;
+	pthread_mutex_unlock(&group->lock);
+
+	// Workers keep their own tasks, everyone else goes through the shared 
+	// queue
+	PoolWorker *self = pool_current(pool);
+	deque_push(self ? &self->deque : &pool->inject, item);
+
+	pthread_mutex_lock(&pool->lock);
+	pool->queued++;
+	pthread_cond_signal(&pool->available);
+	pthread_mutex_unlock(&pool->lock);
+
+	return 0;
+}
+
+void pool_group_wait(ThreadPool *pool, PoolGroup *group)
+{
+	if (!pool)
+		return;
+
+	// Help with the group's own tasks, as long as they are at the top of the
+	// queue. Never picking up unrelated work keeps nesting bounded, and 
+	// prevents a task from being blocked behind an unrelated one.
+	PoolWorker *self = pool_current(pool);
+	PoolDeque *deque = self ? &self->deque : &pool->inject;
+	while (true)
+	{
+		pthread_mutex_lock(&group->lock);
+		bool finished = group->pending == 0;
+		pthread_mutex_unlock(&group->lock);
+		if (finished)
+			return;
+
+		PoolItem *item = deque_pop(deque, group);
+		if (!item)
+			break;
+
+		pool_taken(pool);
+		pool_run(item);
+	}
+
+	// The remaining tasks were taken by other threads, wait for them
+	pthread_mutex_lock(&group->lock);
+	while (group->pending > 0)
+		pthread_cond_wait(&group->done, &group->lock);
+	pthread_mutex_unlock(&group->lock);
+}
+
+// Define C extern for C++
+#ifdef __cplusplus
+}
+#endif
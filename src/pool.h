@@ -0,0 +1,152 @@
+// This file is part of stegman project
+//
+// Copyright (c) 2018 Mateusz Brawański (Emzi0767)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/**
+ * \file
+ * \brief Work-stealing thread pool for running independent pieces of work in 
+ * parallel.
+ */
+
+// Only include once
+#pragma once
+
+// Check if we're using a C99-capable compiler
+#if __STDC_VERSION__ < 199901L
+#error "You need to use a C99-capable compiler to build this program!"
+#endif
+
+// Define C extern for C++
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// POSIX threads
+#include <pthread.h>
+
+/**
+ * Function executed by the pool.
+ *
+ * \param arg Argument supplied when the task was submitted.
+ */
+typedef void (*PoolTask)(void *arg);
+
+/** Opaque thread pool handle. */
+typedef struct ThreadPool ThreadPool;
+
+/**
+ * Group of tasks which can be waited on together. Each caller waiting for its
+ * own batch of work should use a separate group.
+ */
+typedef struct PoolGroup
+{
+	/** Lock protecting the pending counter. */
+	pthread_mutex_t lock;
+
+	/** Signalled when the pending counter reaches zero. */
+	pthread_cond_t done;
+
+	/** Number of submitted tasks which did not finish yet. */
+	size_t pending;
+} PoolGroup;
+
+/**
+ * Gets the number of processors available to the program.
+ *
+ * \return Number of online processors, at least 1.
+ */
+size_t pool_cpu_count(void);
+
+/**
+ * Creates a new thread pool.
+ *
+ * \param threads Number of worker threads. If 0, the number of processors is
+ *                used.
+ * \param pool Pointer to the pool handle. The underlying pointer will be
+ *             initialized.
+ *
+ * \return 0 if the operation was successful, an error code otherwise.
+ */
+int32_t pool_create(size_t threads, ThreadPool **pool);
+
+/**
+ * Stops all worker threads and frees the pool. Any queued tasks are executed
+ * before the workers exit.
+ *
+ * \param pool Pool to destroy.
+ */
+void pool_destroy(ThreadPool *pool);
+
+/**
+ * Gets the number of worker threads in the pool.
+ *
+ * \param pool Pool to examine. Can be NULL.
+ *
+ * \return Number of worker threads, or 1 if pool is NULL.
+ */
+size_t pool_size(const ThreadPool *pool);
+
+/**
+ * Initializes a task group.
+ *
+ * \param group Group to initialize.
+ */
+void pool_group_init(PoolGroup *group);
+
+/**
+ * Releases resources held by a task group. The group must not have pending
+ * tasks.
+ *
+ * \param group Group to destroy.
+ */
+void pool_group_destroy(PoolGroup *group);
+
+/**
+ * Queues a task for execution. If pool is NULL, the task is executed
+ * immediately on the calling thread. Tasks submitted by a worker are queued 
+ * on that worker, and are only taken by other workers once they run out of 
+ * their own work.
+ *
+ * \param pool Pool to run the task on.
+ * \param group Group the task belongs to.
+ * \param task Function to execute.
+ * \param arg Argument for the function.
+ *
+ * \return 0 if the operation was successful, an error code otherwise.
+ */
+int32_t pool_submit(ThreadPool *pool, PoolGroup *group, PoolTask task, void *arg);
+
+/**
+ * Waits until all tasks in the group finish. While waiting, the calling thread
+ * helps executing the group's own queued tasks, so it's safe to call this 
+ * from within a task. Tasks from other groups are never picked up while 
+ * waiting.
+ *
+ * \param pool Pool the tasks were submitted to. Can be NULL.
+ * \param group Group to wait for.
+ */
+void pool_group_wait(ThreadPool *pool, PoolGroup *group);
+
+// Define C extern for C++
+#ifdef __cplusplus
+}
+#endif
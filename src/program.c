@@ -35,6 +35,14 @@ extern "C"
 #include "defs.h"
 #include "encode.h"
 #include "decode.h"
+#include "text.h"
+#include "capacity.h"
+#include "batch.h"
+#include "serve.h"
+#include "watch.h"
+#include "scan.h"
+#include "index.h"
+#include "trace.h"
 
 // Include standard library
 #include <stdlib.h>
@@ -42,6 +50,10 @@ extern "C"
 #include <stdio.h>
 #include <string.h>
 #include <locale.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 // Constant definitions
 const wchar_t *const PROGRAM_NAME        = L"Stegman";
@@ -49,190 +61,363 @@ const wchar_t *const PROGRAM_VERSION     = L"1.0.0";
 const wchar_t *const PROGRAM_AUTHOR      = L"Mateusz Brawański (Emzi0767)";
 const wchar_t *const PROGRAM_DESCRIPTION = L"Stegman is a small utility for safely encoding files or messages in other files using steganography.";
 
-// Entry point
-int32_t main(int argc, char** argv)
+// Gets the number of positional operands the mode starts with. Options are 
+// only looked for after them, so that a message can look like an option.
+static int mode_operands(int argc, char **argv)
 {
-	// Set locale appropriately
-	setlocale(LC_ALL, "");
+	static const char *const MODES[] = { "encode", "decode", "split", "join", "capacity", "batch", "serve", "watch", "scan", "index", "pick" };
+	static const int OPERANDS[] = { 3, 2, 3, 3, 1, 1, 0, 3, 1, 1, 2 };
 
-	// Check if there's enough arguments supplied
-	if (argc < 3 || argc > 5)
+	for (size_t i = 0; argc >= 2 && i < sizeof(MODES) / sizeof(MODES[0]); i++)
 	{
-		print_usage(argv[0]);
-		return 1;
+		if (strcmp(argv[1], MODES[i]) == 0)
+			return 2 + OPERANDS[i];
 	}
 
-	// Check if the first argument is encode or decode
-	size_t oplen = strlen(argv[1]);
-	for (int i = 0; i < oplen; i++)
-		argv[1][i] = tolower(argv[1][i]);
-	
-	// Attempt to load the PNG file
-	FILE *fpng = fopen(argv[3], "rb+");
-	if (!fpng)
-		fail(2, L"There was an error opening '%s'\n", argv[3]);
+	return argc;
+}
 
-	// Convert the password to a proper-type string
-	size_t pwlen = mbcslen(argv[2]);
-	wchar_t *pw = (wchar_t*)calloc(pwlen + 1, sizeof(wchar_t));
-	if (!pw)
+// Finds the --max-memory option, and removes it from the arguments
+static bool memory_option(int *argc, char **argv, int first, uint64_t *limit)
+{
+	const char *value = NULL;
+	*limit = 0;
+	int32_t found = take_option(argc, argv, first, "--max-memory", OPTION_REQUIRED, &value);
+	return found == 0 || (found > 0 && parse_size(value, limit) && *limit);
+}
+
+// Finds the --channels option, and removes it from the arguments
+static bool channels_option(int *argc, char **argv, int first, StegmanChannels *channels, bool *found)
+{
+	static const char *const NAMES[] = { "all", "rgb", "alpha", "blue" };
+
+	const char *value = NULL;
+	*channels = STEGMAN_CHANNELS_ALL;
+	int32_t count = take_option(argc, argv, first, "--channels", OPTION_REQUIRED, &value);
+	*found = count > 0;
+	if (count <= 0)
+		return count == 0;
+
+	for (size_t n = 0; n < sizeof(NAMES) / sizeof(NAMES[0]); n++)
 	{
-		fclose(fpng);
-		fail(128, L"Could not allocate memory (E_PWD_ALLOC)\n");
+		if (strcmp(value, NAMES[n]) == 0)
+		{
+			*channels = (StegmanChannels)n;
+			return true;
+		}
 	}
 
+	return false;
+}
+
+// Converts the password to a proper-type string
+static wchar_t *convert_password(char *arg, size_t *pwlen)
+{
+	*pwlen = mbcslen(arg);
+	wchar_t *pw = (wchar_t*)calloc(*pwlen + 1, sizeof(wchar_t));
+	if (!pw)
+		fail(128, L"Could not allocate memory (E_PWD_ALLOC)\n");
+
 	mbtowc(NULL, NULL, 0);
-	if (!mbstowcs(pw, argv[2], pwlen))
+	if (!mbstowcs(pw, arg, *pwlen))
 	{
 		free(pw);
-		fclose(fpng);
 		fail(256, L"Could not convert password (E_PWD_MBCSTOWCS)");
 	}
 
-	((wchar_t*)pw)[pwlen] = L'\0';
+	pw[*pwlen] = L'\0';
+	return pw;
+}
 
-	if (strcmp(argv[1], "encode") == 0 && argc == 5)
+// Loads the message to encode. Files, given as @<path>, are mapped rather
+// than copied into memory, while text is stored as UTF-8.
+static void convert_message(char *arg, uint8_t **msg, size_t *msglen, InputFile *input)
+{
+	if (arg[0] == '@')
 	{
-		// Encode the data
+		int32_t ires = input_map(arg + 1, input);
+		if (ires == 1)
+			fail(2048, L"There was an error opening '%s'\n", arg + 1);
+		else if (ires)
+			fail(65536, L"Could not read message data (E_BUFFER_UNDERRUN)\n");
 
-		// Check if the input message is a file
-		bool isfile = argv[4][0] == '@';
+		return;
+	}
+
+	// Handle as unicode string
+	mblen(NULL, 0);
+	size_t mlen = mbcslen(arg);
+	wchar_t *wmsg = (wchar_t*)calloc(mlen + 1, sizeof(wchar_t));
+	if (!wmsg)
+		fail(512, L"Could not allocate memory (E_MSG_ALLOC)\n");
+
+	mbtowc(NULL, NULL, 0);
+	if (!mbstowcs(wmsg, arg, mlen))
+	{
+		free(wmsg);
+		fail(1024, L"Could not convert message (E_MSG_MBCSTOWCS)\n");
+	}
+
+	wmsg[mlen] = L'\0';
+	if (text_wcs_to_utf8(wmsg, mlen, msg, msglen))
+	{
+		free(wmsg);
+		fail(1024, L"Could not convert message (E_MSG_UTF8)\n");
+	}
+
+	free(wmsg);
+}
+
+// Opens all carriers of a sharded message
+static FILE **open_carriers(char **names, size_t count, const char *mode)
+{
+	FILE **pngs = (FILE**)calloc(count, sizeof(FILE*));
+	if (!pngs)
+		fail(128, L"Could not allocate memory (E_PNG_ALLOC)\n");
+
+	for (size_t i = 0; i < count; i++)
+	{
+		pngs[i] = fopen(names[i], mode);
+		if (!pngs[i])
+			fail(2, L"There was an error opening '%s'\n", names[i]);
+	}
+
+	return pngs;
+}
+
+static void close_carriers(FILE **pngs, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		fclose(pngs[i]);
+
+	free(pngs);
+}
+
+// Splits a message across multiple carriers, or joins it back
+static int32_t run_shards(int argc, char **argv, StatsFormat stats)
+{
+	size_t pwlen = 0;
+	wchar_t *pw = convert_password(argv[2], &pwlen);
+	size_t count = (size_t)argc - 4;
+	bool succ = false;
+	if (strcmp(argv[1], "split") == 0)
+	{
+		bool isfile = argv[3][0] == '@';
 		uint8_t *msg = NULL;
 		size_t msglen = 0;
-		if (isfile)
+		InputFile input = { NULL, 0, false };
+		convert_message(argv[3], &msg, &msglen, &input);
+
+		FILE **pngs = open_carriers(argv + 4, count, "rb+");
+		size_t used = 0;
+		succ = isfile
+			? encode_shards(pw, pwlen, pngs, count, input.data, input.len, isfile, stats, &used)
+			: encode_shards(pw, pwlen, pngs, count, msg, msglen, isfile, stats, &used);
+		if (succ)
+			wprintf(L"This was a triumph! The data was successfully split across %zu of %zu files!\n", used, count);
+		else
+			wprintf(L"The encoding failed :(\n");
+
+		close_carriers(pngs, count);
+		free(msg);
+		input_release(&input);
+	}
+	else
+	{
+		bool msgstdout = strcmp(argv[3], "-") == 0;
+		FILE *fstatus = msgstdout ? stderr : stdout;
+		FILE **pngs = open_carriers(argv + 4, count, "rb");
+		FILE *fmsg = msgstdout ? stdout : fopen(argv[3], "wb");
+		if (!fmsg)
+			fail(2048, L"There was an error opening '%s'\n", argv[3]);
+
+		bool isfile = false;
+		succ = decode_shards_to(pw, pwlen, pngs, count, fmsg, &isfile, stats);
+		if (msgstdout ? fflush(stdout) != 0 : fclose(fmsg) != 0)
+			succ = false;
+
+		// Don't leave partial messages behind
+		if (!succ && !msgstdout)
+			remove(argv[3]);
+
+		if (succ)
+			fwprintf(fstatus, L"This was a triumph! The data was successfully joined from %zu files!\n", count);
+		else
+			fwprintf(fstatus, L"The decoding failed :(\n");
+
+		close_carriers(pngs, count);
+	}
+
+	free(pw);
+	return succ ? 0 : 1;
+}
+
+// Runs the selected mode
+static int32_t run_mode(int argc, char** argv)
+{
+	// Batch mode takes its own options
+	if (argc >= 3 && strcmp(argv[1], "batch") == 0)
+		return batch_main(argc - 2, argv + 2);
+
+	// So does the daemon
+	if (argc >= 3 && strcmp(argv[1], "serve") == 0)
+		return serve_main(argc - 2, argv + 2);
+
+	if (argc >= 3 && strcmp(argv[1], "watch") == 0)
+		return watch_main(argc - 2, argv + 2);
+
+	if (argc >= 3 && strcmp(argv[1], "scan") == 0)
+		return scan_main(argc - 2, argv + 2);
+
+	if (argc >= 3 && strcmp(argv[1], "index") == 0)
+		return index_main(argc - 2, argv + 2);
+
+	if (argc >= 3 && strcmp(argv[1], "pick") == 0)
+		return pick_main(argc - 2, argv + 2);
+
+	// Measurements and the memory budget can be given anywhere after the 
+	// mode's operands
+	int first = mode_operands(argc, argv);
+	StatsFormat stats = STATS_NONE;
+	uint64_t maxmemory = 0;
+	if (stats_option(&argc, argv, first, &stats) || !memory_option(&argc, argv, first, &maxmemory))
+	{
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	// Spreading the message over the carrier only applies to encoding, and 
+	// picking its channels to encoding and checking the capacity
+	StegmanChannels channels = STEGMAN_CHANNELS_ALL;
+	bool haschannels = false;
+	bool encoding = argc >= 2 && strcmp(argv[1], "encode") == 0;
+	bool probing = argc >= 2 && strcmp(argv[1], "capacity") == 0;
+	int32_t scatter = take_option(&argc, argv, first, "--scatter", OPTION_NONE, NULL);
+	if (scatter < 0 || !channels_option(&argc, argv, first, &channels, &haschannels) 
+		|| (scatter && !encoding) || (haschannels && !encoding && !probing))
+	{
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	// Sharded messages take any number of carriers, each of which is loaded
+	// whole, so they can't be held to a memory budget
+	if (argc >= 5 && (strcmp(argv[1], "split") == 0 || strcmp(argv[1], "join") == 0))
+	{
+		if (maxmemory)
 		{
-			// Handle as file
-			FILE *fmsg = fopen(argv[4] + 1, "rb");
-			if (!fmsg)
-			{
-				free(pw);
-				fclose(fpng);
-				fail(2048, L"There was an error opening '%s'\n", argv[4] + 1);
-			}
-
-			if (fseek(fmsg, 0L, SEEK_END) != 0)
-			{
-				fclose(fmsg);
-				free(pw);
-				fclose(fpng);
-				fail(4096, L"There was an error measuring the file size (E_MSG_SEEK_END)\n");
-			}
-
-			msglen = ftell(fmsg);
-			if ((int64_t)msglen == -1)
-			{
-				fclose(fmsg);
-				free(pw);
-				fclose(fpng);
-				fail(8192, L"There was an error measuring the file size (E_MSG_GET_POS)\n");
-			}
-
-			if (fseek(fmsg, 0L, SEEK_SET) != 0)
-			{
-				fclose(fmsg);
-				free(pw);
-				fclose(fpng);
-				fail(16384, L"There was an error measuring the file size (E_MSG_SEEK_BEGIN)\n");
-			}
-
-			msg = (uint8_t*)calloc(msglen, sizeof(uint8_t));
-			if (!msg)
-			{
-				fclose(fmsg);
-				free(pw);
-				fclose(fpng);
-				fail(32768, L"Could not allocate memory (E_MSG_ALLOC)\n");
-			}
-
-			if (fread(msg, sizeof(uint8_t), msglen, fmsg) != msglen)
-			{
-				free(msg);
-				fclose(fmsg);
-				free(pw);
-				fclose(fpng);
-				fail(65536, L"Could not read message data (E_BUFFER_UNDERRUN)\n");
-			}
-
-			fclose(fmsg);
+			print_usage(argv[0]);
+			return 1;
 		}
-		else
+
+		return run_shards(argc, argv, stats);
+	}
+
+	// Check if there's enough arguments supplied
+	if (argc < 3 || argc > 5)
+	{
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	// Capacity probing does not need a password
+	if (strcmp(argv[1], "capacity") == 0)
+	{
+		if (argc > 4)
 		{
-			// Handle as unicode string
-			mblen(NULL, 0);
-			size_t mlen = mbcslen(argv[4]);
-			msg = (uint8_t*)calloc(mlen + 1, sizeof(wchar_t));
-			msglen = mlen * sizeof(wchar_t);
-			if (!msg)
-			{
-				free(pw);
-				fclose(fpng);
-				fail(512, L"Could not allocate memory (E_MSG_ALLOC)\n");
-			}
-
-			mbtowc(NULL, NULL, 0);
-			if (!mbstowcs((wchar_t*)msg, argv[4], mlen))
-			{
-				free(msg);
-				free(pw);
-				fclose(fpng);
-				fail(1024, L"Could not convert message (E_MSG_MBCSTOWCS)\n");
-			}
-
-			((wchar_t*)msg)[mlen] = L'\0';
+			print_usage(argv[0]);
+			return 1;
 		}
 
+		return print_capacity(argv[2], argc == 4 ? argv[3] : NULL, channels);
+	}
+	
+	// Attempt to load the PNG file. A carrier coming from the standard input
+	// can't be modified in-place, the result goes to the standard output
+	bool pngstdin = strcmp(argv[3], "-") == 0;
+	const char *pngname = pngstdin ? "<stdin>" : argv[3];
+	if (pngstdin && argc == 5 && strcmp(argv[4], "@-") == 0)
+		fail(1, L"The standard input can only be used once\n");
+
+	uint8_t *pngbuf = NULL;
+	FILE *fpng = pngstdin ? open_input(argv[3], &pngbuf) : fopen(argv[3], "rb+");
+	if (!fpng)
+		fail(2, L"There was an error opening '%s'\n", pngname);
+
+	// Convert the password to a proper-type string
+	size_t pwlen = 0;
+	wchar_t *pw = convert_password(argv[2], &pwlen);
+
+	if (strcmp(argv[1], "encode") == 0 && argc == 5)
+	{
 		// Encode the data
-		bool succ = encode(pw, pwlen, fpng, msg, msglen, isfile);
+
+		// Check if the input message is a file
+		bool isfile = argv[4][0] == '@';
+		uint8_t *msg = NULL;
+		size_t msglen = 0;
+		InputFile input = { NULL, 0, false };
+		convert_message(argv[4], &msg, &msglen, &input);
+
+		// Encode the data. When the image goes to the standard output, the
+		// messages go to the standard error instead
+		bool succ = isfile
+			? encode(pw, pwlen, fpng, pngstdin ? stdout : NULL, input.data, input.len, isfile, stats, maxmemory, scatter, channels)
+			: encode(pw, pwlen, fpng, pngstdin ? stdout : NULL, msg, msglen, isfile, stats, maxmemory, scatter, channels);
+		FILE *fstatus = pngstdin ? stderr : stdout;
 		if (succ)
-			wprintf(L"This was a triumph! The data was successfully encoded into file '%s'!\n", argv[3]);
+			fwprintf(fstatus, L"This was a triumph! The data was successfully encoded into file '%s'!\n", pngname);
 		else
-			wprintf(L"The encoding failed :(\n");
+			fwprintf(fstatus, L"The encoding failed :(\n");
 
 		// Free the memory
 		free(msg);
+		input_release(&input);
 	}
 	else if (strcmp(argv[1], "decode") == 0 && (argc == 4 || argc == 5))
 	{
 		// Decode the data
 		bool isfile = false;
-		uint8_t *msg = NULL;
-		size_t msglen = 0;
-		bool succ = decode(pw, pwlen, fpng, &msg, &msglen, &isfile);
-		if (succ)
-			wprintf(L"This was a triumph! The data was successfully decoded from file '%s'!\n", argv[3]);
-		else
-			wprintf(L"The decoding failed :(\n");
-
+		bool msgstdout = argc == 5 && strcmp(argv[4], "-") == 0;
+		FILE *fstatus = msgstdout ? stderr : stdout;
 		if (argc == 5)
 		{
-			// Save the file
-			FILE *fmsg = fopen(argv[4], "wb");
+			// Stream the message into the file, as it's decompressed
+			FILE *fmsg = msgstdout ? stdout : fopen(argv[4], "wb");
 			if (!fmsg)
-			{
-				free(msg);
 				fail(2048, L"There was an error opening '%s'\n", argv[4]);
-			}
 
-			if (fwrite(msg, sizeof(uint8_t), msglen, fmsg) != msglen)
-			{
-				free(msg);
-				fclose(fmsg);
-				fail(4096, L"There was an error writing to '%s'\n", argv[4]);
-			}
+			bool succ = decode_to(pw, pwlen, fpng, fmsg, &isfile, stats, maxmemory);
+			if (msgstdout ? fflush(stdout) != 0 : fclose(fmsg) != 0)
+				succ = false;
 
-			fclose(fmsg);
-		}
-		else if (isfile && argc == 4)
-		{
-			werrorf(L"The message was decoded successfully, however the source was a file. To save it, you need to specify an output file when launching the program.\n");
+			// Don't leave partial messages behind
+			if (!succ && !msgstdout)
+				remove(argv[4]);
+
+			if (succ)
+				fwprintf(fstatus, L"This was a triumph! The data was successfully decoded from file '%s'!\n", pngname);
+			else
+				fwprintf(fstatus, L"The decoding failed :(\n");
 		}
 		else
 		{
-			wprintf(L"Decoded message:\n\n%ls\n", (wchar_t*)msg);
+			uint8_t *msg = NULL;
+			size_t msglen = 0;
+			bool succ = decode(pw, pwlen, fpng, &msg, &msglen, &isfile, stats, maxmemory);
+			if (succ)
+				wprintf(L"This was a triumph! The data was successfully decoded from file '%s'!\n", pngname);
+			else
+				wprintf(L"The decoding failed :(\n");
+
+			if (succ && isfile)
+				werrorf(L"The message was decoded successfully, however the source was a file. To save it, you need to specify an output file when launching the program.\n");
+			else if (succ)
+				wprintf(L"Decoded message:\n\n%ls\n", (wchar_t*)msg);
+
+			// Free the memory
+			free(msg);
 		}
-
-		// Free the memory
-		free(msg);
 	}
 	else
 	{
@@ -242,11 +427,47 @@ int32_t main(int argc, char** argv)
 
 	free(pw);
 	fclose(fpng);
+	free(pngbuf);
 
 	// End of program
 	return 0;
 }
 
+// Entry point
+int32_t main(int argc, char** argv)
+{
+	// Set locale appropriately
+	setlocale(LC_ALL, "");
+
+	// Modes are case-insensitive
+	if (argc >= 2)
+	{
+		size_t oplen = strlen(argv[1]);
+		for (int i = 0; i < oplen; i++)
+			argv[1][i] = tolower(argv[1][i]);
+	}
+
+	// A timeline can be recorded in any mode
+	const char *tracepath = NULL;
+	if (stats_trace_option(&argc, argv, mode_operands(argc, argv), &tracepath))
+	{
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	if (tracepath)
+	{
+		trace_start();
+		trace_name_thread("main", -1);
+	}
+
+	int32_t res = run_mode(argc, argv);
+	if (tracepath && !stats_trace_write(tracepath))
+		werrorf(L"There was an error writing '%s'\n", tracepath);
+
+	return res;
+}
+
 // Function definitions
 int32_t werrorf(const wchar_t* format, ...)
 {
@@ -263,16 +484,120 @@ int32_t werrorf(const wchar_t* format, ...)
 void print_usage(char* progname)
 {
 	werrorf(L"%ls v%ls by %ls\n%ls\n\nUsage:\n", PROGRAM_NAME, PROGRAM_VERSION, PROGRAM_AUTHOR, PROGRAM_DESCRIPTION);
-	werrorf(L"In order to use %ls, you need to specify operation mode. The program has 2 modes: encode, decode. Described below are arguments for each available mode.\n\n", PROGRAM_NAME);
-	werrorf(L"%s encode <password> <target file> <message>\n%s encode <password> <target file> @<source file>\npassword       The password to secure your data before encoding.\ntarget file    The file in which the data will be encoded.\nmessage        Text message to encode in the file.\nsource file    File to encode in the file.\n\n", progname, progname);
-	werrorf(L"%s decode <password> <source file> [target file]\npassword       The password used to secure your encoded data.\nsource file    The file in which the data was encoded.\ntarget file    The file in which the decoded data will be placed.\n\n", progname);
+	werrorf(L"In order to use %ls, you need to specify operation mode. The program has 11 modes: encode, decode, split, join, capacity, batch, serve, watch, scan, index, pick. Described below are arguments for each available mode.\n\n", PROGRAM_NAME);
+	werrorf(L"%s encode <password> <target file> <message> [--scatter] [--channels <set>]\n%s encode <password> <target file> @<source file> [--scatter] [--channels <set>]\npassword       The password to secure your data before encoding.\ntarget file    The file in which the data will be encoded.\nmessage        Text message to encode in the file.\nsource file    File to encode in the file.\n--scatter      Spread the data over the whole file, in blocks placed in an\n               order derived from the password, instead of filling the file\n               from the top.\n--channels     Channels of each pixel to hide the data in: all (default),\n               rgb, alpha, or blue. Fewer channels leave more of the picture\n               untouched, but hold less data.\n\n", progname, progname);
+	werrorf(L"%s decode <password> <source file> [target file]\npassword       The password used to secure your encoded data.\nsource file    The file in which the data was encoded.\ntarget file    The file in which the decoded data will be placed. Text is\n               written as UTF-8.\n\n", progname);
+	werrorf(L"%s split <password> <message> <target file>...\n%s split <password> @<source file> <target file>...\ntarget file    Files across which the data will be encoded, in-place, filled\n               in order. Files which aren't needed are left unchanged.\n\n", progname, progname);
+	werrorf(L"%s join <password> <target file> <source file>...\ntarget file    The file in which the decoded data will be placed. Text is\n               written as UTF-8.\nsource file    Files holding the split data, in any order. All of them are\n               needed.\n\n", progname);
+	werrorf(L"%s capacity <target file> [message] [--channels <set>]\n%s capacity <target file> @<source file> [--channels <set>]\ntarget file    The file to check.\nmessage        Text message to check.\nsource file    File to check.\n--channels     Channels to count, as in encode mode.\n\n", progname, progname);
+	werrorf(L"%s batch <manifest> [--results <file>] [--threads <count>] [--reuse-key]\nmanifest       File listing the jobs, one per line, with tab-separated fields:\n                 encode <carrier> <message or @source file> <output file> <password ref>\n                 decode <carrier> <output file> <password ref>\n               An empty output file encodes in-place. Password references are\n               env:<variable> or file:<path>.\nresults        File to write a JSON result line for each job to, instead of\n               the standard output.\ncount          Number of worker threads, one per processor by default.\n--reuse-key    Derive one key per password and thread, instead of one per\n               image, sharing the salt between images.\n\n", progname);
+	werrorf(L"%s serve --socket <path> [--threads <count>] [--reuse-key]\npath           Unix domain socket to listen on for requests.\ncount          Number of worker threads, one per processor by default.\n--reuse-key    Same as in batch mode.\n\n", progname);
+	werrorf(L"%s watch <spool dir> <output dir> <password ref> [--results <file>] [--threads <count>] [--reuse-key]\nspool dir      Directory to watch for <name>.png carriers and <name>.msg files\n               to encode in them.\noutput dir     Directory to move the encoded <name>.png images to.\npassword ref   Same as in batch mode.\nresults        File to append a JSON result line for each pair to, instead of\n               the standard output.\n\n", progname);
+	werrorf(L"%s scan <dir> [--results <file>] [--threads <count>] [--found]\ndir            Directory to search for PNG images holding messages, including\n               its subdirectories. Only the headers of the images are read.\nresults        File to write a JSON result line for each image to, instead of\n               the standard output.\ncount          Number of threads, four per processor by default.\n--found        Only report images holding a message.\n\n", progname);
+	werrorf(L"%s index <dir> [--index <file>] [--threads <count>]\ndir            Directory of carriers to index, including its subdirectories.\n               Only images added or changed since the last run are read.\nfile           Index file to use, <dir>/.stegman-index by default.\ncount          Same as in scan mode.\n\n", progname);
+	werrorf(L"%s pick <dir> <size> [--index <file>] [--threads <count>]\nsize           Size of the payload, in bytes, with an optional K, M, or G\n               suffix. The smallest indexed carrier without a message, which\n               can hold it even uncompressed, is printed. The index is brought\n               up to date first, as in index mode.\n\n", progname);
+	werrorf(L"Encoding and decoding accept --stats, which prints the time, bytes processed, and\nmemory used by each stage to the standard error once done. --stats=json prints\nthe same as a single line of JSON.\n\n");
+	werrorf(L"Encoding and decoding, but not splitting or joining, also accept --max-memory\n<size>, with an optional K, M, or G suffix. Large carriers are then processed in\nbands of rows, and buffers which don't fit are kept in temporary files in\nTMPDIR. Operations which can't fit fail before doing any work.\n\n");
+	werrorf(L"Every mode accepts --trace <file>, which records a timeline of the stages, jobs,\nand I/O of each thread, and writes it to the file as Chrome trace JSON, which\ncan be opened in Perfetto, once the program finishes.\n\n");
 	werrorf(L"When decoding, and the encoded data comes from a file, you need to specify the target file.\n");
+	werrorf(L"Any file can be given as -, which stands for the standard input, or the standard output for decoded data. An image encoded from the standard input is written to the standard output.\n");
 
 #ifdef __BUILDINFO__
 	werrorf(L"\nBuild info:\nTimestamp:        %ls\nCommit:           %ls\nPath:             %ls\nMachine:          %ls\nUser:             %ls\nCompiler:         %ls\nHost:             %ls\n", __TIMESTAMP_ISO__, __GIT_COMMIT__, __WORKDIR__, __MACHINE__, __USER__, __COMPILER__, __HOST__);
 #endif // __BUILDINFO__
 }
 
+int32_t print_capacity(char *target, char *message, StegmanChannels channels)
+{
+	if (strcmp(target, "-") == 0 && message && strcmp(message, "@-") == 0)
+		fail(1, L"The standard input can only be used once\n");
+
+	uint8_t *pngbuf = NULL;
+	FILE *fpng = open_input(target, &pngbuf);
+	if (!fpng)
+		fail(2, L"There was an error opening '%s'\n", target);
+
+	// Measure the message
+	uint64_t msglen = 0;
+	if (message && strcmp(message, "@-") == 0)
+	{
+		uint8_t *msg = NULL;
+		size_t len = 0;
+		if (!read_stream(stdin, &msg, &len))
+		{
+			fclose(fpng);
+			fail(65536, L"Could not read message data (E_BUFFER_UNDERRUN)\n");
+		}
+
+		msglen = len;
+		free(msg);
+	}
+	else if (message && message[0] == '@')
+	{
+		struct stat st;
+		if (stat(message + 1, &st))
+		{
+			fclose(fpng);
+			fail(2048, L"There was an error opening '%s'\n", message + 1);
+		}
+
+		msglen = st.st_size;
+	}
+	else if (message)
+	{
+		size_t mlen = mbcslen(message);
+		wchar_t *wmsg = (wchar_t*)calloc(mlen + 1, sizeof(wchar_t));
+		uint8_t *msg = NULL;
+		size_t utflen = 0;
+		mbtowc(NULL, NULL, 0);
+		if (!wmsg || !mbstowcs(wmsg, message, mlen) || text_wcs_to_utf8(wmsg, mlen, &msg, &utflen))
+		{
+			free(wmsg);
+			fclose(fpng);
+			fail(1024, L"Could not convert message (E_MSG_MBCSTOWCS)\n");
+		}
+
+		msglen = utflen;
+		free(msg);
+		free(wmsg);
+	}
+
+	CapacityInfo cap;
+	int32_t res = capacity_probe(fpng, msglen, (StegChannels)channels, &cap);
+	fclose(fpng);
+	free(pngbuf);
+	if (res)
+		fail(4, L"Error loading PNG image (%d). Refer to libpng manual for details.\n", res);
+
+	wprintf(L"Image:             %ux%u, %d bits per pixel\n", cap.image.width, cap.image.height, cap.image.bit_depth);
+	if (!cap.available)
+	{
+		werrorf(L"%s.\n", stegman_strerror(STEGMAN_E_CHANNELS));
+		return 1;
+	}
+
+	wprintf(L"Capacity:          %lu bytes\n", (unsigned long)cap.capacity);
+	if (!message)
+		return 0;
+
+	wprintf(L"Message:           %lu bytes\n", (unsigned long)msglen);
+	wprintf(L"Encoded length:    %lu to %lu bytes\n", (unsigned long)cap.minlen, (unsigned long)cap.maxlen);
+	switch (cap.fit)
+	{
+		case FIT_YES:
+			wprintf(L"The message fits in the image.\n");
+			return 0;
+
+		case FIT_MAYBE:
+			wprintf(L"The message fits in the image if it compresses well enough.\n");
+			return 0;
+
+		default:
+			wprintf(L"The message does not fit in the image.\n");
+			return 1;
+	}
+}
+
 void fail(int32_t code, wchar_t *format, ...)
 {
 	va_list args;
@@ -284,6 +609,135 @@ void fail(int32_t code, wchar_t *format, ...)
 	exit(code);
 }
 
+bool read_stream(FILE *src, uint8_t **data, size_t *len)
+{
+	size_t cap = 64 * 1024, used = 0;
+	uint8_t *buf = (uint8_t*)malloc(cap);
+	if (!buf)
+		return false;
+
+	size_t got = 0;
+	while ((got = fread(buf + used, sizeof(uint8_t), cap - used, src)) > 0)
+	{
+		used += got;
+		if (used < cap)
+			continue;
+
+		uint8_t *buf2 = (uint8_t*)realloc(buf, cap * 2);
+		if (!buf2)
+		{
+			free(buf);
+			return false;
+		}
+
+		buf = buf2;
+		cap *= 2;
+	}
+
+	if (ferror(src))
+	{
+		free(buf);
+		return false;
+	}
+
+	*data = buf;
+	*len = used;
+	return true;
+}
+
+FILE *open_input(const char *path, uint8_t **buffer)
+{
+	*buffer = NULL;
+	if (strcmp(path, "-") != 0)
+		return fopen(path, "rb");
+
+	size_t len = 0;
+	if (!read_stream(stdin, buffer, &len))
+		return NULL;
+
+	// An empty buffer can't be opened, it fails as an invalid image instead
+	FILE *file = fmemopen(*buffer, len ? len : 1, "rb");
+	if (!file)
+	{
+		free(*buffer);
+		*buffer = NULL;
+	}
+
+	return file;
+}
+
+int32_t input_map(const char *path, InputFile *input)
+{
+	input->data = NULL;
+	input->len = 0;
+	input->mapped = false;
+	if (strcmp(path, "-") == 0)
+	{
+		uint8_t *data = NULL;
+		if (!read_stream(stdin, &data, &input->len))
+			return 2;
+
+		input->data = data;
+		return 0;
+	}
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return 1;
+
+	struct stat st;
+	if (fstat(fd, &st))
+	{
+		close(fd);
+		return 2;
+	}
+
+	// Pipes and devices can't be mapped, they are read instead
+	if (!S_ISREG(st.st_mode))
+	{
+		FILE *src = fdopen(fd, "rb");
+		uint8_t *data = NULL;
+		bool ok = src && read_stream(src, &data, &input->len);
+		if (src)
+			fclose(src);
+		else
+			close(fd);
+
+		input->data = data;
+		return ok ? 0 : 2;
+	}
+
+	input->len = st.st_size;
+	if (!input->len)
+	{
+		close(fd);
+		return 0;
+	}
+
+	void *data = mmap(NULL, input->len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return 2;
+
+	// The compressor goes through the file once, front to back
+	posix_madvise(data, input->len, POSIX_MADV_SEQUENTIAL);
+	input->data = (const uint8_t*)data;
+	input->mapped = true;
+	return 0;
+}
+
+void input_release(InputFile *input)
+{
+	if (input->mapped)
+		munmap((void*)input->data, input->len);
+	else
+		free((void*)input->data);
+
+	input->data = NULL;
+	input->len = 0;
+	input->mapped = false;
+}
+
 size_t mbcslen(char *str)
 {
 	mblen(NULL, 0);
@@ -302,6 +756,71 @@ size_t mbcslen(char *str)
 	return len;
 }
 
+int32_t take_option(int *argc, char **argv, int first, const char *name, OptionValue kind, const char **value)
+{
+	size_t namelen = strlen(name);
+	int32_t found = 0;
+	int kept = first < *argc ? first : *argc;
+	if (value)
+		*value = NULL;
+
+	for (int i = kept; i < *argc; i++)
+	{
+		const char *arg = argv[i];
+		if (strncmp(arg, name, namelen) != 0 || (arg[namelen] != '\0' && arg[namelen] != '='))
+		{
+			argv[kept++] = argv[i];
+			continue;
+		}
+
+		const char *given = arg[namelen] == '=' ? arg + namelen + 1 : NULL;
+		if (!given && kind == OPTION_REQUIRED)
+		{
+			if (i + 1 >= *argc)
+				return -1;
+
+			given = argv[++i];
+		}
+
+		if (given && kind == OPTION_NONE)
+			return -1;
+
+		if (value)
+			*value = given;
+
+		found++;
+	}
+
+	if (kept < *argc)
+		argv[kept] = NULL;
+
+	*argc = kept;
+	return found;
+}
+
+bool parse_size(const char *str, uint64_t *size)
+{
+	char *end = NULL;
+	unsigned long long value = strtoull(str, &end, 10);
+	if (end == str)
+		return false;
+
+	int shift = 0;
+	const char *suffixes = "kmg";
+	const char *suffix = *end ? strchr(suffixes, tolower(*end)) : NULL;
+	if (suffix)
+	{
+		shift = 10 * (int)(suffix - suffixes + 1);
+		end++;
+	}
+
+	if (*end || value > (UINT64_MAX >> shift))
+		return false;
+
+	*size = (uint64_t)value << shift;
+	return true;
+}
+
 // Define C extern for C++
 #ifdef __cplusplus
 }
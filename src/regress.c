@@ -0,0 +1,632 @@
+// This file is part of stegman project
+//
+// Copyright (c) 2018 Mateusz Brawański (Emzi0767)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Check if we're using a C99-capable compiler
+#if __STDC_VERSION__ < 199901L
+#error "You need to use a C99-capable compiler to build this program!"
+#endif
+
+// Define C extern for C++
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Appropriate headers
+#include "defs.h"
+#include "png.h"
+#include "synth.h"
+#include "stegman.h"
+
+// Standard library
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <png.h>
+
+// Most carriers a sharded case can split its message across
+#define REGRESS_MAX_SHARDS 4
+
+// Single round trip of the corpus. Every case derives its inputs from its 
+// own seed, so the corpus is identical between runs and releases.
+typedef struct RegressCase
+{
+	const char *name;
+	uint32_t size;
+	uint8_t channels;
+	bool interlaced;
+	StegmanPayload type;
+	bool random;
+	uint64_t msglen;
+	bool large;
+
+	// Encoding options, left out for the default layout
+	StegmanChannels layout;
+	bool scatter;
+	uint64_t max_memory;
+
+	// Number of carriers the message is split across, or 0 to use a single 
+	// one. Shards are joined in reverse order, optionally without the first.
+	uint8_t shards;
+	bool missing;
+
+	// Result expected from the first step which fails, if any
+	StegmanResult expect;
+} RegressCase;
+
+static const RegressCase REGRESS_CASES[] =
+{
+	{ "rgb-512-text-short",       512,  3, false, STEGMAN_PAYLOAD_TEXT, false, 200,             false },
+	{ "rgba-1024-text-long",      1024, 4, false, STEGMAN_PAYLOAD_TEXT, false, 200 * 1024,      false },
+	{ "rgb-1024-adam7-text-long", 1024, 3, true,  STEGMAN_PAYLOAD_TEXT, false, 200 * 1024,      false },
+	{ "rgba-1024-file-random",    1024, 4, false, STEGMAN_PAYLOAD_FILE, true,  256 * 1024,      false },
+	{ "rgb-2048-file-chunked",    2048, 3, false, STEGMAN_PAYLOAD_FILE, false, 6 * 1024 * 1024, true },
+	{ "rgba-2048-file-random",    2048, 4, false, STEGMAN_PAYLOAD_FILE, true,  2 * 1024 * 1024, true },
+	{ "rgba-1024-scatter",        1024, 4, false, STEGMAN_PAYLOAD_FILE, true,  256 * 1024,      false, STEGMAN_CHANNELS_ALL,   true,  0, 0, false, STEGMAN_OK },
+	{ "rgb-512-rgb",              512,  3, false, STEGMAN_PAYLOAD_FILE, true,  32 * 1024,       false, STEGMAN_CHANNELS_RGB,   false, 0, 0, false, STEGMAN_OK },
+	{ "rgba-512-rgb",             512,  4, false, STEGMAN_PAYLOAD_FILE, true,  32 * 1024,       false, STEGMAN_CHANNELS_RGB,   false, 0, 0, false, STEGMAN_OK },
+	{ "rgba-512-rgb-scatter",     512,  4, false, STEGMAN_PAYLOAD_FILE, true,  32 * 1024,       false, STEGMAN_CHANNELS_RGB,   true,  0, 0, false, STEGMAN_OK },
+	{ "rgba-512-alpha",           512,  4, false, STEGMAN_PAYLOAD_FILE, true,  32 * 1024,       false, STEGMAN_CHANNELS_ALPHA, false, 0, 0, false, STEGMAN_OK },
+	{ "rgba-512-alpha-scatter",   512,  4, false, STEGMAN_PAYLOAD_FILE, true,  32 * 1024,       false, STEGMAN_CHANNELS_ALPHA, true,  0, 0, false, STEGMAN_OK },
+	{ "rgb-512-alpha-rejected",   512,  3, false, STEGMAN_PAYLOAD_FILE, true,  32 * 1024,       false, STEGMAN_CHANNELS_ALPHA, false, 0, 0, false, STEGMAN_E_CHANNELS },
+	{ "rgb-512-blue",             512,  3, false, STEGMAN_PAYLOAD_FILE, true,  32 * 1024,       false, STEGMAN_CHANNELS_BLUE,  false, 0, 0, false, STEGMAN_OK },
+	{ "rgb-512-blue-scatter",     512,  3, false, STEGMAN_PAYLOAD_FILE, true,  32 * 1024,       false, STEGMAN_CHANNELS_BLUE,  true,  0, 0, false, STEGMAN_OK },
+	{ "rgba-512-blue",            512,  4, false, STEGMAN_PAYLOAD_FILE, true,  32 * 1024,       false, STEGMAN_CHANNELS_BLUE,  false, 0, 0, false, STEGMAN_OK },
+	{ "rgba-512-blue-scatter",    512,  4, false, STEGMAN_PAYLOAD_FILE, true,  32 * 1024,       false, STEGMAN_CHANNELS_BLUE,  true,  0, 0, false, STEGMAN_OK },
+	{ "rgb-512-x3-shards",        512,  3, false, STEGMAN_PAYLOAD_FILE, true,  480 * 1024,      false, STEGMAN_CHANNELS_ALL,   false, 0, 3, false, STEGMAN_OK },
+	{ "rgb-512-x3-shard-missing", 512,  3, false, STEGMAN_PAYLOAD_FILE, true,  480 * 1024,      false, STEGMAN_CHANNELS_ALL,   false, 0, 3, true,  STEGMAN_E_SHARD },
+	{ "rgb-512-x3-shards-budget", 512,  3, false, STEGMAN_PAYLOAD_FILE, true,  480 * 1024,      false, STEGMAN_CHANNELS_ALL,   false, 18 * 1024 * 1024, 3, false, STEGMAN_E_OPTION },
+	{ "rgba-1024-max-memory",     1024, 4, false, STEGMAN_PAYLOAD_FILE, true,  256 * 1024,      false, STEGMAN_CHANNELS_ALL,   false, 18 * 1024 * 1024, 0, false, STEGMAN_OK }
+};
+
+// Differences below this many seconds are treated as noise
+static const double REGRESS_SLACK = 0.002;
+
+static const uint8_t REGRESS_PASSWORD[] = "regression";
+
+// Settings of the run
+typedef struct Regress
+{
+	size_t runs;
+	double tolerance;
+	bool quick;
+	const char *baseline;
+	char *basedata;
+	StegmanContext *ctx;
+	size_t regressions;
+} Regress;
+
+// Generated inputs of a case
+typedef struct RegressInput
+{
+	uint8_t *carrier[REGRESS_MAX_SHARDS];
+	size_t carrierlen[REGRESS_MAX_SHARDS];
+	uint8_t *message;
+	uint64_t msglen;
+
+	// Sharded cases are encoded in-place, in temporary files
+	FILE *files[REGRESS_MAX_SHARDS];
+} RegressInput;
+
+// Message joined from shards
+typedef struct RegressSink
+{
+	uint8_t *data;
+	size_t len;
+	size_t cap;
+} RegressSink;
+
+// Helper functions
+static double regress_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// The library never writes interlaced images, so those are written here
+static int32_t regress_save_interlaced(const uint8_t *pixels, const PngImageInfo *image, FILE *out)
+{
+	png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	png_infop png_inf = png_ptr ? png_create_info_struct(png_ptr) : NULL;
+	png_bytepp rows = (png_bytepp)calloc(image->height, sizeof(png_bytep));
+	if (!png_inf || !rows)
+	{
+		free(rows);
+		png_destroy_write_struct(&png_ptr, &png_inf);
+		return 1;
+	}
+
+	if (setjmp(png_jmpbuf(png_ptr)))
+	{
+		free(rows);
+		png_destroy_write_struct(&png_ptr, &png_inf);
+		return 2;
+	}
+
+	size_t rowsize = png_row_size(image);
+	for (uint32_t i = 0; i < image->height; i++)
+		rows[i] = (png_bytep)(pixels + (size_t)i * rowsize);
+
+	png_init_io(png_ptr, out);
+	png_set_IHDR(png_ptr, png_inf, image->width, image->height, 8, image->bit_depth == 32 ? PNG_COLOR_TYPE_RGB_ALPHA : PNG_COLOR_TYPE_RGB, PNG_INTERLACE_ADAM7, PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+	png_write_info(png_ptr, png_inf);
+	png_set_interlace_handling(png_ptr);
+	png_write_image(png_ptr, rows);
+	png_write_end(png_ptr, NULL);
+
+	free(rows);
+	png_destroy_write_struct(&png_ptr, &png_inf);
+	return 0;
+}
+
+static bool regress_save(const RegressCase *rc, const uint8_t *pixels, size_t pixlen, const PngImageInfo *image, uint8_t **carrier, size_t *carrierlen)
+{
+	char *buf = NULL;
+	size_t buflen = 0;
+	FILE *out = open_memstream(&buf, &buflen);
+	int32_t res = 1;
+	if (out)
+	{
+		res = rc->interlaced ? regress_save_interlaced(pixels, image, out) : png_save_pixels(pixels, pixlen, image, out);
+		fclose(out);
+	}
+
+	*carrier = (uint8_t*)buf;
+	*carrierlen = buflen;
+	return !res;
+}
+
+static bool regress_generate(const RegressCase *rc, uint64_t seed, RegressInput *input)
+{
+	SynthRandom rnd;
+	synth_seed(&rnd, seed);
+
+	PngImageInfo image = { rc->size, rc->size, (uint8_t)(rc->channels * 8), rc->interlaced };
+	size_t pixlen = png_row_size(&image) * image.height;
+	uint8_t *pixels = (uint8_t*)malloc(pixlen);
+	input->message = (uint8_t*)malloc(rc->msglen);
+	if (!pixels || !input->message)
+	{
+		free(pixels);
+		return false;
+	}
+
+	synth_pixels(&rnd, pixels, &image);
+	if (rc->random)
+		synth_random(&rnd, input->message, rc->msglen);
+	else
+		synth_text(&rnd, input->message, rc->msglen);
+	input->msglen = rc->msglen;
+
+	// Further carriers of sharded cases are generated after the message, so
+	// that the first carrier is made the same way as in any other case
+	bool ok = regress_save(rc, pixels, pixlen, &image, input->carrier, input->carrierlen);
+	for (size_t i = 1; ok && i < rc->shards; i++)
+	{
+		synth_pixels(&rnd, pixels, &image);
+		ok = regress_save(rc, pixels, pixlen, &image, input->carrier + i, input->carrierlen + i);
+	}
+
+	free(pixels);
+	return ok;
+}
+
+static int32_t regress_sink(void *arg, const uint8_t *data, size_t len)
+{
+	RegressSink *sink = (RegressSink*)arg;
+	if (sink->len + len > sink->cap)
+	{
+		size_t cap = sink->cap ? sink->cap : 4096;
+		while (cap < sink->len + len)
+			cap *= 2;
+
+		uint8_t *grown = (uint8_t*)realloc(sink->data, cap);
+		if (!grown)
+			return 1;
+
+		sink->data = grown;
+		sink->cap = cap;
+	}
+
+	memcpy(sink->data + sink->len, data, len);
+	sink->len += len;
+	return 0;
+}
+
+// Encodes the message. Sharded cases start every run from fresh copies of 
+// their carriers, and the encoded size is the size of all of them.
+static StegmanResult regress_encode(StegmanContext *ctx, const RegressCase *rc, RegressInput *input, uint8_t **encoded, size_t *encodedlen)
+{
+	if (!rc->shards)
+		return stegman_encode_mem(ctx, REGRESS_PASSWORD, sizeof(REGRESS_PASSWORD) - 1, input->carrier[0], input->carrierlen[0], input->message, input->msglen, rc->type, encoded, encodedlen);
+
+	for (size_t i = 0; i < rc->shards; i++)
+	{
+		FILE *f = input->files[i];
+		if (!f || ftruncate(fileno(f), 0) || fseeko(f, 0, SEEK_SET) 
+			|| fwrite(input->carrier[i], sizeof(uint8_t), input->carrierlen[i], f) != input->carrierlen[i] 
+			|| fflush(f) || fseeko(f, 0, SEEK_SET))
+			return STEGMAN_E_IO;
+	}
+
+	StegmanResult res = stegman_encode_shards(ctx, REGRESS_PASSWORD, sizeof(REGRESS_PASSWORD) - 1, input->files, rc->shards, input->message, input->msglen, rc->type, NULL);
+	*encodedlen = 0;
+	for (size_t i = 0; res == STEGMAN_OK && i < rc->shards; i++)
+	{
+		if (fseeko(input->files[i], 0, SEEK_END))
+			return STEGMAN_E_IO;
+
+		*encodedlen += (size_t)ftello(input->files[i]);
+	}
+
+	return res;
+}
+
+static StegmanResult regress_decode(StegmanContext *ctx, const RegressCase *rc, RegressInput *input, const uint8_t *encoded, size_t encodedlen, uint8_t **message, size_t *msglen, StegmanPayload *type)
+{
+	if (!rc->shards)
+		return stegman_decode_mem(ctx, REGRESS_PASSWORD, sizeof(REGRESS_PASSWORD) - 1, encoded, encodedlen, message, msglen, type);
+
+	FILE *files[REGRESS_MAX_SHARDS];
+	size_t count = 0;
+	for (size_t i = rc->shards; i > (rc->missing ? 1 : 0); i--)
+	{
+		if (fseeko(input->files[i - 1], 0, SEEK_SET))
+			return STEGMAN_E_IO;
+
+		files[count++] = input->files[i - 1];
+	}
+
+	RegressSink sink = { NULL, 0, 0 };
+	StegmanResult res = stegman_decode_shards(ctx, REGRESS_PASSWORD, sizeof(REGRESS_PASSWORD) - 1, files, count, regress_sink, &sink, type);
+	if (res != STEGMAN_OK)
+	{
+		free(sink.data);
+		return res;
+	}
+
+	*message = sink.data;
+	*msglen = sink.len;
+	return STEGMAN_OK;
+}
+
+// Gets a timing of a case from the baseline. Every case is a single object,
+// so the stage is looked up between its name and the closing brace.
+static bool regress_baseline(const Regress *regress, const char *name, const char *stage, double *value)
+{
+	if (!regress->basedata)
+		return false;
+
+	char key[128];
+	snprintf(key, sizeof(key), "\"case\": \"%s\"", name);
+	const char *obj = strstr(regress->basedata, key);
+	if (!obj)
+		return false;
+
+	const char *end = strchr(obj, '}');
+	snprintf(key, sizeof(key), "\"%s\": ", stage);
+	const char *field = strstr(obj, key);
+	if (!field || (end && field > end))
+		return false;
+
+	return sscanf(field + strlen(key), "%lf", value) == 1;
+}
+
+// Creates a library context, with the encoding options of a case if given
+static StegmanResult regress_context(const RegressCase *rc, StegmanContext **ctx)
+{
+	StegmanOptions options;
+	stegman_default_options(&options);
+	options.reuse_key = true;
+	if (rc)
+	{
+		options.channels = rc->layout;
+		options.scatter = rc->scatter;
+		options.max_memory = rc->max_memory;
+	}
+
+	return stegman_create(&options, ctx);
+}
+
+// Checks a failed step against the result the case expects
+static bool regress_expected(const RegressCase *rc, const char *step, StegmanResult res)
+{
+	if (res == rc->expect)
+		return true;
+
+	fprintf(stderr, "%s: %s failed: %s\n", rc->name, step, stegman_strerror(res));
+	return false;
+}
+
+static void regress_compare(Regress *regress, const char *name, const char *stage, double value)
+{
+	double base = 0;
+	if (!regress_baseline(regress, name, stage, &base))
+	{
+		fprintf(stderr, "%-28s %-7s %9.4f s  (no baseline)\n", name, stage, value);
+		return;
+	}
+
+	double change = base > 0 ? (value - base) / base * 100 : 0;
+	bool regressed = value > base * (1 + regress->tolerance) && value - base > REGRESS_SLACK;
+	fprintf(stderr, "%-28s %-7s %9.4f s  baseline %9.4f s  %+6.1f%%%s\n", name, stage, value, base, change, regressed ? "  REGRESSED" : "");
+	if (regressed)
+		regress->regressions++;
+}
+
+// Times the round trip, taking the best of all runs, and checks that every 
+// decoded message matches the original
+static bool regress_case(Regress *regress, const RegressCase *rc, size_t index, bool first)
+{
+	RegressInput input;
+	memset(&input, 0, sizeof(RegressInput));
+	if (!regress_generate(rc, 0x5EED0000ULL + index, &input))
+	{
+		fprintf(stderr, "%s: could not generate the inputs\n", rc->name);
+		free(input.message);
+		return false;
+	}
+
+	double encode = 0, decode = 0;
+	uint8_t *encoded = NULL;
+	size_t encodedlen = 0;
+	bool ok = true;
+
+	for (size_t i = 0; i < rc->shards; i++)
+		input.files[i] = tmpfile();
+
+	// Cases with encoding options of their own get a separate context
+	StegmanContext *ctx = regress->ctx;
+	bool custom = rc->layout != STEGMAN_CHANNELS_ALL || rc->scatter || rc->max_memory;
+	if (custom && regress_context(rc, &ctx) != STEGMAN_OK)
+	{
+		fprintf(stderr, "%s: could not create the library context\n", rc->name);
+		ok = false;
+	}
+
+	// The first encode in a context derives the key
+	if (ok && (first || custom))
+	{
+		StegmanResult res = regress_encode(ctx, rc, &input, &encoded, &encodedlen);
+		if (res != STEGMAN_OK)
+			ok = regress_expected(rc, "encoding", res);
+	}
+
+	for (size_t run = 0; ok && run < regress->runs; run++)
+	{
+		free(encoded);
+		encoded = NULL;
+
+		double start = regress_now();
+		StegmanResult res = regress_encode(ctx, rc, &input, &encoded, &encodedlen);
+		double elapsed = regress_now() - start;
+		if (res != STEGMAN_OK)
+		{
+			ok = regress_expected(rc, "encoding", res);
+			break;
+		}
+
+		if (!run || elapsed < encode)
+			encode = elapsed;
+
+		uint8_t *message = NULL;
+		size_t msglen = 0;
+		StegmanPayload type = STEGMAN_PAYLOAD_FILE;
+		start = regress_now();
+		res = regress_decode(ctx, rc, &input, encoded, encodedlen, &message, &msglen, &type);
+		elapsed = regress_now() - start;
+		if (res != STEGMAN_OK)
+		{
+			ok = regress_expected(rc, "decoding", res);
+			break;
+		}
+
+		if (!run || elapsed < decode)
+			decode = elapsed;
+
+		if (rc->expect != STEGMAN_OK)
+		{
+			fprintf(stderr, "%s: expected a failure: %s\n", rc->name, stegman_strerror(rc->expect));
+			ok = false;
+		}
+		else if (type != rc->type || msglen != input.msglen || memcmp(message, input.message, msglen))
+		{
+			fprintf(stderr, "%s: decoded message does not match\n", rc->name);
+			ok = false;
+		}
+
+		free(message);
+	}
+
+	size_t carrierlen = 0;
+	for (size_t i = 0; i < REGRESS_MAX_SHARDS; i++)
+		carrierlen += input.carrierlen[i];
+
+	printf("%s\n    { \"case\": \"%s\", \"carrier_bytes\": %zu, \"payload_bytes\": %llu, \"encoded_bytes\": %zu, \"encode\": %.6f, \"decode\": %.6f, \"ok\": %s }", first ? "" : ",", rc->name, carrierlen, (unsigned long long)input.msglen, encodedlen, encode, decode, ok ? "true" : "false");
+	fflush(stdout);
+
+	// Failures are expected to be quick, and aren't timed against the 
+	// baseline
+	if (ok && rc->expect == STEGMAN_OK)
+	{
+		regress_compare(regress, rc->name, "encode", encode);
+		regress_compare(regress, rc->name, "decode", decode);
+	}
+
+	if (ctx != regress->ctx)
+		stegman_destroy(ctx);
+
+	for (size_t i = 0; i < REGRESS_MAX_SHARDS; i++)
+	{
+		if (input.files[i])
+			fclose(input.files[i]);
+
+		free(input.carrier[i]);
+	}
+
+	free(encoded);
+	free(input.message);
+	return ok;
+}
+
+static char *regress_read(const char *path)
+{
+	FILE *f = fopen(path, "rb");
+	if (!f)
+		return NULL;
+
+	char *text = NULL;
+	off_t len = -1;
+	if (!fseeko(f, 0, SEEK_END) && (len = ftello(f)) >= 0 && !fseeko(f, 0, SEEK_SET))
+		text = (char*)malloc((size_t)len + 1);
+
+	if (text && fread(text, sizeof(char), (size_t)len, f) != (size_t)len)
+	{
+		free(text);
+		text = NULL;
+	}
+
+	fclose(f);
+	if (text)
+		text[len] = '\0';
+
+	return text;
+}
+
+static void regress_usage(void)
+{
+	fprintf(stderr, "Usage: stegman-regress [--runs <count>] [--baseline <file>] [--tolerance <fraction>] [--quick]\n\n");
+	fprintf(stderr, "Runs full encode and decode round trips over a generated corpus, checks\n");
+	fprintf(stderr, "the decoded messages, and prints the timings as JSON. The output can be\n");
+	fprintf(stderr, "stored, and used as the baseline of later runs.\n\n");
+	fprintf(stderr, "--runs        Number of round trips per case, the best one is kept. 3 by\n");
+	fprintf(stderr, "              default.\n");
+	fprintf(stderr, "--baseline    Results of an earlier run to compare against.\n");
+	fprintf(stderr, "--tolerance   Allowed slowdown against the baseline, 0.1 (10%%) by default.\n");
+	fprintf(stderr, "--quick       Skip the largest carriers.\n\n");
+	fprintf(stderr, "Exits with 1 if a timing regressed beyond the tolerance, and with 2 if a\n");
+	fprintf(stderr, "round trip failed.\n");
+}
+
+// Entry point
+int32_t main(int argc, char **argv)
+{
+	Regress regress = { 3, 0.1, false, NULL, NULL, NULL, 0 };
+	for (int i = 1; i < argc; i++)
+	{
+		char *end = NULL;
+		if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc)
+		{
+			long runs = strtol(argv[++i], &end, 10);
+			if (*end || runs < 1)
+			{
+				regress_usage();
+				return 2;
+			}
+
+			regress.runs = (size_t)runs;
+		}
+		else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc)
+		{
+			regress.tolerance = strtod(argv[++i], &end);
+			if (*end || regress.tolerance < 0)
+			{
+				regress_usage();
+				return 2;
+			}
+		}
+		else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc)
+		{
+			regress.baseline = argv[++i];
+		}
+		else if (strcmp(argv[i], "--quick") == 0)
+		{
+			regress.quick = true;
+		}
+		else
+		{
+			regress_usage();
+			return 2;
+		}
+	}
+
+	if (regress.baseline)
+	{
+		regress.basedata = regress_read(regress.baseline);
+		if (!regress.basedata)
+		{
+			fprintf(stderr, "Could not read the baseline from %s\n", regress.baseline);
+			return 2;
+		}
+	}
+
+	// The key is derived with a random cycle count, so it's derived once by 
+	// an untimed encode and reused, to keep it from skewing the timings
+	if (regress_context(NULL, &regress.ctx) != STEGMAN_OK)
+	{
+		fprintf(stderr, "Could not create the library context\n");
+		free(regress.basedata);
+		return 2;
+	}
+
+	printf("{\n  \"program\": \"stegman-regress\",\n");
+#ifdef __BUILDINFO__
+	printf("  \"commit\": \"%ls\",\n", __GIT_COMMIT__);
+#endif
+	printf("  \"runs\": %zu,\n  \"cases\": [", regress.runs);
+
+	bool ok = true, first = true;
+	size_t count = sizeof(REGRESS_CASES) / sizeof(REGRESS_CASES[0]);
+	for (size_t i = 0; i < count; i++)
+	{
+		if (regress.quick && REGRESS_CASES[i].large)
+			continue;
+
+		ok = regress_case(&regress, REGRESS_CASES + i, i, first) && ok;
+		first = false;
+	}
+
+	printf("\n  ]\n}\n");
+
+	stegman_destroy(regress.ctx);
+	free(regress.basedata);
+
+	if (!ok)
+		return 2;
+
+	if (regress.regressions)
+	{
+		fprintf(stderr, "%zu timings regressed beyond %.0f%% of the baseline\n", regress.regressions, regress.tolerance * 100);
+		return 1;
+	}
+
+	return 0;
+}
+
+// Define C extern for C++
+#ifdef __cplusplus
+}
+#endif
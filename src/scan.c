@@ -0,0 +1,331 @@
+// This file is part of stegman project
+//
+// Copyright (c) 2018 Mateusz Brawański (Emzi0767)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Check if we're using a C99-capable compiler
+#if __STDC_VERSION__ < 199901L
+#error "You need to use a C99-capable compiler to build this program!"
+#endif
+
+// Define C extern for C++
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Appropriate headers
+#include "defs.h"
+#include "capacity.h"
+#include "job.h"
+#include "pool.h"
+#include "trace.h"
+#include "scan.h"
+
+// Standard library
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+// Constant definitions
+static const char SCAN_CARRIER[] = ".png";
+
+// Scanning mostly waits for the disk, so more threads than processors help
+const size_t SCAN_THREADS_PER_CPU = 4;
+
+// Shared state of a running scan
+typedef struct ScanState
+{
+	PoolGroup group;
+	FILE *results;
+	bool foundonly;
+
+	// Protects the results file, and the counters
+	pthread_mutex_t lock;
+	size_t found;
+	size_t failed;
+} ScanState;
+
+// Single image to scan
+typedef struct ScanTask
+{
+	ScanState *state;
+	char *path;
+} ScanTask;
+
+// Paths collected from the directory tree
+typedef struct ScanList
+{
+	char **paths;
+	size_t count;
+	size_t cap;
+} ScanList;
+
+// Helper functions
+static bool scan_is_carrier(const char *name)
+{
+	size_t len = strlen(name), extlen = sizeof(SCAN_CARRIER) - 1;
+	return len > extlen && strcasecmp(name + len - extlen, SCAN_CARRIER) == 0;
+}
+
+static void scan_add(ScanList *list, char *path)
+{
+	if (list->count == list->cap)
+	{
+		list->cap = list->cap ? list->cap * 2 : 256;
+		char **paths = (char**)realloc(list->paths, list->cap * sizeof(char*));
+		if (!paths)
+			fail(128, L"Could not allocate memory (E_SCAN_ALLOC)\n");
+
+		list->paths = paths;
+	}
+
+	list->paths[list->count++] = path;
+}
+
+static void scan_walk(ScanList *list, const char *dirpath)
+{
+	DIR *dir = opendir(dirpath);
+	if (!dir)
+	{
+		werrorf(L"Could not open directory '%s'\n", dirpath);
+		return;
+	}
+
+	struct dirent *ent;
+	while ((ent = readdir(dir)))
+	{
+		if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+			continue;
+
+		size_t len = strlen(dirpath) + strlen(ent->d_name) + 2;
+		char *path = (char*)malloc(len);
+		if (!path)
+			fail(128, L"Could not allocate memory (E_SCAN_ALLOC)\n");
+
+		snprintf(path, len, "%s/%s", dirpath, ent->d_name);
+
+		struct stat st;
+		bool isdir = false, isfile = false;
+		if (lstat(path, &st) == 0)
+		{
+			isdir = S_ISDIR(st.st_mode);
+			isfile = S_ISREG(st.st_mode) || (S_ISLNK(st.st_mode) && stat(path, &st) == 0 && S_ISREG(st.st_mode));
+		}
+
+		if (isdir)
+		{
+			scan_walk(list, path);
+			free(path);
+		}
+		else if (isfile && scan_is_carrier(ent->d_name))
+		{
+			scan_add(list, path);
+		}
+		else
+		{
+			free(path);
+		}
+	}
+
+	closedir(dir);
+}
+
+// Writes the result line, needs to be called with the lock held
+static void scan_record(ScanState *state, const char *path, int32_t res, const PayloadInfo *info)
+{
+	if (res)
+		state->failed++;
+	else if (info->found)
+		state->found++;
+
+	if (state->foundonly && (res || !info->found))
+		return;
+
+	FILE *out = state->results;
+	fprintf(out, "{\"path\":");
+	job_write_string(out, path);
+	if (res)
+	{
+		fprintf(out, ",\"status\":\"error\",\"code\":%d,\"message\":", (int)res);
+		job_write_string(out, scan_error(res));
+		fprintf(out, "}\n");
+		return;
+	}
+
+	fprintf(out, ",\"status\":\"ok\",\"width\":%lu,\"height\":%lu,\"channels\":%u,\"interlaced\":%s,\"capacity\":%llu,\"found\":%s", (unsigned long)info->image.width, (unsigned long)info->image.height, (unsigned)(info->image.bit_depth / 8), info->image.interlaced ? "true" : "false", (unsigned long long)info->capacity, info->found ? "true" : "false");
+	if (info->found)
+		fprintf(out, ",\"flags\":%d,\"cycles\":%u,\"length\":%llu", (int)info->flags, (unsigned)info->cycles, (unsigned long long)info->length);
+
+	fprintf(out, "}\n");
+}
+
+static void scan_task(void *arg)
+{
+	ScanTask *task = (ScanTask*)arg;
+	ScanState *state = task->state;
+
+	PayloadInfo info;
+	int32_t res = scan_probe(task->path, &info);
+	pthread_mutex_lock(&state->lock);
+	scan_record(state, task->path, res, &info);
+	pthread_mutex_unlock(&state->lock);
+}
+
+static void scan_usage(void)
+{
+	werrorf(L"Usage: scan <dir> [--results <file>] [--threads <count>] [--found]\n");
+}
+
+// Function definitions
+void scan_find(const char *root, char ***paths, size_t *count)
+{
+	ScanList list;
+	memset(&list, 0, sizeof(ScanList));
+	scan_walk(&list, root);
+	*paths = list.paths;
+	*count = list.count;
+}
+
+void scan_free(char **paths, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		free(paths[i]);
+	free(paths);
+}
+
+int32_t scan_probe(const char *path, PayloadInfo *info)
+{
+	trace_begin("scan", "probe");
+	int32_t res = 2;
+	FILE *png = fopen(path, "rb");
+	if (png)
+	{
+		res = capacity_payload(png, info);
+		fclose(png);
+	}
+
+	trace_end("scan", "probe");
+	return res;
+}
+
+const char *scan_error(int32_t res)
+{
+	switch (res)
+	{
+		case 2: return "Could not open the file";
+		case 16: return "Unsupported bit depth";
+		case 32: return "Unsupported colour type";
+		case 128: return "Could not read the file";
+		default: return "Not a valid PNG image";
+	}
+}
+
+int32_t scan_main(int argc, char **argv)
+{
+	if (argc < 1)
+	{
+		scan_usage();
+		return 1;
+	}
+
+	// Parse the options
+	const char *root = argv[0];
+	const char *results = NULL;
+	size_t threads = pool_cpu_count() * SCAN_THREADS_PER_CPU;
+	ScanState state;
+	memset(&state, 0, sizeof(ScanState));
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--results") == 0 && i + 1 < argc)
+		{
+			results = argv[++i];
+		}
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+		{
+			threads = strtoul(argv[++i], NULL, 10);
+		}
+		else if (strcmp(argv[i], "--found") == 0)
+		{
+			state.foundonly = true;
+		}
+		else
+		{
+			scan_usage();
+			return 1;
+		}
+	}
+
+	struct stat st;
+	if (stat(root, &st) || !S_ISDIR(st.st_mode))
+		fail(2, L"'%s' is not a directory\n", root);
+
+	// The tree is walked up front, as listing is cheap compared to probing
+	char **paths = NULL;
+	size_t count = 0;
+	scan_find(root, &paths, &count);
+	ScanTask *tasks = (ScanTask*)calloc(count ? count : 1, sizeof(ScanTask));
+	if (!tasks)
+		fail(128, L"Could not allocate memory (E_SCAN_ALLOC)\n");
+
+	state.results = results ? fopen(results, "wb") : stdout;
+	if (!state.results)
+		fail(2, L"There was an error opening '%s'\n", results);
+
+	ThreadPool *pool = NULL;
+	if (pool_create(threads, &pool))
+		fail(4, L"Could not start worker threads\n");
+
+	pthread_mutex_init(&state.lock, NULL);
+	pool_group_init(&state.group);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		ScanTask *task = tasks + i;
+		task->state = &state;
+		task->path = paths[i];
+		if (pool_submit(pool, &state.group, scan_task, task))
+			scan_task(task);
+	}
+
+	pool_group_wait(pool, &state.group);
+	pool_group_destroy(&state.group);
+	pool_destroy(pool);
+	pthread_mutex_destroy(&state.lock);
+
+	if (results)
+		fclose(state.results);
+	else
+		fflush(stdout);
+
+	free(tasks);
+	scan_free(paths, count);
+
+	werrorf(L"Scanned %lu images, %lu hold a message, %lu failed.\n", (unsigned long)count, (unsigned long)state.found, (unsigned long)state.failed);
+	return state.failed ? 1 : 0;
+}
+
+// Define C extern for C++
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,107 @@
+// This file is part of stegman project
+//
+// Copyright (c) 2018 Mateusz Brawański (Emzi0767)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/**
+ * \file
+ * \brief Fast detection of messages across a directory of carriers.
+ */
+
+// Only include once
+#pragma once
+
+// Check if we're using a C99-capable compiler
+#if __STDC_VERSION__ < 199901L
+#error "You need to use a C99-capable compiler to build this program!"
+#endif
+
+// Define C extern for C++
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Payload probing
+#include "capacity.h"
+
+/** Default number of probing threads for each processor. */
+extern const size_t SCAN_THREADS_PER_CPU;
+
+/**
+ * Collects the paths of all PNG images in a directory and its 
+ * subdirectories. Symbolic links to directories are not followed, so that 
+ * loops can't occur.
+ *
+ * \param root Directory to search.
+ * \param paths Pointer to the array of paths, each starting with the root. 
+ *              The underlying pointer will be initialized, and needs to be 
+ *              released with scan_free.
+ * \param count Pointer to the number of paths.
+ */
+void scan_find(const char *root, char ***paths, size_t *count);
+
+/**
+ * Frees paths collected by scan_find.
+ *
+ * \param paths Array of paths to free.
+ * \param count Number of paths.
+ */
+void scan_free(char **paths, size_t count);
+
+/**
+ * Checks whether an image holds a message, reading as little of it as 
+ * possible.
+ *
+ * \param path Path to the image.
+ * \param info Result of the probe.
+ *
+ * \return 0 if the operation was successful, an error code otherwise. 2 if 
+ *         the file could not be opened, error codes of capacity_payload 
+ *         otherwise.
+ */
+int32_t scan_probe(const char *path, PayloadInfo *info);
+
+/**
+ * Gets a description of an error code returned by scan_probe.
+ *
+ * \param res Error code to describe.
+ *
+ * \return Static, human-readable description.
+ */
+const char *scan_error(int32_t res);
+
+/**
+ * Scans a directory tree for PNG images holding messages, in parallel, and 
+ * writes a result record for each image as a line of JSON. Only the leading
+ * rows of each image are decompressed, so scanning is bound by reading the 
+ * files, rather than by decoding them.
+ *
+ * \param argc Number of arguments, following the mode name.
+ * \param argv Arguments following the mode name. The first is the directory.
+ *
+ * \return Exit code for the program.
+ */
+int32_t scan_main(int argc, char **argv);
+
+// Define C extern for C++
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,744 @@
+// This file is part of stegman project
+//
+// Copyright (c) 2018 Mateusz Brawański (Emzi0767)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Check if we're using a C99-capable compiler
+#if __STDC_VERSION__ < 199901L
+#error "You need to use a C99-capable compiler to build this program!"
+#endif
+
+// Define C extern for C++
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Appropriate headers
+#include "defs.h"
+#include "job.h"
+#include "serve.h"
+#include "trace.h"
+
+// Standard library
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <openssl/crypto.h>
+
+// Constant definitions
+#define SERVE_MAX_FDS 3
+static const size_t SERVE_MAX_LINE = 1024;
+static const size_t SERVE_MAX_PASSWORD = 4096;
+
+// Sources of request data
+typedef enum ServeSource
+{
+	SOURCE_NONE = 0,
+	SOURCE_INLINE,
+	SOURCE_FD
+} ServeSource;
+
+// Parsed request line
+typedef struct ServeRequest
+{
+	JobOperation op;
+	size_t passlen;
+	ServeSource carrier;
+	size_t carrierlen;
+	ServeSource payload;
+	size_t payloadlen;
+	StegmanPayload type;
+	bool hastype;
+	ServeSource output;
+} ServeRequest;
+
+// Daemon state
+typedef struct ServeState
+{
+	JobRunner *runner;
+	pthread_mutex_t lock;
+	pthread_cond_t idle;
+	struct ServeClient *clients;
+	size_t active;
+} ServeState;
+
+// Single client connection
+typedef struct ServeClient
+{
+	ServeState *state;
+	struct ServeClient *next;
+	int sock;
+
+	// Received bytes not consumed yet
+	uint8_t buf[4096];
+	size_t bufpos;
+	size_t buflen;
+
+	// Descriptors received with the current request
+	int fds[SERVE_MAX_FDS];
+	size_t fdcount;
+	size_t fdnext;
+} ServeClient;
+
+static volatile sig_atomic_t serve_stopping = 0;
+
+// Helper functions
+static void serve_signal(int sig)
+{
+	serve_stopping = 1;
+}
+
+static void client_close_fds(ServeClient *client)
+{
+	for (size_t i = client->fdnext; i < client->fdcount; i++)
+		close(client->fds[i]);
+
+	client->fdcount = 0;
+	client->fdnext = 0;
+}
+
+static int client_take_fd(ServeClient *client)
+{
+	return client->fdnext < client->fdcount ? client->fds[client->fdnext++] : -1;
+}
+
+// Receives more data, along with any passed descriptors
+static bool client_fill(ServeClient *client)
+{
+	if (client->bufpos == client->buflen)
+		client->bufpos = client->buflen = 0;
+
+	if (client->buflen == sizeof(client->buf))
+		return false;
+
+	struct iovec iov;
+	iov.iov_base = client->buf + client->buflen;
+	iov.iov_len = sizeof(client->buf) - client->buflen;
+
+	union
+	{
+		struct cmsghdr hdr;
+		char data[CMSG_SPACE(sizeof(int) * SERVE_MAX_FDS)];
+	} ctrl;
+
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = ctrl.data;
+	msg.msg_controllen = sizeof(ctrl.data);
+
+	ssize_t len = 0;
+	do
+		len = recvmsg(client->sock, &msg, 0);
+	while (len < 0 && errno == EINTR);
+
+	for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+	{
+		if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+
+		size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		int *fds = (int*)CMSG_DATA(cmsg);
+		for (size_t i = 0; i < count; i++)
+		{
+			if (client->fdcount < SERVE_MAX_FDS)
+				client->fds[client->fdcount++] = fds[i];
+			else
+				close(fds[i]);
+		}
+	}
+
+	if (len <= 0)
+		return false;
+
+	client->buflen += len;
+	return true;
+}
+
+static bool client_line(ServeClient *client, char *line, size_t cap)
+{
+	size_t len = 0;
+	while (true)
+	{
+		while (client->bufpos < client->buflen)
+		{
+			char c = (char)client->buf[client->bufpos++];
+			if (c == '\n')
+			{
+				line[len] = '\0';
+				return true;
+			}
+
+			if (len + 1 >= cap)
+				return false;
+
+			line[len++] = c;
+		}
+
+		if (!client_fill(client))
+			return false;
+	}
+}
+
+static bool client_read(ServeClient *client, uint8_t *dst, size_t len)
+{
+	size_t buffered = client->buflen - client->bufpos;
+	if (buffered > len)
+		buffered = len;
+
+	memcpy(dst, client->buf + client->bufpos, buffered);
+	client->bufpos += buffered;
+	dst += buffered;
+	len -= buffered;
+
+	while (len)
+	{
+		ssize_t got = recv(client->sock, dst, len, 0);
+		if (got < 0 && errno == EINTR)
+			continue;
+
+		if (got <= 0)
+			return false;
+
+		dst += got;
+		len -= got;
+	}
+
+	return true;
+}
+
+static bool serve_write(int fd, const uint8_t *data, size_t len, bool sock)
+{
+	while (len)
+	{
+		ssize_t sent = sock ? send(fd, data, len, MSG_NOSIGNAL) : write(fd, data, len);
+		if (sent < 0 && errno == EINTR)
+			continue;
+
+		if (sent <= 0)
+			return false;
+
+		data += sent;
+		len -= sent;
+	}
+
+	return true;
+}
+
+static bool client_reply_error(ServeClient *client, StegmanResult res, int32_t detail, const char *message)
+{
+	char line[256];
+	int len = snprintf(line, sizeof(line), "error %d %d %s\n", (int)res, (int)detail, message ? message : stegman_strerror(res));
+	if (len < 0 || (size_t)len >= sizeof(line))
+		len = sizeof(line) - 1;
+
+	return serve_write(client->sock, (const uint8_t*)line, len, true);
+}
+
+static bool client_reply_ok(ServeClient *client, const uint8_t *data, size_t len, const char *kind)
+{
+	char line[64];
+	int hlen = snprintf(line, sizeof(line), "ok %lu %s\n", (unsigned long)len, kind);
+	return serve_write(client->sock, (const uint8_t*)line, hlen, true) && serve_write(client->sock, data, len, true);
+}
+
+// Reads everything from a descriptor
+static bool serve_slurp(int fd, uint8_t **data, size_t *len)
+{
+	size_t cap = 64 * 1024, used = 0;
+	uint8_t *buf = (uint8_t*)malloc(cap);
+	if (!buf)
+		return false;
+
+	while (true)
+	{
+		if (used == cap)
+		{
+			uint8_t *buf2 = (uint8_t*)realloc(buf, cap * 2);
+			if (!buf2)
+			{
+				free(buf);
+				return false;
+			}
+
+			buf = buf2;
+			cap *= 2;
+		}
+
+		ssize_t got = read(fd, buf + used, cap - used);
+		if (got < 0 && errno == EINTR)
+			continue;
+
+		if (got < 0)
+		{
+			free(buf);
+			return false;
+		}
+
+		if (got == 0)
+			break;
+
+		used += got;
+	}
+
+	*data = buf;
+	*len = used;
+	return true;
+}
+
+static bool serve_parse_source(const char *value, ServeSource *source, size_t *len)
+{
+	if (strcmp(value, "fd") == 0)
+	{
+		*source = SOURCE_FD;
+		return true;
+	}
+
+	char *end = NULL;
+	errno = 0;
+	unsigned long long n = strtoull(value, &end, 10);
+	if (errno || !*value || *end)
+		return false;
+
+	*source = SOURCE_INLINE;
+	*len = (size_t)n;
+	return true;
+}
+
+// Parses the request line, returns NULL or a description of the problem
+static const char *serve_parse(char *line, ServeRequest *req)
+{
+	memset(req, 0, sizeof(ServeRequest));
+	char *save = NULL;
+	char *token = strtok_r(line, " ", &save);
+	if (!token)
+		return "Empty request";
+
+	if (strcmp(token, "encode") == 0)
+		req->op = JOB_ENCODE;
+	else if (strcmp(token, "decode") == 0)
+		req->op = JOB_DECODE;
+	else
+		return "Unknown operation";
+
+	bool haspass = false;
+	while ((token = strtok_r(NULL, " ", &save)))
+	{
+		char *value = strchr(token, '=');
+		if (!value)
+			return "Malformed field";
+
+		*value++ = '\0';
+		size_t unused = 0;
+		if (strcmp(token, "password") == 0)
+		{
+			char *end = NULL;
+			req->passlen = strtoul(value, &end, 10);
+			if (!*value || *end || req->passlen > SERVE_MAX_PASSWORD)
+				return "Invalid password length";
+
+			haspass = true;
+		}
+		else if (strcmp(token, "carrier") == 0)
+		{
+			if (!serve_parse_source(value, &req->carrier, &req->carrierlen))
+				return "Invalid carrier";
+		}
+		else if (strcmp(token, "payload") == 0)
+		{
+			if (!serve_parse_source(value, &req->payload, &req->payloadlen))
+				return "Invalid payload";
+		}
+		else if (strcmp(token, "output") == 0)
+		{
+			if (!serve_parse_source(value, &req->output, &unused) || req->output != SOURCE_FD)
+				return "Output can only be a descriptor";
+		}
+		else if (strcmp(token, "type") == 0)
+		{
+			if (strcmp(value, "file") == 0)
+				req->type = STEGMAN_PAYLOAD_FILE;
+			else if (strcmp(value, "text") == 0)
+				req->type = STEGMAN_PAYLOAD_TEXT;
+			else
+				return "Invalid type";
+
+			req->hastype = true;
+		}
+		else
+		{
+			return "Unknown field";
+		}
+	}
+
+	if (!haspass)
+		return "No password";
+
+	if (req->carrier == SOURCE_NONE)
+		return "No carrier";
+
+	if (req->op == JOB_ENCODE && (req->payload == SOURCE_NONE || !req->hastype))
+		return "No payload";
+
+	if (req->op == JOB_DECODE && req->payload != SOURCE_NONE)
+		return "Decoding takes no payload";
+
+	return NULL;
+}
+
+// Serves a single request, returns whether the connection can be kept
+static bool serve_request(ServeClient *client, char *line)
+{
+	ServeRequest req;
+	const char *error = serve_parse(line, &req);
+	if (error)
+	{
+		// The data following the line can't be skipped reliably
+		client_close_fds(client);
+		client_reply_error(client, STEGMAN_E_ARGUMENT, 0, error);
+		return false;
+	}
+
+	bool keep = false;
+	uint8_t *password = NULL, *wpassword = NULL, *carrier = NULL, *payload = NULL, *result = NULL;
+	size_t wpasslen = 0, payloadlen = 0, reslen = 0;
+	FILE *fcarrier = NULL, *foutput = NULL;
+	int carrierfd = req.carrier == SOURCE_FD ? client_take_fd(client) : -1;
+	int payloadfd = req.payload == SOURCE_FD ? client_take_fd(client) : -1;
+	int outputfd = req.output == SOURCE_FD ? client_take_fd(client) : -1;
+
+	// Receive the inline data
+	password = (uint8_t*)calloc(req.passlen + 1, sizeof(uint8_t));
+	if (req.carrier == SOURCE_INLINE)
+		carrier = (uint8_t*)malloc(req.carrierlen ? req.carrierlen : 1);
+	if (req.payload == SOURCE_INLINE)
+		payload = (uint8_t*)malloc(req.payloadlen ? req.payloadlen : 1);
+
+	if (!password || (req.carrier == SOURCE_INLINE && !carrier) || (req.payload == SOURCE_INLINE && !payload))
+	{
+		client_reply_error(client, STEGMAN_E_ALLOC, 0, NULL);
+		goto cleanup;
+	}
+
+	if (!client_read(client, password, req.passlen)
+		|| (carrier && !client_read(client, carrier, req.carrierlen))
+		|| (payload && !client_read(client, payload, req.payloadlen)))
+		goto cleanup;
+
+	keep = true;
+	if ((req.carrier == SOURCE_FD && carrierfd < 0) || (req.payload == SOURCE_FD && payloadfd < 0) || (req.output == SOURCE_FD && outputfd < 0))
+	{
+		keep = client_reply_error(client, STEGMAN_E_ARGUMENT, 0, "Missing file descriptor");
+		goto cleanup;
+	}
+
+	// Passwords are used the same way as by the rest of the program
+	if (memchr(password, '\0', req.passlen) || !job_widen((char*)password, &wpassword, &wpasslen))
+	{
+		keep = client_reply_error(client, STEGMAN_E_ARGUMENT, 0, "Could not convert password");
+		goto cleanup;
+	}
+
+	if (carrier)
+		fcarrier = fmemopen(carrier, req.carrierlen ? req.carrierlen : 1, "rb");
+	else
+		fcarrier = fdopen(carrierfd, "rb");
+	if (!fcarrier)
+	{
+		keep = client_reply_error(client, STEGMAN_E_IO, 0, "Could not open the carrier");
+		goto cleanup;
+	}
+
+	if (!carrier)
+		carrierfd = -1;
+
+	StegmanContext *ctx = runner_acquire(client->state->runner);
+	if (!ctx)
+	{
+		keep = client_reply_error(client, STEGMAN_E_ALLOC, 0, NULL);
+		goto cleanup;
+	}
+
+	StegmanResult res = STEGMAN_OK;
+	const char *kind = "png";
+	if (req.op == JOB_ENCODE)
+	{
+		if (payloadfd >= 0)
+		{
+			if (!serve_slurp(payloadfd, &payload, &payloadlen))
+				res = STEGMAN_E_IO;
+		}
+		else
+		{
+			payloadlen = req.payloadlen;
+		}
+
+		if (res == STEGMAN_OK)
+		{
+			char *memout = NULL;
+			size_t memoutlen = 0;
+			foutput = outputfd >= 0 ? fdopen(outputfd, "wb") : open_memstream(&memout, &memoutlen);
+			if (!foutput)
+			{
+				res = STEGMAN_E_IO;
+			}
+			else
+			{
+				if (outputfd >= 0)
+					outputfd = -1;
+
+				res = stegman_encode_copy(ctx, wpassword, wpasslen, fcarrier, foutput, payload, payloadlen, req.type);
+				if (fclose(foutput) && res == STEGMAN_OK)
+					res = STEGMAN_E_IO;
+
+				foutput = NULL;
+				result = (uint8_t*)memout;
+				reslen = memout ? memoutlen : 0;
+			}
+		}
+	}
+	else
+	{
+		StegmanPayload type = STEGMAN_PAYLOAD_FILE;
+		res = stegman_decode_file(ctx, wpassword, wpasslen, fcarrier, &result, &reslen, &type);
+		if (res == STEGMAN_OK && !job_text_utf8(&result, &reslen, &type))
+			res = STEGMAN_E_ARGUMENT;
+
+		kind = type == STEGMAN_PAYLOAD_FILE ? "file" : "text";
+		if (res == STEGMAN_OK && outputfd >= 0)
+		{
+			if (!serve_write(outputfd, result, reslen, false))
+				res = STEGMAN_E_IO;
+
+			reslen = 0;
+		}
+	}
+
+	int32_t detail = stegman_error_detail(ctx);
+	runner_release(client->state->runner, ctx);
+	if (res != STEGMAN_OK)
+		keep = client_reply_error(client, res, detail, NULL);
+	else
+		keep = client_reply_ok(client, result, req.op == JOB_ENCODE && req.output == SOURCE_FD ? 0 : reslen, kind);
+
+cleanup:
+	if (fcarrier)
+		fclose(fcarrier);
+	if (carrierfd >= 0)
+		close(carrierfd);
+	if (payloadfd >= 0)
+		close(payloadfd);
+	if (outputfd >= 0)
+		close(outputfd);
+	client_close_fds(client);
+
+	if (password)
+		OPENSSL_cleanse(password, req.passlen);
+	if (wpassword)
+		OPENSSL_cleanse(wpassword, wpasslen);
+	free(password);
+	free(wpassword);
+	free(carrier);
+	free(payload);
+	free(result);
+	return keep;
+}
+
+static void *serve_client(void *arg)
+{
+	ServeClient *client = (ServeClient*)arg;
+	ServeState *state = client->state;
+
+	trace_name_thread("client", -1);
+	char *line = (char*)malloc(SERVE_MAX_LINE);
+	while (line && client_line(client, line, SERVE_MAX_LINE))
+	{
+		trace_begin("job", "request");
+		bool keep = serve_request(client, line);
+		trace_end("job", "request");
+		if (!keep)
+			break;
+	}
+
+	free(line);
+	client_close_fds(client);
+	close(client->sock);
+
+	// Unregister the client
+	pthread_mutex_lock(&state->lock);
+	for (ServeClient **c = &state->clients; *c; c = &(*c)->next)
+	{
+		if (*c == client)
+		{
+			*c = client->next;
+			break;
+		}
+	}
+
+	if (--state->active == 0)
+		pthread_cond_broadcast(&state->idle);
+	pthread_mutex_unlock(&state->lock);
+
+	free(client);
+	return NULL;
+}
+
+static void serve_usage(void)
+{
+	werrorf(L"Usage: serve --socket <path> [--threads <count>] [--reuse-key]\n");
+}
+
+// Function definitions
+int32_t serve_main(int argc, char **argv)
+{
+	// Parse the options
+	const char *path = NULL;
+	size_t threads = 0;
+	StegmanOptions options;
+	stegman_default_options(&options);
+	for (int i = 0; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc)
+			path = argv[++i];
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			threads = strtoul(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "--reuse-key") == 0)
+			options.reuse_key = true;
+		else
+			path = NULL, i = argc;
+	}
+
+	if (!path)
+	{
+		serve_usage();
+		return 1;
+	}
+
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path))
+		fail(2, L"Socket path '%s' is too long\n", path);
+
+	strcpy(addr.sun_path, path);
+
+	// Remove a socket left behind by a previous instance
+	struct stat st;
+	if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+		unlink(path);
+
+	int lsock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (lsock < 0 || bind(lsock, (struct sockaddr*)&addr, sizeof(addr)) || listen(lsock, 64))
+		fail(2, L"Could not listen on '%s' (%d)\n", path, errno);
+
+	// Only the listening thread handles termination signals
+	sigset_t sigs, oldsigs;
+	sigemptyset(&sigs);
+	sigaddset(&sigs, SIGINT);
+	sigaddset(&sigs, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &sigs, &oldsigs);
+
+	ServeState state;
+	memset(&state, 0, sizeof(ServeState));
+	if (runner_create(threads, &options, &state.runner))
+	{
+		close(lsock);
+		unlink(path);
+		fail(4, L"Could not start worker threads\n");
+	}
+
+	pthread_mutex_init(&state.lock, NULL);
+	pthread_cond_init(&state.idle, NULL);
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = serve_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	pthread_sigmask(SIG_SETMASK, &oldsigs, NULL);
+
+	werrorf(L"Listening on '%s'.\n", path);
+	while (!serve_stopping)
+	{
+		int sock = accept(lsock, NULL, NULL);
+		if (sock < 0)
+			continue;
+
+		ServeClient *client = (ServeClient*)calloc(1, sizeof(ServeClient));
+		if (!client)
+		{
+			close(sock);
+			continue;
+		}
+
+		client->state = &state;
+		client->sock = sock;
+
+		pthread_mutex_lock(&state.lock);
+		client->next = state.clients;
+		state.clients = client;
+		state.active++;
+		pthread_mutex_unlock(&state.lock);
+
+		pthread_t thread;
+		pthread_sigmask(SIG_BLOCK, &sigs, NULL);
+		int created = pthread_create(&thread, NULL, serve_client, client);
+		pthread_sigmask(SIG_SETMASK, &oldsigs, NULL);
+		if (created)
+		{
+			client->state = &state;
+			serve_client(client);
+			continue;
+		}
+
+		pthread_detach(thread);
+	}
+
+	// Stop accepting, and let clients finish the request in progress
+	close(lsock);
+	unlink(path);
+
+	pthread_mutex_lock(&state.lock);
+	for (ServeClient *c = state.clients; c; c = c->next)
+		shutdown(c->sock, SHUT_RD);
+	while (state.active > 0)
+		pthread_cond_wait(&state.idle, &state.lock);
+	pthread_mutex_unlock(&state.lock);
+
+	runner_destroy(state.runner);
+	pthread_cond_destroy(&state.idle);
+	pthread_mutex_destroy(&state.lock);
+	werrorf(L"Stopped.\n");
+	return 0;
+}
+
+// Define C extern for C++
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,74 @@
+// This file is part of stegman project
+//
+// Copyright (c) 2018 Mateusz Brawański (Emzi0767)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/**
+ * \file
+ * \brief Daemon serving encode and decode requests over a Unix domain socket.
+ */
+
+// Only include once
+#pragma once
+
+// Check if we're using a C99-capable compiler
+#if __STDC_VERSION__ < 199901L
+#error "You need to use a C99-capable compiler to build this program!"
+#endif
+
+// Define C extern for C++
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * Listens for requests on a Unix domain socket until interrupted. Each client
+ * connection is served by its own thread, while the work itself runs on a 
+ * shared thread pool with warm library contexts.
+ *
+ * A request is a line of space-separated fields, followed by the data it 
+ * references:
+ *
+ *     encode password=<n> carrier=<n|fd> payload=<n|fd> type=<file|text> [output=fd]
+ *     decode password=<n> carrier=<n|fd> [output=fd]
+ *
+ * A number means that many bytes follow the line, in the order password, 
+ * carrier, payload. `fd` means the file descriptor was passed along with the 
+ * line using SCM_RIGHTS; descriptors are taken in the order carrier, payload,
+ * output. Passed carriers need to be seekable.
+ *
+ * Each request is answered with a line, followed by the result unless it was
+ * written to a passed output descriptor:
+ *
+ *     ok <n> <file|text|png>
+ *     error <code> <detail> <message>
+ *
+ * \param argc Number of arguments, following the mode name.
+ * \param argv Arguments following the mode name.
+ *
+ * \return Exit code for the program.
+ */
+int32_t serve_main(int argc, char **argv);
+
+// Define C extern for C++
+#ifdef __cplusplus
+}
+#endif
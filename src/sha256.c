@@ -41,6 +41,7 @@ extern "C"
 #include <openssl/rand.h>
 #include <openssl/sha.h>
 #include <openssl/err.h>
+#include <openssl/crypto.h>
 
 // Constant definitions
 const int32_t SALT_SIZE = 16;
@@ -56,6 +57,24 @@ int32_t sha_gen_salt(uint8_t salt[SALT_SIZE])
 	return 0;
 }
 
+int32_t sha_gen_cycles(uint16_t *cycles)
+{
+	uint16_t rnd = 0;
+	if (!RAND_bytes((uint8_t*)&rnd, sizeof(rnd)))
+		return ERR_get_error();
+
+	*cycles = (uint16_t)(rnd % 32768 + 32767);
+	return 0;
+}
+
+int32_t sha_digest(const uint8_t *msg, size_t len, uint8_t result[DIGEST_SIZE])
+{
+	if (!SHA256(msg, len, result))
+		return ERR_get_error();
+
+	return 0;
+}
+
 int32_t sha_hash(const uint8_t *msg, size_t len, uint8_t salt[SALT_SIZE], uint16_t cycles, uint8_t result[DIGEST_SIZE])
 {
 	uint8_t *tmp = (uint8_t*)calloc(len + SALT_SIZE, sizeof(uint8_t));
@@ -93,6 +112,8 @@ int32_t sha_hash(const uint8_t *msg, size_t len, uint8_t salt[SALT_SIZE], uint16
 		memcpy(tmp, result, DIGEST_SIZE);
 	}
 
+	// The buffer holds a copy of the key now
+	OPENSSL_cleanse(tmp, DIGEST_SIZE + SALT_SIZE);
 	free(tmp);
 	return 0;
 }
@@ -55,6 +55,27 @@ extern const int32_t DIGEST_SIZE;
  */
 int32_t sha_gen_salt(uint8_t salt[SALT_SIZE]);
 
+/**
+ * Generates a random number of hashing cycles, between 32767 and 65534, using
+ * a Cryptographically-Secure Pseudorandom Number Generator.
+ *
+ * \param cycles Pointer to the cycle count.
+ *
+ * \return 0 if the operation was successful, an error code otherwise.
+ */
+int32_t sha_gen_cycles(uint16_t *cycles);
+
+/**
+ * Computes a single SHA-256 digest of the supplied message.
+ *
+ * \param msg Message to create a digest of.
+ * \param len Length of the message.
+ * \param result The digest.
+ *
+ * \return 0 if the operation was successful, an error code otherwise.
+ */
+int32_t sha_digest(const uint8_t *msg, size_t len, uint8_t result[DIGEST_SIZE]);
+
 /**
  * Hashes the supplied message using SHA-256 algorithm, with specified salt,
  * and cycle count.
@@ -0,0 +1,93 @@
+// This file is part of stegman project
+//
+// Copyright (c) 2018 Mateusz Brawański (Emzi0767)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Check if we're using a C99-capable compiler
+#if __STDC_VERSION__ < 199901L
+#error "You need to use a C99-capable compiler to build this program!"
+#endif
+
+// Define C extern for C++
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Appropriate headers
+#include "defs.h"
+#include "spill.h"
+
+// Standard library
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+// Function definitions
+void *spill_map(size_t size)
+{
+	if (!size)
+		size = 1;
+
+	const char *dir = getenv("TMPDIR");
+	if (!dir || !dir[0])
+		dir = "/tmp";
+
+	size_t pathlen = strlen(dir) + sizeof("/stegman-XXXXXX");
+	char *path = (char*)malloc(pathlen);
+	if (!path)
+		return NULL;
+
+	snprintf(path, pathlen, "%s/stegman-XXXXXX", dir);
+	int fd = mkstemp(path);
+	if (fd < 0)
+	{
+		free(path);
+		return NULL;
+	}
+
+	// The file goes away once the mapping does
+	unlink(path);
+	free(path);
+
+	void *ptr = MAP_FAILED;
+	if (!ftruncate(fd, (off_t)size))
+		ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+	close(fd);
+	return ptr == MAP_FAILED ? NULL : ptr;
+}
+
+void spill_unmap(void *ptr, size_t size)
+{
+	if (!ptr)
+		return;
+
+	// Pages which were never touched don't need to be read back, so only the
+	// caller knows which part of the buffer needs wiping
+	munmap(ptr, size ? size : 1);
+}
+
+// Define C extern for C++
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,66 @@
+// This file is part of stegman project
+//
+// Copyright (c) 2018 Mateusz Brawański (Emzi0767)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/**
+ * \file
+ * \brief Buffers backed by temporary files, for data which doesn't fit in memory.
+ */
+
+// Only include once
+#pragma once
+
+// Check if we're using a C99-capable compiler
+#if __STDC_VERSION__ < 199901L
+#error "You need to use a C99-capable compiler to build this program!"
+#endif
+
+// Define C extern for C++
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * Maps a zero-filled buffer backed by an unlinked temporary file. The kernel 
+ * writes its pages out to the file, and drops them from memory, whenever 
+ * memory runs short. The file is created in `TMPDIR`, or `/tmp` if it's not
+ * set, which should not be a memory-backed file system.
+ *
+ * \param size Size of the buffer, in bytes.
+ *
+ * \return Pointer to the buffer, or NULL if it could not be created.
+ */
+void *spill_map(size_t size);
+
+/**
+ * Unmaps a buffer created by spill_map, which removes the file. The buffer is
+ * not wiped, callers holding sensitive data need to wipe the part they used.
+ *
+ * \param ptr Buffer to unmap. Can be NULL.
+ * \param size Size of the buffer, as given to spill_map.
+ */
+void spill_unmap(void *ptr, size_t size);
+
+// Define C extern for C++
+#ifdef __cplusplus
+}
+#endif
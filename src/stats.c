@@ -0,0 +1,139 @@
+// This file is part of stegman project
+//
+// Copyright (c) 2018 Mateusz Brawański (Emzi0767)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Check if we're using a C99-capable compiler
+#if __STDC_VERSION__ < 199901L
+#error "You need to use a C99-capable compiler to build this program!"
+#endif
+
+// Define C extern for C++
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Appropriate headers
+#include "defs.h"
+#include "stats.h"
+#include "trace.h"
+
+// Standard library
+#include <stdio.h>
+#include <string.h>
+
+// Helper functions
+static bool stats_ran(const StegmanStageStats *stage)
+{
+	return stage->nanoseconds || stage->bytes_in || stage->bytes_out;
+}
+
+static void stats_print_text(const StegmanStats *stats, const char *operation)
+{
+	fwprintf(stderr, L"\nStatistics (%s):\n%-12s %12s %16s %16s\n", operation, "Stage", "Time (ms)", "Bytes in", "Bytes out");
+	for (int32_t i = 0; i < STEGMAN_STAGE_COUNT; i++)
+	{
+		const StegmanStageStats *stage = stats->stages + i;
+		if (!stats_ran(stage))
+			continue;
+
+		fwprintf(stderr, L"%-12s %12.3f %16llu %16llu\n", stegman_stage_name((StegmanStage)i), stage->nanoseconds / 1e6, (unsigned long long)stage->bytes_in, (unsigned long long)stage->bytes_out);
+	}
+
+	fwprintf(stderr, L"%-12s %12.3f\n\n", "total", stats->nanoseconds / 1e6);
+	fwprintf(stderr, L"Arena:             %llu bytes in %llu allocations, %llu bytes at peak\n", (unsigned long long)stats->allocated, (unsigned long long)stats->allocations, (unsigned long long)stats->allocated_peak);
+	fwprintf(stderr, L"Pixel buffer:      %llu bytes\n", (unsigned long long)stats->pixel_buffer);
+	fwprintf(stderr, L"Peak RSS:          %llu bytes\n", (unsigned long long)stats->peak_rss);
+}
+
+static void stats_print_json(const StegmanStats *stats, const char *operation)
+{
+	fwprintf(stderr, L"{\"op\":\"%s\",\"total_ns\":%llu,\"stages\":{", operation, (unsigned long long)stats->nanoseconds);
+	bool first = true;
+	for (int32_t i = 0; i < STEGMAN_STAGE_COUNT; i++)
+	{
+		const StegmanStageStats *stage = stats->stages + i;
+		if (!stats_ran(stage))
+			continue;
+
+		fwprintf(stderr, L"%s\"%s\":{\"ns\":%llu,\"bytes_in\":%llu,\"bytes_out\":%llu}", first ? "" : ",", stegman_stage_name((StegmanStage)i), (unsigned long long)stage->nanoseconds, (unsigned long long)stage->bytes_in, (unsigned long long)stage->bytes_out);
+		first = false;
+	}
+
+	fwprintf(stderr, L"},\"arena_bytes\":%llu,\"arena_peak_bytes\":%llu,\"arena_allocations\":%llu,\"pixel_buffer_bytes\":%llu,\"peak_rss_bytes\":%llu}\n", (unsigned long long)stats->allocated, (unsigned long long)stats->allocated_peak, (unsigned long long)stats->allocations, (unsigned long long)stats->pixel_buffer, (unsigned long long)stats->peak_rss);
+}
+
+// Function definitions
+int32_t stats_option(int *argc, char **argv, int first, StatsFormat *format)
+{
+	const char *value = NULL;
+	*format = STATS_NONE;
+	int32_t found = take_option(argc, argv, first, "--stats", OPTION_OPTIONAL, &value);
+	if (found < 0)
+		return 1;
+
+	if (!found)
+		return 0;
+
+	if (!value || strcmp(value, "text") == 0)
+		*format = STATS_TEXT;
+	else if (strcmp(value, "json") == 0)
+		*format = STATS_JSON;
+	else
+		return 1;
+
+	return 0;
+}
+
+int32_t stats_trace_option(int *argc, char **argv, int first, const char **path)
+{
+	int32_t found = take_option(argc, argv, first, "--trace", OPTION_REQUIRED, path);
+	return found < 0 || (found > 0 && !**path) ? 1 : 0;
+}
+
+bool stats_trace_write(const char *path)
+{
+	FILE *out = fopen(path, "w");
+	bool succ = out && !trace_write(out);
+	if (out && fclose(out))
+		succ = false;
+
+	trace_stop();
+	return succ;
+}
+
+void stats_print(const StegmanContext *ctx, StatsFormat format, const char *operation)
+{
+	if (format == STATS_NONE)
+		return;
+
+	StegmanStats stats;
+	stegman_stats(ctx, &stats);
+	if (format == STATS_JSON)
+		stats_print_json(&stats, operation);
+	else
+		stats_print_text(&stats, operation);
+}
+
+// Define C extern for C++
+#ifdef __cplusplus
+}
+#endif
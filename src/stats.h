@@ -0,0 +1,110 @@
+// This file is part of stegman project
+//
+// Copyright (c) 2018 Mateusz Brawański (Emzi0767)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/**
+ * \file
+ * \brief Reporting of per-stage measurements on the command line.
+ */
+
+// Only include once
+#pragma once
+
+// Check if we're using a C99-capable compiler
+#if __STDC_VERSION__ < 199901L
+#error "You need to use a C99-capable compiler to build this program!"
+#endif
+
+// Define C extern for C++
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Library
+#include "stegman.h"
+
+/** Formats in which measurements can be reported. */
+typedef enum StatsFormat
+{
+	/** Measurements are not reported. */
+	STATS_NONE = 0,
+
+	/** Human-readable table. */
+	STATS_TEXT,
+
+	/** Single line of JSON. */
+	STATS_JSON
+} StatsFormat;
+
+/**
+ * Finds the `--stats` and `--stats=<format>` options, and removes them from
+ * the arguments, so that the remaining ones can be parsed positionally.
+ *
+ * \param argc Pointer to the number of arguments. The underlying value will
+ *             be updated.
+ * \param argv Arguments to examine.
+ * \param first Index of the first argument which can be an option.
+ * \param format Pointer to the requested format. The underlying value will 
+ *               be set to STATS_NONE if the option is absent.
+ *
+ * \return 0 if the operation was successful, an error code otherwise.
+ */
+int32_t stats_option(int *argc, char **argv, int first, StatsFormat *format);
+
+/**
+ * Finds the `--trace <file>` and `--trace=<file>` options, and removes them 
+ * from the arguments.
+ *
+ * \param argc Pointer to the number of arguments. The underlying value will
+ *             be updated.
+ * \param argv Arguments to examine.
+ * \param first Index of the first argument which can be an option.
+ * \param path Pointer to the path of the trace file. The underlying pointer 
+ *             will be set to NULL if the option is absent.
+ *
+ * \return 0 if the operation was successful, an error code otherwise.
+ */
+int32_t stats_trace_option(int *argc, char **argv, int first, const char **path);
+
+/**
+ * Writes the recorded timeline to a file, and stops recording.
+ *
+ * \param path Path of the file to write.
+ *
+ * \return Whether the operation was successful.
+ */
+bool stats_trace_write(const char *path);
+
+/**
+ * Prints the measurements of the last operation of a context to the standard
+ * error.
+ *
+ * \param ctx Context which ran the operation.
+ * \param format Format to print in. Nothing is printed for STATS_NONE.
+ * \param operation Name of the operation, such as encode or decode.
+ */
+void stats_print(const StegmanContext *ctx, StatsFormat format, const char *operation);
+
+// Define C extern for C++
+#ifdef __cplusplus
+}
+#endif
@@ -43,10 +43,15 @@ extern "C"
 
 // Constant definitions
 const int32_t STEG_MAGIC = 0x0BADFACE;
+const uint64_t STEG_HEADER_SIZE = 4 + 4 + 2 + 16 + 16 + 8;
+const uint64_t STEG_HEADER_SPAN = (4 + 4 + 2 + 16 + 16 + 8) * 16;
+const uint64_t STEG_SHARD_SIZE = 8 + 2 + 2 + 4;
+const uint64_t STEG_BLOCK_SIZE = 16;
+const int32_t STEG_CHANNELS_SHIFT = 16;
 
 // Helper functions and constants
-const uint8_t BITMASK = ~0x03;
-const uint8_t BITDATA = 0x03;
+static const uint8_t BITMASK = ~0x03;
+static const uint8_t BITDATA = 0x03;
 static inline void encode_byte(uint8_t byte, uint8_t *ptr)
 {
 	uint8_t t = byte;
@@ -66,7 +71,267 @@ static inline void decode_byte(uint8_t *ptr, uint8_t *byte)
 	*byte = t;
 }
 
+// Channel kernels. Each byte takes up 4 channel bytes of the layout. Every 
+// combination of channels and pixel size gets a kernel of its own, so that 
+// excluded channels are skipped by fixed strides, without testing each byte.
+static inline void encode_lanes(uint8_t byte, uint8_t *ptr, const uint8_t *lanes)
+{
+	for (int i = 0; i < 4; i++)
+		ptr[lanes[i]] = (ptr[lanes[i]] & BITMASK) | ((byte >> ((3 - i) * 2)) & BITDATA);
+}
+
+static inline void decode_lanes(const uint8_t *ptr, const uint8_t *lanes, uint8_t *byte)
+{
+	uint8_t t = 0;
+	for (int i = 0; i < 4; i++)
+		t |= (ptr[lanes[i]] & BITDATA) << ((3 - i) * 2);
+
+	*byte = t;
+}
+
+// A single channel, with a byte spanning 4 pixels
+static inline void encode_strided(const uint8_t *src, uint64_t len, uint8_t *cpx, const size_t stride)
+{
+	for (uint64_t i = 0; i < len; i++, cpx += stride * 4)
+	{
+		cpx[0] = (cpx[0] & BITMASK) | ((src[i] >> 6) & BITDATA);
+		cpx[stride] = (cpx[stride] & BITMASK) | ((src[i] >> 4) & BITDATA);
+		cpx[stride * 2] = (cpx[stride * 2] & BITMASK) | ((src[i] >> 2) & BITDATA);
+		cpx[stride * 3] = (cpx[stride * 3] & BITMASK) | (src[i] & BITDATA);
+	}
+}
+
+static inline void decode_strided(const uint8_t *cpx, uint64_t len, uint8_t *tgt, const size_t stride)
+{
+	for (uint64_t i = 0; i < len; i++, cpx += stride * 4)
+	{
+		tgt[i] = (uint8_t)(((cpx[0] & BITDATA) << 6) | ((cpx[stride] & BITDATA) << 4) 
+			| ((cpx[stride * 2] & BITDATA) << 2) | (cpx[stride * 3] & BITDATA));
+	}
+}
+
+// Red, green, and blue of 4-byte pixels. Every 3 bytes fill 4 pixels, and a 
+// byte starting within a group uses the lanes following the previous one.
+static const uint8_t RGB4_LANES[12] = { 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14 };
+
+static void encode_rgb4(const uint8_t *src, uint64_t len, uint64_t pos, uint8_t *base)
+{
+	for (; len && pos % 3; len--, pos++, src++)
+		encode_lanes(*src, base + pos / 3 * 16, RGB4_LANES + pos % 3 * 4);
+
+	uint8_t *cpx = base + pos / 3 * 16;
+	for (; len >= 3; len -= 3, src += 3, cpx += 16)
+	{
+		encode_lanes(src[0], cpx, RGB4_LANES);
+		encode_lanes(src[1], cpx, RGB4_LANES + 4);
+		encode_lanes(src[2], cpx, RGB4_LANES + 8);
+	}
+
+	for (uint64_t i = 0; i < len; i++)
+		encode_lanes(src[i], cpx, RGB4_LANES + i * 4);
+}
+
+static void decode_rgb4(const uint8_t *base, uint64_t pos, uint8_t *tgt, uint64_t len)
+{
+	for (; len && pos % 3; len--, pos++, tgt++)
+		decode_lanes(base + pos / 3 * 16, RGB4_LANES + pos % 3 * 4, tgt);
+
+	const uint8_t *cpx = base + pos / 3 * 16;
+	for (; len >= 3; len -= 3, tgt += 3, cpx += 16)
+	{
+		decode_lanes(cpx, RGB4_LANES, tgt);
+		decode_lanes(cpx, RGB4_LANES + 4, tgt + 1);
+		decode_lanes(cpx, RGB4_LANES + 8, tgt + 2);
+	}
+
+	for (uint64_t i = 0; i < len; i++)
+		decode_lanes(cpx, RGB4_LANES + i * 4, tgt + i);
+}
+
+// Number of content bytes the layout has room for, past the header
+static uint64_t layout_slots(const StegLayout *layout, uint64_t pixellen)
+{
+	uint64_t slots = pixellen / 4;
+	if (layout && layout->channels != STEG_CHANNELS_ALL)
+	{
+		uint64_t pixels = pixellen / layout->pixelsize;
+		slots = layout->channels == STEG_CHANNELS_RGB ? pixels * 3 / 4 : pixels / 4;
+	}
+
+	return slots > STEG_HEADER_SIZE ? slots - STEG_HEADER_SIZE : 0;
+}
+
+// Picks the kernel once for the whole range. Positions count bytes of the 
+// layout from the first pixel, so the header comes first.
+static void slots_encode(const StegLayout *layout, const uint8_t *src, uint64_t len, uint64_t pos, uint8_t *pixels)
+{
+	StegChannels channels = layout ? layout->channels : STEG_CHANNELS_ALL;
+	uint8_t *base = pixels;
+	switch (channels)
+	{
+		case STEG_CHANNELS_RGB:
+			encode_rgb4(src, len, pos, base);
+			break;
+
+		case STEG_CHANNELS_ALPHA:
+			encode_strided(src, len, base + pos * 16 + 3, 4);
+			break;
+
+		case STEG_CHANNELS_BLUE:
+			if (layout->pixelsize == 4)
+				encode_strided(src, len, base + pos * 16 + 2, 4);
+			else
+				encode_strided(src, len, base + pos * 12 + 2, 3);
+			break;
+
+		default:
+			base += pos * 4;
+			for (uint64_t i = 0; i < len; i++, base += 4)
+				encode_byte(src[i], base);
+			break;
+	}
+}
+
+static void slots_decode(const StegLayout *layout, const uint8_t *pixels, uint64_t pos, uint8_t *tgt, uint64_t len)
+{
+	StegChannels channels = layout ? layout->channels : STEG_CHANNELS_ALL;
+	const uint8_t *base = pixels;
+	switch (channels)
+	{
+		case STEG_CHANNELS_RGB:
+			decode_rgb4(base, pos, tgt, len);
+			break;
+
+		case STEG_CHANNELS_ALPHA:
+			decode_strided(base + pos * 16 + 3, len, tgt, 4);
+			break;
+
+		case STEG_CHANNELS_BLUE:
+			if (layout->pixelsize == 4)
+				decode_strided(base + pos * 16 + 2, len, tgt, 4);
+			else
+				decode_strided(base + pos * 12 + 2, len, tgt, 3);
+			break;
+
+		default:
+			base += pos * 4;
+			for (uint64_t i = 0; i < len; i++, base += 4)
+				decode_byte((uint8_t*)base, tgt + i);
+			break;
+	}
+}
+
+// Contents are placed past the header
+static void layout_encode(const StegLayout *layout, const uint8_t *src, uint64_t len, uint64_t pos, uint8_t *pixels)
+{
+	slots_encode(layout, src, len, STEG_HEADER_SIZE + pos, pixels);
+}
+
+static void layout_decode(const StegLayout *layout, const uint8_t *pixels, uint64_t pos, uint8_t *tgt, uint64_t len)
+{
+	slots_decode(layout, pixels, STEG_HEADER_SIZE + pos, tgt, len);
+}
+
+// Keyed round function of the block permutation
+static inline uint64_t traversal_mix(uint64_t x, uint64_t key)
+{
+	uint64_t z = x ^ key;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+// Checks that whole blocks within the carrier are being accessed
+static inline bool traversal_range(const StegTraversal *trav, uint64_t offset, uint64_t len, size_t pixellen)
+{
+	return !(offset % STEG_BLOCK_SIZE) && !(len % STEG_BLOCK_SIZE)
+		&& offset / STEG_BLOCK_SIZE <= trav->blocks
+		&& len / STEG_BLOCK_SIZE <= trav->blocks - offset / STEG_BLOCK_SIZE
+		&& trav->blocks * STEG_BLOCK_SIZE <= layout_slots(&trav->layout, pixellen);
+}
+
+// Decodes the header from the leading bytes of a layout, if it's there
+static bool header_decode(const StegLayout *layout, const uint8_t *pixels, size_t pixellen, StegMessage *data)
+{
+	uint8_t header[4 + 4 + 2 + 16 + 16 + 8];
+	if (pixellen < steg_layout_span(layout, 0))
+		return false;
+
+	slots_decode(layout, pixels, 0, header, STEG_HEADER_SIZE);
+	const uint8_t *ptr = header;
+	int32_t magic = 0;
+	for (int8_t i = 0; i < 4; i++)
+		magic |= (int32_t)((uint32_t)*ptr++ << (i * 8));
+
+	uint32_t flags = 0;
+	for (int8_t i = 0; i < 4; i++)
+		flags |= (uint32_t)*ptr++ << (i * 8);
+
+	// The channels are recorded in the header, and have to be the ones it 
+	// was found in
+	StegChannels channels = layout ? layout->channels : STEG_CHANNELS_ALL;
+	if (magic != STEG_MAGIC || (StegChannels)((flags & MSG_CHANNELS) >> STEG_CHANNELS_SHIFT) != channels)
+		return false;
+
+	data->flags = (StegMessageFlags)flags;
+	data->cycles = (uint16_t)(ptr[0] | (ptr[1] << 8));
+	ptr += 2;
+
+	memcpy(data->iv, ptr, IV_SIZE);
+	ptr += IV_SIZE;
+	memcpy(data->salt, ptr, SALT_SIZE);
+	ptr += SALT_SIZE;
+
+	data->length = 0;
+	for (int8_t i = 0; i < 8; i++)
+		data->length |= (uint64_t)ptr[i] << (i * 8);
+
+	return true;
+}
+
 // Function definitions
+uint64_t steg_capacity(uint64_t pixellen)
+{
+	// Each byte takes up 4 bytes of pixel data
+	uint64_t slots = pixellen / 4;
+	if (slots < STEG_HEADER_SIZE)
+		return 0;
+
+	return ((slots - STEG_HEADER_SIZE) / 16) * 16;
+}
+
+bool steg_layout_init(StegLayout *layout, StegChannels channels, uint8_t pixelsize)
+{
+	if ((pixelsize != 3 && pixelsize != 4) || channels > STEG_CHANNELS_BLUE)
+		return false;
+
+	if (channels == STEG_CHANNELS_ALPHA && pixelsize != 4)
+		return false;
+
+	// Without alpha, the colour channels are all there is
+	if (channels == STEG_CHANNELS_RGB && pixelsize == 3)
+		channels = STEG_CHANNELS_ALL;
+
+	layout->channels = channels;
+	layout->pixelsize = pixelsize;
+	return true;
+}
+
+uint64_t steg_layout_capacity(const StegLayout *layout, uint64_t pixellen)
+{
+	return layout_slots(layout, pixellen) / 16 * 16;
+}
+
+uint64_t steg_layout_span(const StegLayout *layout, uint64_t len)
+{
+	if (!layout || layout->channels == STEG_CHANNELS_ALL)
+		return (STEG_HEADER_SIZE + len) * 4;
+
+	// Lanes of the last byte, rounded up to whole pixels
+	uint64_t lanes = (STEG_HEADER_SIZE + len) * 4, perpixel = layout->channels == STEG_CHANNELS_RGB ? 3 : 1;
+	return (lanes + perpixel - 1) / perpixel * layout->pixelsize;
+}
+
 void steg_init_msg(StegMessage *msg)
 {
 	int32_t magic = STEG_MAGIC;
@@ -75,115 +340,210 @@ void steg_init_msg(StegMessage *msg)
 
 bool steg_encode(const StegMessage *data, uint8_t *pixels, size_t pixellen)
 {
-	uint8_t *cpx = pixels;
-	uint64_t ctr = 0, len = data->length;
-
+	uint64_t len = data->length;
 	if (len % 16)
 		len = ((len / 16) + 1) * 16;
 
-	// Encode magic
-	encode_byte(data->magic, cpx + (ctr++ * 4));
-	encode_byte(data->magic >> 8, cpx + (ctr++ * 4));
-	encode_byte(data->magic >> 16, cpx + (ctr++ * 4));
-	encode_byte(data->magic >> 24, cpx + (ctr++ * 4));
-
-	// Encode flags
-	encode_byte(data->flags, cpx + (ctr++ * 4));
-	encode_byte(data->flags >> 8, cpx + (ctr++ * 4));
-	encode_byte(data->flags >> 16, cpx + (ctr++ * 4));
-	encode_byte(data->flags >> 24, cpx + (ctr++ * 4));
-
-	// Encode hash cycle count
-	encode_byte(data->cycles, cpx + (ctr++ * 4));
-	encode_byte(data->cycles >> 8, cpx + (ctr++ * 4));
-
-	// Encode iv
-	for (int8_t i = 0; i < IV_SIZE; i++)
-		encode_byte(data->iv[i], cpx + (ctr++ * 4));
-
-	// Encode salt
-	for (int8_t i = 0; i < SALT_SIZE; i++)
-		encode_byte(data->salt[i], cpx + (ctr++ * 4));
-
-	// Encode length
-	encode_byte(data->length, cpx + (ctr++ * 4));
-	encode_byte(data->length >> 8, cpx + (ctr++ * 4));
-	encode_byte(data->length >> 16, cpx + (ctr++ * 4));
-	encode_byte(data->length >> 24, cpx + (ctr++ * 4));
-	encode_byte(data->length >> 32, cpx + (ctr++ * 4));
-	encode_byte(data->length >> 40, cpx + (ctr++ * 4));
-	encode_byte(data->length >> 48, cpx + (ctr++ * 4));
-	encode_byte(data->length >> 56, cpx + (ctr++ * 4));
-
-	// Encode content
-	cpx += ctr * 4;
-	uint8_t *cptr = data->contents;
-	for (uint64_t i = 0; i < len; i++)
-	{
-		encode_byte(*cptr, cpx);
+	return steg_encode_header(NULL, data, pixels, pixellen) && steg_encode_range(NULL, data->contents, len, 0, pixels, pixellen);
+}
 
-		cptr++;
-		cpx += 4;
-		if (cpx > (pixels + pixellen))
-			return false;
-	}
+bool steg_encode_header(const StegLayout *layout, const StegMessage *data, uint8_t *pixels, size_t pixellen)
+{
+	uint8_t header[4 + 4 + 2 + 16 + 16 + 8];
+	uint8_t *ptr = header;
+	if (pixellen < steg_layout_span(layout, 0))
+		return false;
+
+	// Magic, flags, and hash cycle count, stored little-endian
+	for (int8_t i = 0; i < 4; i++)
+		*ptr++ = (uint8_t)(data->magic >> (i * 8));
+	for (int8_t i = 0; i < 4; i++)
+		*ptr++ = (uint8_t)(data->flags >> (i * 8));
+	for (int8_t i = 0; i < 2; i++)
+		*ptr++ = (uint8_t)(data->cycles >> (i * 8));
 
+	// IV and salt
+	memcpy(ptr, data->iv, IV_SIZE);
+	ptr += IV_SIZE;
+	memcpy(ptr, data->salt, SALT_SIZE);
+	ptr += SALT_SIZE;
+
+	// Length
+	for (int8_t i = 0; i < 8; i++)
+		*ptr++ = (uint8_t)(data->length >> (i * 8));
+
+	slots_encode(layout, header, STEG_HEADER_SIZE, 0, pixels);
 	return true;
 }
 
-bool steg_decode(const uint8_t *pixels, size_t pixellen, StegMessage *data)
+bool steg_encode_range(const StegLayout *layout, const uint8_t *src, uint64_t len, uint64_t offset, uint8_t *pixels, size_t pixellen)
 {
-	uint8_t *cpx = pixels, *bptr = NULL;
-	uint64_t ctr = 0;
+	uint64_t slots = layout_slots(layout, pixellen);
+	if (offset > slots || len > slots - offset)
+		return false;
 
-	// Decode and verify the magic
-	int32_t magic = 0;
-	bptr = (uint8_t*)(&magic);
-	for (int8_t i = 0; i < sizeof(int32_t); i++)
-		decode_byte(cpx + (ctr++ * 4), bptr + i);
-	
-	if (magic != STEG_MAGIC)
+	layout_encode(layout, src, len, offset, pixels);
+	return true;
+}
+
+bool steg_decode_range(const StegLayout *layout, const uint8_t *pixels, size_t pixellen, uint64_t offset, uint8_t *tgt, uint64_t len)
+{
+	uint64_t slots = layout_slots(layout, pixellen);
+	if (offset > slots || len > slots - offset)
 		return false;
-	
-	// Decode message flags
-	StegMessageFlags flags = MSG_NONE;
-	bptr = (uint8_t*)(&flags);
-	for (int8_t i = 0; i < sizeof(int32_t); i++)
-		decode_byte(cpx + (ctr++ * 4), bptr + i);
-	
-	data->flags = flags;
 
-	// Decode hash cycle count
-	uint16_t hcc = 0;
-	bptr = (uint8_t*)(&hcc);
-	for (int8_t i = 0; i < sizeof(uint16_t); i++)
-		decode_byte(cpx + (ctr++ * 4), bptr + i);
-	
-	data->cycles = hcc;
+	layout_decode(layout, pixels, offset, tgt, len);
+	return true;
+}
 
-	// Decode iv
-	for (int8_t i = 0; i < IV_SIZE; i++)
-		decode_byte(cpx + (ctr++ * 4), data->iv + i);
-	
-	// Decode salt
-	for (int8_t i = 0; i < SALT_SIZE; i++)
-		decode_byte(cpx + (ctr++ * 4), data->salt + i);
-	
-	// Decode message length
-	uint64_t len = 0;
-	bptr = (uint8_t*)(&len);
-	for (int8_t i = 0; i < sizeof(uint64_t); i++)
-		decode_byte(cpx + (ctr++ * 4), bptr + i);
+bool steg_encode_shard(const StegShard *shard, uint8_t *pixels, size_t pixellen)
+{
+	// Stored little-endian, like the message header
+	uint8_t header[16] = { 0 };
+	for (int8_t i = 0; i < 8; i++)
+		header[i] = (uint8_t)(shard->id >> (i * 8));
+
+	header[8] = (uint8_t)shard->index;
+	header[9] = (uint8_t)(shard->index >> 8);
+	header[10] = (uint8_t)shard->count;
+	header[11] = (uint8_t)(shard->count >> 8);
+	return steg_encode_range(NULL, header, STEG_SHARD_SIZE, 0, pixels, pixellen);
+}
+
+bool steg_decode_shard(const uint8_t *pixels, size_t pixellen, StegShard *shard)
+{
+	uint8_t header[16];
+	if (!steg_decode_range(NULL, pixels, pixellen, 0, header, STEG_SHARD_SIZE))
+		return false;
+
+	shard->id = 0;
+	for (int8_t i = 0; i < 8; i++)
+		shard->id |= (uint64_t)header[i] << (i * 8);
 
-	data->length = len;
+	shard->index = (uint16_t)(header[8] | (header[9] << 8));
+	shard->count = (uint16_t)(header[10] | (header[11] << 8));
+	return true;
+}
+
+int32_t steg_traversal_init(StegTraversal *trav, const StegLayout *layout, const uint8_t *key, uint64_t pixellen)
+{
+	if (layout)
+		trav->layout = *layout;
+	else
+		steg_layout_init(&trav->layout, STEG_CHANNELS_ALL, 4);
+
+	// Round keys come from a hash of the key, tagged so that it's never the
+	// same as any other hash of it
+	static const char TAG[] = "stegman scatter";
+	uint8_t seed[KEY_SIZE + sizeof(TAG)];
+	uint8_t digest[DIGEST_SIZE];
+	memcpy(seed, key, KEY_SIZE);
+	memcpy(seed + KEY_SIZE, TAG, sizeof(TAG));
+	int32_t res = sha_digest(seed, sizeof(seed), digest);
+	memset(seed, 0, sizeof(seed));
+	if (res)
+		return res;
+
+	for (int8_t i = 0; i < 4; i++)
+	{
+		trav->rounds[i] = 0;
+		for (int8_t j = 0; j < 8; j++)
+			trav->rounds[i] |= (uint64_t)digest[i * 8 + j] << (j * 8);
+	}
+
+	memset(digest, 0, sizeof(digest));
+
+	// The permutation works on a power of 4 large enough to number all the 
+	// blocks, split into two halves
+	trav->blocks = steg_layout_capacity(&trav->layout, pixellen) / STEG_BLOCK_SIZE;
+	trav->halfbits = 0;
+	while (trav->halfbits < 32 && (1ULL << (trav->halfbits * 2)) < trav->blocks)
+		trav->halfbits++;
+
+	return 0;
+}
+
+uint64_t steg_traversal_block(const StegTraversal *trav, uint64_t block)
+{
+	// A Feistel network permutes the whole power of 4. Positions past the 
+	// last block are permuted again until they land on one, which keeps the
+	// mapping a permutation of the blocks. The domain is less than 4 times 
+	// the block count, so that takes few steps.
+	uint32_t half = trav->halfbits;
+	uint64_t mask = (1ULL << half) - 1;
+	do
+	{
+		uint64_t left = block >> half, right = block & mask;
+		for (int8_t i = 0; i < 4; i++)
+		{
+			uint64_t next = left ^ (traversal_mix(right, trav->rounds[i]) & mask);
+			left = right;
+			right = next;
+		}
+
+		block = (left << half) | right;
+	} while (block >= trav->blocks);
+
+	return block;
+}
+
+bool steg_encode_scattered(const StegTraversal *trav, const uint8_t *src, uint64_t len, uint64_t offset, uint8_t *pixels, size_t pixellen)
+{
+	if (!traversal_range(trav, offset, len, pixellen))
+		return false;
+
+	for (uint64_t block = offset / STEG_BLOCK_SIZE, end = block + len / STEG_BLOCK_SIZE; block < end; block++, src += STEG_BLOCK_SIZE)
+		layout_encode(&trav->layout, src, STEG_BLOCK_SIZE, steg_traversal_block(trav, block) * STEG_BLOCK_SIZE, pixels);
+
+	return true;
+}
+
+bool steg_decode_scattered(const StegTraversal *trav, const uint8_t *pixels, size_t pixellen, uint64_t offset, uint8_t *tgt, uint64_t len)
+{
+	if (!traversal_range(trav, offset, len, pixellen))
+		return false;
+
+	for (uint64_t block = offset / STEG_BLOCK_SIZE, end = block + len / STEG_BLOCK_SIZE; block < end; block++, tgt += STEG_BLOCK_SIZE)
+		layout_decode(&trav->layout, pixels, steg_traversal_block(trav, block) * STEG_BLOCK_SIZE, tgt, STEG_BLOCK_SIZE);
+
+	return true;
+}
+
+bool steg_decode_header(const uint8_t *pixels, size_t pixellen, uint8_t pixelsize, StegMessage *data)
+{
+	// The header is in the same channels as the contents, so it's looked for
+	// in every layout, starting with all channels, which older messages use
+	for (int32_t channels = STEG_CHANNELS_ALL; channels <= STEG_CHANNELS_BLUE; channels++)
+	{
+		StegLayout layout;
+		if (steg_layout_init(&layout, (StegChannels)channels, pixelsize) 
+			&& layout.channels == (StegChannels)channels 
+			&& header_decode(&layout, pixels, pixellen, data))
+			return true;
+	}
+
+	return false;
+}
+
+bool steg_decode(Arena *arena, const uint8_t *pixels, size_t pixellen, StegMessage *data)
+{
+	if (!header_decode(NULL, pixels, pixellen, data))
+		return false;
 
 	// Round to block size for decryption purposes
+	uint64_t len = data->length;
 	if (len % 16)
 		len = ((len / 16) + 1) * 16;
-	
+
+	if (len > steg_capacity(pixellen))
+		return false;
+
 	// Decode encrypted contents
-	cpx += ctr * 4;
-	data->contents = (uint8_t*)calloc(len, sizeof(uint8_t));
+	uint8_t *cpx = (uint8_t*)pixels + STEG_HEADER_SIZE * 4;
+	data->contents = (uint8_t*)arena_alloc(arena, len);
+	if (!data->contents)
+		return false;
+
 	uint8_t *cptr = data->contents;
 	for (uint64_t i = 0; i < len; i++)
 	{
@@ -39,6 +39,9 @@ extern "C"
 {
 #endif
 
+// Arena allocator
+#include "arena.h"
+
 /** Magic value, which indicates valid stegman data. */
 extern const int32_t STEG_MAGIC;
 
@@ -49,9 +52,63 @@ typedef enum StegMessageFlags
 	MSG_NONE = 0,
 
 	/** Indicates that the source message was a file. */
-	MSG_FILE = 1
+	MSG_FILE = 1,
+
+	/** Indicates that the message was compressed in independent blocks. */
+	MSG_CHUNKED = 2,
+
+	/** Indicates that the message was compressed using a preset dictionary. */
+	MSG_DICT = 4,
+
+	/** Indicates that the text message is stored as UTF-8. */
+	MSG_UTF8 = 8,
+
+	/** Indicates that the contents are one shard of a message split across 
+	 * multiple carriers. */
+	MSG_SHARD = 16,
+
+	/** Indicates that the contents are spread over the carrier in blocks, in
+	 * an order derived from the key. */
+	MSG_SCATTER = 32,
+
+	/** Bits holding the ID of the preset dictionary. */
+	MSG_DICT_ID = 0x0000FF00,
+
+	/** Bits holding the channels the contents are stored in. */
+	MSG_CHANNELS = 0x00FF0000
 } StegMessageFlags;
 
+/** Channels of each pixel which hold the message contents. */
+typedef enum StegChannels
+{
+	/** All channels, in order, regardless of pixel boundaries. */
+	STEG_CHANNELS_ALL = 0,
+
+	/** Red, green, and blue channels, leaving alpha untouched. On pixels 
+	 * without alpha, this is the same as all channels. */
+	STEG_CHANNELS_RGB = 1,
+
+	/** Alpha channel only. Only available on pixels with alpha. */
+	STEG_CHANNELS_ALPHA = 2,
+
+	/** Blue channel only. */
+	STEG_CHANNELS_BLUE = 3
+} StegChannels;
+
+/** Position of the channel selection within the message flags, in bits. */
+extern const int32_t STEG_CHANNELS_SHIFT;
+
+/** Placement of the message within the pixels. The header takes up the 
+ * leading channel bytes of the layout, and the contents follow it. */
+typedef struct StegLayout
+{
+	/** Channels holding the message. */
+	StegChannels channels;
+
+	/** Number of bytes of each pixel, 3 or 4. */
+	uint8_t pixelsize;
+} StegLayout;
+
 /** Information about the encoded message. */
 typedef struct StegMessage
 {
@@ -77,6 +134,96 @@ typedef struct StegMessage
 	uint8_t *contents;
 } StegMessage;
 
+/** Size of the message header preceding the contents, in bytes. */
+extern const uint64_t STEG_HEADER_SIZE;
+
+/** Largest amount of pixel data the message header can take up, which it 
+ * does in the alpha channel of 4-byte pixels, in bytes. */
+extern const uint64_t STEG_HEADER_SPAN;
+
+/** Size of the shard header at the start of the contents of a shard, in 
+ * bytes. It's stored unencrypted, and keeps the rest of the contents aligned 
+ * to the AES block size. */
+extern const uint64_t STEG_SHARD_SIZE;
+
+/** Position of a shard within a message split across multiple carriers. */
+typedef struct StegShard
+{
+	/** Random ID shared by all shards of a message. */
+	uint64_t id;
+
+	/** Position of the shard, starting at 0. */
+	uint16_t index;
+
+	/** Number of shards the message was split into. */
+	uint16_t count;
+} StegShard;
+
+/** Number of content bytes in a block of a scattered message. Each block 
+ * takes up 64 consecutive channel bytes of the layout, which is a cache line 
+ * when all channels are used. */
+extern const uint64_t STEG_BLOCK_SIZE;
+
+/** Key-seeded order in which the blocks of a scattered message are laid out
+ * in a carrier. Positions are computed on demand, so no table is needed. */
+typedef struct StegTraversal
+{
+	/** Placement of the contents within the pixels. */
+	StegLayout layout;
+
+	/** Number of blocks the carrier can hold. */
+	uint64_t blocks;
+
+	/** Number of bits in each half of a permuted block index. */
+	uint32_t halfbits;
+
+	/** Keys of the permutation rounds. */
+	uint64_t rounds[4];
+} StegTraversal;
+
+/**
+ * Calculates how many bytes of encrypted contents fit in a pixel array, when
+ * all channels are used. The result is a multiple of the AES block size.
+ *
+ * \param pixellen Length of the pixel array, in bytes.
+ *
+ * \return Maximum length of the contents, in bytes.
+ */
+uint64_t steg_capacity(uint64_t pixellen);
+
+/**
+ * Prepares the placement of message contents within pixels.
+ *
+ * \param layout Layout to initialize.
+ * \param channels Channels to hold the contents.
+ * \param pixelsize Number of bytes of each pixel, 3 or 4.
+ *
+ * \return Whether the channels are available on such pixels.
+ */
+bool steg_layout_init(StegLayout *layout, StegChannels channels, uint8_t pixelsize);
+
+/**
+ * Calculates how many bytes of encrypted contents fit in a pixel array with
+ * given layout. The result is a multiple of the AES block size.
+ *
+ * \param layout Placement of the contents. If NULL, all channels are used.
+ * \param pixellen Length of the pixel array, in bytes.
+ *
+ * \return Maximum length of the contents, in bytes.
+ */
+uint64_t steg_layout_capacity(const StegLayout *layout, uint64_t pixellen);
+
+/**
+ * Calculates how much pixel data, from the start of the pixel array, holds 
+ * the header and contents of given length.
+ *
+ * \param layout Placement of the contents. If NULL, all channels are used.
+ * \param len Length of the contents, in bytes.
+ *
+ * \return Length of the pixel data, in bytes.
+ */
+uint64_t steg_layout_span(const StegLayout *layout, uint64_t len);
+
 /**
  * Initializes given StegMessage with proper constants.
  *
@@ -95,16 +242,153 @@ void steg_init_msg(StegMessage *msg);
  */
 bool steg_encode(const StegMessage *data, uint8_t *pixels, size_t pixellen);
 
+/**
+ * Encodes only the header of the message in the supplied pixel array. The
+ * contents are left untouched.
+ *
+ * \param layout Placement of the message. If NULL, all channels are used. 
+ *               The channels have to match the ones recorded in the flags.
+ * \param data Message data to encode the header of.
+ * \param pixels Pixels to encode the header in.
+ * \param pixellen Length of the pixel array.
+ *
+ * \return Whether the operation succeded.
+ */
+bool steg_encode_header(const StegLayout *layout, const StegMessage *data, uint8_t *pixels, size_t pixellen);
+
+/**
+ * Encodes bytes at given position of the message contents in the supplied 
+ * pixel array.
+ *
+ * \param layout Placement of the contents. If NULL, all channels are used.
+ * \param src Bytes to encode.
+ * \param len Number of bytes to encode.
+ * \param offset Position within the contents to encode the bytes at.
+ * \param pixels Pixels to encode the bytes in.
+ * \param pixellen Length of the pixel array.
+ *
+ * \return Whether the bytes fit in the pixel array.
+ */
+bool steg_encode_range(const StegLayout *layout, const uint8_t *src, uint64_t len, uint64_t offset, uint8_t *pixels, size_t pixellen);
+
+/**
+ * Decodes bytes at given position of the message contents from the supplied
+ * pixel array.
+ *
+ * \param layout Placement of the contents. If NULL, all channels are used.
+ * \param pixels Pixels to decode the bytes from.
+ * \param pixellen Length of the pixel array.
+ * \param offset Position within the contents to decode the bytes from.
+ * \param tgt Buffer for the decoded bytes.
+ * \param len Number of bytes to decode.
+ *
+ * \return Whether the bytes were within the pixel array.
+ */
+bool steg_decode_range(const StegLayout *layout, const uint8_t *pixels, size_t pixellen, uint64_t offset, uint8_t *tgt, uint64_t len);
+
+/**
+ * Encodes a shard header at the start of the message contents.
+ *
+ * \param shard Shard header to encode.
+ * \param pixels Pixels to encode the header in.
+ * \param pixellen Length of the pixel array.
+ *
+ * \return Whether the header fits in the pixel array.
+ */
+bool steg_encode_shard(const StegShard *shard, uint8_t *pixels, size_t pixellen);
+
+/**
+ * Decodes a shard header from the start of the message contents.
+ *
+ * \param pixels Pixels to decode the header from.
+ * \param pixellen Length of the pixel array.
+ * \param shard Pointer to the decoded header.
+ *
+ * \return Whether the header was within the pixel array.
+ */
+bool steg_decode_shard(const uint8_t *pixels, size_t pixellen, StegShard *shard);
+
+/**
+ * Prepares the block order of a scattered message for a pixel array.
+ *
+ * \param trav Traversal to initialize.
+ * \param layout Placement of the contents. If NULL, all channels are used.
+ * \param key Key the message is encrypted with, `KEY_SIZE` bytes long. The
+ *            order is derived from its hash, never from the key itself.
+ * \param pixellen Length of the pixel array, in bytes.
+ *
+ * \return 0 if the operation was successful, an error code otherwise.
+ */
+int32_t steg_traversal_init(StegTraversal *trav, const StegLayout *layout, const uint8_t *key, uint64_t pixellen);
+
+/**
+ * Gets the position of a block of a scattered message in the carrier.
+ *
+ * \param trav Traversal to use.
+ * \param block Index of the block within the contents.
+ *
+ * \return Index of the block within the carrier.
+ */
+uint64_t steg_traversal_block(const StegTraversal *trav, uint64_t block);
+
+/**
+ * Encodes whole blocks of a scattered message in the supplied pixel array. 
+ * Bytes are sequential within each block.
+ *
+ * \param trav Traversal of the pixel array.
+ * \param src Bytes to encode.
+ * \param len Number of bytes to encode, a multiple of `STEG_BLOCK_SIZE`.
+ * \param offset Position within the contents to encode the bytes at, a 
+ *               multiple of `STEG_BLOCK_SIZE`.
+ * \param pixels Pixels to encode the bytes in.
+ * \param pixellen Length of the pixel array.
+ *
+ * \return Whether the bytes fit in the pixel array.
+ */
+bool steg_encode_scattered(const StegTraversal *trav, const uint8_t *src, uint64_t len, uint64_t offset, uint8_t *pixels, size_t pixellen);
+
+/**
+ * Decodes whole blocks of a scattered message from the supplied pixel array.
+ *
+ * \param trav Traversal of the pixel array.
+ * \param pixels Pixels to decode the bytes from.
+ * \param pixellen Length of the pixel array.
+ * \param offset Position within the contents to decode the bytes from, a 
+ *               multiple of `STEG_BLOCK_SIZE`.
+ * \param tgt Buffer for the decoded bytes.
+ * \param len Number of bytes to decode, a multiple of `STEG_BLOCK_SIZE`.
+ *
+ * \return Whether the bytes were within the pixel array.
+ */
+bool steg_decode_scattered(const StegTraversal *trav, const uint8_t *pixels, size_t pixellen, uint64_t offset, uint8_t *tgt, uint64_t len);
+
+/**
+ * Decodes only the header of the message from the supplied pixel array. The
+ * contents are left untouched. Every layout the pixels allow is tried, and 
+ * the header is only accepted in the channels recorded in its flags.
+ *
+ * \param pixels Pixels to decode the header from.
+ * \param pixellen Length of the pixel array. Only the first 
+ *                 `STEG_HEADER_SPAN` bytes are examined.
+ * \param pixelsize Number of bytes of each pixel, 3 or 4.
+ * \param data Pointer to the structure with decoded data.
+ *
+ * \return Whether a valid header was found.
+ */
+bool steg_decode_header(const uint8_t *pixels, size_t pixellen, uint8_t pixelsize, StegMessage *data);
+
 /**
  * Decodes data from the supplied pixel array.
  *
+ * \param arena Arena to allocate the message contents from. If NULL, the 
+ *              contents are allocated on the heap.
  * \param pixels Pixels to decode the data from.
  * \param pixellen Length of the decoded pixel array.
  * \param data Pointer to the structure with decoded data.
  *
  * \return Whether the operation succeeded.
  */
-bool steg_decode(const uint8_t *pixels, size_t pixellen, StegMessage *data);
+bool steg_decode(Arena *arena, const uint8_t *pixels, size_t pixellen, StegMessage *data);
 
 // Define C extern for C++
 #ifdef __cplusplus
@@ -0,0 +1,2027 @@
+// This file is part of stegman project
+//
+// Copyright (c) 2018 Mateusz Brawański (Emzi0767)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Check if we're using a C99-capable compiler
+#if __STDC_VERSION__ < 199901L
+#error "You need to use a C99-capable compiler to build this program!"
+#endif
+
+// Define C extern for C++
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Appropriate headers
+#include "defs.h"
+#include "aes.h"
+#include "sha256.h"
+#include "zlib.h"
+#include "png.h"
+#include "steg.h"
+#include "pool.h"
+#include "arena.h"
+#include "dict.h"
+#include "capacity.h"
+#include "stegman.h"
+#include "trace.h"
+#include "spill.h"
+#include "context.h"
+
+// Standard library
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <openssl/crypto.h>
+
+// Carriers with more pixel data than this are encoded in bands of rows, 
+// instead of being loaded whole
+static const uint64_t BAND_MIN_PIXELS = 256 * 1024 * 1024;
+
+// Amount of pixel data passed through at a time while encoding in bands
+static const size_t BAND_SIZE = 16 * 1024 * 1024;
+
+// Smallest part of a scattered message embedded or extracted by one task
+static const uint64_t SCATTER_MIN_SPAN = 256 * 1024;
+
+// Memory taken by libraries, thread stacks, and small buffers, which a memory 
+// budget can't control. Of the rest, half goes to pixels, and a quarter to 
+// other buffers.
+static const uint64_t BUDGET_OVERHEAD = 16 * 1024 * 1024;
+
+struct StegmanContext
+{
+	// Options the context was created with
+	StegmanOptions options;
+
+	// Worker threads, which might be shared with other contexts
+	ThreadPool *pool;
+	bool ownspool;
+
+	// Buffers of the current operation, wiped and reused by the next one
+	Arena *arena;
+
+	// Underlying error code of the last failure
+	int32_t detail;
+
+	// Most recently derived key, identified by password digest, salt, and 
+	// cycle count
+	bool haskey;
+	uint8_t keypass[32];
+	uint8_t keysalt[16];
+	uint16_t keycycles;
+	uint8_t key[32];
+
+	// Pixel buffer, reused between operations
+	uint8_t *pixels;
+	size_t pixelcap;
+
+	// Pixel buffer backed by a temporary file, for the current operation
+	uint8_t *spill;
+	size_t spilllen;
+
+	// Measurements of the last operation
+	StegmanStats stats;
+};
+
+// Key derivation stage
+typedef struct KeyTask
+{
+	const uint8_t *password;
+	size_t passlen;
+	const uint8_t *salt;
+	uint16_t cycles;
+	uint8_t *key;
+	int32_t res;
+	uint64_t ns;
+} KeyTask;
+
+// Key derivation stage of the decoder, which is started by the loader as 
+// soon as the rows containing the message header are decoded
+typedef struct HeaderTask
+{
+	StegmanContext *ctx;
+	ThreadPool *pool;
+	PoolGroup *group;
+	const uint8_t *passdigest;
+	bool checked;
+	bool found;
+	uint64_t needed;
+	StegMessage smsg;
+	KeyTask key;
+} HeaderTask;
+
+// Carrier loading stage. When encoding in bands, only the leading rows are 
+// loaded, and the reader is kept open for the rest.
+typedef struct LoadTask
+{
+	FILE *png;
+	uint8_t *pixels;
+	size_t pixelcap;
+	size_t pixelcount;
+	PngImageInfo pnginf;
+	int32_t res;
+	HeaderTask *header;
+	uint32_t headrows;
+	uint32_t bandrows;
+	PngReader *reader;
+	uint64_t ns;
+	uint64_t readlen;
+} LoadTask;
+
+// Compression stage
+typedef struct CompressTask
+{
+	ThreadPool *pool;
+	Arena *arena;
+	const uint8_t *message;
+	size_t msglen;
+	bool text;
+	bool chunked;
+	DictionaryId dictid;
+	uint8_t *data;
+	uint64_t datalen;
+	int32_t res;
+	uint64_t ns;
+} CompressTask;
+
+// Helper functions
+static inline uint64_t max(uint64_t a, uint64_t b)
+{
+	return a > b ? a : b;
+}
+
+static inline uint64_t min(uint64_t a, uint64_t b)
+{
+	return a < b ? a : b;
+}
+
+static StegmanResult fail_with(StegmanContext *ctx, StegmanResult res, int32_t detail)
+{
+	ctx->detail = detail;
+	return res;
+}
+
+static uint64_t stats_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Current position of a stream, used to count bytes read and written
+static uint64_t stats_position(FILE *f)
+{
+	off_t pos = ftello(f);
+	return pos > 0 ? (uint64_t)pos : 0;
+}
+
+static void stats_add(StegmanContext *ctx, StegmanStage stage, uint64_t ns, uint64_t in, uint64_t out)
+{
+	StegmanStageStats *st = ctx->stats.stages + stage;
+	st->nanoseconds += ns;
+	st->bytes_in += in;
+	st->bytes_out += out;
+}
+
+// Marks the start of a stage on the timeline, and starts measuring it
+static uint64_t stage_begin(StegmanStage stage)
+{
+	trace_begin("stage", stegman_stage_name(stage));
+	return stats_now();
+}
+
+static uint64_t stage_end(StegmanStage stage, uint64_t start)
+{
+	uint64_t ns = stats_now() - start;
+	trace_end("stage", stegman_stage_name(stage));
+	return ns;
+}
+
+static void task_derive_key(void *arg)
+{
+	KeyTask *task = (KeyTask*)arg;
+
+	// Create the AES key by hashing the password using SHA-256
+	uint64_t start = stage_begin(STEGMAN_STAGE_KEY);
+	task->res = sha_hash(task->password, task->passlen, (uint8_t*)task->salt, task->cycles, task->key);
+	task->ns = stage_end(STEGMAN_STAGE_KEY, start);
+}
+
+// Checks whether the cached key was derived from given parameters
+static bool key_cached(const StegmanContext *ctx, const uint8_t *passdigest, const uint8_t *salt, uint16_t cycles)
+{
+	return ctx->haskey
+		&& ctx->keycycles == cycles
+		&& !memcmp(ctx->keypass, passdigest, DIGEST_SIZE)
+		&& (!salt || !memcmp(ctx->keysalt, salt, SALT_SIZE));
+}
+
+static void header_check(HeaderTask *task, const uint8_t *pixels, size_t loaded, uint8_t pixelsize)
+{
+	task->checked = true;
+	task->found = steg_decode_header(pixels, loaded, pixelsize, &task->smsg);
+	if (!task->found)
+		return;
+
+	// Pixel data holding the header and the padded contents. Scattered 
+	// contents can be anywhere in the carrier.
+	StegLayout layout;
+	StegChannels channels = (StegChannels)((task->smsg.flags & MSG_CHANNELS) >> STEG_CHANNELS_SHIFT);
+	uint64_t len = task->smsg.length;
+	bool known = steg_layout_init(&layout, channels, pixelsize) && !(task->smsg.flags & MSG_SCATTER);
+	task->needed = known && len < UINT64_MAX / 16 - STEG_HEADER_SIZE - 16 ? steg_layout_span(&layout, (len + 15) / 16 * 16) : UINT64_MAX;
+
+	// Derive the key while the rest of the image is still being loaded
+	if (key_cached(task->ctx, task->passdigest, task->smsg.salt, task->smsg.cycles))
+	{
+		memcpy(task->key.key, task->ctx->key, KEY_SIZE);
+		return;
+	}
+
+	task->key.salt = task->smsg.salt;
+	task->key.cycles = task->smsg.cycles;
+	if (pool_submit(task->pool, task->group, task_derive_key, &task->key))
+		task_derive_key(&task->key);
+}
+
+static bool load_progress(void *arg, const uint8_t *pixels, size_t loaded)
+{
+	LoadTask *load = (LoadTask*)arg;
+	HeaderTask *task = load->header;
+	if (!task || loaded < STEG_HEADER_SPAN)
+		return true;
+
+	if (!task->checked)
+		header_check(task, pixels, loaded, load->pnginf.bit_depth / 8);
+
+	// Rows past the end of the message are never needed, so loading stops as
+	// soon as they are reached
+	return task->found && loaded < task->needed;
+}
+
+// Loads the leading rows of the carrier, and leaves the reader open. The 
+// buffer is large enough to hold a band of rows later on.
+static int32_t load_head(LoadTask *task)
+{
+	int32_t res = png_reader_open(task->png, &task->reader, &task->pnginf);
+	if (res)
+		return res;
+
+	size_t rowsize = png_row_size(&task->pnginf);
+	size_t len = rowsize * max(task->headrows, task->bandrows);
+	if (task->pixelcap < len)
+	{
+		free(task->pixels);
+		task->pixels = (uint8_t*)malloc(len);
+		task->pixelcap = task->pixels ? len : 0;
+		if (!task->pixels)
+			return 128;
+	}
+
+	task->pixelcount = rowsize * task->headrows;
+	return png_reader_rows(task->reader, task->pixels, task->headrows);
+}
+
+static void task_load_carrier(void *arg)
+{
+	LoadTask *task = (LoadTask*)arg;
+	uint64_t start = stage_begin(STEGMAN_STAGE_PNG_LOAD);
+	uint64_t pos = stats_position(task->png);
+	if (task->headrows)
+		task->res = load_head(task);
+	else
+		task->res = png_load_pixels_progress(task->png, &task->pixels, &task->pixelcap, &task->pixelcount, &task->pnginf, load_progress, task);
+	task->readlen = stats_position(task->png) - pos;
+	task->ns = stage_end(STEGMAN_STAGE_PNG_LOAD, start);
+}
+
+static void load_init(LoadTask *task, StegmanContext *ctx, FILE *png, HeaderTask *header)
+{
+	memset(task, 0, sizeof(LoadTask));
+	task->png = png;
+	task->pixels = ctx->pixels;
+	task->pixelcap = ctx->pixelcap;
+	task->header = header;
+}
+
+static void load_finish(LoadTask *task, StegmanContext *ctx)
+{
+	// Keep the buffer for the next operation, unless it's backed by a file
+	if (ctx->spill && task->pixels == ctx->spill)
+		return;
+
+	ctx->pixels = task->pixels;
+	ctx->pixelcap = task->pixelcap;
+}
+
+// Memory available to the operation's own buffers, or 0 without a budget
+static uint64_t budget_available(const StegmanContext *ctx)
+{
+	return ctx->options.max_memory > BUDGET_OVERHEAD ? ctx->options.max_memory - BUDGET_OVERHEAD : 0;
+}
+
+static bool budget_too_small(const StegmanContext *ctx)
+{
+	return ctx->options.max_memory && ctx->options.max_memory <= BUDGET_OVERHEAD;
+}
+
+// Loads the pixels into a buffer backed by a temporary file. The context's 
+// own buffer is released, so that it doesn't count against the budget.
+static StegmanResult load_spill(StegmanContext *ctx, LoadTask *task, size_t len)
+{
+	free(ctx->pixels);
+	ctx->pixels = NULL;
+	ctx->pixelcap = 0;
+
+	ctx->spill = (uint8_t*)spill_map(len);
+	if (!ctx->spill)
+		return STEGMAN_E_ALLOC;
+
+	ctx->spilllen = len;
+	task->pixels = ctx->spill;
+	task->pixelcap = len;
+	return STEGMAN_OK;
+}
+
+// Plans decoding within the memory budget. Only the rows holding the message 
+// are loaded, but the buffer has to be large enough for the whole carrier.
+static StegmanResult load_plan_decode(StegmanContext *ctx, LoadTask *task)
+{
+	uint64_t budget = budget_available(ctx);
+	if (!budget)
+		return STEGMAN_OK;
+
+	CapacityInfo cap;
+	int32_t res = capacity_probe(task->png, 0, STEG_CHANNELS_ALL, &cap);
+	if (res)
+		return fail_with(ctx, STEGMAN_E_PNG_LOAD, res);
+
+	return cap.pixellen > budget / 2 ? load_spill(ctx, task, cap.pixellen) : STEGMAN_OK;
+}
+
+// Plans banded encoding of large carriers. Only the rows which can hold the
+// largest possible message are loaded up front, while the message is being 
+// compressed. Interlaced carriers, and carriers of scattered messages, can 
+// only be loaded whole. Under a memory budget, carriers which don't fit are 
+// encoded in bands as well, and rows which still don't fit are backed by a 
+// temporary file.
+static StegmanResult load_plan(StegmanContext *ctx, LoadTask *task, const CapacityInfo *cap, const StegLayout *layout)
+{
+	uint64_t budget = budget_available(ctx);
+	uint64_t pixelbudget = budget / 2;
+	bool fits = !budget || cap->pixellen <= pixelbudget;
+	if (cap->image.interlaced || ctx->options.scatter || (cap->pixellen < BAND_MIN_PIXELS && fits))
+		return fits ? STEGMAN_OK : load_spill(ctx, task, cap->pixellen);
+
+	// Each band has to fit, or the carrier can't be encoded at all
+	size_t rowsize = png_row_size(&cap->image);
+	uint64_t bandsize = budget ? min(BAND_SIZE, pixelbudget / 4) : BAND_SIZE;
+	if (budget && rowsize > bandsize)
+		return STEGMAN_E_MEMORY;
+
+	uint64_t needed = steg_layout_span(layout, cap->maxlen);
+	task->headrows = (uint32_t)min(needed / rowsize + 1, cap->image.height);
+	task->bandrows = (uint32_t)min(max(bandsize / rowsize, 1), cap->image.height);
+
+	size_t len = rowsize * max(task->headrows, task->bandrows);
+	return budget && len > pixelbudget ? load_spill(ctx, task, len) : STEGMAN_OK;
+}
+
+// Copies a finished image back into the carrier it was read from
+static StegmanResult save_copy(StegmanContext *ctx, FILE *src, FILE *tgt)
+{
+	uint8_t *buf = (uint8_t*)arena_alloc(ctx->arena, ZLIB_STREAM_SIZE);
+	if (!buf || fflush(src) || fseeko(src, 0, SEEK_SET))
+		return STEGMAN_E_IO;
+
+	size_t read = 0;
+	while ((read = fread(buf, sizeof(uint8_t), ZLIB_STREAM_SIZE, src)) > 0)
+		if (fwrite(buf, sizeof(uint8_t), read, tgt) != read)
+			return STEGMAN_E_IO;
+
+	return ferror(src) ? STEGMAN_E_IO : STEGMAN_OK;
+}
+
+// Writes the leading rows holding the message, followed by the rest of the 
+// carrier, passed through one band at a time
+static StegmanResult save_bands(StegmanContext *ctx, LoadTask *task, FILE *out)
+{
+	// Reading and writing are interleaved, but measured as separate stages
+	uint64_t start = stage_begin(STEGMAN_STAGE_PNG_SAVE), readns = 0;
+	uint64_t inpos = stats_position(task->png), outpos = stats_position(out);
+	size_t rowsize = png_row_size(&task->pnginf);
+
+	PngWriter *writer = NULL;
+	int32_t res = png_writer_open(out, &task->pnginf, &writer);
+	if (res)
+	{
+		stage_end(STEGMAN_STAGE_PNG_SAVE, start);
+		return fail_with(ctx, STEGMAN_E_PNG_SAVE, res);
+	}
+
+	res = png_writer_rows(writer, task->pixels, task->headrows);
+	for (uint32_t row = task->headrows; !res && row < task->pnginf.height; row += task->bandrows)
+	{
+		uint32_t count = (uint32_t)min(task->bandrows, task->pnginf.height - row);
+		uint64_t readstart = stage_begin(STEGMAN_STAGE_PNG_LOAD);
+		res = png_reader_rows(task->reader, task->pixels, count);
+		readns += stage_end(STEGMAN_STAGE_PNG_LOAD, readstart);
+		if (res)
+		{
+			png_writer_abort(writer);
+			stage_end(STEGMAN_STAGE_PNG_SAVE, start);
+			return fail_with(ctx, STEGMAN_E_PNG_LOAD, res);
+		}
+
+		res = png_writer_rows(writer, task->pixels, count);
+	}
+
+	if (res)
+		png_writer_abort(writer);
+	else
+		res = png_writer_finish(writer);
+
+	uint64_t ns = stage_end(STEGMAN_STAGE_PNG_SAVE, start);
+	if (res)
+		return fail_with(ctx, STEGMAN_E_PNG_SAVE, res);
+
+	uint64_t loaded = (uint64_t)(task->pnginf.height - task->headrows) * rowsize;
+	stats_add(ctx, STEGMAN_STAGE_PNG_LOAD, readns, stats_position(task->png) - inpos, loaded);
+	stats_add(ctx, STEGMAN_STAGE_PNG_SAVE, ns - readns, (uint64_t)task->pnginf.height * rowsize, stats_position(out) - outpos);
+	return STEGMAN_OK;
+}
+
+// Saves a carrier encoded in bands. The carrier is still being read, so an 
+// in-place encode goes through a temporary file.
+static StegmanResult save_banded(StegmanContext *ctx, LoadTask *task, FILE *in, FILE *out)
+{
+	FILE *tmp = out == in ? tmpfile() : out;
+	if (!tmp)
+		return STEGMAN_E_IO;
+
+	StegmanResult res = save_bands(ctx, task, tmp);
+	png_reader_close(task->reader);
+	task->reader = NULL;
+
+	if (res == STEGMAN_OK && tmp != out)
+	{
+		fflush(out);
+		fseeko(out, 0, SEEK_SET);
+		res = ftruncate(fileno(out), 0) ? STEGMAN_E_IO : save_copy(ctx, tmp, out);
+	}
+
+	if (tmp != out)
+		fclose(tmp);
+
+	return res;
+}
+
+static void task_compress(void *arg)
+{
+	CompressTask *task = (CompressTask*)arg;
+	uint64_t start = stage_begin(STEGMAN_STAGE_COMPRESS);
+
+	// Large messages are compressed in parallel blocks
+	task->chunked = task->msglen > ZLIB_CHUNK_SIZE;
+	if (task->chunked)
+		task->res = zlib_compress_chunked(task->pool, task->arena, task->message, task->msglen, &task->data, &task->datalen);
+	else
+		task->res = zlib_compress(task->arena, task->message, task->msglen, &task->data, &task->datalen);
+
+	// Short text messages might compress better using a preset dictionary
+	task->dictid = DICT_NONE;
+	if (!task->res && task->text && task->msglen <= DICT_MAX_MESSAGE)
+	{
+		const uint8_t *dict = NULL;
+		size_t dictlen = 0;
+		uint8_t *ddata = NULL;
+		uint64_t ddatalen = 0;
+		if (!dict_get(DICT_TEXT_UTF8, &dict, &dictlen) && !zlib_compress_dict(task->arena, task->message, task->msglen, dict, dictlen, &ddata, &ddatalen))
+		{
+			if (ddatalen < task->datalen)
+			{
+				arena_free(task->arena, task->data);
+				task->data = ddata;
+				task->datalen = ddatalen;
+				task->dictid = DICT_TEXT_UTF8;
+			}
+			else
+			{
+				arena_free(task->arena, ddata);
+			}
+		}
+	}
+
+	task->ns = stage_end(STEGMAN_STAGE_COMPRESS, start);
+}
+
+static void key_store(StegmanContext *ctx, const uint8_t *passdigest, const uint8_t *salt, uint16_t cycles, const uint8_t *key)
+{
+	memcpy(ctx->keypass, passdigest, DIGEST_SIZE);
+	memcpy(ctx->keysalt, salt, SALT_SIZE);
+	memcpy(ctx->key, key, KEY_SIZE);
+	ctx->keycycles = cycles;
+	ctx->haskey = true;
+}
+
+// Part of a scattered message, embedded or extracted on a worker
+typedef struct ScatterTask
+{
+	const StegTraversal *trav;
+	uint8_t *contents;
+	uint64_t offset;
+	uint64_t len;
+	uint8_t *pixels;
+	size_t pixellen;
+	bool encode;
+	bool done;
+} ScatterTask;
+
+static void task_scatter(void *arg)
+{
+	ScatterTask *task = (ScatterTask*)arg;
+	if (task->encode)
+		task->done = steg_encode_scattered(task->trav, task->contents + task->offset, task->len, task->offset, task->pixels, task->pixellen);
+	else
+		task->done = steg_decode_scattered(task->trav, task->pixels, task->pixellen, task->offset, task->contents + task->offset, task->len);
+}
+
+// Embeds or extracts the padded contents of a scattered message. Block 
+// positions are computed as they're needed, so the contents are simply split 
+// into one span per worker.
+static StegmanResult scatter_run(StegmanContext *ctx, const StegLayout *layout, const uint8_t *key, uint8_t *contents, uint64_t len, uint8_t *pixels, size_t pixellen, bool encode)
+{
+	StegTraversal trav;
+	int32_t res = steg_traversal_init(&trav, layout, key, pixellen);
+	if (res)
+		return fail_with(ctx, STEGMAN_E_KEY, res);
+
+	uint64_t blocks = len / STEG_BLOCK_SIZE;
+	uint64_t count = min(pool_size(ctx->pool), max(len / SCATTER_MIN_SPAN, 1));
+	ScatterTask *tasks = (ScatterTask*)arena_alloc(ctx->arena, count * sizeof(ScatterTask));
+	if (!tasks)
+		return STEGMAN_E_ALLOC;
+
+	PoolGroup group;
+	pool_group_init(&group);
+	for (uint64_t i = 0; i < count; i++)
+	{
+		uint64_t first = blocks * i / count, last = blocks * (i + 1) / count;
+		ScatterTask task = { &trav, contents, first * STEG_BLOCK_SIZE, (last - first) * STEG_BLOCK_SIZE, pixels, pixellen, encode, false };
+		tasks[i] = task;
+		if (pool_submit(ctx->pool, &group, task_scatter, tasks + i))
+			task_scatter(tasks + i);
+	}
+	pool_group_wait(ctx->pool, &group);
+	pool_group_destroy(&group);
+	memset(&trav, 0, sizeof(StegTraversal));
+
+	for (uint64_t i = 0; i < count; i++)
+	{
+		if (!tasks[i].done)
+			return encode ? STEGMAN_E_CAPACITY : STEGMAN_E_NO_MESSAGE;
+	}
+
+	return STEGMAN_OK;
+}
+
+// Key material of a new message. The key and password digest live in the 
+// arena, so that they're wiped with everything else.
+typedef struct EncodeSecrets
+{
+	uint8_t salt[16];
+	uint8_t iv[16];
+	uint16_t cycles;
+	uint8_t *key;
+	uint8_t *passdigest;
+
+	// Whether the key of the previous message was reused, and doesn't need 
+	// to be derived
+	bool haskey;
+} EncodeSecrets;
+
+// Generates the IV, along with a new salt and cycle count, unless the 
+// previous key can be reused
+static StegmanResult encode_secrets(StegmanContext *ctx, const uint8_t *password, size_t passlen, EncodeSecrets *secrets)
+{
+	secrets->key = (uint8_t*)arena_alloc(ctx->arena, KEY_SIZE);
+	secrets->passdigest = (uint8_t*)arena_alloc(ctx->arena, DIGEST_SIZE);
+	if (!secrets->key || !secrets->passdigest)
+		return STEGMAN_E_ALLOC;
+
+	// Generate IV
+	int32_t res = aes_gen_iv(secrets->iv);
+	if (res)
+		return fail_with(ctx, STEGMAN_E_RANDOM, res);
+
+	// Reuse the previous salt and key if allowed, otherwise generate new ones
+	secrets->cycles = 0;
+	res = sha_digest(password, passlen, secrets->passdigest);
+	if (res)
+		return fail_with(ctx, STEGMAN_E_KEY, res);
+
+	secrets->haskey = ctx->options.reuse_key && key_cached(ctx, secrets->passdigest, NULL, ctx->keycycles);
+	if (secrets->haskey)
+	{
+		memcpy(secrets->salt, ctx->keysalt, SALT_SIZE);
+		memcpy(secrets->key, ctx->key, KEY_SIZE);
+		secrets->cycles = ctx->keycycles;
+		return STEGMAN_OK;
+	}
+
+	res = sha_gen_salt(secrets->salt);
+	if (!res)
+		res = sha_gen_cycles(&secrets->cycles);
+	if (res)
+		return fail_with(ctx, STEGMAN_E_RANDOM, res);
+
+	return STEGMAN_OK;
+}
+
+// Prepends the magic value to the compressed message, encrypts it, and fills
+// in the message header. The length of the encrypted contents, which are 
+// padded to the AES block size, is returned separately.
+static StegmanResult encode_encrypt(StegmanContext *ctx, const EncodeSecrets *secrets, const CompressTask *comptask, StegmanPayload type, StegMessage *smsg, uint64_t *contentlen)
+{
+	uint64_t start = stage_begin(STEGMAN_STAGE_ENCRYPT);
+	uint32_t isize = sizeof(int32_t);
+	uint8_t *data2 = (uint8_t*)arena_alloc(ctx->arena, comptask->datalen + isize);
+	if (!data2)
+	{
+		stage_end(STEGMAN_STAGE_ENCRYPT, start);
+		return STEGMAN_E_ALLOC;
+	}
+
+	memcpy(data2 + isize, comptask->data, comptask->datalen);
+	*((int32_t*)data2) = STEG_MAGIC;
+	uint64_t data2len = comptask->datalen + isize;
+
+	// Encrypt the data
+	uint8_t *data = NULL;
+	uint64_t datalen = 0;
+	uint8_t iv2[IV_SIZE];
+	memcpy(iv2, secrets->iv, IV_SIZE * sizeof(uint8_t));
+	int32_t res = aes_encrypt(ctx->arena, data2, data2len, secrets->key, iv2, &data, &datalen);
+	uint64_t ns = stage_end(STEGMAN_STAGE_ENCRYPT, start);
+	if (res)
+		return fail_with(ctx, STEGMAN_E_ENCRYPT, res);
+
+	stats_add(ctx, STEGMAN_STAGE_ENCRYPT, ns, data2len, datalen);
+
+	// Prepare steganographic data
+	smsg->flags = (type == STEGMAN_PAYLOAD_FILE ? MSG_FILE : MSG_UTF8) | (comptask->chunked ? MSG_CHUNKED : 0);
+	if (comptask->dictid != DICT_NONE)
+		smsg->flags |= MSG_DICT | ((comptask->dictid << DICT_ID_SHIFT) & MSG_DICT_ID);
+	smsg->cycles = secrets->cycles;
+	memcpy(smsg->iv, secrets->iv, IV_SIZE);
+	memcpy(smsg->salt, secrets->salt, SALT_SIZE);
+	smsg->length = data2len;
+	smsg->contents = data;
+	*contentlen = datalen;
+	return STEGMAN_OK;
+}
+
+// Runs the encoder. Intermediate buffers come from the context's arena, so 
+// they are released all at once by the caller, along with the carrier 
+// reader.
+static StegmanResult encode_stream(StegmanContext *ctx, const uint8_t *password, size_t passlen, FILE *in, FILE *out, const uint8_t *message, size_t msglen, StegmanPayload type, LoadTask *loadtask)
+{
+	if (budget_too_small(ctx))
+		return STEGMAN_E_MEMORY;
+
+	// Reject carriers which are too small before doing any expensive work
+	CapacityInfo cap;
+	int32_t res = capacity_probe(in, msglen, (StegChannels)ctx->options.channels, &cap);
+	if (res)
+		return fail_with(ctx, STEGMAN_E_PNG_LOAD, res);
+
+	StegLayout layout;
+	if (!cap.available || !steg_layout_init(&layout, (StegChannels)ctx->options.channels, cap.image.bit_depth / 8))
+		return STEGMAN_E_CHANNELS;
+
+	uint64_t capacity = cap.capacity;
+	if (cap.minlen > capacity)
+		return STEGMAN_E_CAPACITY;
+
+	// Pick how to load the carrier before doing any expensive work, as well
+	StegmanResult sres = load_plan(ctx, loadtask, &cap, &layout);
+	if (sres != STEGMAN_OK)
+		return sres;
+
+	EncodeSecrets secrets;
+	sres = encode_secrets(ctx, password, passlen, &secrets);
+	if (sres != STEGMAN_OK)
+		return sres;
+
+	// Derive the key, load the carrier, and compress the message concurrently.
+	// Without a pool, the stages simply run one after another. Only the 
+	// compression stage, which runs on this thread, uses the arena.
+	bool haskey = secrets.haskey;
+	KeyTask keytask = { password, passlen, secrets.salt, secrets.cycles, secrets.key, 0 };
+	CompressTask comptask = { ctx->pool, ctx->arena, message, msglen, type != STEGMAN_PAYLOAD_FILE, false, DICT_NONE, NULL, 0, 0 };
+
+	PoolGroup group;
+	pool_group_init(&group);
+	if (!haskey && pool_submit(ctx->pool, &group, task_derive_key, &keytask))
+		task_derive_key(&keytask);
+	if (pool_submit(ctx->pool, &group, task_load_carrier, loadtask))
+		task_load_carrier(loadtask);
+	task_compress(&comptask);
+	pool_group_wait(ctx->pool, &group);
+	pool_group_destroy(&group);
+	load_finish(loadtask, ctx);
+
+	if (!haskey)
+		stats_add(ctx, STEGMAN_STAGE_KEY, keytask.ns, passlen, KEY_SIZE);
+	stats_add(ctx, STEGMAN_STAGE_COMPRESS, comptask.ns, msglen, comptask.datalen);
+	stats_add(ctx, STEGMAN_STAGE_PNG_LOAD, loadtask->ns, loadtask->readlen, loadtask->pixelcount);
+
+	uint64_t datalen = comptask.datalen;
+	uint8_t *pixels = loadtask->pixels;
+	uint64_t pixelcount = loadtask->pixelcount;
+
+	if (comptask.res)
+		return fail_with(ctx, STEGMAN_E_COMPRESS, comptask.res);
+
+	if (keytask.res)
+		return fail_with(ctx, STEGMAN_E_KEY, keytask.res);
+
+	if (!haskey)
+		key_store(ctx, secrets.passdigest, secrets.salt, secrets.cycles, secrets.key);
+
+	if (loadtask->res)
+		return fail_with(ctx, STEGMAN_E_PNG_LOAD, loadtask->res);
+
+	// Check if enough space. When encoding in bands, the loaded rows have 
+	// room for the message whenever the whole carrier does.
+	if (capacity_content_length(datalen) > capacity)
+		return STEGMAN_E_CAPACITY;
+
+	StegMessage smsg;
+	steg_init_msg(&smsg);
+	sres = encode_encrypt(ctx, &secrets, &comptask, type, &smsg, &datalen);
+	if (sres != STEGMAN_OK)
+		return sres;
+
+	// Steganographically encode the data in the selected channels, spreading
+	// it over the whole carrier if asked to
+	smsg.flags |= (StegMessageFlags)(layout.channels << STEG_CHANNELS_SHIFT);
+	if (ctx->options.scatter)
+		smsg.flags |= MSG_SCATTER;
+
+	uint64_t start = stage_begin(STEGMAN_STAGE_EMBED);
+	bool embedded = steg_encode_header(&layout, &smsg, pixels, pixelcount);
+	if (embedded && ctx->options.scatter)
+		sres = scatter_run(ctx, &layout, secrets.key, smsg.contents, datalen, pixels, pixelcount, true);
+	else if (embedded)
+		embedded = steg_encode_range(&layout, smsg.contents, datalen, 0, pixels, pixelcount);
+	uint64_t ns = stage_end(STEGMAN_STAGE_EMBED, start);
+	if (!embedded)
+		return STEGMAN_E_CAPACITY;
+
+	if (sres != STEGMAN_OK)
+		return sres;
+
+	stats_add(ctx, STEGMAN_STAGE_EMBED, ns, STEG_HEADER_SIZE + datalen, steg_layout_span(&layout, datalen));
+
+	if (loadtask->reader)
+		return save_banded(ctx, loadtask, in, out);
+
+	// Write the PNG, replacing the original if writing in-place
+	if (out == in)
+	{
+		fflush(out);
+		fseek(out, 0L, SEEK_SET);
+		if (ftruncate(fileno(out), 0L))
+			return STEGMAN_E_IO;
+	}
+
+	start = stage_begin(STEGMAN_STAGE_PNG_SAVE);
+	uint64_t outpos = stats_position(out);
+	res = png_save_pixels(pixels, pixelcount, &loadtask->pnginf, out);
+	bool flushed = !res && !fflush(out);
+	ns = stage_end(STEGMAN_STAGE_PNG_SAVE, start);
+	if (res)
+		return fail_with(ctx, STEGMAN_E_PNG_SAVE, res);
+
+	if (!flushed)
+		return STEGMAN_E_IO;
+
+	stats_add(ctx, STEGMAN_STAGE_PNG_SAVE, ns, pixelcount, stats_position(out) - outpos);
+	return STEGMAN_OK;
+}
+
+// Decrypts the contents of a message, and checks the magic value preceding
+// the compressed data
+static StegmanResult decode_contents(StegmanContext *ctx, const uint8_t *contents, uint64_t length, const uint8_t *key, const uint8_t *iv, uint8_t **content, uint64_t *contentlen)
+{
+	uint8_t *data = NULL;
+	uint64_t datalen = 0;
+	uint8_t iv2[IV_SIZE];
+	memcpy(iv2, iv, IV_SIZE * sizeof(uint8_t));
+	uint64_t start = stage_begin(STEGMAN_STAGE_DECRYPT);
+	int32_t res = aes_decrypt(ctx->arena, contents, length, key, iv2, &data, &datalen);
+	uint64_t ns = stage_end(STEGMAN_STAGE_DECRYPT, start);
+	if (res)
+		return fail_with(ctx, STEGMAN_E_DECRYPT, res);
+
+	stats_add(ctx, STEGMAN_STAGE_DECRYPT, ns, length, datalen);
+
+	// Check if header matches
+	size_t isize = sizeof(int32_t);
+	if (datalen < isize || *((int32_t*)data) != STEG_MAGIC)
+		return STEGMAN_E_PASSWORD;
+
+	*content = data + isize;
+	*contentlen = datalen - isize;
+	return STEGMAN_OK;
+}
+
+// Finds the message in the carrier, and decrypts it. The decrypted data, 
+// following the magic, is allocated from the context's arena.
+static StegmanResult decode_decrypt(StegmanContext *ctx, const uint8_t *password, size_t passlen, FILE *in, uint8_t **content, uint64_t *contentlen, StegMessageFlags *flags)
+{
+	int32_t res = 0;
+	if (budget_too_small(ctx))
+		return STEGMAN_E_MEMORY;
+
+	// Key material lives in the arena, so that it's wiped with everything else
+	uint8_t *key = (uint8_t*)arena_alloc(ctx->arena, KEY_SIZE);
+	uint8_t *passdigest = (uint8_t*)arena_alloc(ctx->arena, DIGEST_SIZE);
+	if (!key || !passdigest)
+		return STEGMAN_E_ALLOC;
+
+	res = sha_digest(password, passlen, passdigest);
+	if (res)
+		return fail_with(ctx, STEGMAN_E_KEY, res);
+
+	// Load the PNG data in the background. The key is derived as soon as the
+	// header is loaded.
+	PoolGroup group;
+	pool_group_init(&group);
+
+	HeaderTask headertask;
+	memset(&headertask, 0, sizeof(HeaderTask));
+	headertask.ctx = ctx;
+	headertask.pool = ctx->pool;
+	headertask.group = &group;
+	headertask.passdigest = passdigest;
+	headertask.key.password = password;
+	headertask.key.passlen = passlen;
+	headertask.key.key = key;
+
+	LoadTask loadtask;
+	load_init(&loadtask, ctx, in, &headertask);
+	StegmanResult sres = load_plan_decode(ctx, &loadtask);
+	if (sres != STEGMAN_OK)
+	{
+		pool_group_destroy(&group);
+		return sres;
+	}
+
+	if (pool_submit(ctx->pool, &group, task_load_carrier, &loadtask))
+		task_load_carrier(&loadtask);
+
+	pool_group_wait(ctx->pool, &group);
+	pool_group_destroy(&group);
+	load_finish(&loadtask, ctx);
+
+	uint8_t *pixels = loadtask.pixels;
+	uint64_t pixelcount = loadtask.pixelcount;
+	stats_add(ctx, STEGMAN_STAGE_PNG_LOAD, loadtask.ns, loadtask.readlen, pixelcount);
+	if (loadtask.res)
+		return fail_with(ctx, STEGMAN_E_PNG_LOAD, loadtask.res);
+
+	StegMessage smsg;
+	steg_init_msg(&smsg);
+	bool haskey = headertask.found;
+	res = headertask.key.res;
+
+	// Decode the steganographic message header
+	uint64_t start = stage_begin(STEGMAN_STAGE_EXTRACT);
+	bool found = steg_decode_header(pixels, pixelcount, loadtask.pnginf.bit_depth / 8, &smsg);
+	uint64_t ns = stage_end(STEGMAN_STAGE_EXTRACT, start);
+	if (!found)
+		return STEGMAN_E_NO_MESSAGE;
+
+	// A single shard doesn't hold a whole message
+	if (smsg.flags & MSG_SHARD)
+		return STEGMAN_E_SHARD;
+
+	// The padded contents are in the channels the encoder picked
+	StegLayout layout;
+	StegChannels channels = (StegChannels)((smsg.flags & MSG_CHANNELS) >> STEG_CHANNELS_SHIFT);
+	uint64_t len = (smsg.length + 15) / 16 * 16;
+	if (!steg_layout_init(&layout, channels, loadtask.pnginf.bit_depth / 8) || smsg.length > UINT64_MAX - 15 || len > steg_layout_capacity(&layout, pixelcount))
+		return STEGMAN_E_NO_MESSAGE;
+
+	smsg.contents = (uint8_t*)arena_alloc(ctx->arena, len);
+	if (!smsg.contents)
+		return STEGMAN_E_ALLOC;
+
+	// Scattered contents can only be located once the key is known
+	bool scatter = smsg.flags & MSG_SCATTER;
+	if (!scatter)
+	{
+		start = stage_begin(STEGMAN_STAGE_EXTRACT);
+		steg_decode_range(&layout, pixels, pixelcount, 0, smsg.contents, len);
+		ns += stage_end(STEGMAN_STAGE_EXTRACT, start);
+		stats_add(ctx, STEGMAN_STAGE_EXTRACT, ns, steg_layout_span(&layout, len), STEG_HEADER_SIZE + len);
+	}
+
+	// Create the AES key, unless it was created while loading
+	if (haskey)
+	{
+		stats_add(ctx, STEGMAN_STAGE_KEY, headertask.key.ns, passlen, KEY_SIZE);
+	}
+	else
+	{
+		start = stage_begin(STEGMAN_STAGE_KEY);
+		res = sha_hash(password, passlen, smsg.salt, smsg.cycles, key);
+		stats_add(ctx, STEGMAN_STAGE_KEY, stage_end(STEGMAN_STAGE_KEY, start), passlen, KEY_SIZE);
+	}
+
+	if (res)
+		return fail_with(ctx, STEGMAN_E_KEY, res);
+
+	if (scatter)
+	{
+		start = stage_begin(STEGMAN_STAGE_EXTRACT);
+		sres = scatter_run(ctx, &layout, key, smsg.contents, len, pixels, pixelcount, false);
+		stats_add(ctx, STEGMAN_STAGE_EXTRACT, ns + stage_end(STEGMAN_STAGE_EXTRACT, start), steg_layout_span(&layout, len), STEG_HEADER_SIZE + len);
+		if (sres != STEGMAN_OK)
+			return sres;
+	}
+
+	key_store(ctx, passdigest, smsg.salt, smsg.cycles, key);
+
+	sres = decode_contents(ctx, smsg.contents, smsg.length, key, smsg.iv, content, contentlen);
+	*flags = smsg.flags;
+	return sres;
+}
+
+static StegmanPayload decode_type(StegMessageFlags flags)
+{
+	if (flags & MSG_FILE)
+		return STEGMAN_PAYLOAD_FILE;
+	else if (flags & MSG_UTF8)
+		return STEGMAN_PAYLOAD_TEXT;
+	else
+		return STEGMAN_PAYLOAD_TEXT_WCHAR;
+}
+
+// Finds the preset dictionary a message was compressed with, if any
+static StegmanResult decode_dictionary(StegmanContext *ctx, StegMessageFlags flags, const uint8_t **dict, size_t *dictlen)
+{
+	if ((flags & MSG_CHUNKED) || !(flags & MSG_DICT))
+		return STEGMAN_OK;
+
+	DictionaryId dictid = (DictionaryId)((flags & MSG_DICT_ID) >> DICT_ID_SHIFT);
+	if (dict_get(dictid, dict, dictlen))
+		return fail_with(ctx, STEGMAN_E_DICTIONARY, dictid);
+
+	return STEGMAN_OK;
+}
+
+// Runs the decoder. Intermediate buffers come from the context's arena, only
+// the resulting message is allocated on the heap.
+static StegmanResult decode_stream(StegmanContext *ctx, const uint8_t *password, size_t passlen, FILE *in, uint8_t **message, size_t *msglen, StegmanPayload *type)
+{
+	uint8_t *data = NULL;
+	uint64_t datalen = 0;
+	StegMessageFlags flags = MSG_NONE;
+	StegmanResult sres = decode_decrypt(ctx, password, passlen, in, &data, &datalen, &flags);
+	if (sres != STEGMAN_OK)
+		return sres;
+
+	const uint8_t *dict = NULL;
+	size_t dictlen = 0;
+	StegmanResult dres = decode_dictionary(ctx, flags, &dict, &dictlen);
+	if (dres != STEGMAN_OK)
+		return dres;
+
+	// Decompress the data straight into the heap buffer returned to the caller
+	int32_t res = 0;
+	uint64_t start = stage_begin(STEGMAN_STAGE_DECOMPRESS);
+	uint8_t *data2 = NULL;
+	uint64_t data2len = 0;
+	if (flags & MSG_CHUNKED)
+		res = zlib_decompress_chunked(ctx->pool, NULL, data, datalen, &data2, &data2len);
+	else if (dict)
+		res = zlib_decompress_dict(NULL, data, datalen, dict, dictlen, &data2, &data2len);
+	else
+		res = zlib_decompress(NULL, data, datalen, &data2, &data2len);
+
+	uint64_t ns = stage_end(STEGMAN_STAGE_DECOMPRESS, start);
+	if (res)
+		return fail_with(ctx, STEGMAN_E_DECOMPRESS, res);
+
+	stats_add(ctx, STEGMAN_STAGE_DECOMPRESS, ns, datalen, data2len);
+
+	// Terminate the message, so text can be used as a string directly
+	uint8_t *msg = (uint8_t*)realloc(data2, data2len + sizeof(wchar_t));
+	if (!msg)
+	{
+		free(data2);
+		return STEGMAN_E_ALLOC;
+	}
+
+	memset(msg + data2len, 0, sizeof(wchar_t));
+	*message = msg;
+	*msglen = data2len;
+	*type = decode_type(flags);
+
+	return STEGMAN_OK;
+}
+
+// Sink counting the bytes handed to the caller's sink
+typedef struct CountingSink
+{
+	StegmanSink sink;
+	void *arg;
+	uint64_t written;
+} CountingSink;
+
+static int32_t sink_count(void *arg, const uint8_t *data, size_t len)
+{
+	CountingSink *sink = (CountingSink*)arg;
+	sink->written += len;
+	return sink->sink(sink->arg, data, len);
+}
+
+// Translates the result of decompressing into a sink
+static StegmanResult decompress_result(StegmanContext *ctx, int32_t res)
+{
+	if (res == 128)
+		return STEGMAN_E_IO;
+
+	if (res)
+		return fail_with(ctx, STEGMAN_E_DECOMPRESS, res);
+
+	return STEGMAN_OK;
+}
+
+// Decompresses decrypted contents, handing them to a sink
+static StegmanResult decode_sink_contents(StegmanContext *ctx, const uint8_t *data, uint64_t datalen, StegMessageFlags flags, StegmanSink sink, void *arg, StegmanPayload *type)
+{
+	// The kind of message is known before any of it is handed over
+	*type = decode_type(flags);
+
+	const uint8_t *dict = NULL;
+	size_t dictlen = 0;
+	StegmanResult sres = decode_dictionary(ctx, flags, &dict, &dictlen);
+	if (sres != STEGMAN_OK)
+		return sres;
+
+	// Time spent in the sink is included in the decompression stage
+	int32_t res = 0;
+	uint64_t start = stage_begin(STEGMAN_STAGE_DECOMPRESS);
+	CountingSink counter = { sink, arg, 0 };
+	if (flags & MSG_CHUNKED)
+		res = zlib_decompress_chunked_stream(ctx->pool, ctx->arena, data, datalen, sink_count, &counter);
+	else
+		res = zlib_decompress_stream(ctx->arena, data, datalen, dict, dictlen, sink_count, &counter);
+
+	stats_add(ctx, STEGMAN_STAGE_DECOMPRESS, stage_end(STEGMAN_STAGE_DECOMPRESS, start), datalen, counter.written);
+	return decompress_result(ctx, res);
+}
+
+// Runs the decoder, handing the message to a sink as it's decompressed, 
+// instead of collecting it in memory
+static StegmanResult decode_sink_stream(StegmanContext *ctx, const uint8_t *password, size_t passlen, FILE *in, StegmanSink sink, void *arg, StegmanPayload *type)
+{
+	uint8_t *data = NULL;
+	uint64_t datalen = 0;
+	StegMessageFlags flags = MSG_NONE;
+	StegmanResult sres = decode_decrypt(ctx, password, passlen, in, &data, &datalen, &flags);
+	if (sres != STEGMAN_OK)
+		return sres;
+
+	return decode_sink_contents(ctx, data, datalen, flags, sink, arg, type);
+}
+
+// Single carrier of a message split across multiple carriers. Each carrier 
+// is loaded, embedded or extracted, and written on a worker of its own.
+typedef struct ShardTask
+{
+	FILE *png;
+
+	// Message header, shared by all shards, except for the length
+	StegMessage header;
+	StegShard shard;
+	bool found;
+
+	// Piece of the encrypted contents held by the shard, and its length 
+	// rounded up to the AES block size
+	uint8_t *contents;
+	uint64_t piecelen;
+
+	// Number of content bytes the carrier can hold, following the shard 
+	// header
+	uint64_t capacity;
+
+	StegmanResult sres;
+	int32_t res;
+	uint64_t loadns;
+	uint64_t embedns;
+	uint64_t savens;
+	uint64_t readlen;
+	uint64_t pixelcount;
+	uint64_t written;
+} ShardTask;
+
+static uint64_t shard_padded(uint64_t len)
+{
+	return (len + 15) / 16 * 16;
+}
+
+static void shard_fail(ShardTask *task, StegmanResult sres, int32_t res)
+{
+	task->sres = sres;
+	task->res = res;
+}
+
+static bool shard_progress(void *arg, const uint8_t *pixels, size_t loaded)
+{
+	const ShardTask *task = (const ShardTask*)arg;
+	return loaded < (STEG_HEADER_SIZE + STEG_SHARD_SIZE + task->piecelen) * 4;
+}
+
+// Loads the carrier, embeds the shard, and writes the carrier back in-place
+static void task_shard_embed(void *arg)
+{
+	ShardTask *task = (ShardTask*)arg;
+	uint8_t *pixels = NULL;
+	size_t pixellen = 0;
+	PngImageInfo pnginf;
+
+	uint64_t start = stage_begin(STEGMAN_STAGE_PNG_LOAD);
+	int32_t res = fseeko(task->png, 0, SEEK_SET) ? 128 : png_load_pixels(task->png, &pixels, &pixellen, &pnginf);
+	task->readlen = stats_position(task->png);
+	task->pixelcount = pixellen;
+	task->loadns = stage_end(STEGMAN_STAGE_PNG_LOAD, start);
+	if (res)
+		return shard_fail(task, STEGMAN_E_PNG_LOAD, res);
+
+	start = stage_begin(STEGMAN_STAGE_EMBED);
+	bool embedded = steg_encode_header(NULL, &task->header, pixels, pixellen)
+		&& steg_encode_shard(&task->shard, pixels, pixellen)
+		&& steg_encode_range(NULL, task->contents, task->piecelen, STEG_SHARD_SIZE, pixels, pixellen);
+	task->embedns = stage_end(STEGMAN_STAGE_EMBED, start);
+	if (!embedded)
+	{
+		free(pixels);
+		return shard_fail(task, STEGMAN_E_CAPACITY, 0);
+	}
+
+	start = stage_begin(STEGMAN_STAGE_PNG_SAVE);
+	fflush(task->png);
+	if (fseeko(task->png, 0, SEEK_SET) || ftruncate(fileno(task->png), 0))
+		res = -1;
+	else
+		res = png_save_pixels(pixels, pixellen, &pnginf, task->png);
+
+	bool flushed = !res && !fflush(task->png);
+	task->written = stats_position(task->png);
+	task->savens = stage_end(STEGMAN_STAGE_PNG_SAVE, start);
+	free(pixels);
+	if (res > 0)
+		shard_fail(task, STEGMAN_E_PNG_SAVE, res);
+	else if (!flushed)
+		shard_fail(task, STEGMAN_E_IO, 0);
+}
+
+// Reads the message and shard headers from the leading rows of the carrier
+static void task_shard_probe(void *arg)
+{
+	ShardTask *task = (ShardTask*)arg;
+	uint8_t *pixels = NULL;
+	size_t pixellen = 0;
+	PngImageInfo pnginf;
+
+	uint64_t start = stage_begin(STEGMAN_STAGE_PNG_LOAD);
+	int32_t res = fseeko(task->png, 0, SEEK_SET) ? 128 : png_load_head(task->png, (STEG_HEADER_SIZE + STEG_SHARD_SIZE) * 4, &pixels, &pixellen, &pnginf);
+	task->readlen = stats_position(task->png);
+	task->loadns = stage_end(STEGMAN_STAGE_PNG_LOAD, start);
+	if (res)
+		return shard_fail(task, STEGMAN_E_PNG_LOAD, res);
+
+	task->found = steg_decode_header(pixels, pixellen, pnginf.bit_depth / 8, &task->header) 
+		&& (task->header.flags & MSG_SHARD) 
+		&& !(task->header.flags & MSG_CHANNELS)
+		&& task->header.length >= STEG_SHARD_SIZE
+		&& steg_decode_shard(pixels, pixellen, &task->shard);
+	free(pixels);
+}
+
+// Loads the rows holding the shard, and extracts its piece of the contents
+static void task_shard_extract(void *arg)
+{
+	ShardTask *task = (ShardTask*)arg;
+	uint8_t *pixels = NULL;
+	size_t pixellen = 0;
+	PngImageInfo pnginf;
+
+	uint64_t start = stage_begin(STEGMAN_STAGE_PNG_LOAD);
+	int32_t res = fseeko(task->png, 0, SEEK_SET) ? 128 : png_load_pixels_progress(task->png, &pixels, NULL, &pixellen, &pnginf, shard_progress, task);
+	task->readlen += stats_position(task->png);
+	task->pixelcount = pixellen;
+	task->loadns += stage_end(STEGMAN_STAGE_PNG_LOAD, start);
+	if (res)
+		return shard_fail(task, STEGMAN_E_PNG_LOAD, res);
+
+	start = stage_begin(STEGMAN_STAGE_EXTRACT);
+	bool extracted = steg_decode_range(NULL, pixels, pixellen, STEG_SHARD_SIZE, task->contents, task->piecelen);
+	task->embedns = stage_end(STEGMAN_STAGE_EXTRACT, start);
+	free(pixels);
+	if (!extracted)
+		shard_fail(task, STEGMAN_E_NO_MESSAGE, 0);
+}
+
+// Runs a task on every carrier in parallel, and reports the first failure
+static StegmanResult shard_run(StegmanContext *ctx, ShardTask *tasks, size_t count, PoolTask run, KeyTask *keytask)
+{
+	PoolGroup group;
+	pool_group_init(&group);
+	if (keytask && pool_submit(ctx->pool, &group, task_derive_key, keytask))
+		task_derive_key(keytask);
+	for (size_t i = 0; i < count; i++)
+	{
+		if (pool_submit(ctx->pool, &group, run, tasks + i))
+			run(tasks + i);
+	}
+	pool_group_wait(ctx->pool, &group);
+	pool_group_destroy(&group);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		ShardTask *task = tasks + i;
+		stats_add(ctx, STEGMAN_STAGE_PNG_LOAD, task->loadns, task->readlen, task->pixelcount);
+		if (run == task_shard_embed)
+		{
+			stats_add(ctx, STEGMAN_STAGE_EMBED, task->embedns, STEG_HEADER_SIZE + STEG_SHARD_SIZE + task->piecelen, (STEG_HEADER_SIZE + STEG_SHARD_SIZE + task->piecelen) * 4);
+			stats_add(ctx, STEGMAN_STAGE_PNG_SAVE, task->savens, task->pixelcount, task->written);
+		}
+		else if (run == task_shard_extract)
+		{
+			stats_add(ctx, STEGMAN_STAGE_EXTRACT, task->embedns, task->piecelen * 4, task->piecelen);
+		}
+
+		task->loadns = task->embedns = task->savens = task->readlen = 0;
+	}
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if (tasks[i].sres != STEGMAN_OK)
+			return fail_with(ctx, tasks[i].sres, tasks[i].res);
+	}
+
+	return STEGMAN_OK;
+}
+
+// Runs the sharded encoder. The message is compressed and encrypted once, 
+// and the encrypted contents are split between the carriers, in order.
+static StegmanResult encode_shards_stream(StegmanContext *ctx, const uint8_t *password, size_t passlen, FILE **pngs, size_t count, const uint8_t *message, size_t msglen, StegmanPayload type, size_t *used)
+{
+	if (!count || count > UINT16_MAX)
+		return STEGMAN_E_ARGUMENT;
+
+	if (budget_too_small(ctx))
+		return STEGMAN_E_MEMORY;
+
+	ShardTask *tasks = (ShardTask*)arena_alloc(ctx->arena, count * sizeof(ShardTask));
+	if (!tasks)
+		return STEGMAN_E_ALLOC;
+
+	// Reject carriers which are too small before doing any expensive work
+	memset(tasks, 0, count * sizeof(ShardTask));
+	uint64_t capacity = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		CapacityInfo cap;
+		int32_t res = capacity_probe(pngs[i], msglen, STEG_CHANNELS_ALL, &cap);
+		if (res)
+			return fail_with(ctx, STEGMAN_E_PNG_LOAD, res);
+
+		tasks[i].png = pngs[i];
+		tasks[i].capacity = cap.capacity > STEG_SHARD_SIZE ? cap.capacity - STEG_SHARD_SIZE : 0;
+		capacity += tasks[i].capacity;
+	}
+
+	if (capacity_content_length(zlib_compress_min(msglen)) > capacity)
+		return STEGMAN_E_CAPACITY;
+
+	EncodeSecrets secrets;
+	StegmanResult sres = encode_secrets(ctx, password, passlen, &secrets);
+	if (sres != STEGMAN_OK)
+		return sres;
+
+	// Shards share a random ID, so that shards of different messages are 
+	// never mixed up
+	uint8_t id[IV_SIZE];
+	int32_t res = aes_gen_iv(id);
+	if (res)
+		return fail_with(ctx, STEGMAN_E_RANDOM, res);
+
+	// Derive the key while the message is being compressed
+	bool haskey = secrets.haskey;
+	KeyTask keytask = { password, passlen, secrets.salt, secrets.cycles, secrets.key, 0 };
+	CompressTask comptask = { ctx->pool, ctx->arena, message, msglen, type != STEGMAN_PAYLOAD_FILE, false, DICT_NONE, NULL, 0, 0 };
+
+	PoolGroup group;
+	pool_group_init(&group);
+	if (!haskey && pool_submit(ctx->pool, &group, task_derive_key, &keytask))
+		task_derive_key(&keytask);
+	task_compress(&comptask);
+	pool_group_wait(ctx->pool, &group);
+	pool_group_destroy(&group);
+
+	if (!haskey)
+		stats_add(ctx, STEGMAN_STAGE_KEY, keytask.ns, passlen, KEY_SIZE);
+	stats_add(ctx, STEGMAN_STAGE_COMPRESS, comptask.ns, msglen, comptask.datalen);
+
+	if (comptask.res)
+		return fail_with(ctx, STEGMAN_E_COMPRESS, comptask.res);
+
+	if (keytask.res)
+		return fail_with(ctx, STEGMAN_E_KEY, keytask.res);
+
+	if (!haskey)
+		key_store(ctx, secrets.passdigest, secrets.salt, secrets.cycles, secrets.key);
+
+	if (capacity_content_length(comptask.datalen) > capacity)
+		return STEGMAN_E_CAPACITY;
+
+	StegMessage smsg;
+	steg_init_msg(&smsg);
+	uint64_t datalen = 0;
+	sres = encode_encrypt(ctx, &secrets, &comptask, type, &smsg, &datalen);
+	if (sres != STEGMAN_OK)
+		return sres;
+
+	// Fill the carriers in order. Capacities are multiples of the AES block
+	// size, so every shard but the last one holds whole blocks.
+	size_t shards = 0;
+	uint64_t offset = 0;
+	for (size_t i = 0; i < count && offset < datalen; i++)
+	{
+		ShardTask *task = tasks + i;
+		if (!task->capacity)
+			continue;
+
+		task->piecelen = min(task->capacity, datalen - offset);
+		task->contents = smsg.contents + offset;
+		offset += task->piecelen;
+		memmove(tasks + shards++, task, sizeof(ShardTask));
+	}
+
+	if (offset < datalen)
+		return STEGMAN_E_CAPACITY;
+
+	// The last shard records the unpadded length, like a whole message does
+	for (size_t i = 0; i < shards; i++)
+	{
+		ShardTask *task = tasks + i;
+		memcpy(&task->header, &smsg, sizeof(StegMessage));
+		task->header.flags |= MSG_SHARD;
+		task->header.length = STEG_SHARD_SIZE + task->piecelen - (i + 1 == shards ? datalen - smsg.length : 0);
+		memcpy(&task->shard.id, id, sizeof(uint64_t));
+		task->shard.index = (uint16_t)i;
+		task->shard.count = (uint16_t)shards;
+	}
+
+	if (used)
+		*used = shards;
+
+	return shard_run(ctx, tasks, shards, task_shard_embed, NULL);
+}
+
+// Checks that the carriers hold all shards of one message, and orders them
+static StegmanResult shard_order(StegmanContext *ctx, ShardTask *tasks, size_t count, ShardTask **order)
+{
+	memset(order, 0, count * sizeof(ShardTask*));
+	const ShardTask *first = tasks;
+	for (size_t i = 0; i < count; i++)
+	{
+		ShardTask *task = tasks + i;
+		if (!task->found)
+			return STEGMAN_E_NO_MESSAGE;
+
+		if (task->shard.id != first->shard.id 
+			|| task->shard.count != count 
+			|| task->shard.index >= count 
+			|| order[task->shard.index]
+			|| task->header.flags != first->header.flags
+			|| task->header.cycles != first->header.cycles
+			|| memcmp(task->header.iv, first->header.iv, IV_SIZE)
+			|| memcmp(task->header.salt, first->header.salt, SALT_SIZE))
+			return STEGMAN_E_SHARD;
+
+		order[task->shard.index] = task;
+	}
+
+	// Only the last shard may end with a partial block
+	for (size_t i = 0; i + 1 < count; i++)
+	{
+		if ((order[i]->header.length - STEG_SHARD_SIZE) % 16)
+			return STEGMAN_E_SHARD;
+	}
+
+	return STEGMAN_OK;
+}
+
+// Contents of a sharded message, decrypted and handed to the decompressor as
+// each shard is extracted
+typedef struct ShardStream
+{
+	StegmanContext *ctx;
+	const uint8_t *key;
+
+	// Last block of ciphertext of the previous shard, starting with the IV
+	uint8_t chain[16];
+
+	// The magic value preceding the compressed data is checked before any of
+	// it is handed over
+	uint8_t magic[sizeof(int32_t)];
+	size_t magiclen;
+
+	// Contents still to come, not counting the padding of the last shard
+	uint64_t left;
+
+	ZlibInflater *inflater;
+	CountingSink counter;
+	uint64_t decryptns;
+	uint64_t decompressns;
+} ShardStream;
+
+// Decrypts the piece of the contents held by a shard, and decompresses it
+static StegmanResult shard_stream_piece(ShardStream *stream, uint8_t *piece, uint64_t piecelen)
+{
+	uint64_t start = stage_begin(STEGMAN_STAGE_DECRYPT);
+	int32_t res = aes_decrypt_chain(piece, piecelen, stream->key, stream->chain);
+	stream->decryptns += stage_end(STEGMAN_STAGE_DECRYPT, start);
+	if (res)
+		return fail_with(stream->ctx, STEGMAN_E_DECRYPT, res);
+
+	uint64_t len = min(piecelen, stream->left);
+	stream->left -= len;
+	if (stream->magiclen < sizeof(int32_t))
+	{
+		size_t take = (size_t)min(sizeof(int32_t) - stream->magiclen, len);
+		memcpy(stream->magic + stream->magiclen, piece, take);
+		stream->magiclen += take;
+		piece += take;
+		len -= take;
+		if (stream->magiclen < sizeof(int32_t))
+			return STEGMAN_OK;
+
+		int32_t magic = 0;
+		memcpy(&magic, stream->magic, sizeof(int32_t));
+		if (magic != STEG_MAGIC)
+			return STEGMAN_E_PASSWORD;
+	}
+
+	start = stage_begin(STEGMAN_STAGE_DECOMPRESS);
+	res = zlib_inflater_feed(stream->inflater, piece, len);
+	stream->decompressns += stage_end(STEGMAN_STAGE_DECOMPRESS, start);
+	return decompress_result(stream->ctx, res);
+}
+
+// Runs the sharded decoder. Headers are read first, so that the shards can be
+// extracted in order, one at a time, and each one's piece of the contents 
+// decrypted and decompressed before the next is extracted. Only a single 
+// piece is held in memory at a time.
+static StegmanResult decode_shards_stream(StegmanContext *ctx, const uint8_t *password, size_t passlen, FILE **pngs, size_t count, StegmanSink sink, void *arg, StegmanPayload *type)
+{
+	if (!count || count > UINT16_MAX)
+		return STEGMAN_E_ARGUMENT;
+
+	if (budget_too_small(ctx))
+		return STEGMAN_E_MEMORY;
+
+	// Key material lives in the arena, so that it's wiped with everything else
+	uint8_t *key = (uint8_t*)arena_alloc(ctx->arena, KEY_SIZE);
+	uint8_t *passdigest = (uint8_t*)arena_alloc(ctx->arena, DIGEST_SIZE);
+	ShardTask *tasks = (ShardTask*)arena_alloc(ctx->arena, count * sizeof(ShardTask));
+	ShardTask **order = (ShardTask**)arena_alloc(ctx->arena, count * sizeof(ShardTask*));
+	if (!key || !passdigest || !tasks || !order)
+		return STEGMAN_E_ALLOC;
+
+	int32_t res = sha_digest(password, passlen, passdigest);
+	if (res)
+		return fail_with(ctx, STEGMAN_E_KEY, res);
+
+	memset(tasks, 0, count * sizeof(ShardTask));
+	for (size_t i = 0; i < count; i++)
+	{
+		tasks[i].png = pngs[i];
+		steg_init_msg(&tasks[i].header);
+	}
+
+	StegmanResult sres = shard_run(ctx, tasks, count, task_shard_probe, NULL);
+	if (sres == STEGMAN_OK)
+		sres = shard_order(ctx, tasks, count, order);
+	if (sres != STEGMAN_OK)
+		return sres;
+
+	// Every shard is extracted into the same buffer
+	uint64_t length = 0, slicelen = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		uint64_t piece = order[i]->header.length - STEG_SHARD_SIZE;
+		order[i]->piecelen = shard_padded(piece);
+		length += piece;
+		slicelen = max(slicelen, order[i]->piecelen);
+	}
+
+	if (length < sizeof(int32_t))
+		return STEGMAN_E_PASSWORD;
+
+	uint8_t *slice = (uint8_t*)arena_alloc(ctx->arena, slicelen);
+	if (!slice)
+		return STEGMAN_E_ALLOC;
+
+	for (size_t i = 0; i < count; i++)
+		order[i]->contents = slice;
+
+	// The kind of message is known before any of it is handed over
+	const StegMessage *header = &order[0]->header;
+	StegMessageFlags flags = header->flags & ~MSG_SHARD;
+	*type = decode_type(flags);
+
+	const uint8_t *dict = NULL;
+	size_t dictlen = 0;
+	sres = decode_dictionary(ctx, flags, &dict, &dictlen);
+	if (sres != STEGMAN_OK)
+		return sres;
+
+	ShardStream stream;
+	memset(&stream, 0, sizeof(ShardStream));
+	stream.ctx = ctx;
+	stream.key = key;
+	stream.left = length;
+	stream.counter.sink = sink;
+	stream.counter.arg = arg;
+	memcpy(stream.chain, header->iv, IV_SIZE);
+	res = zlib_inflater_open(ctx->pool, ctx->arena, length - sizeof(int32_t), (flags & MSG_CHUNKED) != 0, dict, dictlen, sink_count, &stream.counter, &stream.inflater);
+	if (res)
+		return fail_with(ctx, STEGMAN_E_DECOMPRESS, res);
+
+	// Derive the key while the first shard is being extracted
+	bool haskey = key_cached(ctx, passdigest, header->salt, header->cycles);
+	KeyTask keytask = { password, passlen, header->salt, header->cycles, key, 0 };
+	if (haskey)
+		memcpy(key, ctx->key, KEY_SIZE);
+
+	for (size_t i = 0; sres == STEGMAN_OK && i < count; i++)
+	{
+		bool derive = !i && !haskey;
+		sres = shard_run(ctx, order[i], 1, task_shard_extract, derive ? &keytask : NULL);
+		if (derive)
+			stats_add(ctx, STEGMAN_STAGE_KEY, keytask.ns, passlen, KEY_SIZE);
+		if (derive && sres == STEGMAN_OK && keytask.res)
+			sres = fail_with(ctx, STEGMAN_E_KEY, keytask.res);
+		if (!i && sres == STEGMAN_OK)
+			key_store(ctx, passdigest, header->salt, header->cycles, key);
+
+		if (sres == STEGMAN_OK)
+			sres = shard_stream_piece(&stream, slice, order[i]->piecelen);
+	}
+
+	uint64_t start = stage_begin(STEGMAN_STAGE_DECOMPRESS);
+	res = zlib_inflater_finish(stream.inflater);
+	stream.decompressns += stage_end(STEGMAN_STAGE_DECOMPRESS, start);
+	stats_add(ctx, STEGMAN_STAGE_DECRYPT, stream.decryptns, length, length);
+	stats_add(ctx, STEGMAN_STAGE_DECOMPRESS, stream.decompressns, length - sizeof(int32_t), stream.counter.written);
+	if (sres != STEGMAN_OK)
+		return sres;
+
+	return decompress_result(ctx, res);
+}
+
+// Starts measuring a new operation
+static uint64_t run_start(StegmanContext *ctx, const char *name)
+{
+	ctx->detail = 0;
+	ctx->spill = NULL;
+	ctx->spilllen = 0;
+	memset(&ctx->stats, 0, sizeof(StegmanStats));
+	trace_begin("operation", name);
+	return stats_now();
+}
+
+// Records totals of an operation, then wipes and rewinds the arena for the
+// next one
+static void run_finish(StegmanContext *ctx, const char *name, uint64_t start)
+{
+	ctx->stats.nanoseconds = stats_now() - start;
+	trace_end("operation", name);
+
+	ArenaStats arena;
+	arena_stats(ctx->arena, &arena);
+	ctx->stats.allocated = arena.allocated;
+	ctx->stats.allocated_peak = arena.peak;
+	ctx->stats.allocations = arena.allocations;
+	ctx->stats.pixel_buffer = ctx->pixelcap;
+
+	struct rusage usage;
+	if (!getrusage(RUSAGE_SELF, &usage))
+		ctx->stats.peak_rss = (uint64_t)usage.ru_maxrss * 1024;
+
+	spill_unmap(ctx->spill, ctx->spilllen);
+	ctx->spill = NULL;
+	arena_reset(ctx->arena);
+}
+
+// Runs an operation
+static StegmanResult encode_run(StegmanContext *ctx, const uint8_t *password, size_t passlen, FILE *in, FILE *out, const uint8_t *message, size_t msglen, StegmanPayload type)
+{
+	uint64_t start = run_start(ctx, "encode");
+	LoadTask loadtask;
+	load_init(&loadtask, ctx, in, NULL);
+	StegmanResult res = encode_stream(ctx, password, passlen, in, out, message, msglen, type, &loadtask);
+	png_reader_close(loadtask.reader);
+	run_finish(ctx, "encode", start);
+	return res;
+}
+
+static StegmanResult decode_sink_run(StegmanContext *ctx, const uint8_t *password, size_t passlen, FILE *in, StegmanSink sink, void *arg, StegmanPayload *type)
+{
+	uint64_t start = run_start(ctx, "decode");
+	StegmanResult res = decode_sink_stream(ctx, password, passlen, in, sink, arg, type);
+	run_finish(ctx, "decode", start);
+	return res;
+}
+
+// Descriptor the message is written to
+typedef struct FdSink
+{
+	int fd;
+	int error;
+} FdSink;
+
+// Writes a piece of the message to a descriptor
+static int32_t sink_fd(void *arg, const uint8_t *data, size_t len)
+{
+	FdSink *sink = (FdSink*)arg;
+	while (len)
+	{
+		ssize_t written = write(sink->fd, data, len);
+		if (written < 0 && errno == EINTR)
+			continue;
+
+		if (written <= 0)
+		{
+			sink->error = written < 0 ? errno : EIO;
+			return 1;
+		}
+
+		data += written;
+		len -= written;
+	}
+
+	return 0;
+}
+
+static StegmanResult decode_run(StegmanContext *ctx, const uint8_t *password, size_t passlen, FILE *in, uint8_t **message, size_t *msglen, StegmanPayload *type)
+{
+	uint64_t start = run_start(ctx, "decode");
+	StegmanResult res = decode_stream(ctx, password, passlen, in, message, msglen, type);
+	run_finish(ctx, "decode", start);
+	return res;
+}
+
+static StegmanResult encode_shards_run(StegmanContext *ctx, const uint8_t *password, size_t passlen, FILE **pngs, size_t count, const uint8_t *message, size_t msglen, StegmanPayload type, size_t *used)
+{
+	uint64_t start = run_start(ctx, "encode");
+	StegmanResult res = encode_shards_stream(ctx, password, passlen, pngs, count, message, msglen, type, used);
+	run_finish(ctx, "encode", start);
+	return res;
+}
+
+static StegmanResult decode_shards_run(StegmanContext *ctx, const uint8_t *password, size_t passlen, FILE **pngs, size_t count, StegmanSink sink, void *arg, StegmanPayload *type)
+{
+	uint64_t start = run_start(ctx, "decode");
+	StegmanResult res = decode_shards_stream(ctx, password, passlen, pngs, count, sink, arg, type);
+	run_finish(ctx, "decode", start);
+	return res;
+}
+
+// Function definitions
+void stegman_default_options(StegmanOptions *options)
+{
+	memset(options, 0, sizeof(StegmanOptions));
+	options->threads = 0;
+	options->reuse_key = false;
+	options->max_memory = 0;
+	options->scatter = false;
+	options->channels = STEGMAN_CHANNELS_ALL;
+}
+
+StegmanResult stegman_create(const StegmanOptions *options, StegmanContext **ctx)
+{
+	if (!ctx)
+		return STEGMAN_E_ARGUMENT;
+
+	size_t threads = options ? options->threads : 0;
+	ThreadPool *pool = NULL;
+
+	// Without worker threads, everything runs on the calling thread
+	if (pool_create(threads, &pool))
+		pool = NULL;
+
+	StegmanResult res = stegman_create_shared(options, pool, ctx);
+	if (res != STEGMAN_OK)
+	{
+		pool_destroy(pool);
+		return res;
+	}
+
+	(*ctx)->ownspool = true;
+	return STEGMAN_OK;
+}
+
+StegmanResult stegman_create_shared(const StegmanOptions *options, ThreadPool *pool, StegmanContext **ctx)
+{
+	if (!ctx)
+		return STEGMAN_E_ARGUMENT;
+
+	StegmanContext *c = (StegmanContext*)calloc(1, sizeof(StegmanContext));
+	if (!c)
+		return STEGMAN_E_ALLOC;
+
+	if (options)
+		c->options = *options;
+	else
+		stegman_default_options(&c->options);
+
+	if (arena_create(0, &c->arena))
+	{
+		free(c);
+		return STEGMAN_E_ALLOC;
+	}
+
+	// Intermediate buffers get a quarter of the memory budget
+	arena_set_limit(c->arena, budget_available(c) / 4);
+
+	c->pool = pool;
+	*ctx = c;
+	return STEGMAN_OK;
+}
+
+void stegman_destroy(StegmanContext *ctx)
+{
+	if (!ctx)
+		return;
+
+	if (ctx->ownspool)
+		pool_destroy(ctx->pool);
+	arena_destroy(ctx->arena);
+	free(ctx->pixels);
+	OPENSSL_cleanse(ctx, sizeof(StegmanContext));
+	free(ctx);
+}
+
+const char *stegman_strerror(StegmanResult res)
+{
+	switch (res)
+	{
+		case STEGMAN_OK:
+			return "Success";
+		case STEGMAN_E_ARGUMENT:
+			return "Invalid argument";
+		case STEGMAN_E_ALLOC:
+			return "Could not allocate memory";
+		case STEGMAN_E_RANDOM:
+			return "Error generating random values. Refer to OpenSSL docs for RAND_bytes for more details";
+		case STEGMAN_E_KEY:
+			return "Error generating AES key. Refer to OpenSSL docs for SHA256 for more details";
+		case STEGMAN_E_COMPRESS:
+			return "Error compressing data. Refer to ZLib manual for details";
+		case STEGMAN_E_ENCRYPT:
+			return "Error encrypting data. Refer to OpenSSL manual for details";
+		case STEGMAN_E_PNG_LOAD:
+			return "Error loading PNG image. Refer to libpng manual for details";
+		case STEGMAN_E_PNG_SAVE:
+			return "Error saving PNG image. Refer to libpng manual for details";
+		case STEGMAN_E_CAPACITY:
+			return "Not enough pixel data to encode the message in";
+		case STEGMAN_E_NO_MESSAGE:
+			return "Failed to decode data from pixels";
+		case STEGMAN_E_DECRYPT:
+			return "Error decrypting data. Refer to OpenSSL manual for details";
+		case STEGMAN_E_PASSWORD:
+			return "Decrypted data was corrupted or invalid, the password is likely wrong";
+		case STEGMAN_E_DICTIONARY:
+			return "The message was compressed using an unknown dictionary";
+		case STEGMAN_E_DECOMPRESS:
+			return "Error decompressing data. Refer to ZLib manual for details";
+		case STEGMAN_E_IO:
+			return "Error reading or writing data";
+		case STEGMAN_E_MEMORY:
+			return "The operation can't fit in the memory budget";
+		case STEGMAN_E_SHARD:
+			return "The carriers don't hold all shards of a single message";
+		case STEGMAN_E_CHANNELS:
+			return "The carrier doesn't have the selected channels";
+		case STEGMAN_E_OPTION:
+			return "The selected options aren't supported by this operation";
+		default:
+			return "Unknown error";
+	}
+}
+
+int32_t stegman_error_detail(const StegmanContext *ctx)
+{
+	return ctx ? ctx->detail : 0;
+}
+
+void stegman_stats(const StegmanContext *ctx, StegmanStats *stats)
+{
+	*stats = ctx->stats;
+}
+
+const char *stegman_stage_name(StegmanStage stage)
+{
+	switch (stage)
+	{
+		case STEGMAN_STAGE_KEY:
+			return "key";
+		case STEGMAN_STAGE_COMPRESS:
+			return "compress";
+		case STEGMAN_STAGE_ENCRYPT:
+			return "encrypt";
+		case STEGMAN_STAGE_PNG_LOAD:
+			return "png_load";
+		case STEGMAN_STAGE_EMBED:
+			return "embed";
+		case STEGMAN_STAGE_PNG_SAVE:
+			return "png_save";
+		case STEGMAN_STAGE_EXTRACT:
+			return "extract";
+		case STEGMAN_STAGE_DECRYPT:
+			return "decrypt";
+		case STEGMAN_STAGE_DECOMPRESS:
+			return "decompress";
+		default:
+			return "unknown";
+	}
+}
+
+StegmanResult stegman_encode_mem(StegmanContext *ctx, const uint8_t *password, size_t passlen, const uint8_t *carrier, size_t carrierlen, const uint8_t *message, size_t msglen, StegmanPayload type, uint8_t **result, size_t *reslen)
+{
+	if (!ctx || !password || !carrier || !carrierlen || (!message && msglen) || !result || !reslen)
+		return STEGMAN_E_ARGUMENT;
+
+	FILE *in = fmemopen((void*)carrier, carrierlen, "rb");
+	if (!in)
+		return STEGMAN_E_IO;
+
+	char *buf = NULL;
+	size_t buflen = 0;
+	FILE *out = open_memstream(&buf, &buflen);
+	if (!out)
+	{
+		fclose(in);
+		return STEGMAN_E_IO;
+	}
+
+	StegmanResult res = encode_run(ctx, password, passlen, in, out, message, msglen, type);
+	fclose(in);
+	if (fclose(out) && res == STEGMAN_OK)
+		res = STEGMAN_E_IO;
+
+	if (res != STEGMAN_OK)
+	{
+		free(buf);
+		return res;
+	}
+
+	*result = (uint8_t*)buf;
+	*reslen = buflen;
+	return STEGMAN_OK;
+}
+
+StegmanResult stegman_decode_mem(StegmanContext *ctx, const uint8_t *password, size_t passlen, const uint8_t *carrier, size_t carrierlen, uint8_t **message, size_t *msglen, StegmanPayload *type)
+{
+	if (!ctx || !password || !carrier || !carrierlen || !message || !msglen || !type)
+		return STEGMAN_E_ARGUMENT;
+
+	FILE *in = fmemopen((void*)carrier, carrierlen, "rb");
+	if (!in)
+		return STEGMAN_E_IO;
+
+	StegmanResult res = decode_run(ctx, password, passlen, in, message, msglen, type);
+	fclose(in);
+	return res;
+}
+
+StegmanResult stegman_encode_file(StegmanContext *ctx, const uint8_t *password, size_t passlen, FILE *png, const uint8_t *message, size_t msglen, StegmanPayload type)
+{
+	if (!ctx || !password || !png || (!message && msglen))
+		return STEGMAN_E_ARGUMENT;
+
+	return encode_run(ctx, password, passlen, png, png, message, msglen, type);
+}
+
+StegmanResult stegman_encode_copy(StegmanContext *ctx, const uint8_t *password, size_t passlen, FILE *carrier, FILE *output, const uint8_t *message, size_t msglen, StegmanPayload type)
+{
+	if (!ctx || !password || !carrier || !output || (!message && msglen))
+		return STEGMAN_E_ARGUMENT;
+
+	return encode_run(ctx, password, passlen, carrier, output, message, msglen, type);
+}
+
+StegmanResult stegman_decode_file(StegmanContext *ctx, const uint8_t *password, size_t passlen, FILE *png, uint8_t **message, size_t *msglen, StegmanPayload *type)
+{
+	if (!ctx || !password || !png || !message || !msglen || !type)
+		return STEGMAN_E_ARGUMENT;
+
+	return decode_run(ctx, password, passlen, png, message, msglen, type);
+}
+
+StegmanResult stegman_decode_sink(StegmanContext *ctx, const uint8_t *password, size_t passlen, FILE *png, StegmanSink sink, void *arg, StegmanPayload *type)
+{
+	if (!ctx || !password || !png || !sink || !type)
+		return STEGMAN_E_ARGUMENT;
+
+	return decode_sink_run(ctx, password, passlen, png, sink, arg, type);
+}
+
+StegmanResult stegman_decode_fd(StegmanContext *ctx, const uint8_t *password, size_t passlen, FILE *png, int fd, StegmanPayload *type)
+{
+	if (fd < 0)
+		return STEGMAN_E_ARGUMENT;
+
+	FdSink sink = { fd, 0 };
+	StegmanResult res = stegman_decode_sink(ctx, password, passlen, png, sink_fd, &sink, type);
+	if (res == STEGMAN_E_IO && ctx)
+		ctx->detail = sink.error;
+
+	return res;
+}
+
+StegmanResult stegman_encode_shards(StegmanContext *ctx, const uint8_t *password, size_t passlen, FILE **pngs, size_t count, const uint8_t *message, size_t msglen, StegmanPayload type, size_t *used)
+{
+	if (!ctx || !password || !pngs || !message)
+		return STEGMAN_E_ARGUMENT;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if (!pngs[i])
+			return STEGMAN_E_ARGUMENT;
+	}
+
+	// Shards are embedded in the default layout only, and their carriers are
+	// loaded whole
+	if (ctx->options.channels != STEGMAN_CHANNELS_ALL || ctx->options.scatter || ctx->options.max_memory)
+		return STEGMAN_E_OPTION;
+
+	return encode_shards_run(ctx, password, passlen, pngs, count, message, msglen, type, used);
+}
+
+StegmanResult stegman_decode_shards(StegmanContext *ctx, const uint8_t *password, size_t passlen, FILE **pngs, size_t count, StegmanSink sink, void *arg, StegmanPayload *type)
+{
+	if (!ctx || !password || !pngs || !sink || !type)
+		return STEGMAN_E_ARGUMENT;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if (!pngs[i])
+			return STEGMAN_E_ARGUMENT;
+	}
+
+	if (ctx->options.max_memory)
+		return STEGMAN_E_OPTION;
+
+	return decode_shards_run(ctx, password, passlen, pngs, count, sink, arg, type);
+}
+
+// Define C extern for C++
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,508 @@
+// This file is part of stegman project
+//
+// Copyright (c) 2018 Mateusz Brawański (Emzi0767)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/**
+ * \file
+ * \brief Stegman library interface, for embedding stegman in other programs.
+ */
+
+// Only include once
+#pragma once
+
+// Check if we're using a C99-capable compiler
+#if __STDC_VERSION__ < 199901L
+#error "You need to use a C99-capable compiler to build this program!"
+#endif
+
+// Define C extern for C++
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Standard library
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// Only the functions below are exported from the shared library, everything 
+// else is built with hidden visibility
+#if defined(__GNUC__) && __GNUC__ >= 4
+#define STEGMAN_API __attribute__((visibility("default")))
+#else
+#define STEGMAN_API
+#endif
+
+/** Opaque library context. Holds options, worker threads, and buffers reused
+ * between operations. A context must not be used by multiple threads at once,
+ * but separate contexts are independent of each other. */
+typedef struct StegmanContext StegmanContext;
+
+/** Result codes returned by library functions. */
+typedef enum StegmanResult
+{
+	/** The operation succeeded. */
+	STEGMAN_OK = 0,
+
+	/** Invalid arguments were supplied. */
+	STEGMAN_E_ARGUMENT,
+
+	/** Memory could not be allocated. */
+	STEGMAN_E_ALLOC,
+
+	/** Salt, IV, or cycle count could not be generated. */
+	STEGMAN_E_RANDOM,
+
+	/** The password could not be hashed into a key. */
+	STEGMAN_E_KEY,
+
+	/** The message could not be compressed. */
+	STEGMAN_E_COMPRESS,
+
+	/** The message could not be encrypted. */
+	STEGMAN_E_ENCRYPT,
+
+	/** The carrier image could not be loaded, or is in unsupported format. */
+	STEGMAN_E_PNG_LOAD,
+
+	/** The carrier image could not be written. */
+	STEGMAN_E_PNG_SAVE,
+
+	/** The message does not fit in the carrier image. */
+	STEGMAN_E_CAPACITY,
+
+	/** The carrier image does not contain a message. */
+	STEGMAN_E_NO_MESSAGE,
+
+	/** The message could not be decrypted. */
+	STEGMAN_E_DECRYPT,
+
+	/** The decrypted data is invalid, most likely due to a wrong password. */
+	STEGMAN_E_PASSWORD,
+
+	/** The message was compressed using an unknown dictionary. */
+	STEGMAN_E_DICTIONARY,
+
+	/** The message could not be decompressed. */
+	STEGMAN_E_DECOMPRESS,
+
+	/** Input or output stream could not be read or written. */
+	STEGMAN_E_IO,
+
+	/** Operation can't be done within the memory budget. */
+	STEGMAN_E_MEMORY,
+
+	/** The carriers don't hold all shards of a single message. */
+	STEGMAN_E_SHARD,
+
+	/** The carrier doesn't have the channels selected to hold the message. */
+	STEGMAN_E_CHANNELS,
+
+	/** The options select a feature the operation doesn't support. */
+	STEGMAN_E_OPTION
+} StegmanResult;
+
+/** Channels of each pixel which hold the encoded message. */
+typedef enum StegmanChannels
+{
+	/** All channels, including alpha. */
+	STEGMAN_CHANNELS_ALL = 0,
+
+	/** Red, green, and blue, leaving alpha untouched. */
+	STEGMAN_CHANNELS_RGB = 1,
+
+	/** Alpha only. Requires carriers with alpha. */
+	STEGMAN_CHANNELS_ALPHA = 2,
+
+	/** Blue only. */
+	STEGMAN_CHANNELS_BLUE = 3
+} StegmanChannels;
+
+/** Kind of the hidden payload. */
+typedef enum StegmanPayload
+{
+	/** Arbitrary binary data, such as file contents. */
+	STEGMAN_PAYLOAD_FILE = 0,
+
+	/** UTF-8 encoded text. */
+	STEGMAN_PAYLOAD_TEXT = 1,
+
+	/** Text stored by older versions, as raw `wchar_t` characters. */
+	STEGMAN_PAYLOAD_TEXT_WCHAR = 2
+} StegmanPayload;
+
+/**
+ * Function receiving a decoded message in consecutive pieces.
+ *
+ * \param arg Argument supplied along with the function.
+ * \param data Next piece of the message. Only valid during the call.
+ * \param len Length of the piece, in bytes.
+ *
+ * \return 0 to continue, anything else to stop decoding.
+ */
+typedef int32_t (*StegmanSink)(void *arg, const uint8_t *data, size_t len);
+
+/** Stages of the encoding and decoding pipelines. */
+typedef enum StegmanStage
+{
+	/** Derivation of the key from the password. */
+	STEGMAN_STAGE_KEY = 0,
+
+	/** Compression of the message. */
+	STEGMAN_STAGE_COMPRESS,
+
+	/** Encryption of the compressed message. */
+	STEGMAN_STAGE_ENCRYPT,
+
+	/** Decoding of the carrier's pixels. */
+	STEGMAN_STAGE_PNG_LOAD,
+
+	/** Embedding of the encrypted message in the pixels. */
+	STEGMAN_STAGE_EMBED,
+
+	/** Encoding of the resulting image. */
+	STEGMAN_STAGE_PNG_SAVE,
+
+	/** Extraction of the encrypted message from the pixels. */
+	STEGMAN_STAGE_EXTRACT,
+
+	/** Decryption of the extracted message. */
+	STEGMAN_STAGE_DECRYPT,
+
+	/** Decompression of the message, including handing it to a sink. */
+	STEGMAN_STAGE_DECOMPRESS,
+
+	/** Number of stages. */
+	STEGMAN_STAGE_COUNT
+} StegmanStage;
+
+/** Measurements of a single stage. */
+typedef struct StegmanStageStats
+{
+	/** Time spent in the stage, in nanoseconds. */
+	uint64_t nanoseconds;
+
+	/** Number of bytes the stage consumed. */
+	uint64_t bytes_in;
+
+	/** Number of bytes the stage produced. */
+	uint64_t bytes_out;
+} StegmanStageStats;
+
+/** 
+ * Measurements of the last operation of a context. Stages which run 
+ * concurrently overlap, so their times can add up to more than the total.
+ */
+typedef struct StegmanStats
+{
+	/** Measurements of each stage, indexed by `StegmanStage`. Stages which 
+	 * did not run are zeroed. */
+	StegmanStageStats stages[STEGMAN_STAGE_COUNT];
+
+	/** Wall-clock time of the whole operation, in nanoseconds. */
+	uint64_t nanoseconds;
+
+	/** Total size of intermediate buffers allocated, in bytes. */
+	uint64_t allocated;
+
+	/** Largest size of intermediate buffers in use at once, in bytes. */
+	uint64_t allocated_peak;
+
+	/** Number of intermediate buffers allocated. */
+	uint64_t allocations;
+
+	/** Size of the pixel buffer held by the context, in bytes. */
+	uint64_t pixel_buffer;
+
+	/** Peak resident set size of the whole process so far, in bytes. */
+	uint64_t peak_rss;
+} StegmanStats;
+
+/** Options controlling the behaviour of a context. */
+typedef struct StegmanOptions
+{
+	/** Number of worker threads. 0 uses one thread per processor. */
+	size_t threads;
+
+	/** Whether to reuse the salt and derived key for consecutive encodes with
+	 * the same password. This saves key derivation time for every message 
+	 * after the first, at the cost of all of them sharing a salt. Every 
+	 * message still uses a unique IV. */
+	bool reuse_key;
+
+	/** Largest amount of memory an operation should use, in bytes, or 0 for 
+	 * no limit. Carriers are loaded in bands of rows, and buffers which 
+	 * don't fit are backed by temporary files. Operations which can't fit
+	 * even then fail with STEGMAN_E_MEMORY before doing any work. */
+	uint64_t max_memory;
+
+	/** Whether to spread encoded messages over the whole carrier, in blocks 
+	 * of 64 bytes of pixel data placed in an order derived from the key, 
+	 * instead of filling the carrier from the top. Carriers are then always
+	 * loaded whole, and so are they when decoding such messages. Decoding 
+	 * detects the layout by itself. */
+	bool scatter;
+
+	/** Channels to encode messages in, header included. Fewer channels leave
+	 * more of each pixel untouched, at the cost of capacity. Decoding detects
+	 * the channels by itself. */
+	StegmanChannels channels;
+} StegmanOptions;
+
+/**
+ * Fills the options with default values.
+ *
+ * \param options Options to initialize.
+ */
+STEGMAN_API void stegman_default_options(StegmanOptions *options);
+
+/**
+ * Creates a new library context.
+ *
+ * \param options Options for the context. If NULL, defaults are used.
+ * \param ctx Pointer to the context. The underlying pointer will be 
+ *            initialized.
+ *
+ * \return STEGMAN_OK if the operation was successful, an error code otherwise.
+ */
+STEGMAN_API StegmanResult stegman_create(const StegmanOptions *options, StegmanContext **ctx);
+
+/**
+ * Destroys a library context, wiping any key material it holds.
+ *
+ * \param ctx Context to destroy. Can be NULL.
+ */
+STEGMAN_API void stegman_destroy(StegmanContext *ctx);
+
+/**
+ * Gets a description of a result code.
+ *
+ * \param res Result code to describe.
+ *
+ * \return Static, human-readable description.
+ */
+STEGMAN_API const char *stegman_strerror(StegmanResult res);
+
+/**
+ * Gets the error code reported by the underlying library (OpenSSL, ZLib, or 
+ * libpng) during the last failed operation.
+ *
+ * \param ctx Context to examine.
+ *
+ * \return Underlying error code, or 0 if there was none.
+ */
+STEGMAN_API int32_t stegman_error_detail(const StegmanContext *ctx);
+
+/**
+ * Gets the measurements of the last operation, whether it succeeded or not.
+ *
+ * \param ctx Context to examine.
+ * \param stats Pointer to the measurements to fill.
+ */
+STEGMAN_API void stegman_stats(const StegmanContext *ctx, StegmanStats *stats);
+
+/**
+ * Gets the name of a pipeline stage, as used in reports.
+ *
+ * \param stage Stage to name.
+ *
+ * \return Static, lowercase name of the stage.
+ */
+STEGMAN_API const char *stegman_stage_name(StegmanStage stage);
+
+/**
+ * Encodes a message into a PNG image held in memory.
+ *
+ * \param ctx Library context.
+ * \param password Password bytes to encrypt the data with.
+ * \param passlen Length of the password, in bytes.
+ * \param carrier Carrier PNG image bytes.
+ * \param carrierlen Length of the carrier image.
+ * \param message Bytes of the message to encode.
+ * \param msglen Length of the message.
+ * \param type Kind of the message. Text needs to be UTF-8.
+ * \param result Pointer to the resulting PNG image bytes. The underlying 
+ *               pointer will be initialized, and needs to be released with 
+ *               `free`.
+ * \param reslen Pointer to the length of the resulting image.
+ *
+ * \return STEGMAN_OK if the operation was successful, an error code otherwise.
+ */
+STEGMAN_API StegmanResult stegman_encode_mem(StegmanContext *ctx, const uint8_t *password, size_t passlen, const uint8_t *carrier, size_t carrierlen, const uint8_t *message, size_t msglen, StegmanPayload type, uint8_t **result, size_t *reslen);
+
+/**
+ * Decodes a message from a PNG image held in memory.
+ *
+ * \param ctx Library context.
+ * \param password Password bytes to decrypt the data with.
+ * \param passlen Length of the password, in bytes.
+ * \param carrier Carrier PNG image bytes.
+ * \param carrierlen Length of the carrier image.
+ * \param message Pointer to the message bytes. The underlying pointer will be 
+ *                initialized, and needs to be released with `free`. The 
+ *                message is followed by `sizeof(wchar_t)` zero bytes, which 
+ *                are not included in its length.
+ * \param msglen Pointer to the length of the message.
+ * \param type Pointer to the kind of the message.
+ *
+ * \return STEGMAN_OK if the operation was successful, an error code otherwise.
+ */
+STEGMAN_API StegmanResult stegman_decode_mem(StegmanContext *ctx, const uint8_t *password, size_t passlen, const uint8_t *carrier, size_t carrierlen, uint8_t **message, size_t *msglen, StegmanPayload *type);
+
+/**
+ * Encodes a message into a PNG file, in-place.
+ *
+ * \param ctx Library context.
+ * \param password Password bytes to encrypt the data with.
+ * \param passlen Length of the password, in bytes.
+ * \param png Carrier PNG file, opened for reading and writing.
+ * \param message Bytes of the message to encode.
+ * \param msglen Length of the message.
+ * \param type Kind of the message. Text needs to be UTF-8.
+ *
+ * \return STEGMAN_OK if the operation was successful, an error code otherwise.
+ */
+STEGMAN_API StegmanResult stegman_encode_file(StegmanContext *ctx, const uint8_t *password, size_t passlen, FILE *png, const uint8_t *message, size_t msglen, StegmanPayload type);
+
+/**
+ * Encodes a message into a copy of a PNG file, leaving the original intact.
+ *
+ * \param ctx Library context.
+ * \param password Password bytes to encrypt the data with.
+ * \param passlen Length of the password, in bytes.
+ * \param carrier Carrier PNG file, opened for reading.
+ * \param output File to write the resulting PNG to, opened for writing.
+ * \param message Bytes of the message to encode.
+ * \param msglen Length of the message.
+ * \param type Kind of the message. Text needs to be UTF-8.
+ *
+ * \return STEGMAN_OK if the operation was successful, an error code otherwise.
+ */
+STEGMAN_API StegmanResult stegman_encode_copy(StegmanContext *ctx, const uint8_t *password, size_t passlen, FILE *carrier, FILE *output, const uint8_t *message, size_t msglen, StegmanPayload type);
+
+/**
+ * Decodes a message from a PNG file.
+ *
+ * \param ctx Library context.
+ * \param password Password bytes to decrypt the data with.
+ * \param passlen Length of the password, in bytes.
+ * \param png Carrier PNG file.
+ * \param message Pointer to the message bytes, as in stegman_decode_mem.
+ * \param msglen Pointer to the length of the message.
+ * \param type Pointer to the kind of the message.
+ *
+ * \return STEGMAN_OK if the operation was successful, an error code otherwise.
+ */
+STEGMAN_API StegmanResult stegman_decode_file(StegmanContext *ctx, const uint8_t *password, size_t passlen, FILE *png, uint8_t **message, size_t *msglen, StegmanPayload *type);
+
+/**
+ * Decodes a message from a PNG file, handing it to a sink in pieces as it's
+ * decompressed, rather than collecting all of it in memory. Memory use does 
+ * not depend on the length of the message. If decoding fails half-way, the 
+ * sink may have received part of the message.
+ *
+ * \param ctx Library context.
+ * \param password Password bytes to decrypt the data with.
+ * \param passlen Length of the password, in bytes.
+ * \param png Carrier PNG file.
+ * \param sink Function receiving the message.
+ * \param arg Argument for the sink.
+ * \param type Pointer to the kind of the message. Set before the sink is 
+ *             first called.
+ *
+ * \return STEGMAN_OK if the operation was successful, STEGMAN_E_IO if the 
+ *         sink stopped it, an error code otherwise.
+ */
+STEGMAN_API StegmanResult stegman_decode_sink(StegmanContext *ctx, const uint8_t *password, size_t passlen, FILE *png, StegmanSink sink, void *arg, StegmanPayload *type);
+
+/**
+ * Decodes a message from a PNG file, writing it to a file descriptor in 
+ * pieces as it's decompressed. The message is written as it is; legacy text
+ * is not converted.
+ *
+ * \param ctx Library context.
+ * \param password Password bytes to decrypt the data with.
+ * \param passlen Length of the password, in bytes.
+ * \param png Carrier PNG file.
+ * \param fd Descriptor to write the message to.
+ * \param type Pointer to the kind of the message.
+ *
+ * \return STEGMAN_OK if the operation was successful, STEGMAN_E_IO if writing
+ *         failed, an error code otherwise.
+ */
+STEGMAN_API StegmanResult stegman_decode_fd(StegmanContext *ctx, const uint8_t *password, size_t passlen, FILE *png, int fd, StegmanPayload *type);
+
+/**
+ * Encodes a message split across multiple PNG files, in-place. The message is
+ * compressed and encrypted once, and the result is divided into shards, which
+ * are embedded in the carriers in order, in parallel. Carriers left over once
+ * the message fits are not modified. Each carrier is loaded whole while its
+ * shard is being embedded, so the context can't have a memory budget. Shards
+ * always take up all channels, in order, so the channels option has to be 
+ * left at STEGMAN_CHANNELS_ALL, and the scatter option off.
+ *
+ * \param ctx Library context.
+ * \param password Password bytes to encrypt the data with.
+ * \param passlen Length of the password, in bytes.
+ * \param pngs Carrier PNG files, opened for reading and writing.
+ * \param count Number of carriers, at most 65535.
+ * \param message Message bytes to encode.
+ * \param msglen Length of the message, in bytes.
+ * \param type Kind of the message.
+ * \param used Pointer to the number of carriers which received a shard. Can 
+ *             be NULL.
+ *
+ * \return STEGMAN_OK if the operation was successful, STEGMAN_E_CAPACITY if 
+ *         the carriers can't hold the message together, STEGMAN_E_OPTION if
+ *         the context selects other channels, scattering, or a memory 
+ *         budget, an error code otherwise.
+ */
+STEGMAN_API StegmanResult stegman_encode_shards(StegmanContext *ctx, const uint8_t *password, size_t passlen, FILE **pngs, size_t count, const uint8_t *message, size_t msglen, StegmanPayload type, size_t *used);
+
+/**
+ * Decodes a message split across multiple PNG files, and passes it to a sink 
+ * in pieces as it's decompressed. The carriers can be supplied in any order,
+ * but all of them need to be present. Shards are extracted one at a time, in
+ * order, and each one's piece of the message is decrypted and decompressed 
+ * before the next is extracted. Each carrier is loaded whole, so the context 
+ * can't have a memory budget.
+ *
+ * \param ctx Library context.
+ * \param password Password bytes to decrypt the data with.
+ * \param passlen Length of the password, in bytes.
+ * \param pngs Carrier PNG files.
+ * \param count Number of carriers.
+ * \param sink Function receiving the message.
+ * \param arg Argument for the sink.
+ * \param type Pointer to the kind of the message.
+ *
+ * \return STEGMAN_OK if the operation was successful, STEGMAN_E_SHARD if the
+ *         carriers don't make up a complete message, STEGMAN_E_OPTION if the
+ *         context has a memory budget, an error code otherwise.
+ */
+STEGMAN_API StegmanResult stegman_decode_shards(StegmanContext *ctx, const uint8_t *password, size_t passlen, FILE **pngs, size_t count, StegmanSink sink, void *arg, StegmanPayload *type);
+
+// Define C extern for C++
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,85 @@
+// This file is part of stegman project
+//
+// Copyright (c) 2018 Mateusz Brawański (Emzi0767)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Check if we're using a C99-capable compiler
+#if __STDC_VERSION__ < 199901L
+#error "You need to use a C99-capable compiler to build this program!"
+#endif
+
+// Define C extern for C++
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Appropriate headers
+#include "defs.h"
+#include "synth.h"
+
+// Words the text is made up of
+static const char *const SYNTH_WORDS[] = { "the ", "secret ", "meeting ", "is ", "at ", "station ", "tomorrow ", "please ", "bring ", "documents ", "and ", "money ", "\n" };
+
+// Function definitions
+void synth_seed(SynthRandom *rnd, uint64_t seed)
+{
+	// The generator gets stuck at 0
+	rnd->state = seed ? seed : 0x9E3779B97F4A7C15ULL;
+}
+
+uint64_t synth_next(SynthRandom *rnd)
+{
+	rnd->state ^= rnd->state << 13;
+	rnd->state ^= rnd->state >> 7;
+	rnd->state ^= rnd->state << 17;
+	return rnd->state;
+}
+
+void synth_random(SynthRandom *rnd, uint8_t *data, uint64_t len)
+{
+	for (uint64_t i = 0; i < len; i++)
+		data[i] = (uint8_t)synth_next(rnd);
+}
+
+void synth_text(SynthRandom *rnd, uint8_t *data, uint64_t len)
+{
+	size_t words = sizeof(SYNTH_WORDS) / sizeof(SYNTH_WORDS[0]);
+	for (uint64_t i = 0; i < len; )
+	{
+		const char *word = SYNTH_WORDS[synth_next(rnd) % words];
+		for (size_t j = 0; word[j] && i < len; j++)
+			data[i++] = (uint8_t)word[j];
+	}
+}
+
+void synth_pixels(SynthRandom *rnd, uint8_t *data, const PngImageInfo *image)
+{
+	size_t channels = image->bit_depth / 8;
+	for (uint32_t y = 0; y < image->height; y++)
+		for (uint32_t x = 0; x < image->width; x++)
+			for (size_t c = 0; c < channels; c++)
+				*data++ = (uint8_t)((x + y * (c + 1)) / 4 + (synth_next(rnd) & 0x07));
+}
+
+// Define C extern for C++
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,102 @@
+// This file is part of stegman project
+//
+// Copyright (c) 2018 Mateusz Brawański (Emzi0767)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/**
+ * \file
+ * \brief Deterministic synthetic inputs for the benchmark and regression tools.
+ */
+
+// Only include once
+#pragma once
+
+// Check if we're using a C99-capable compiler
+#if __STDC_VERSION__ < 199901L
+#error "You need to use a C99-capable compiler to build this program!"
+#endif
+
+// Define C extern for C++
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// PNG wrapper
+#include "png.h"
+
+/** State of the deterministic pseudo-random generator. */
+typedef struct SynthRandom
+{
+	/** Current state, never 0. */
+	uint64_t state;
+} SynthRandom;
+
+/**
+ * Seeds the generator. The same seed always yields the same sequence.
+ *
+ * \param rnd Generator to seed.
+ * \param seed Seed value.
+ */
+void synth_seed(SynthRandom *rnd, uint64_t seed);
+
+/**
+ * Generates the next pseudo-random value.
+ *
+ * \param rnd Generator to advance.
+ *
+ * \return Next value.
+ */
+uint64_t synth_next(SynthRandom *rnd);
+
+/**
+ * Fills a buffer with incompressible bytes.
+ *
+ * \param rnd Generator to use.
+ * \param data Buffer to fill.
+ * \param len Length of the buffer, in bytes.
+ */
+void synth_random(SynthRandom *rnd, uint8_t *data, uint64_t len);
+
+/**
+ * Fills a buffer with text made up of common words, which compresses like a 
+ * real message.
+ *
+ * \param rnd Generator to use.
+ * \param data Buffer to fill.
+ * \param len Length of the buffer, in bytes.
+ */
+void synth_text(SynthRandom *rnd, uint8_t *data, uint64_t len);
+
+/**
+ * Fills a pixel buffer with a photo-like image: smooth gradients with a little
+ * noise.
+ *
+ * \param rnd Generator to use.
+ * \param data Buffer to fill, holding `png_row_size(image) * image->height` 
+ *             bytes.
+ * \param image Dimensions and format of the image.
+ */
+void synth_pixels(SynthRandom *rnd, uint8_t *data, const PngImageInfo *image);
+
+// Define C extern for C++
+#ifdef __cplusplus
+}
+#endif
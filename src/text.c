@@ -0,0 +1,170 @@
+// This file is part of stegman project
+//
+// Copyright (c) 2018 Mateusz Brawański (Emzi0767)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Check if we're using a C99-capable compiler
+#if __STDC_VERSION__ < 199901L
+#error "You need to use a C99-capable compiler to build this program!"
+#endif
+
+// Define C extern for C++
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Appropriate headers
+#include "defs.h"
+#include "text.h"
+
+// Standard library
+#include <stdlib.h>
+
+// Smallest code point which needs given number of continuation bytes
+static const uint32_t UTF8_MIN[] = { 0, 0x80, 0x800, 0x10000 };
+
+// Function definitions
+int32_t text_wcs_to_utf8(const wchar_t *src, size_t srclen, uint8_t **result, size_t *reslen)
+{
+	// UTF-8 takes up at most 4 bytes per code point
+	*result = (uint8_t*)calloc(srclen * 4 + 1, sizeof(uint8_t));
+	if (!(*result))
+		return 1;
+
+	uint8_t *ptr = *result;
+	for (size_t i = 0; i < srclen; i++)
+	{
+		uint32_t cp = (uint32_t)src[i];
+		if (cp < 0x80)
+		{
+			*ptr++ = cp;
+		}
+		else if (cp < 0x800)
+		{
+			*ptr++ = 0xC0 | (cp >> 6);
+			*ptr++ = 0x80 | (cp & 0x3F);
+		}
+		else if (cp < 0x10000)
+		{
+			if (cp >= 0xD800 && cp <= 0xDFFF)
+			{
+				free(*result);
+				return 2;
+			}
+
+			*ptr++ = 0xE0 | (cp >> 12);
+			*ptr++ = 0x80 | ((cp >> 6) & 0x3F);
+			*ptr++ = 0x80 | (cp & 0x3F);
+		}
+		else if (cp < 0x110000)
+		{
+			*ptr++ = 0xF0 | (cp >> 18);
+			*ptr++ = 0x80 | ((cp >> 12) & 0x3F);
+			*ptr++ = 0x80 | ((cp >> 6) & 0x3F);
+			*ptr++ = 0x80 | (cp & 0x3F);
+		}
+		else
+		{
+			free(*result);
+			return 2;
+		}
+	}
+
+	*reslen = ptr - *result;
+	return 0;
+}
+
+int32_t text_utf8_to_wcs(const uint8_t *src, size_t srclen, wchar_t **result, size_t *reslen)
+{
+	// Every code point takes up at least 1 byte
+	*result = (wchar_t*)calloc(srclen + 1, sizeof(wchar_t));
+	if (!(*result))
+		return 1;
+
+	size_t len = 0;
+	for (size_t i = 0; i < srclen; len++)
+	{
+		uint8_t lead = src[i];
+		uint32_t cp = 0;
+		size_t extra = 0;
+		if (lead < 0x80)
+		{
+			cp = lead;
+		}
+		else if ((lead & 0xE0) == 0xC0)
+		{
+			cp = lead & 0x1F;
+			extra = 1;
+		}
+		else if ((lead & 0xF0) == 0xE0)
+		{
+			cp = lead & 0x0F;
+			extra = 2;
+		}
+		else if ((lead & 0xF8) == 0xF0)
+		{
+			cp = lead & 0x07;
+			extra = 3;
+		}
+		else
+		{
+			free(*result);
+			return 2;
+		}
+
+		if (extra > srclen - i - 1)
+		{
+			free(*result);
+			return 2;
+		}
+
+		for (size_t j = 1; j <= extra; j++)
+		{
+			if ((src[i + j] & 0xC0) != 0x80)
+			{
+				free(*result);
+				return 2;
+			}
+
+			cp = (cp << 6) | (src[i + j] & 0x3F);
+		}
+
+		// Only accept what the encoder produces: no overlong forms, 
+		// surrogates, or values past the last code point
+		if (cp < UTF8_MIN[extra] || (cp >= 0xD800 && cp <= 0xDFFF) || cp >= 0x110000)
+		{
+			free(*result);
+			return 2;
+		}
+
+		(*result)[len] = (wchar_t)cp;
+		i += extra + 1;
+	}
+
+	(*result)[len] = L'\0';
+	*reslen = len;
+	return 0;
+}
+
+// Define C extern for C++
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,73 @@
+// This file is part of stegman project
+//
+// Copyright (c) 2018 Mateusz Brawański (Emzi0767)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/**
+ * \file
+ * \brief Text conversion helpers for message storage.
+ */
+
+// Only include once
+#pragma once
+
+// Check if we're using a C99-capable compiler
+#if __STDC_VERSION__ < 199901L
+#error "You need to use a C99-capable compiler to build this program!"
+#endif
+
+// Define C extern for C++
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * Converts a wide string to UTF-8.
+ *
+ * \param src Wide string to convert.
+ * \param srclen Length of the string, in characters.
+ * \param result Pointer to resulting UTF-8 bytes. The underlying pointer will 
+ *               be initialized.
+ * \param reslen Pointer to length of the result, in bytes.
+ *
+ * \return 0 if the operation was successful, an error code otherwise.
+ */
+int32_t text_wcs_to_utf8(const wchar_t *src, size_t srclen, uint8_t **result, size_t *reslen);
+
+/**
+ * Converts UTF-8 bytes to a wide string. The result is null-terminated. 
+ * Overlong forms, surrogates, and values above U+10FFFF are rejected.
+ *
+ * \param src UTF-8 bytes to convert.
+ * \param srclen Length of the data, in bytes.
+ * \param result Pointer to resulting wide string. The underlying pointer will 
+ *               be initialized.
+ * \param reslen Pointer to length of the result, in characters, not including
+ *               the terminator.
+ *
+ * \return 0 if the operation was successful, an error code otherwise.
+ */
+int32_t text_utf8_to_wcs(const uint8_t *src, size_t srclen, wchar_t **result, size_t *reslen);
+
+// Define C extern for C++
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,311 @@
+// This file is part of stegman project
+//
+// Copyright (c) 2018 Mateusz Brawański (Emzi0767)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Check if we're using a C99-capable compiler
+#if __STDC_VERSION__ < 199901L
+#error "You need to use a C99-capable compiler to build this program!"
+#endif
+
+// Define C extern for C++
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Appropriate headers
+#include "defs.h"
+#include "trace.h"
+
+// Standard library
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+
+// Number of events in each block of a thread's buffer
+#define TRACE_BLOCK_EVENTS 4096
+
+typedef struct TraceEvent
+{
+	const char *category;
+	const char *name;
+	uint64_t ts;
+	uint64_t id;
+	char phase;
+} TraceEvent;
+
+typedef struct TraceBlock
+{
+	struct TraceBlock *next;
+	size_t count;
+	TraceEvent events[TRACE_BLOCK_EVENTS];
+} TraceBlock;
+
+// Events recorded by a single thread. Only the owning thread appends to it, 
+// so recording doesn't need any locks.
+typedef struct TraceBuffer
+{
+	struct TraceBuffer *next;
+	uint32_t tid;
+	const char *name;
+	int32_t index;
+	TraceBlock *first;
+	TraceBlock *last;
+} TraceBuffer;
+
+// Per-thread state. Buffers belong to the recording session which created 
+// them, and are released with it, even if the thread is still running.
+typedef struct TraceThread
+{
+	uint64_t session;
+	TraceBuffer *buffer;
+	const char *name;
+	int32_t index;
+} TraceThread;
+
+// Recording state
+static bool trace_on = false;
+static uint64_t trace_session = 0;
+static uint64_t trace_epoch = 0;
+static uint32_t trace_tids = 0;
+static TraceBuffer *trace_buffers = NULL;
+
+// State of the current thread
+static pthread_key_t trace_key;
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+
+// Helper functions
+static void trace_key_create(void)
+{
+	pthread_key_create(&trace_key, free);
+}
+
+static uint64_t trace_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static TraceThread *trace_thread(void)
+{
+	pthread_once(&trace_once, trace_key_create);
+	TraceThread *thread = (TraceThread*)pthread_getspecific(trace_key);
+	if (thread)
+		return thread;
+
+	thread = (TraceThread*)calloc(1, sizeof(TraceThread));
+	if (!thread)
+		return NULL;
+
+	thread->index = -1;
+	if (pthread_setspecific(trace_key, thread))
+	{
+		free(thread);
+		return NULL;
+	}
+
+	return thread;
+}
+
+// Gets the calling thread's buffer for the current session, creating it on
+// first use
+static TraceBuffer *trace_buffer(void)
+{
+	TraceThread *thread = trace_thread();
+	if (!thread)
+		return NULL;
+
+	uint64_t session = __atomic_load_n(&trace_session, __ATOMIC_ACQUIRE);
+	if (thread->buffer && thread->session == session)
+		return thread->buffer;
+
+	TraceBuffer *buffer = (TraceBuffer*)calloc(1, sizeof(TraceBuffer));
+	if (!buffer)
+		return NULL;
+
+	buffer->tid = __atomic_add_fetch(&trace_tids, 1, __ATOMIC_RELAXED);
+	buffer->name = thread->name;
+	buffer->index = thread->index;
+
+	// Threads register themselves without locking, by pushing onto the list
+	buffer->next = __atomic_load_n(&trace_buffers, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&trace_buffers, &buffer->next, buffer, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		;
+
+	thread->session = session;
+	thread->buffer = buffer;
+	return buffer;
+}
+
+static void trace_record(char phase, const char *category, const char *name, uint64_t id)
+{
+	if (!__atomic_load_n(&trace_on, __ATOMIC_RELAXED))
+		return;
+
+	TraceBuffer *buffer = trace_buffer();
+	if (!buffer)
+		return;
+
+	// Events which can't be stored are dropped
+	TraceBlock *block = buffer->last;
+	if (!block || block->count == TRACE_BLOCK_EVENTS)
+	{
+		TraceBlock *next = (TraceBlock*)malloc(sizeof(TraceBlock));
+		if (!next)
+			return;
+
+		next->next = NULL;
+		next->count = 0;
+		if (block)
+			block->next = next;
+		else
+			buffer->first = next;
+		buffer->last = next;
+		block = next;
+	}
+
+	TraceEvent *event = block->events + block->count;
+	event->category = category;
+	event->name = name;
+	event->ts = trace_now();
+	event->id = id;
+	event->phase = phase;
+	block->count++;
+}
+
+static void trace_release(void)
+{
+	TraceBuffer *buffer = __atomic_exchange_n(&trace_buffers, NULL, __ATOMIC_ACQ_REL);
+	while (buffer)
+	{
+		TraceBlock *block = buffer->first;
+		while (block)
+		{
+			TraceBlock *next = block->next;
+			free(block);
+			block = next;
+		}
+
+		TraceBuffer *next = buffer->next;
+		free(buffer);
+		buffer = next;
+	}
+}
+
+// Function definitions
+void trace_start(void)
+{
+	__atomic_store_n(&trace_on, false, __ATOMIC_RELEASE);
+	trace_release();
+	trace_epoch = trace_now();
+	__atomic_add_fetch(&trace_session, 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&trace_on, true, __ATOMIC_RELEASE);
+}
+
+void trace_stop(void)
+{
+	__atomic_store_n(&trace_on, false, __ATOMIC_RELEASE);
+	trace_release();
+	__atomic_add_fetch(&trace_session, 1, __ATOMIC_RELEASE);
+}
+
+bool trace_enabled(void)
+{
+	return __atomic_load_n(&trace_on, __ATOMIC_RELAXED);
+}
+
+void trace_name_thread(const char *name, int32_t index)
+{
+	TraceThread *thread = trace_thread();
+	if (!thread)
+		return;
+
+	thread->name = name;
+	thread->index = index;
+	if (thread->buffer && thread->session == __atomic_load_n(&trace_session, __ATOMIC_ACQUIRE))
+	{
+		thread->buffer->name = name;
+		thread->buffer->index = index;
+	}
+}
+
+void trace_begin(const char *category, const char *name)
+{
+	trace_record('B', category, name, 0);
+}
+
+void trace_end(const char *category, const char *name)
+{
+	trace_record('E', category, name, 0);
+}
+
+void trace_async_begin(const char *category, const char *name, uint64_t id)
+{
+	trace_record('b', category, name, id);
+}
+
+void trace_async_end(const char *category, const char *name, uint64_t id)
+{
+	trace_record('e', category, name, id);
+}
+
+int32_t trace_write(FILE *out)
+{
+	int pid = (int)getpid();
+	bool first = true;
+	fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+	for (TraceBuffer *buffer = __atomic_load_n(&trace_buffers, __ATOMIC_ACQUIRE); buffer; buffer = buffer->next)
+	{
+		// Name the thread, so that the timeline shows which is which
+		fprintf(out, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"", first ? "" : ",", pid, buffer->tid);
+		if (buffer->name && buffer->index >= 0)
+			fprintf(out, "%s %d", buffer->name, buffer->index);
+		else if (buffer->name)
+			fprintf(out, "%s", buffer->name);
+		else
+			fprintf(out, "thread %u", buffer->tid);
+		fprintf(out, "\"}}");
+		first = false;
+
+		for (TraceBlock *block = buffer->first; block; block = block->next)
+		{
+			for (size_t i = 0; i < block->count; i++)
+			{
+				const TraceEvent *event = block->events + i;
+				double ts = (event->ts - trace_epoch) / 1e3;
+				fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u", event->name, event->category, event->phase, ts, pid, buffer->tid);
+				if (event->phase == 'b' || event->phase == 'e')
+					fprintf(out, ",\"id\":\"0x%llx\"", (unsigned long long)event->id);
+				fprintf(out, "}");
+			}
+		}
+	}
+
+	fprintf(out, "\n]}\n");
+	return fflush(out) || ferror(out) ? 1 : 0;
+}
+
+// Define C extern for C++
+#ifdef __cplusplus
+}
+#endif
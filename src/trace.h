@@ -0,0 +1,123 @@
+// This file is part of stegman project
+//
+// Copyright (c) 2018 Mateusz Brawański (Emzi0767)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/**
+ * \file
+ * \brief Recording of a timeline of pipeline stages, jobs, and I/O, exported as Chrome trace JSON.
+ */
+
+// Only include once
+#pragma once
+
+// Check if we're using a C99-capable compiler
+#if __STDC_VERSION__ < 199901L
+#error "You need to use a C99-capable compiler to build this program!"
+#endif
+
+// Define C extern for C++
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Standard library
+#include <stdio.h>
+
+/**
+ * Starts recording events, discarding any previously recorded ones. Until 
+ * this is called, recording functions return immediately.
+ */
+void trace_start(void);
+
+/**
+ * Stops recording events, and releases the recorded ones. No other thread 
+ * may be recording while this is called.
+ */
+void trace_stop(void);
+
+/**
+ * Checks whether events are being recorded.
+ *
+ * \return Whether events are being recorded.
+ */
+bool trace_enabled(void);
+
+/**
+ * Names the calling thread in the timeline. Can be called before recording
+ * starts.
+ *
+ * \param name Static name of the thread.
+ * \param index Index appended to the name, or -1 for none.
+ */
+void trace_name_thread(const char *name, int32_t index);
+
+/**
+ * Records the start of a span on the calling thread. Spans on a thread must
+ * be nested, each ending before the one enclosing it.
+ *
+ * \param category Static name of the category, such as stage, job, or io.
+ * \param name Static name of the span.
+ */
+void trace_begin(const char *category, const char *name);
+
+/**
+ * Records the end of the innermost span on the calling thread.
+ *
+ * \param category Static name of the category.
+ * \param name Static name of the span.
+ */
+void trace_end(const char *category, const char *name);
+
+/**
+ * Records the start of an asynchronous span, which can overlap others, and
+ * end on any thread.
+ *
+ * \param category Static name of the category.
+ * \param name Static name of the span.
+ * \param id Identifier matching the start with the end.
+ */
+void trace_async_begin(const char *category, const char *name, uint64_t id);
+
+/**
+ * Records the end of an asynchronous span.
+ *
+ * \param category Static name of the category.
+ * \param name Static name of the span.
+ * \param id Identifier given when the span started.
+ */
+void trace_async_end(const char *category, const char *name, uint64_t id);
+
+/**
+ * Writes the recorded events as Chrome trace JSON, which can be opened in 
+ * Perfetto or chrome://tracing. No other thread may be recording while this
+ * is called.
+ *
+ * \param out File to write to.
+ *
+ * \return 0 if the operation was successful, an error code otherwise.
+ */
+int32_t trace_write(FILE *out);
+
+// Define C extern for C++
+#ifdef __cplusplus
+}
+#endif
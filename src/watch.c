@@ -0,0 +1,406 @@
+// This file is part of stegman project
+//
+// Copyright (c) 2018 Mateusz Brawański (Emzi0767)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Check if we're using a C99-capable compiler
+#if __STDC_VERSION__ < 199901L
+#error "You need to use a C99-capable compiler to build this program!"
+#endif
+
+// Define C extern for C++
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Appropriate headers
+#include "defs.h"
+#include "job.h"
+#include "watch.h"
+
+// Standard library
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+// Constant definitions
+static const char WATCH_CARRIER[] = ".png";
+static const char WATCH_PAYLOAD[] = ".msg";
+
+// File of a pair which arrived, and is waiting for its counterpart
+typedef struct WatchEntry
+{
+	char *name;
+	bool carrier;
+	bool payload;
+	struct WatchEntry *next;
+} WatchEntry;
+
+// Shared state of the watcher
+typedef struct WatchState
+{
+	JobRunner *runner;
+	PoolGroup group;
+	FILE *results;
+	const char *spool;
+	const char *outdir;
+	const char *password;
+	WatchEntry *waiting;
+	size_t submitted;
+	size_t maxinflight;
+
+	// Protects the counters below
+	pthread_mutex_t lock;
+	pthread_cond_t finished;
+	size_t inflight;
+	size_t failed;
+} WatchState;
+
+// Single pair being encoded
+typedef struct WatchTask
+{
+	WatchState *state;
+	char *target;
+	Job job;
+	JobResult result;
+} WatchTask;
+
+static volatile sig_atomic_t watch_stopping = 0;
+
+// Helper functions
+static void watch_signal(int sig)
+{
+	watch_stopping = 1;
+}
+
+// Concatenates a NULL-terminated list of strings
+static char *watch_join(const char *first, ...)
+{
+	va_list args;
+	size_t len = 1;
+	va_start(args, first);
+	for (const char *s = first; s; s = va_arg(args, const char*))
+		len += strlen(s);
+	va_end(args);
+
+	char *result = (char*)malloc(len);
+	if (!result)
+		fail(128, L"Could not allocate memory (E_WATCH_ALLOC)\n");
+
+	result[0] = '\0';
+	va_start(args, first);
+	for (const char *s = first; s; s = va_arg(args, const char*))
+		strcat(result, s);
+	va_end(args);
+
+	return result;
+}
+
+// Moves a file aside, so that it's not picked up again
+static void watch_set_aside(const char *path)
+{
+	char *failed = watch_join(path, ".failed", NULL);
+	rename(path, failed);
+	free(failed);
+}
+
+static void watch_task(void *arg)
+{
+	WatchTask *task = (WatchTask*)arg;
+	WatchState *state = task->state;
+	job_run(state->runner, &task->job, &task->result);
+
+	// The result only appears in the output directory once complete
+	if (task->result.res == STEGMAN_OK && rename(task->job.output, task->target))
+	{
+		task->result.res = STEGMAN_E_IO;
+		task->result.detail = errno;
+		task->result.error = "Could not move the result to the output directory";
+		remove(task->job.output);
+	}
+
+	// Report where the result was meant to end up
+	char *temp = task->job.output;
+	task->job.output = task->target;
+	task->target = temp;
+
+	if (task->result.res == STEGMAN_OK)
+	{
+		remove(task->job.carrier);
+		remove(task->job.payload + 1);
+	}
+	else
+	{
+		watch_set_aside(task->job.carrier);
+		watch_set_aside(task->job.payload + 1);
+	}
+
+	pthread_mutex_lock(&state->lock);
+	job_write_result(state->results, &task->job, &task->result);
+	fflush(state->results);
+	if (task->result.res != STEGMAN_OK)
+		state->failed++;
+
+	state->inflight--;
+	pthread_cond_broadcast(&state->finished);
+	pthread_mutex_unlock(&state->lock);
+
+	free(task->job.carrier);
+	free(task->job.payload);
+	free(task->job.output);
+	free(task->target);
+	free(task);
+}
+
+// Queues a complete pair, waiting while the workers are saturated
+static void watch_submit(WatchState *state, const char *name)
+{
+	WatchTask *task = (WatchTask*)calloc(1, sizeof(WatchTask));
+	if (!task)
+		fail(128, L"Could not allocate memory (E_WATCH_ALLOC)\n");
+
+	task->state = state;
+	task->job.op = JOB_ENCODE;
+	task->job.line = ++state->submitted;
+	task->job.password = (char*)state->password;
+	task->job.carrier = watch_join(state->spool, "/", name, WATCH_CARRIER, NULL);
+	task->job.payload = watch_join("@", state->spool, "/", name, WATCH_PAYLOAD, NULL);
+	task->job.output = watch_join(state->outdir, "/.", name, WATCH_CARRIER, ".tmp", NULL);
+	task->target = watch_join(state->outdir, "/", name, WATCH_CARRIER, NULL);
+
+	pthread_mutex_lock(&state->lock);
+	while (state->inflight >= state->maxinflight)
+		pthread_cond_wait(&state->finished, &state->lock);
+	state->inflight++;
+	pthread_mutex_unlock(&state->lock);
+
+	if (pool_submit(runner_pool(state->runner), &state->group, watch_task, task))
+		watch_task(task);
+}
+
+// Records the arrival of a file, and queues the pair once complete
+static void watch_arrived(WatchState *state, const char *file)
+{
+	size_t len = strlen(file);
+	if (file[0] == '.' || len <= 4)
+		return;
+
+	bool carrier = strcmp(file + len - 4, WATCH_CARRIER) == 0;
+	bool payload = strcmp(file + len - 4, WATCH_PAYLOAD) == 0;
+	if (!carrier && !payload)
+		return;
+
+	WatchEntry **entry = &state->waiting;
+	while (*entry && (strncmp((*entry)->name, file, len - 4) || (*entry)->name[len - 4]))
+		entry = &(*entry)->next;
+
+	if (!*entry)
+	{
+		*entry = (WatchEntry*)calloc(1, sizeof(WatchEntry));
+		if (!*entry)
+			fail(128, L"Could not allocate memory (E_WATCH_ALLOC)\n");
+
+		(*entry)->name = strndup(file, len - 4);
+		if (!(*entry)->name)
+			fail(128, L"Could not allocate memory (E_WATCH_ALLOC)\n");
+	}
+
+	WatchEntry *e = *entry;
+	e->carrier |= carrier;
+	e->payload |= payload;
+	if (!e->carrier || !e->payload)
+		return;
+
+	// A half of the pair may be left over from a previous pair of the same 
+	// name, which was processed already
+	char *cpath = watch_join(state->spool, "/", e->name, WATCH_CARRIER, NULL);
+	char *ppath = watch_join(state->spool, "/", e->name, WATCH_PAYLOAD, NULL);
+	e->carrier = access(cpath, F_OK) == 0;
+	e->payload = access(ppath, F_OK) == 0;
+	free(cpath);
+	free(ppath);
+	if (!e->carrier || !e->payload)
+		return;
+
+	*entry = e->next;
+	watch_submit(state, e->name);
+	free(e->name);
+	free(e);
+}
+
+// Picks up files which arrived while nobody was watching
+static void watch_scan(WatchState *state)
+{
+	DIR *dir = opendir(state->spool);
+	if (!dir)
+		return;
+
+	struct dirent *ent;
+	while ((ent = readdir(dir)))
+		watch_arrived(state, ent->d_name);
+
+	closedir(dir);
+}
+
+static void watch_usage(void)
+{
+	werrorf(L"Usage: watch <spool dir> <output dir> <password ref> [--results <file>] [--threads <count>] [--reuse-key]\n");
+}
+
+// Function definitions
+int32_t watch_main(int argc, char **argv)
+{
+	if (argc < 3)
+	{
+		watch_usage();
+		return 1;
+	}
+
+	// Parse the options
+	WatchState state;
+	memset(&state, 0, sizeof(WatchState));
+	state.spool = argv[0];
+	state.outdir = argv[1];
+	state.password = argv[2];
+
+	const char *results = NULL;
+	size_t threads = 0;
+	StegmanOptions options;
+	stegman_default_options(&options);
+	for (int i = 3; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--results") == 0 && i + 1 < argc)
+		{
+			results = argv[++i];
+		}
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+		{
+			threads = strtoul(argv[++i], NULL, 10);
+		}
+		else if (strcmp(argv[i], "--reuse-key") == 0)
+		{
+			options.reuse_key = true;
+		}
+		else
+		{
+			watch_usage();
+			return 1;
+		}
+	}
+
+	struct stat st;
+	if (stat(state.outdir, &st) || !S_ISDIR(st.st_mode))
+		fail(2, L"'%s' is not a directory\n", state.outdir);
+
+	// Watch before scanning, so that no file falls in between
+	int ifd = inotify_init();
+	if (ifd < 0 || inotify_add_watch(ifd, state.spool, IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR) < 0)
+		fail(2, L"Could not watch '%s' (%d)\n", state.spool, errno);
+
+	state.results = results ? fopen(results, "ab") : stdout;
+	if (!state.results)
+		fail(2, L"There was an error opening '%s'\n", results);
+
+	// Only the watching thread handles termination signals
+	sigset_t sigs, oldsigs;
+	sigemptyset(&sigs);
+	sigaddset(&sigs, SIGINT);
+	sigaddset(&sigs, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &sigs, &oldsigs);
+
+	if (runner_create(threads, &options, &state.runner))
+		fail(4, L"Could not start worker threads\n");
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = watch_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	pthread_sigmask(SIG_SETMASK, &oldsigs, NULL);
+
+	// Keep a few pairs queued per worker, the rest waits in the kernel
+	state.maxinflight = pool_size(runner_pool(state.runner)) * 2;
+	pthread_mutex_init(&state.lock, NULL);
+	pthread_cond_init(&state.finished, NULL);
+	pool_group_init(&state.group);
+
+	werrorf(L"Watching '%s'.\n", state.spool);
+	watch_scan(&state);
+
+	union
+	{
+		struct inotify_event ev;
+		uint8_t data[4096];
+	} buf;
+
+	while (!watch_stopping)
+	{
+		ssize_t len = read(ifd, buf.data, sizeof(buf));
+		if (len <= 0)
+			continue;
+
+		for (ssize_t off = 0; off < len; )
+		{
+			const struct inotify_event *ev = (const struct inotify_event*)(buf.data + off);
+			off += sizeof(struct inotify_event) + ev->len;
+
+			// Events were lost, look at the whole directory again
+			if (ev->mask & IN_Q_OVERFLOW)
+				watch_scan(&state);
+			else if (ev->len && !(ev->mask & IN_ISDIR))
+				watch_arrived(&state, ev->name);
+		}
+	}
+
+	// Finish the pairs in progress
+	close(ifd);
+	pool_group_wait(runner_pool(state.runner), &state.group);
+	pool_group_destroy(&state.group);
+	runner_destroy(state.runner);
+	pthread_cond_destroy(&state.finished);
+	pthread_mutex_destroy(&state.lock);
+
+	while (state.waiting)
+	{
+		WatchEntry *next = state.waiting->next;
+		free(state.waiting->name);
+		free(state.waiting);
+		state.waiting = next;
+	}
+
+	if (results)
+		fclose(state.results);
+
+	werrorf(L"Processed %lu pairs, %lu failed.\n", (unsigned long)state.submitted, (unsigned long)state.failed);
+	return state.failed ? 1 : 0;
+}
+
+// Define C extern for C++
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,61 @@
+// This file is part of stegman project
+//
+// Copyright (c) 2018 Mateusz Brawański (Emzi0767)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/**
+ * \file
+ * \brief Spool directory watcher, encoding files as soon as they arrive.
+ */
+
+// Only include once
+#pragma once
+
+// Check if we're using a C99-capable compiler
+#if __STDC_VERSION__ < 199901L
+#error "You need to use a C99-capable compiler to build this program!"
+#endif
+
+// Define C extern for C++
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * Watches a spool directory, and encodes every pair of `<name>.png` carrier 
+ * and `<name>.msg` payload as soon as both were closed after writing, or 
+ * moved into the directory. Pairs already present on startup are picked up 
+ * too. Results are written to `<name>.png` in the output directory, through a
+ * temporary file which is renamed once complete, and the pair is removed from
+ * the spool. Pairs which fail are renamed with a `.failed` suffix. Runs until
+ * interrupted.
+ *
+ * \param argc Number of arguments, following the mode name.
+ * \param argv Arguments following the mode name.
+ *
+ * \return Exit code for the program.
+ */
+int32_t watch_main(int argc, char **argv);
+
+// Define C extern for C++
+#ifdef __cplusplus
+}
+#endif
@@ -40,20 +40,297 @@ extern "C"
 #include <string.h>
 #include <zlib.h>
 
+// Constant definitions
+const uint64_t ZLIB_CHUNK_SIZE = 4 * 1024 * 1024;
+const size_t ZLIB_STREAM_SIZE = 64 * 1024;
+
 // Helper
 static inline uint64_t max(uint64_t a, uint64_t b)
 {
 	return a > b ? a : b;
 }
 
+static inline uint64_t min(uint64_t a, uint64_t b)
+{
+	return a < b ? a : b;
+}
+
+// Size of the chunked stream header: total length, block size, block count
+static const size_t CHUNK_HEADER_SIZE = sizeof(uint64_t) + sizeof(uint32_t) + sizeof(uint32_t);
+
+// Work item for a single block
+typedef struct ZlibBlock
+{
+	const uint8_t *src;
+	uint64_t srclen;
+	uint8_t *dst;
+	uint64_t dstlen;
+	int32_t res;
+} ZlibBlock;
+
+static void zlib_compress_block(void *arg)
+{
+	ZlibBlock *blk = (ZlibBlock*)arg;
+	uLongf dstlen = blk->dstlen;
+	blk->res = compress2(blk->dst, &dstlen, blk->src, blk->srclen, Z_BEST_COMPRESSION);
+	blk->dstlen = dstlen;
+}
+
+static void zlib_decompress_block(void *arg)
+{
+	ZlibBlock *blk = (ZlibBlock*)arg;
+	uLongf dstlen = blk->dstlen;
+	blk->res = uncompress(blk->dst, &dstlen, blk->src, blk->srclen);
+	if (blk->res == Z_OK && dstlen != blk->dstlen)
+		blk->res = Z_DATA_ERROR;
+}
+
+// Reads and validates the header of a chunked stream. Block buffers are 
+// sized from it, so only the block size written by the compressor is 
+// accepted.
+static bool zlib_chunked_header(const uint8_t *data, uint64_t length, uint64_t *total, uint64_t *bsize, uint64_t *count)
+{
+	if (length < CHUNK_HEADER_SIZE)
+		return false;
+
+	*total = *((uint64_t*)data);
+	*bsize = *((uint32_t*)(data + sizeof(uint64_t)));
+	*count = *((uint32_t*)(data + sizeof(uint64_t) + sizeof(uint32_t)));
+	return *bsize == ZLIB_CHUNK_SIZE && *count == *total / *bsize + (*total % *bsize ? 1 : 0) && *count <= (length - CHUNK_HEADER_SIZE) / sizeof(uint64_t);
+}
+
+// Decompresses a round of blocks in parallel, and hands them to the sink in 
+// order
+static int32_t zlib_decompress_round(ThreadPool *pool, ZlibBlock *blocks, uint64_t round, ZlibSink sink, void *arg)
+{
+	PoolGroup group;
+	pool_group_init(&group);
+	for (uint64_t i = 0; i < round; i++)
+		if (pool_submit(pool, &group, zlib_decompress_block, blocks + i))
+			zlib_decompress_block(blocks + i);
+	pool_group_wait(pool, &group);
+	pool_group_destroy(&group);
+
+	for (uint64_t i = 0; i < round; i++)
+	{
+		if (blocks[i].res != Z_OK)
+			return blocks[i].res;
+
+		if (sink(arg, blocks[i].dst, blocks[i].dstlen))
+			return 128;
+	}
+
+	return Z_OK;
+}
+
+// State of a decompression fed in pieces
+struct ZlibInflater
+{
+	ThreadPool *pool;
+	Arena *arena;
+	ZlibSink sink;
+	void *arg;
+	uint64_t length;
+	bool chunked;
+
+	// First failure, after which further input is ignored
+	int32_t res;
+
+	// Leading bytes, which are collected before anything is decompressed: the
+	// length prefix, or the chunked stream header
+	uint8_t head[sizeof(uint64_t) * 2];
+	size_t headlen;
+
+	// Single stream
+	z_stream strm;
+	const uint8_t *dict;
+	size_t dictlen;
+	uint8_t *buf;
+	bool ended;
+
+	// Chunked stream. Compressed blocks are collected until there's one for 
+	// every worker, and then decompressed together.
+	uint64_t total, bsize, count;
+	uint64_t *table;
+	uint64_t tablelen;
+	uint64_t width;
+	ZlibBlock *blocks;
+	uint8_t *staging;
+	uint8_t *buffers;
+	uint64_t next, filled, round, staged;
+};
+
+static size_t zlib_inflater_head(ZlibInflater *inflater)
+{
+	return inflater->chunked ? CHUNK_HEADER_SIZE : sizeof(uint64_t);
+}
+
+// Reads the chunked stream header, and allocates the block table and buffers
+static int32_t zlib_inflater_blocks(ZlibInflater *inflater)
+{
+	if (!zlib_chunked_header(inflater->head, inflater->length, &inflater->total, &inflater->bsize, &inflater->count))
+		return 64;
+
+	if (!inflater->count)
+		return Z_OK;
+
+	inflater->width = min(pool_size(inflater->pool), inflater->count);
+	inflater->table = (uint64_t*)arena_alloc(inflater->arena, inflater->count * sizeof(uint64_t));
+	inflater->blocks = inflater->table ? (ZlibBlock*)arena_alloc(inflater->arena, inflater->width * sizeof(ZlibBlock)) : NULL;
+	inflater->staging = inflater->blocks ? (uint8_t*)arena_alloc(inflater->arena, inflater->width * compressBound(inflater->bsize)) : NULL;
+	inflater->buffers = inflater->staging ? (uint8_t*)arena_alloc(inflater->arena, inflater->width * inflater->bsize) : NULL;
+	return inflater->buffers ? Z_OK : 16;
+}
+
+// Checks that the block table describes blocks the buffers can hold, and that
+// fit in the stream
+static int32_t zlib_inflater_table(ZlibInflater *inflater)
+{
+	uint64_t left = inflater->length - CHUNK_HEADER_SIZE - inflater->count * sizeof(uint64_t);
+	for (uint64_t i = 0; i < inflater->count; i++)
+	{
+		if (!inflater->table[i] || inflater->table[i] > compressBound(inflater->bsize) || inflater->table[i] > left)
+			return 64;
+
+		left -= inflater->table[i];
+	}
+
+	return Z_OK;
+}
+
+// Collects compressed blocks, and decompresses each round once it's complete
+static int32_t zlib_inflater_chunked(ZlibInflater *inflater, const uint8_t *data, uint64_t length)
+{
+	uint64_t tablesize = inflater->count * sizeof(uint64_t);
+	while (length)
+	{
+		if (inflater->tablelen < tablesize)
+		{
+			uint64_t take = min(tablesize - inflater->tablelen, length);
+			memcpy((uint8_t*)inflater->table + inflater->tablelen, data, take);
+			inflater->tablelen += take;
+			data += take;
+			length -= take;
+
+			int32_t res = inflater->tablelen == tablesize ? zlib_inflater_table(inflater) : Z_OK;
+			if (res != Z_OK)
+				return res;
+
+			continue;
+		}
+
+		// Anything past the last block is ignored
+		if (inflater->next >= inflater->count)
+			return Z_OK;
+
+		uint64_t srclen = inflater->table[inflater->next];
+		uint64_t take = min(srclen - inflater->filled, length);
+		memcpy(inflater->staging + inflater->staged, data, take);
+		inflater->staged += take;
+		inflater->filled += take;
+		data += take;
+		length -= take;
+		if (inflater->filled < srclen)
+			continue;
+
+		ZlibBlock *blk = inflater->blocks + inflater->round;
+		blk->src = inflater->staging + inflater->staged - srclen;
+		blk->srclen = srclen;
+		blk->dst = inflater->buffers + inflater->round * inflater->bsize;
+		blk->dstlen = min(inflater->bsize, inflater->total - inflater->next * inflater->bsize);
+		inflater->round++;
+		inflater->next++;
+		inflater->filled = 0;
+		if (inflater->round < inflater->width && inflater->next < inflater->count)
+			continue;
+
+		int32_t res = zlib_decompress_round(inflater->pool, inflater->blocks, inflater->round, inflater->sink, inflater->arg);
+		inflater->round = inflater->staged = 0;
+		if (res != Z_OK)
+			return res;
+	}
+
+	return Z_OK;
+}
+
+// Inflates a single stream, handing the output over as it's produced
+static int32_t zlib_inflater_single(ZlibInflater *inflater, const uint8_t *data, uint64_t length)
+{
+	z_stream *strm = &inflater->strm;
+	while (length && !inflater->ended)
+	{
+		// Input is fed in pieces as well, so lengths beyond 4 GiB work
+		strm->next_in = (Bytef*)data;
+		strm->avail_in = (uInt)min(length, UINT32_MAX);
+		data += strm->avail_in;
+		length -= strm->avail_in;
+
+		for (;;)
+		{
+			strm->next_out = inflater->buf;
+			strm->avail_out = ZLIB_STREAM_SIZE;
+			int32_t res = inflate(strm, Z_NO_FLUSH);
+			if (res == Z_NEED_DICT)
+			{
+				res = inflater->dict ? inflateSetDictionary(strm, inflater->dict, inflater->dictlen) : Z_DATA_ERROR;
+				if (res == Z_OK)
+					continue;
+			}
+
+			// No progress can be made until more input arrives
+			if (res == Z_BUF_ERROR)
+				break;
+
+			if (res != Z_OK && res != Z_STREAM_END)
+				return res;
+
+			size_t produced = ZLIB_STREAM_SIZE - strm->avail_out;
+			if (produced && inflater->sink(inflater->arg, inflater->buf, produced))
+				return 128;
+
+			if (res == Z_STREAM_END)
+			{
+				inflater->ended = true;
+				break;
+			}
+
+			if (!strm->avail_in && strm->avail_out)
+				break;
+		}
+	}
+
+	return Z_OK;
+}
+
 // Function definitions
-int32_t zlib_compress(const uint8_t *data, uint64_t length, uint8_t **result, uint64_t *reslen)
+uint64_t zlib_compress_bound(uint64_t length)
+{
+	size_t isize = sizeof(uint64_t);
+	if (length <= ZLIB_CHUNK_SIZE)
+		return compressBound(length) + isize;
+
+	uint64_t count = length / ZLIB_CHUNK_SIZE;
+	uint64_t rest = length % ZLIB_CHUNK_SIZE;
+	uint64_t bound = CHUNK_HEADER_SIZE + count * (compressBound(ZLIB_CHUNK_SIZE) + isize);
+	if (rest)
+		bound += compressBound(rest) + isize;
+
+	return bound;
+}
+
+uint64_t zlib_compress_min(uint64_t length)
+{
+	// Length prefix, zlib header and checksum
+	return sizeof(uint64_t) + 6 + length / 1032;
+}
+
+int32_t zlib_compress(Arena *arena, const uint8_t *data, uint64_t length, uint8_t **result, uint64_t *reslen)
 {
 	// Allocate necessary buffers
 	uint64_t buflen = max(length * 2, length + 256) + 8;
 	size_t isize = sizeof(uint64_t);
 	*reslen = buflen + isize;
-	*result = (uint8_t*)calloc(*reslen, sizeof(uint8_t));
+	*result = (uint8_t*)arena_alloc(arena, *reslen);
 	if (!(*result))
 		return 16;
 
@@ -61,20 +338,23 @@ int32_t zlib_compress(const uint8_t *data, uint64_t length, uint8_t **result, ui
 	*((uint64_t*)*result) = length;
 
 	// Compress the data
-	int32_t res = compress2(*result + isize, &buflen, data, length, Z_BEST_COMPRESSION);
+	uLongf outlen = buflen;
+	int32_t res = compress2(*result + isize, &outlen, data, length, Z_BEST_COMPRESSION);
 	if (res != Z_OK)
 	{
-		free(*result);
+		arena_free(arena, *result);
 		return res;
 	}
 
+	buflen = outlen;
+
 	// Truncate the buffer
 	if (buflen + isize != *reslen)
 	{
-		uint8_t *result2 = realloc(*result, buflen + isize);
+		uint8_t *result2 = (uint8_t*)arena_realloc(arena, *result, *reslen, buflen + isize);
 		if (!result2)
 		{
-			free(*result);
+			arena_free(arena, *result);
 			return 32;
 		}
 
@@ -85,23 +365,396 @@ int32_t zlib_compress(const uint8_t *data, uint64_t length, uint8_t **result, ui
 	return res;
 }
 
-int32_t zlib_decompress(const uint8_t *data, uint64_t length, uint8_t **result, uint64_t *reslen)
+int32_t zlib_decompress(Arena *arena, const uint8_t *data, uint64_t length, uint8_t **result, uint64_t *reslen)
 {
 	// Allocate necessary buffers
 	size_t isize = sizeof(uint64_t);
 	*reslen = *((uint64_t*)data);
-	*result = (uint8_t*)calloc(*reslen, sizeof(uint8_t));
+	*result = (uint8_t*)arena_alloc(arena, *reslen);
 	if (!(*result))
 		return 16;
 	
 	// Decompress the data
-	int32_t res = uncompress(*result, reslen, data + isize, length - isize);
+	uLongf outlen = *reslen;
+	int32_t res = uncompress(*result, &outlen, data + isize, length - isize);
+	if (res != Z_OK)
+	{
+		arena_free(arena, *result);
+		return res;
+	}
+
+	*reslen = outlen;
+	return res;
+}
+
+int32_t zlib_compress_dict(Arena *arena, const uint8_t *data, uint64_t length, const uint8_t *dict, size_t dictlen, uint8_t **result, uint64_t *reslen)
+{
+	z_stream strm;
+	memset(&strm, 0, sizeof(strm));
+	int32_t res = deflateInit(&strm, Z_BEST_COMPRESSION);
+	if (res != Z_OK)
+		return res;
+
+	res = deflateSetDictionary(&strm, dict, dictlen);
+	if (res != Z_OK)
+	{
+		deflateEnd(&strm);
+		return res;
+	}
+
+	// Allocate necessary buffers
+	size_t isize = sizeof(uint64_t);
+	uint64_t buflen = deflateBound(&strm, length);
+	*result = (uint8_t*)arena_alloc(arena, buflen + isize);
+	if (!(*result))
+	{
+		deflateEnd(&strm);
+		return 16;
+	}
+
+	// Put the decompressed length in front of the data
+	*((uint64_t*)*result) = length;
+
+	// Compress the data
+	strm.next_in = (Bytef*)data;
+	strm.avail_in = length;
+	strm.next_out = *result + isize;
+	strm.avail_out = buflen;
+	res = deflate(&strm, Z_FINISH);
+	*reslen = strm.total_out + isize;
+	deflateEnd(&strm);
+	if (res != Z_STREAM_END)
+	{
+		arena_free(arena, *result);
+		return res == Z_OK ? Z_BUF_ERROR : res;
+	}
+
+	return Z_OK;
+}
+
+int32_t zlib_decompress_dict(Arena *arena, const uint8_t *data, uint64_t length, const uint8_t *dict, size_t dictlen, uint8_t **result, uint64_t *reslen)
+{
+	// Allocate necessary buffers
+	size_t isize = sizeof(uint64_t);
+	*reslen = *((uint64_t*)data);
+	*result = (uint8_t*)arena_alloc(arena, *reslen ? *reslen : 1);
+	if (!(*result))
+		return 16;
+
+	z_stream strm;
+	memset(&strm, 0, sizeof(strm));
+	strm.next_in = (Bytef*)(data + isize);
+	strm.avail_in = length - isize;
+	int32_t res = inflateInit(&strm);
 	if (res != Z_OK)
 	{
-		free(*result);
+		arena_free(arena, *result);
+		return res;
+	}
+
+	// Decompress the data, supplying the dictionary once requested
+	strm.next_out = *result;
+	strm.avail_out = *reslen;
+	res = inflate(&strm, Z_FINISH);
+	if (res == Z_NEED_DICT)
+	{
+		res = inflateSetDictionary(&strm, dict, dictlen);
+		if (res == Z_OK)
+			res = inflate(&strm, Z_FINISH);
+	}
+
+	uint64_t total = strm.total_out;
+	inflateEnd(&strm);
+	if (res != Z_STREAM_END || total != *reslen)
+	{
+		arena_free(arena, *result);
+		return res == Z_STREAM_END || res == Z_OK ? Z_DATA_ERROR : res;
+	}
+
+	return Z_OK;
+}
+
+int32_t zlib_compress_chunked(ThreadPool *pool, Arena *arena, const uint8_t *data, uint64_t length, uint8_t **result, uint64_t *reslen)
+{
+	// Split the input into blocks
+	uint64_t count = length / ZLIB_CHUNK_SIZE + (length % ZLIB_CHUNK_SIZE ? 1 : 0);
+	if (count > UINT32_MAX)
+		return 64;
+
+	ZlibBlock *blocks = (ZlibBlock*)arena_alloc(arena, (count ? count : 1) * sizeof(ZlibBlock));
+	if (!blocks)
+		return 16;
+
+	for (uint64_t i = 0; i < count; i++)
+	{
+		blocks[i].src = data + i * ZLIB_CHUNK_SIZE;
+		blocks[i].srclen = min(ZLIB_CHUNK_SIZE, length - i * ZLIB_CHUNK_SIZE);
+		blocks[i].dstlen = compressBound(blocks[i].srclen);
+		blocks[i].dst = (uint8_t*)arena_alloc(arena, blocks[i].dstlen);
+		if (!blocks[i].dst)
+		{
+			for (uint64_t j = 0; j < i; j++)
+				arena_free(arena, blocks[j].dst);
+			arena_free(arena, blocks);
+			return 16;
+		}
+	}
+
+	// Compress all blocks
+	PoolGroup group;
+	pool_group_init(&group);
+	for (uint64_t i = 0; i < count; i++)
+		if (pool_submit(pool, &group, zlib_compress_block, blocks + i))
+			zlib_compress_block(blocks + i);
+	pool_group_wait(pool, &group);
+	pool_group_destroy(&group);
+
+	// Calculate output size
+	int32_t res = Z_OK;
+	uint64_t total = CHUNK_HEADER_SIZE + count * sizeof(uint64_t);
+	for (uint64_t i = 0; i < count; i++)
+	{
+		if (blocks[i].res != Z_OK)
+			res = blocks[i].res;
+
+		total += blocks[i].dstlen;
+	}
+
+	if (res == Z_OK)
+	{
+		*reslen = total;
+		*result = (uint8_t*)arena_alloc(arena, total);
+		if (!(*result))
+			res = 16;
+	}
+
+	// Write the block table, followed by the blocks
+	if (res == Z_OK)
+	{
+		uint8_t *ptr = *result;
+		*((uint64_t*)ptr) = length;
+		*((uint32_t*)(ptr + sizeof(uint64_t))) = (uint32_t)ZLIB_CHUNK_SIZE;
+		*((uint32_t*)(ptr + sizeof(uint64_t) + sizeof(uint32_t))) = (uint32_t)count;
+		ptr += CHUNK_HEADER_SIZE;
+
+		for (uint64_t i = 0; i < count; i++)
+		{
+			*((uint64_t*)ptr) = blocks[i].dstlen;
+			ptr += sizeof(uint64_t);
+		}
+
+		for (uint64_t i = 0; i < count; i++)
+		{
+			memcpy(ptr, blocks[i].dst, blocks[i].dstlen);
+			ptr += blocks[i].dstlen;
+		}
+	}
+
+	for (uint64_t i = 0; i < count; i++)
+		arena_free(arena, blocks[i].dst);
+	arena_free(arena, blocks);
+
+	return res;
+}
+
+int32_t zlib_decompress_chunked(ThreadPool *pool, Arena *arena, const uint8_t *data, uint64_t length, uint8_t **result, uint64_t *reslen)
+{
+	// Read the header
+	uint64_t total = 0, bsize = 0, count = 0;
+	if (!zlib_chunked_header(data, length, &total, &bsize, &count))
+		return 64;
+
+	ZlibBlock *blocks = (ZlibBlock*)arena_alloc(arena, (count ? count : 1) * sizeof(ZlibBlock));
+	if (!blocks)
+		return 16;
+
+	*reslen = total;
+	*result = (uint8_t*)arena_alloc(arena, total ? total : 1);
+	if (!(*result))
+	{
+		arena_free(arena, blocks);
+		return 16;
+	}
+
+	// Locate the blocks using the block table
+	const uint64_t *table = (const uint64_t*)(data + CHUNK_HEADER_SIZE);
+	uint64_t offset = CHUNK_HEADER_SIZE + count * sizeof(uint64_t);
+	for (uint64_t i = 0; i < count; i++)
+	{
+		if (table[i] > length - offset)
+		{
+			arena_free(arena, *result);
+			arena_free(arena, blocks);
+			return 64;
+		}
+
+		blocks[i].src = data + offset;
+		blocks[i].srclen = table[i];
+		blocks[i].dst = *result + i * bsize;
+		blocks[i].dstlen = min(bsize, total - i * bsize);
+		offset += table[i];
+	}
+
+	// Decompress all blocks
+	PoolGroup group;
+	pool_group_init(&group);
+	for (uint64_t i = 0; i < count; i++)
+		if (pool_submit(pool, &group, zlib_decompress_block, blocks + i))
+			zlib_decompress_block(blocks + i);
+	pool_group_wait(pool, &group);
+	pool_group_destroy(&group);
+
+	int32_t res = Z_OK;
+	for (uint64_t i = 0; i < count; i++)
+		if (blocks[i].res != Z_OK)
+			res = blocks[i].res;
+
+	arena_free(arena, blocks);
+	if (res != Z_OK)
+		arena_free(arena, *result);
+
+	return res;
+}
+
+int32_t zlib_decompress_stream(Arena *arena, const uint8_t *data, uint64_t length, const uint8_t *dict, size_t dictlen, ZlibSink sink, void *arg)
+{
+	ZlibInflater *inflater = NULL;
+	int32_t res = zlib_inflater_open(NULL, arena, length, false, dict, dictlen, sink, arg, &inflater);
+	if (res != Z_OK)
 		return res;
+
+	zlib_inflater_feed(inflater, data, length);
+	return zlib_inflater_finish(inflater);
+}
+
+int32_t zlib_decompress_chunked_stream(ThreadPool *pool, Arena *arena, const uint8_t *data, uint64_t length, ZlibSink sink, void *arg)
+{
+	uint64_t total = 0, bsize = 0, count = 0;
+	if (!zlib_chunked_header(data, length, &total, &bsize, &count))
+		return 64;
+
+	// One buffer per worker, reused for every round of blocks
+	uint64_t width = min(pool_size(pool), count ? count : 1);
+	ZlibBlock *blocks = (ZlibBlock*)arena_alloc(arena, width * sizeof(ZlibBlock));
+	uint8_t *buffers = blocks ? (uint8_t*)arena_alloc(arena, width * bsize) : NULL;
+	if (!buffers)
+	{
+		arena_free(arena, blocks);
+		return 16;
+	}
+
+	const uint64_t *table = (const uint64_t*)(data + CHUNK_HEADER_SIZE);
+	uint64_t offset = CHUNK_HEADER_SIZE + count * sizeof(uint64_t);
+	int32_t res = Z_OK;
+	for (uint64_t first = 0; first < count && res == Z_OK; first += width)
+	{
+		uint64_t round = min(width, count - first);
+		for (uint64_t i = 0; i < round; i++)
+		{
+			uint64_t index = first + i;
+			if (table[index] > length - offset)
+			{
+				res = 64;
+				round = i;
+				break;
+			}
+
+			blocks[i].src = data + offset;
+			blocks[i].srclen = table[index];
+			blocks[i].dst = buffers + i * bsize;
+			blocks[i].dstlen = min(bsize, total - index * bsize);
+			offset += table[index];
+		}
+
+		if (res == Z_OK)
+			res = zlib_decompress_round(pool, blocks, round, sink, arg);
 	}
 
+	arena_free(arena, buffers);
+	arena_free(arena, blocks);
+	return res;
+}
+
+int32_t zlib_inflater_open(ThreadPool *pool, Arena *arena, uint64_t length, bool chunked, const uint8_t *dict, size_t dictlen, ZlibSink sink, void *arg, ZlibInflater **inflater)
+{
+	ZlibInflater *inf = (ZlibInflater*)arena_alloc(arena, sizeof(ZlibInflater));
+	if (!inf)
+		return 16;
+
+	inf->pool = pool;
+	inf->arena = arena;
+	inf->sink = sink;
+	inf->arg = arg;
+	inf->length = length;
+	inf->chunked = chunked;
+	inf->dict = dict;
+	inf->dictlen = dictlen;
+	if (!chunked)
+	{
+		inf->buf = (uint8_t*)arena_alloc(arena, ZLIB_STREAM_SIZE);
+		int32_t res = inf->buf ? inflateInit(&inf->strm) : 16;
+		if (res != Z_OK)
+		{
+			arena_free(arena, inf->buf);
+			arena_free(arena, inf);
+			return res;
+		}
+	}
+
+	*inflater = inf;
+	return Z_OK;
+}
+
+int32_t zlib_inflater_feed(ZlibInflater *inflater, const uint8_t *data, uint64_t length)
+{
+	if (inflater->res != Z_OK)
+		return inflater->res;
+
+	size_t headsize = zlib_inflater_head(inflater);
+	if (inflater->headlen < headsize)
+	{
+		uint64_t take = min(headsize - inflater->headlen, length);
+		memcpy(inflater->head + inflater->headlen, data, take);
+		inflater->headlen += take;
+		data += take;
+		length -= take;
+		if (inflater->headlen < headsize)
+			return Z_OK;
+
+		if (inflater->chunked)
+			inflater->res = zlib_inflater_blocks(inflater);
+	}
+
+	if (inflater->res == Z_OK)
+		inflater->res = inflater->chunked ? zlib_inflater_chunked(inflater, data, length) : zlib_inflater_single(inflater, data, length);
+
+	return inflater->res;
+}
+
+int32_t zlib_inflater_finish(ZlibInflater *inflater)
+{
+	int32_t res = inflater->res;
+	if (res == Z_OK && inflater->chunked)
+	{
+		if (inflater->headlen < CHUNK_HEADER_SIZE || inflater->next < inflater->count)
+			res = 64;
+	}
+	else if (res == Z_OK)
+	{
+		if (!inflater->ended || inflater->strm.total_out != *((uint64_t*)inflater->head))
+			res = Z_DATA_ERROR;
+	}
+
+	Arena *arena = inflater->arena;
+	if (!inflater->chunked)
+		inflateEnd(&inflater->strm);
+
+	arena_free(arena, inflater->buffers);
+	arena_free(arena, inflater->staging);
+	arena_free(arena, inflater->blocks);
+	arena_free(arena, inflater->table);
+	arena_free(arena, inflater->buf);
+	arena_free(arena, inflater);
 	return res;
 }
 
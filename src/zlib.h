@@ -39,9 +39,55 @@ extern "C"
 {
 #endif
 
+// Thread pool and arena allocator
+#include "pool.h"
+#include "arena.h"
+
+/** Size of a single independently-compressed block in chunked mode, in bytes. */
+extern const uint64_t ZLIB_CHUNK_SIZE;
+
+/** Largest piece of data handed to a sink when streaming, in bytes. */
+extern const size_t ZLIB_STREAM_SIZE;
+
+/**
+ * Calculates the largest possible result of compressing data of given length,
+ * including the length prefix and, for large data, the block table.
+ *
+ * \param length Length of the data.
+ *
+ * \return Upper bound of the compressed length.
+ */
+uint64_t zlib_compress_bound(uint64_t length);
+
+/**
+ * Calculates the smallest possible result of compressing data of given length.
+ * Deflate cannot compress better than about 1032:1.
+ *
+ * \param length Length of the data.
+ *
+ * \return Lower bound of the compressed length.
+ */
+uint64_t zlib_compress_min(uint64_t length);
+
+/**
+ * Function receiving decompressed data in consecutive pieces.
+ *
+ * \param arg Argument supplied along with the function.
+ * \param data Next piece of the data. Only valid during the call.
+ * \param len Length of the piece.
+ *
+ * \return 0 to continue, anything else to stop decompressing.
+ */
+typedef int32_t (*ZlibSink)(void *arg, const uint8_t *data, size_t len);
+
+/** Opaque handle of a decompression which is fed its input in pieces. */
+typedef struct ZlibInflater ZlibInflater;
+
 /**
  * Zlib-compresses supplied data.
  *
+ * \param arena Arena to allocate the result from. If NULL, the result is 
+ *              allocated on the heap.
  * \param data Data to compress.
  * \param length Length of the data.
  * \param result Pointer to result bytes. The underlying pointer will be initialized.
@@ -49,19 +95,178 @@ extern "C"
  *
  * \return 0 if the operation was successful, an error code otherwise.
  */
-int32_t zlib_compress(const uint8_t *data, uint64_t length, uint8_t **result, uint64_t *reslen);
+int32_t zlib_compress(Arena *arena, const uint8_t *data, uint64_t length, uint8_t **result, uint64_t *reslen);
 
 /**
  * Zlib-decompresses supplied data.
  *
+ * \param arena Arena to allocate the result from. If NULL, the result is 
+ *              allocated on the heap.
+ * \param data Data to decompress.
+ * \param length Length of the data.
+ * \param result Pointer to result bytes. The underlying pointer will be initialized.
+ * \param reslen Pointer to result length. It will be set to length of resulting data.
+ *
+ * \return 0 if the operation was successful, an error code otherwise.
+ */
+int32_t zlib_decompress(Arena *arena, const uint8_t *data, uint64_t length, uint8_t **result, uint64_t *reslen);
+
+/**
+ * Zlib-compresses supplied data using a preset dictionary. The same 
+ * dictionary needs to be supplied when decompressing.
+ *
+ * \param arena Arena to allocate the result from. If NULL, the result is 
+ *              allocated on the heap.
+ * \param data Data to compress.
+ * \param length Length of the data.
+ * \param dict Preset dictionary bytes.
+ * \param dictlen Length of the preset dictionary.
+ * \param result Pointer to result bytes. The underlying pointer will be initialized.
+ * \param reslen Pointer to result length. It will be set to length of compressed data.
+ *
+ * \return 0 if the operation was successful, an error code otherwise.
+ */
+int32_t zlib_compress_dict(Arena *arena, const uint8_t *data, uint64_t length, const uint8_t *dict, size_t dictlen, uint8_t **result, uint64_t *reslen);
+
+/**
+ * Zlib-decompresses data compressed using a preset dictionary.
+ *
+ * \param arena Arena to allocate the result from. If NULL, the result is 
+ *              allocated on the heap.
  * \param data Data to decompress.
  * \param length Length of the data.
+ * \param dict Preset dictionary bytes.
+ * \param dictlen Length of the preset dictionary.
  * \param result Pointer to result bytes. The underlying pointer will be initialized.
  * \param reslen Pointer to result length. It will be set to length of resulting data.
  *
  * \return 0 if the operation was successful, an error code otherwise.
  */
-int32_t zlib_decompress(const uint8_t *data, uint64_t length, uint8_t **result, uint64_t *reslen);
+int32_t zlib_decompress_dict(Arena *arena, const uint8_t *data, uint64_t length, const uint8_t *dict, size_t dictlen, uint8_t **result, uint64_t *reslen);
+
+/**
+ * Zlib-compresses supplied data in independent blocks of ZLIB_CHUNK_SIZE
+ * bytes. The blocks are compressed in parallel, and the result is prefixed 
+ * with a table of compressed block lengths.
+ *
+ * \param pool Pool to compress the blocks on. If NULL, blocks are compressed 
+ *             sequentially.
+ * \param arena Arena to allocate the result from. If NULL, the result is 
+ *              allocated on the heap.
+ * \param data Data to compress.
+ * \param length Length of the data.
+ * \param result Pointer to result bytes. The underlying pointer will be initialized.
+ * \param reslen Pointer to result length. It will be set to length of compressed data.
+ *
+ * \return 0 if the operation was successful, an error code otherwise.
+ */
+int32_t zlib_compress_chunked(ThreadPool *pool, Arena *arena, const uint8_t *data, uint64_t length, uint8_t **result, uint64_t *reslen);
+
+/**
+ * Zlib-decompresses data produced by zlib_compress_chunked. The blocks are 
+ * decompressed in parallel.
+ *
+ * \param pool Pool to decompress the blocks on. If NULL, blocks are 
+ *             decompressed sequentially.
+ * \param arena Arena to allocate the result from. If NULL, the result is 
+ *              allocated on the heap.
+ * \param data Data to decompress.
+ * \param length Length of the data.
+ * \param result Pointer to result bytes. The underlying pointer will be initialized.
+ * \param reslen Pointer to result length. It will be set to length of resulting data.
+ *
+ * \return 0 if the operation was successful, an error code otherwise.
+ */
+int32_t zlib_decompress_chunked(ThreadPool *pool, Arena *arena, const uint8_t *data, uint64_t length, uint8_t **result, uint64_t *reslen);
+
+/**
+ * Zlib-decompresses data produced by zlib_compress or zlib_compress_dict, 
+ * handing it to a sink in pieces of at most ZLIB_STREAM_SIZE bytes. Memory use 
+ * does not depend on the length of the data.
+ *
+ * \param arena Arena to allocate the working buffer from. If NULL, the buffer
+ *              is allocated on the heap.
+ * \param data Data to decompress.
+ * \param length Length of the data.
+ * \param dict Preset dictionary bytes, or NULL if none was used.
+ * \param dictlen Length of the preset dictionary.
+ * \param sink Function receiving the decompressed data.
+ * \param arg Argument for the sink.
+ *
+ * \return 0 if the operation was successful, 128 if the sink stopped it, an 
+ *         error code otherwise.
+ */
+int32_t zlib_decompress_stream(Arena *arena, const uint8_t *data, uint64_t length, const uint8_t *dict, size_t dictlen, ZlibSink sink, void *arg);
+
+/**
+ * Zlib-decompresses data produced by zlib_compress_chunked, handing it to a
+ * sink one block at a time. As many blocks as the pool has workers are 
+ * decompressed in parallel, so memory use does not depend on the length of 
+ * the data.
+ *
+ * \param pool Pool to decompress the blocks on. If NULL, blocks are 
+ *             decompressed sequentially.
+ * \param arena Arena to allocate the working buffers from. If NULL, the 
+ *              buffers are allocated on the heap.
+ * \param data Data to decompress.
+ * \param length Length of the data.
+ * \param sink Function receiving the decompressed data.
+ * \param arg Argument for the sink.
+ *
+ * \return 0 if the operation was successful, 128 if the sink stopped it, an 
+ *         error code otherwise.
+ */
+int32_t zlib_decompress_chunked_stream(ThreadPool *pool, Arena *arena, const uint8_t *data, uint64_t length, ZlibSink sink, void *arg);
+
+/**
+ * Starts decompressing data produced by zlib_compress, zlib_compress_dict, or
+ * zlib_compress_chunked, which will be supplied in pieces of any size. The 
+ * output is handed to a sink as the input arrives, as by 
+ * zlib_decompress_stream and zlib_decompress_chunked_stream. Chunked input is
+ * collected until a block for every worker of the pool is complete, so 
+ * memory use does not depend on the length of the data.
+ *
+ * \param pool Pool to decompress blocks on. If NULL, blocks are decompressed
+ *             one at a time.
+ * \param arena Arena to allocate the state and working buffers from. If NULL,
+ *              they are allocated on the heap.
+ * \param length Total length of the data which will be supplied.
+ * \param chunked Whether the data was produced by zlib_compress_chunked.
+ * \param dict Preset dictionary bytes, or NULL if none was used. It has to 
+ *             remain valid until the decompression is finished.
+ * \param dictlen Length of the preset dictionary.
+ * \param sink Function receiving the decompressed data.
+ * \param arg Argument for the sink.
+ * \param inflater Pointer to the handle of the decompression. The underlying
+ *                 pointer will be initialized.
+ *
+ * \return 0 if the operation was successful, an error code otherwise.
+ */
+int32_t zlib_inflater_open(ThreadPool *pool, Arena *arena, uint64_t length, bool chunked, const uint8_t *dict, size_t dictlen, ZlibSink sink, void *arg, ZlibInflater **inflater);
+
+/**
+ * Supplies the next piece of the data to a decompression. After a failure, 
+ * further pieces are ignored.
+ *
+ * \param inflater Decompression to supply the data to.
+ * \param data Next piece of the data. Only used during the call.
+ * \param length Length of the piece.
+ *
+ * \return 0 if the operation was successful, 128 if the sink stopped it, an 
+ *         error code otherwise.
+ */
+int32_t zlib_inflater_feed(ZlibInflater *inflater, const uint8_t *data, uint64_t length);
+
+/**
+ * Finishes a decompression, checking that the data was complete, and releases
+ * it. This has to be called even if supplying the data failed.
+ *
+ * \param inflater Decompression to finish.
+ *
+ * \return 0 if the operation was successful, 128 if the sink stopped it, an 
+ *         error code otherwise.
+ */
+int32_t zlib_inflater_finish(ZlibInflater *inflater);
 
 // Define C extern for C++
 #ifdef __cplusplus